@@ -2,8 +2,8 @@
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
-layout(location = 2) in int selected;
-layout(location = 3) in int visible;
+layout(location = 2) in uint flags;
+layout(location = 3) in float value;
 
 flat out vec4 vColor;
 flat out float vVisible;
@@ -12,12 +12,29 @@ flat out float vSelected;
 uniform mat4 mvp_matrix;
 uniform int size;
 uniform float alpha;
+// 0 = colors of the spots, 1 = color map of the values, 2 = alpha from the values
+uniform int mode;
+uniform float legend_min;
+uniform float legend_max;
+uniform sampler2D colormap;
 
 void main()
 {
+    bool visible = (flags & 1u) != 0u;
+    bool selected = (flags & 2u) != 0u;
     gl_Position = mvp_matrix * vec4(position, 1.0);
-    gl_PointSize = selected == 1 ? max(1, int(size / 2)) : size;
-    vColor = alpha != -1 ? vec4(color.rgb, alpha) : color;
+    gl_PointSize = selected ? max(1, int(size / 2)) : size;
+    // the value normalized to the legend range
+    float norm_value = legend_max > legend_min ?
+        clamp((value - legend_min) / (legend_max - legend_min), 0.0, 1.0) : 0.0;
+    vec4 spot_color = color;
+    if (mode == 1) {
+        float texel = 0.5 / float(textureSize(colormap, 0).x);
+        spot_color = texture(colormap, vec2(mix(texel, 1.0 - texel, norm_value), 0.5));
+    } else if (mode == 2) {
+        spot_color = vec4(color.rgb, norm_value);
+    }
+    vColor = alpha != -1 ? vec4(spot_color.rgb, alpha) : spot_color;
     vVisible = float(visible);
     vSelected = float(selected);
 }
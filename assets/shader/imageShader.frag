@@ -1,13 +1,19 @@
 #version 330
 
-uniform sampler2D tex;
+uniform sampler2DArray tex;
 
 in vec2 v_texcoord;
+flat in vec2 v_texsize;
+flat in float v_layer;
 
 out vec4 fColor;
 
 void main()
 {
+    // the tiles of the edges only fill part of the layer so the coordinates
+    // are clamped to the center of their last texel
+    vec2 texel = 0.5 / vec2(textureSize(tex, 0).xy);
+    vec2 texcoord = clamp(v_texcoord, texel, v_texsize - texel);
     // Set fragment color from texture
-    fColor = texture(tex, v_texcoord);
+    fColor = texture(tex, vec3(texcoord, v_layer));
 }
@@ -1,14 +1,22 @@
 #version 330
 
-layout(location = 0) in vec3 a_position;
-layout(location = 1) in vec2 a_texcoord;
+// the rect of the tile (x, y, width, height) in scene units
+layout(location = 0) in vec4 a_rect;
+// the layer of the tile in the texture array and the size of the tile in the layer
+layout(location = 1) in vec3 a_layer;
 
 uniform mat4 mvp_matrix;
 
 out vec2 v_texcoord;
+flat out vec2 v_texsize;
+flat out float v_layer;
 
 void main()
 {
-    gl_Position = mvp_matrix * vec4(a_position, 1.0);
-    v_texcoord = a_texcoord;
+    // the corners of the quad (triangle strip) are given by the index of the vertex
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = mvp_matrix * vec4(a_rect.xy + corner * a_rect.zw, 0.0, 1.0);
+    v_texcoord = corner * a_layer.yz;
+    v_texsize = a_layer.yz;
+    v_layer = a_layer.x;
 }
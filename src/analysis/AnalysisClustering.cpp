@@ -135,7 +135,7 @@ void AnalysisClustering::computeClustersAsync()
                                                     m_ui->spots_threshold->value());
 
     // quick sanity check
-    if (data.counts.n_rows < 10 || data.counts.n_cols < 10) {
+    if (data.n_rows() < 10 || data.n_cols() < 10) {
         QMessageBox::critical(this,
                               tr("Spots clustering"),
                               tr("The number of spots or genes is too small"),
@@ -152,18 +152,17 @@ void AnalysisClustering::computeClustersAsync()
     } else if (m_ui->normalization_cpm->isChecked()) {
         normalization = SettingsWidget::CPM;
     }
-    mat A = STData::normalizeCounts(data, normalization).counts;
+    mat A = STData::normalizeCounts(data, normalization).dense();
     if (m_ui->logScale->isChecked()) {
         A = log1p(A);
     }
 
     // keep top variance genes
-    if (num_genes_keep < data.counts.n_cols) {
-        const auto var_genes = var(data.counts, 1);
-        const auto idx = conv_to<uvec>::from(sort_index(var_genes, "descend"));
-        const auto idx2 = conv_to<ucolvec>::from(idx.head(num_genes_keep));
-        data.counts = data.counts.cols(idx2);
-        qDebug() << "Keeping " << data.counts.n_cols << " genes";
+    if (num_genes_keep < A.n_cols) {
+        const rowvec var_genes = var(A, 0, 0);
+        const uvec idx = sort_index(var_genes, "descend");
+        A = A.cols(idx.head(num_genes_keep));
+        qDebug() << "Keeping " << A.n_cols << " genes";
     }
 
     // run dimensionality reduction
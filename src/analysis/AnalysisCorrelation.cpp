@@ -48,10 +48,8 @@ AnalysisCorrelation::AnalysisCorrelation(const STData::STDataFrame &data1,
             to_keepA.at(i) = data1.genes.indexOf(shared_gene);
             to_keepB.at(i) = data2.genes.indexOf(shared_gene);
         }
-        m_dataA.counts = m_dataA.counts.cols(to_keepA);
-        m_dataA.genes = shared_genes;
-        m_dataB.counts = m_dataB.counts.cols(to_keepB);
-        m_dataB.genes = shared_genes;
+        m_dataA = STData::sliceColumns(m_dataA, to_keepA);
+        m_dataB = STData::sliceColumns(m_dataB, to_keepB);
 
         // create the connections
         connect(m_ui->logScale, &QCheckBox::clicked,
@@ -81,8 +79,8 @@ void AnalysisCorrelation::slotUpdateData()
     QGuiApplication::setOverrideCursor(Qt::WaitCursor);
 
     // get the matrices of counts and log them if applies
-    mat A = m_dataA.counts;
-    mat B = m_dataB.counts;
+    mat A = m_dataA.dense();
+    mat B = m_dataB.dense();
     if (m_ui->logScale->isChecked()) {
         A = log1p(A);
         B = log1p(B);
@@ -341,10 +341,8 @@ void AnalysisDEA::slotRun()
                 to_keepA.at(i) = dataA.genes.indexOf(shared_gene);
                 to_keepB.at(i) = dataB.genes.indexOf(shared_gene);
             }
-            dataA.counts = dataA.counts.cols(to_keepA);
-            dataA.genes = shared_genes;
-            dataB.counts = dataB.counts.cols(to_keepB);
-            dataB.genes = shared_genes;
+            dataA = STData::sliceColumns(dataA, to_keepA);
+            dataB = STData::sliceColumns(dataB, to_keepB);
         } else {
             QMessageBox::critical(this,
                                   tr("DEA Analysis"),
@@ -353,8 +351,8 @@ void AnalysisDEA::slotRun()
         }
 
         // normalize and log
-        mat A = STData::normalizeCounts(dataA, m_normalization).counts;
-        mat B = STData::normalizeCounts(dataB, m_normalization).counts;
+        mat A = STData::normalizeCounts(dataA, m_normalization).dense();
+        mat B = STData::normalizeCounts(dataB, m_normalization).dense();
         if (m_ui->log_scale) {
             A = log1p(A);
             B = log1p(B);
@@ -4,6 +4,7 @@
 #include <QtCharts/QBarSeries>
 #include <QtCharts/QBarSet>
 #include <QDebug>
+#include "math/SparseMatrix.h"
 #include "ui_analysisQC.h"
 
 AnalysisQC::AnalysisQC(const STData::STDataFrame &data,
@@ -15,15 +16,25 @@ AnalysisQC::AnalysisQC(const STData::STDataFrame &data,
 
     qDebug() << "QC computing data";
 
-    // compute the stats
-    const vec nonzero_col = conv_to<vec>::from(sum(data.counts != 0, 0));
-    const vec nonzero_row = conv_to<vec>::from(sum(data.counts != 0, 1));
-    const colvec rowsums = sum(data.counts, 1);
+    // compute the stats (only the non-zero counts are visited when the matrix is sparse)
+    const auto nonzero = [](const double value) { return value != 0; };
+    vec nonzero_col;
+    vec nonzero_row;
+    colvec rowsums;
+    if (data.is_sparse) {
+        nonzero_col = conv_to<vec>::from(STMath::colCount(data.sp_counts, nonzero));
+        nonzero_row = conv_to<vec>::from(STMath::rowCount(data.sp_counts, nonzero));
+        rowsums = STMath::rowSums(data.sp_counts);
+    } else {
+        nonzero_col = conv_to<vec>::from(STMath::colCount(data.counts, nonzero));
+        nonzero_row = conv_to<vec>::from(STMath::rowCount(data.counts, nonzero));
+        rowsums = STMath::rowSums(data.counts);
+    }
     const QString max_transcripts_spot = QString::number(rowsums.max());
     const QString max_genes_spot = QString::number(nonzero_row.max());
-    const QString num_genes = QString::number(data.counts.n_cols);
-    const QString num_spots = QString::number(data.counts.n_rows);
-    const QString total_transcripts = QString::number(accu(data.counts));
+    const QString num_genes = QString::number(data.n_cols());
+    const QString num_spots = QString::number(data.n_rows());
+    const QString total_transcripts = QString::number(accu(rowsums));
     const QString avg_genes = QString::number(mean(nonzero_row));
     const QString avg_transcritps = QString::number(mean(rowsums));
     const QString std_genes = QString::number(stddev(nonzero_row));
@@ -3,9 +3,62 @@
 #include <QImage>
 #include <QColor>
 
+#include <algorithm>
+
 namespace Color
 {
 
+ColorLookupTable::ColorLookupTable(const ColorGradients cmap)
+    : m_colors()
+{
+    QCPColorGradient gradient(cmap);
+    const int levels = gradient.levelCount();
+    const QCPRange range(0, levels - 1);
+    m_colors.resize(levels);
+    for (int i = 0; i < levels; ++i) {
+        m_colors[i] = gradient.color(i, range);
+    }
+}
+
+const ColorLookupTable &ColorLookupTable::get(const ColorGradients cmap)
+{
+    // the tables of all the gradients are built the first time (thread-safe static)
+    static const std::vector<ColorLookupTable> tables = []() {
+        std::vector<ColorLookupTable> tables;
+        for (int i = QCPColorGradient::gpGrayscale; i <= QCPColorGradient::gpHues; ++i) {
+            tables.push_back(ColorLookupTable(static_cast<ColorGradients>(i)));
+        }
+        return tables;
+    }();
+    return tables.at(cmap);
+}
+
+QRgb ColorLookupTable::rgb(const double value, const double min, const double max) const
+{
+    const double last = m_colors.size() - 1;
+    const double scale = max > min ? last / (max - min) : 0.0;
+    const double level = std::clamp((value - min) * scale, 0.0, last);
+    return m_colors[static_cast<size_t>(level)];
+}
+
+void ColorLookupTable::rgb(const float *values, const int size,
+                           const float min, const float max, QRgb *colors) const
+{
+    const float last = m_colors.size() - 1;
+    const float scale = max > min ? last / (max - min) : 0.0f;
+    const QRgb *table = m_colors.data();
+    #pragma omp simd
+    for (int i = 0; i < size; ++i) {
+        const float level = std::min(std::max((values[i] - min) * scale, 0.0f), last);
+        colors[i] = table[static_cast<int>(level)];
+    }
+}
+
+int ColorLookupTable::size() const
+{
+    return static_cast<int>(m_colors.size());
+}
+
 QImage createLegend(const int width,
                     const int height,
                     const double lowerbound,
@@ -14,6 +67,7 @@ QImage createLegend(const int width,
 {
     // create an empty image
     QImage image(width, height, QImage::Format_ARGB32);
+    const ColorLookupTable &table = ColorLookupTable::get(cmap);
     for (int y = 0; y < height; ++y) {
         // get the color of each line of the image as the heatmap
         // color normalized to the lower and upper bound of the image
@@ -24,8 +78,7 @@ QImage createLegend(const int width,
                                                        static_cast<double>(height),
                                                        lowerbound,
                                                        upperbound);
-        const QColor color = Color::createCMapColor(adjusted_value, lowerbound, upperbound, cmap);
-        const QRgb rgb_color = color.rgb();
+        const QRgb rgb_color = table.rgb(adjusted_value, lowerbound, upperbound) | 0xff000000;
         for (int x = 0; x < width; ++x) {
             image.setPixel(x, y, rgb_color);
         }
@@ -33,6 +86,16 @@ QImage createLegend(const int width,
     return image;
 }
 
+QImage createColorMap(const int size, const ColorGradients cmap)
+{
+    const ColorLookupTable &table = ColorLookupTable::get(cmap);
+    QImage image(size, 1, QImage::Format_RGBA8888);
+    for (int x = 0; x < size; ++x) {
+        image.setPixelColor(x, 0, QColor(table.rgb(x, 0, size - 1)));
+    }
+    return image;
+}
+
 QColor createHeatMapLinearColor(const double value, const double min, const double max)
 {
     const double halfmax = (min + max) / 2;
@@ -118,17 +181,13 @@ QColor createRangeColor(const double value, const double min, const double max,
 
 QColor createCMapColorGpHot(const double value, const double min, const double max)
 {
-    const QCPRange range(min, max);
-    QCPColorGradient cmap(QCPColorGradient::gpHot);
-    return QColor(cmap.color(value, range));
+    return createCMapColor(value, min, max, ColorGradients::gpHot);
 }
 
 QColor createCMapColor(const double value, const double min,
                        const double max, const ColorGradients cmap)
 {
-    const QCPRange range(min, max);
-    QCPColorGradient cmapper(cmap);
-    return QColor(cmapper.color(value, range));
+    return QColor(ColorLookupTable::get(cmap).rgb(value, min, max));
 }
 
 QColor adjustVisualMode(const QColor color,
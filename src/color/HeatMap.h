@@ -5,6 +5,9 @@
 #include "qcustomplot.h"
 #include "viewPages/SettingsWidget.h"
 
+#include <QColor>
+#include <vector>
+
 class QImage;
 
 // Heatmap is a convenience namespace which contains functions to generate
@@ -14,6 +17,35 @@ namespace Color
 
 typedef QCPColorGradient::GradientPreset ColorGradients;
 
+// ColorLookupTable contains the colors of the levels of a gradient, it is built
+// once per gradient (get()) and shared so the values are mapped to colors with
+// a table lookup instead of creating a QCPColorGradient (and its levels) every time.
+// The values are mapped to the levels as QCPColorGradient does (linear and clamped)
+class ColorLookupTable
+{
+
+public:
+
+    // returns the (shared) lookup table of the gradient, it is thread-safe
+    static const ColorLookupTable &get(const ColorGradients cmap);
+
+    // returns the color of the value in the range min-max
+    QRgb rgb(const double value, const double min, const double max) const;
+
+    // maps an array of values to colors (the loop is branch-free so it can be vectorized)
+    void rgb(const float *values, const int size,
+             const float min, const float max, QRgb *colors) const;
+
+    // the number of levels of the gradient
+    int size() const;
+
+private:
+
+    explicit ColorLookupTable(const ColorGradients cmap);
+
+    std::vector<QRgb> m_colors;
+};
+
 // Convenience function to generate a heatmap spectrum image
 // using a linear interpolation spectra in the gradient given as input
 // using the upper and lower bounds given as parameters
@@ -23,6 +55,10 @@ QImage createLegend(const int width,
                     const double upperbound,
                     const ColorGradients cmap);
 
+// Convenience function to generate a color map image (size x 1, RGBA8)
+// with the colors of the gradient given as input (the lookup table of the view)
+QImage createColorMap(const int size, const ColorGradients cmap);
+
 // Convenience function to generate a QColor color from a real value
 // using a wavelength function
 QColor createHeatMapWaveLenghtColor(const double value);
@@ -6,6 +6,8 @@
 #include <QDir>
 
 static const QString SettingsPrefixConfFile = QStringLiteral("configuration");
+static const QString SettingsTextureMemory = QStringLiteral("texture_memory_mb");
+static const int DefaultTextureMemory = 512;
 
 Configuration::Configuration()
     : m_settings(nullptr)
@@ -46,3 +48,10 @@ bool Configuration::is_valid() const
     return !m_settings.isNull() && m_settings->status() == QSettings::NoError;
 }
 
+int Configuration::textureMemoryBudget() const
+{
+    bool ok = false;
+    const int budget = readSetting(SettingsTextureMemory).toInt(&ok);
+    return ok && budget > 0 ? budget : DefaultTextureMemory;
+}
+
@@ -24,6 +24,9 @@ public:
     // True if the QSettings object is initilized and valid
     bool is_valid() const;
 
+    // the memory (in MB) that the textures of the tissue image can use
+    int textureMemoryBudget() const;
+
 private:
     // reads the setting stored in the key given and returns
     // its value or empty string if there was a problem
@@ -13,7 +13,8 @@ class Cluster
 
 public:
 
-    typedef QList<QString> ClusterType;
+    // the ids of the spots of the dataset (see STData::spotIds())
+    typedef QVector<int> ClusterType;
 
     Cluster();
     explicit Cluster(const Cluster &other);
@@ -0,0 +1,251 @@
+#include "CompressedFile.h"
+
+#include "options_cmake.h"
+
+#include <QDebug>
+
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+
+// size of the blocks of compressed data read from the file
+constexpr qint64 INPUT_SIZE = 1 << 20;
+
+}
+
+CompressedFile::CompressedFile(const QString &filename, const int block_size)
+    : m_file(filename)
+    , m_format(format(filename))
+    , m_block_size(block_size)
+    , m_finished(false)
+    , m_cancelled(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Could not open the compressed file");
+    }
+    m_thread = std::thread(&CompressedFile::decompress, this);
+}
+
+CompressedFile::~CompressedFile()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelled = true;
+    }
+    m_not_full.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+QByteArray CompressedFile::nextBlock()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_empty.wait(lock, [this]() { return !m_blocks.empty() || m_finished; });
+    if (m_blocks.empty()) {
+        if (!m_error.isEmpty()) {
+            throw std::runtime_error(m_error.toStdString());
+        }
+        return QByteArray();
+    }
+    QByteArray block = std::move(m_blocks.front());
+    m_blocks.pop_front();
+    lock.unlock();
+    m_not_full.notify_one();
+    return block;
+}
+
+CompressedFile::Format CompressedFile::format(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return Plain;
+    }
+    const QByteArray magic = file.read(4);
+    if (magic.startsWith("\x1f\x8b")) {
+        return Gzip;
+    } else if (magic == QByteArray("\x28\xb5\x2f\xfd", 4)) {
+        return Zstd;
+    }
+    return Plain;
+}
+
+bool CompressedFile::isCompressed(const QString &filename)
+{
+    return format(filename) != Plain;
+}
+
+QByteArray CompressedFile::readAll(const QString &filename)
+{
+    CompressedFile file(filename);
+    QByteArray content;
+    for (QByteArray block = file.nextBlock(); !block.isEmpty(); block = file.nextBlock()) {
+        content.append(block);
+    }
+    return content;
+}
+
+bool CompressedFile::push(QByteArray &&block)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_full.wait(lock, [this]() { return m_blocks.size() < MAX_QUEUED_BLOCKS || m_cancelled; });
+    if (m_cancelled) {
+        return false;
+    }
+    m_blocks.push_back(std::move(block));
+    lock.unlock();
+    m_not_empty.notify_one();
+    return true;
+}
+
+void CompressedFile::decompress()
+{
+    bool decompressed = false;
+    if (m_format == Gzip) {
+        decompressed = decompressGzip();
+    } else if (m_format == Zstd) {
+        decompressed = decompressZstd();
+    } else {
+        // plain files are read by blocks
+        decompressed = true;
+        while (!m_file.atEnd()) {
+            QByteArray block = m_file.read(m_block_size);
+            if (block.isEmpty() || !push(std::move(block))) {
+                break;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!decompressed && m_error.isEmpty()) {
+            m_error = QStringLiteral("The compressed file could not be decompressed");
+        }
+        m_finished = true;
+    }
+    m_not_empty.notify_all();
+}
+
+bool CompressedFile::decompressGzip()
+{
+#ifdef HAVE_ZLIB
+    z_stream stream = {};
+    // 15 + 32 detects the gzip or zlib header automatically
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return false;
+    }
+
+    QByteArray input;
+    QByteArray block(m_block_size, Qt::Uninitialized);
+    stream.next_out = reinterpret_cast<Bytef *>(block.data());
+    stream.avail_out = static_cast<uInt>(m_block_size);
+    bool ok = true;
+    bool cancelled = false;
+    bool output_full = false;
+    int status = Z_OK;
+    while (ok && !cancelled) {
+        // more input is only needed when the decoder has no pending output
+        if (stream.avail_in == 0 && !output_full) {
+            if (m_file.atEnd()) {
+                // the stream must end exactly at the end of the file
+                ok = status == Z_STREAM_END;
+                break;
+            }
+            input = m_file.read(INPUT_SIZE);
+            stream.next_in = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = static_cast<uInt>(input.size());
+        }
+        // files with several gzip members (e.g. bgzip) are decompressed as one stream
+        if (status == Z_STREAM_END) {
+            inflateReset(&stream);
+        }
+        status = inflate(&stream, Z_NO_FLUSH);
+        output_full = stream.avail_out == 0 && status != Z_STREAM_END;
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            qDebug() << "Error decompressing gzip file " << (stream.msg ? stream.msg : "");
+            ok = false;
+        } else if (stream.avail_out == 0) {
+            cancelled = !push(std::move(block));
+            block = QByteArray(m_block_size, Qt::Uninitialized);
+            stream.next_out = reinterpret_cast<Bytef *>(block.data());
+            stream.avail_out = static_cast<uInt>(m_block_size);
+        }
+    }
+    const int remaining = m_block_size - static_cast<int>(stream.avail_out);
+    if (ok && !cancelled && remaining > 0) {
+        block.truncate(remaining);
+        push(std::move(block));
+    }
+    inflateEnd(&stream);
+    return ok;
+#else
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_error = QStringLiteral("Support for gzip files is not available in this build");
+    return false;
+#endif
+}
+
+bool CompressedFile::decompressZstd()
+{
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    if (stream == nullptr) {
+        return false;
+    }
+    ZSTD_initDStream(stream);
+
+    QByteArray block(m_block_size, Qt::Uninitialized);
+    ZSTD_outBuffer output = {block.data(), static_cast<size_t>(m_block_size), 0};
+    bool ok = true;
+    bool cancelled = false;
+    size_t status = 0;
+    while (ok && !cancelled && !m_file.atEnd()) {
+        const QByteArray input_data = m_file.read(INPUT_SIZE);
+        ZSTD_inBuffer input = {input_data.constData(), static_cast<size_t>(input_data.size()), 0};
+        while (ok && !cancelled && input.pos < input.size) {
+            status = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(status)) {
+                qDebug() << "Error decompressing zstd file " << ZSTD_getErrorName(status);
+                ok = false;
+            } else if (output.pos == output.size) {
+                cancelled = !push(std::move(block));
+                block = QByteArray(m_block_size, Qt::Uninitialized);
+                output = {block.data(), static_cast<size_t>(m_block_size), 0};
+            }
+        }
+    }
+    // flush the data kept by the decoder
+    while (ok && !cancelled && status != 0) {
+        ZSTD_inBuffer input = {nullptr, 0, 0};
+        const size_t previous_pos = output.pos;
+        status = ZSTD_decompressStream(stream, &output, &input);
+        if (ZSTD_isError(status) || (output.pos == previous_pos && output.pos < output.size)) {
+            // the frame is incomplete (truncated file)
+            ok = false;
+        } else if (output.pos == output.size) {
+            cancelled = !push(std::move(block));
+            block = QByteArray(m_block_size, Qt::Uninitialized);
+            output = {block.data(), static_cast<size_t>(m_block_size), 0};
+        }
+    }
+    if (ok && !cancelled && output.pos > 0) {
+        block.truncate(static_cast<int>(output.pos));
+        push(std::move(block));
+    }
+    ZSTD_freeDStream(stream);
+    return ok;
+#else
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_error = QStringLiteral("Support for zstd files is not available in this build");
+    return false;
+#endif
+}
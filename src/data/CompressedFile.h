@@ -0,0 +1,76 @@
+#ifndef COMPRESSEDFILE_H
+#define COMPRESSEDFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// CompressedFile reads compressed files (gzip and zstd when available) by blocks.
+// The blocks are decompressed on a separate thread and queued ahead of the consumer
+// so the decompression of the next blocks overlaps with the processing of the current one.
+// Errors (corrupted file or unsupported format) are reported as exceptions by nextBlock()
+class CompressedFile
+{
+
+public:
+
+    enum Format {
+        Plain = 0,
+        Gzip = 1,
+        Zstd = 2
+    };
+
+    // size of the decompressed blocks and number of blocks decompressed ahead
+    static constexpr int DEFAULT_BLOCK_SIZE = 1 << 22;
+    static constexpr size_t MAX_QUEUED_BLOCKS = 4;
+
+    // opens the file and starts decompressing it (throws if the file cannot be opened)
+    explicit CompressedFile(const QString &filename, const int block_size = DEFAULT_BLOCK_SIZE);
+    ~CompressedFile();
+
+    // returns the next block of decompressed data or an empty block at the end of the file
+    // it throws an exception if the file could not be decompressed
+    QByteArray nextBlock();
+
+    // returns the format of the file using its first bytes (magic number)
+    static Format format(const QString &filename);
+
+    // true if the file is compressed in any of the supported formats
+    static bool isCompressed(const QString &filename);
+
+    // helper function that decompresses the whole file
+    static QByteArray readAll(const QString &filename);
+
+private:
+
+    // decompress the file (producer thread)
+    void decompress();
+    bool decompressGzip();
+    bool decompressZstd();
+
+    // adds a block to the queue (waits if the queue is full)
+    // returns false if the consumer is not reading anymore
+    bool push(QByteArray &&block);
+
+    QFile m_file;
+    Format m_format;
+    int m_block_size;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<QByteArray> m_blocks;
+    bool m_finished;
+    bool m_cancelled;
+    QString m_error;
+
+    Q_DISABLE_COPY(CompressedFile)
+};
+
+#endif // COMPRESSEDFILE_H
@@ -1,7 +1,12 @@
 #include "Dataset.h"
 #include <QDebug>
-#include <QImageReader>
+#include <QFileInfo>
+#include <QtConcurrent>
 #include "STData.h"
+#include "LoadingProgress.h"
+#include "ImagePyramid.h"
+#include "MeshLevels.h"
+#include "MatrixParser.h"
 #include "DatasetImporter.h"
 
 Dataset::Dataset()
@@ -14,8 +19,9 @@ Dataset::Dataset()
     , m_scaling_factor(0.5)
     , m_is3D(false)
     , m_alignment()
-    , m_image_tiles()
+    , m_image_pyramid(nullptr)
     , m_image_bounds()
+    , m_mesh(nullptr)
     , m_data(nullptr)
 {
 }
@@ -44,8 +50,9 @@ Dataset::Dataset(const Dataset &other)
     m_scaling_factor = other.m_scaling_factor;
     m_is3D = other.m_is3D;
     m_alignment = other.m_alignment;
-    m_image_tiles = other.m_image_tiles;
+    m_image_pyramid = other.m_image_pyramid;
     m_image_bounds = other.m_image_bounds;
+    m_mesh = other.m_mesh;
     m_data = other.m_data;
 }
 
@@ -64,8 +71,9 @@ Dataset &Dataset::operator=(const Dataset &other)
     m_scaling_factor = other.m_scaling_factor;
     m_is3D = other.m_is3D;
     m_alignment = other.m_alignment;
-    m_image_tiles = other.m_image_tiles;
+    m_image_pyramid = other.m_image_pyramid;
     m_image_bounds = other.m_image_bounds;
+    m_mesh = other.m_mesh;
     m_data = other.m_data;
     return (*this);
 }
@@ -128,9 +136,9 @@ double Dataset::scalingFactor() const
     return m_scaling_factor;
 }
 
-const QVector<QPair<QImage, QPoint>> &Dataset::image_tiles() const
+const QSharedPointer<ImagePyramid> Dataset::image_pyramid() const
 {
-    return m_image_tiles;
+    return m_image_pyramid;
 }
 
 const QRect Dataset::image_bounds() const
@@ -138,6 +146,11 @@ const QRect Dataset::image_bounds() const
     return m_image_bounds;
 }
 
+const QSharedPointer<MeshLevels> Dataset::mesh() const
+{
+    return m_mesh;
+}
+
 bool Dataset::is3D() const
 {
     return m_is3D;
@@ -178,76 +191,117 @@ void Dataset::scalingFactor(const double scaling_factor)
     m_scaling_factor = scaling_factor;
 }
 
-void Dataset::load_data()
+void Dataset::load_data(LoadingProgress *progress)
 {
     // Parse ST Data file and spot coordinates (if any)
+    // the data file can be a folder with a Matrix Market file (10x Genomics format)
+    QString data_file = m_data_file;
+    if (QFileInfo(m_data_file).isDir()) {
+        data_file = MatrixParser::findMTX(m_data_file);
+        if (data_file.isEmpty()) {
+            qDebug() << "No matrix of counts found in the folder " << m_data_file;
+            throw std::runtime_error("No matrix of counts found in the dataset folder");
+        }
+    }
+
+    // Parse image (in 2D only) in a different thread while the data is parsed
+    // the exceptions are not propagated by QtConcurrent so the error is returned
+    const bool has_image = !m_is3D && !m_image_file.isNull() && !m_image_file.isEmpty();
+    QFuture<QString> image_future;
+    if (has_image) {
+        image_future = QtConcurrent::run([this, progress]() {
+            try {
+                return load_Image(progress) ? QString() : QString("Error parsing Image file");
+            } catch (const std::exception &e) {
+                return QString(e.what());
+            }
+        });
+    } else {
+        LoadingProgress::update(progress, LoadingProgress::DecodeImage, 1.0);
+        LoadingProgress::update(progress, LoadingProgress::TileImage, 1.0);
+    }
+
+    // Parse the mesh (in 3D only) and create its levels in a different thread too
+    const bool has_mesh = m_is3D && !m_mesh_file.isNull() && !m_mesh_file.isEmpty();
+    QFuture<QString> mesh_future;
+    if (has_mesh) {
+        mesh_future = QtConcurrent::run([this, progress]() {
+            try {
+                load_Mesh(progress);
+                return QString();
+            } catch (const std::exception &e) {
+                return QString(e.what());
+            }
+        });
+    } else {
+        LoadingProgress::update(progress, LoadingProgress::LoadMesh, 1.0);
+    }
+
     m_data = QSharedPointer<STData>(new STData());
     try {
-        m_data->init(m_data_file, m_spots_file);
+        m_data->init(data_file, m_spots_file, progress);
         m_data->is3D(m_is3D);
     } catch (const std::exception &e) {
         qDebug() << "Error parsing data matrix or spot coordinates " << e.what();
+        // the image and mesh threads use this object so they must finish first
+        if (progress != nullptr) {
+            progress->cancel();
+        }
+        image_future.waitForFinished();
+        mesh_future.waitForFinished();
         throw;
     }
 
-    // Parse image (in 2D only)
-    if (!m_is3D && !m_image_file.isNull() && !m_image_file.isEmpty()) {
-        const bool parsed = load_Image();
-        if (!parsed) {
-            qDebug() << "Error parsing image file";
-            throw std::runtime_error("Error parsing Image file");
+    if (has_mesh) {
+        mesh_future.waitForFinished();
+        const QString mesh_error = mesh_future.result();
+        if (progress != nullptr && progress->cancelled()) {
+            throw LoadingCancelled();
+        }
+        if (!mesh_error.isEmpty()) {
+            qDebug() << "Error parsing mesh file " << mesh_error;
+            throw std::runtime_error(mesh_error.toStdString());
+        }
+    }
+
+    if (has_image) {
+        image_future.waitForFinished();
+        const QString image_error = image_future.result();
+        if (progress != nullptr && progress->cancelled()) {
+            throw LoadingCancelled();
+        }
+        if (!image_error.isEmpty()) {
+            qDebug() << "Error parsing image file " << image_error;
+            throw std::runtime_error(image_error.toStdString());
         }
         m_alignment = QTransform::fromScale(m_scaling_factor, m_scaling_factor);
         qDebug() << "Setting alignment matrix to " << m_alignment;
     }
 }
 
-bool Dataset::load_Image() {
-
-    // image buffer reader
-    QImageReader imageReader(m_image_file);
-
-    // scale image with the scaling factors
-    QSize imageSize = imageReader.size();
-    qDebug() << "Parsed image of size " << imageSize;
-    imageSize *= m_scaling_factor;
-    imageReader.setScaledSize(imageSize);
+bool Dataset::load_Image(LoadingProgress *progress) {
 
-    // load the image
-    QImage image;
-    if (!imageReader.read(&image)) {
-        qDebug() << "Tissue image cannot be parsed " << imageReader.errorString();
+    // create the pyramid of tiles, the image is loaded in full resolution
+    // (the fine levels are decoded on demand when the format supports it)
+    // and the scaling factor is applied when rendering
+    QSharedPointer<ImagePyramid> pyramid(new ImagePyramid());
+    if (!pyramid->open(m_image_file, m_scaling_factor, progress)) {
         return false;
     }
+    m_image_pyramid = pyramid;
 
     // store the scaled image size
-    m_image_bounds = image.rect();
+    m_image_bounds = pyramid->bounds().toRect();
     qDebug() << "Setting image of size " << m_image_bounds;
 
-    // compute tiles size and numbers
-    constexpr int tile_width = 256;
-    constexpr int tile_height = 256;
-    const int width = image.width();
-    const int height = image.height();
-    const int xCount = width / tile_width;
-    const int yCount = height / tile_height;
-    const int count = xCount * yCount;
-
-    // create tiles
-    m_image_tiles.resize(count);
-    #pragma omp parallel for
-    for (int i = 0; i < count; ++i) {
-        // tiles sizes
-        const int x = tile_width * (i % xCount);
-        const int y = tile_height * (i / xCount);
-        const int texture_width = std::min(width - x, tile_width);
-        const int texture_height = std::min(height - y, tile_height);
-        // QImage should be thread-safe
-        m_image_tiles[i] = (QPair<QImage, QPoint>(image.copy(x, y,
-                                                             texture_width,
-                                                             texture_height),
-                                                  QPoint(x, y)));
-    }
-
     return true;
 }
+
+void Dataset::load_Mesh(LoadingProgress *progress)
+{
+    // the levels of detail of the mesh are created (or read from the mesh cache)
+    // so the renderer can pick the level that matches the distance of the camera
+    QSharedPointer<MeshLevels> mesh(new MeshLevels());
+    mesh->open(m_mesh_file, progress);
+    m_mesh = mesh;
+}
@@ -7,6 +7,9 @@
 
 class STData;
 class DatasetImporter;
+class LoadingProgress;
+class ImagePyramid;
+class MeshLevels;
 
 // Data model class to store datasets.
 // A dataset is composed of a data frame (matrix of counts
@@ -14,7 +17,8 @@ class DatasetImporter;
 // to pixel mapping file. Optionally users may load a 3D Mesh too.
 // Datasets can be 2D or 3D.
 // The alignment matrix to map spot coordiantes to pixel coordinates
-// and the tiles of the HE image are generated when the dataset is loaded.
+// and the pyramid of tiles of the HE image (or the levels of the 3D mesh) are
+// generated when the dataset is loaded.
 class Dataset
 {
 
@@ -42,8 +46,9 @@ public:
 
     // generated
     const QTransform &alignmentMatrix() const;
-    const QVector<QPair<QImage, QPoint>> &image_tiles() const;
+    const QSharedPointer<ImagePyramid> image_pyramid() const;
     const QRect image_bounds() const;
+    const QSharedPointer<MeshLevels> mesh() const;
     bool is3D() const;
 
     // setters
@@ -57,13 +62,21 @@ public:
 
     // creates the STData object (parse data)
     // Parses : matrix of counts, image and spots-file
+    // the image is decoded and tiled (or the mesh is parsed and simplified in 3D)
+    // while the matrix of counts is parsed
+    // the progress is reported to progress (if given) and LoadingCancelled
+    // is thrown if the loading is cancelled
     // throws exception if parsing is something went wrong
-    void load_data();
+    void load_data(LoadingProgress *progress = nullptr);
 
 private:
 
-    // Function to parse the image and break into tiles
-    bool load_Image();
+    // Function to parse the image and create the pyramid of tiles
+    bool load_Image(LoadingProgress *progress);
+
+    // Function to parse the mesh and create its levels of detail
+    // throws exception if the mesh cannot be parsed
+    void load_Mesh(LoadingProgress *progress);
 
     QString m_name;
     QString m_statComments;
@@ -76,8 +89,9 @@ private:
 
     // generated
     QTransform m_alignment;
-    QVector<QPair<QImage, QPoint>> m_image_tiles;
+    QSharedPointer<ImagePyramid> m_image_pyramid;
     QRect m_image_bounds;
+    QSharedPointer<MeshLevels> m_mesh;
 
     // ST data
     QSharedPointer<STData> m_data;
@@ -0,0 +1,405 @@
+#include "DatasetCache.h"
+#include "data/MatrixParser.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+constexpr char MAGIC[8] = {'S', 'T', 'V', 'C', 'A', 'C', 'H', 'E'};
+constexpr quint32 VERSION = 2;
+constexpr char SUFFIX[] = ".stcache";
+
+// the cache file starts with the header followed by the sections (aligned to 8 bytes):
+// spot totals, gene totals, spot coordinates (x,y,z), the counts (dense column-major
+// or sparse CSC as column pointers, row indices and values) and the spot and gene names
+// (length and UTF-8 bytes of each name)
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 is_sparse;
+    quint64 data_size;
+    qint64 data_mtime;
+    quint64 spots_size;
+    qint64 spots_mtime;
+    // the features and barcodes files of a Matrix Market file (zero otherwise)
+    quint64 features_size;
+    qint64 features_mtime;
+    quint64 barcodes_size;
+    qint64 barcodes_mtime;
+    quint64 n_spots;
+    quint64 n_genes;
+    quint64 n_nonzero;
+    quint64 names_size;
+};
+
+inline quint64 align(const quint64 size)
+{
+    return (size + 7) & ~quint64(7);
+}
+
+inline quint64 coordinatesSize(const Header &header)
+{
+    return header.n_spots * 3 * sizeof(float);
+}
+
+inline quint64 countsSize(const Header &header)
+{
+    return header.is_sparse ? align((header.n_genes + 1) * sizeof(quint64))
+                              + header.n_nonzero * (sizeof(quint64) + sizeof(double))
+                            : header.n_spots * header.n_genes * sizeof(double);
+}
+
+// the size that the cache file must have according to its header
+inline quint64 fileSize(const Header &header)
+{
+    return align(sizeof(Header))
+            + header.n_spots * sizeof(double)
+            + header.n_genes * sizeof(double)
+            + align(coordinatesSize(header))
+            + countsSize(header)
+            + header.names_size;
+}
+
+// the name of the cache file is a hash of the paths of the source files
+QString cacheFile(const QString &data_file, const QString &spots_file)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QFileInfo(data_file).absoluteFilePath().toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(QFileInfo(spots_file).absoluteFilePath().toUtf8());
+    const QString name = QString::fromLatin1(hash.result().toHex()) + SUFFIX;
+    return QDir(DatasetCache::directory()).filePath(name);
+}
+
+// fills the header with the size and modification time of the source files
+// (the names of a Matrix Market file are in the features and barcodes files)
+void sourceInfo(const QString &data_file, const QString &spots_file, Header &header)
+{
+    const QFileInfo data_info(data_file);
+    const QFileInfo spots_info(spots_file);
+    header.data_size = static_cast<quint64>(data_info.size());
+    header.data_mtime = data_info.lastModified().toMSecsSinceEpoch();
+    header.spots_size = static_cast<quint64>(spots_info.size());
+    header.spots_mtime = spots_info.lastModified().toMSecsSinceEpoch();
+    header.features_size = 0;
+    header.features_mtime = 0;
+    header.barcodes_size = 0;
+    header.barcodes_mtime = 0;
+    QString features_file;
+    QString barcodes_file;
+    if (MatrixParser::isMatrixMarket(data_file)
+            && MatrixParser::findMTXNames(data_file, features_file, barcodes_file)) {
+        const QFileInfo features_info(features_file);
+        const QFileInfo barcodes_info(barcodes_file);
+        header.features_size = static_cast<quint64>(features_info.size());
+        header.features_mtime = features_info.lastModified().toMSecsSinceEpoch();
+        header.barcodes_size = static_cast<quint64>(barcodes_info.size());
+        header.barcodes_mtime = barcodes_info.lastModified().toMSecsSinceEpoch();
+    }
+}
+
+// writes a section of the cache file padded to 8 bytes
+bool writeSection(QIODevice &device, const void *data, const quint64 size)
+{
+    static const char padding[8] = {};
+    const qint64 padding_size = static_cast<qint64>(align(size) - size);
+    return device.write(static_cast<const char *>(data), size) == static_cast<qint64>(size)
+            && device.write(padding, padding_size) == padding_size;
+}
+
+void appendName(QByteArray &names, const QString &name)
+{
+    const QByteArray bytes = name.toUtf8();
+    const quint32 length = bytes.size();
+    names.append(reinterpret_cast<const char *>(&length), sizeof(quint32));
+    names.append(bytes);
+}
+
+// parses n names from the names section, returns false if the section is not valid
+bool parseNames(const uchar *&pos, const uchar *end, const quint64 n, QList<QString> &names)
+{
+    names.reserve(static_cast<int>(n));
+    for (quint64 i = 0; i < n; ++i) {
+        quint32 length;
+        if (end - pos < static_cast<qint64>(sizeof(quint32))) {
+            return false;
+        }
+        std::memcpy(&length, pos, sizeof(quint32));
+        pos += sizeof(quint32);
+        if (end - pos < static_cast<qint64>(length)) {
+            return false;
+        }
+        names.append(QString::fromUtf8(reinterpret_cast<const char *>(pos),
+                                        static_cast<int>(length)));
+        pos += length;
+    }
+    return true;
+}
+
+// true if the sparse (CSC) sections are consistent: the column pointers start at 0,
+// do not decrease and end at n_nonzero and the row indices of each column are
+// increasing and lower than n_rows (so a corrupt file cannot index out of bounds)
+bool validSparse(const quint64 *col_ptrs, const quint64 *row_indices,
+                 const quint64 n_rows, const quint64 n_cols, const quint64 n_nonzero)
+{
+    if (col_ptrs[0] != 0 || col_ptrs[n_cols] != n_nonzero
+            || !std::is_sorted(col_ptrs, col_ptrs + n_cols + 1)) {
+        return false;
+    }
+    bool valid = true;
+    #pragma omp parallel for reduction(&&:valid)
+    for (quint64 j = 0; j < n_cols; ++j) {
+        quint64 previous = 0;
+        for (quint64 k = col_ptrs[j]; k < col_ptrs[j + 1]; ++k) {
+            const quint64 row = row_indices[k];
+            valid = valid && row < n_rows && (k == col_ptrs[j] || row > previous);
+            previous = row;
+        }
+    }
+    return valid;
+}
+
+// loads the cache file, the source files are checked if source is given
+// (the file is memory-mapped and its sections are copied into the entry)
+bool loadFile(const QString &filename, const Header *source, DatasetCache::Entry &entry)
+{
+    QFile file(filename);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (size < static_cast<qint64>(sizeof(Header))) {
+        qDebug() << "The cache file " << file.fileName() << " is not valid";
+        return false;
+    }
+
+    // the mapping is released when the file is closed
+    const uchar *mapped = file.map(0, size);
+    if (mapped == nullptr) {
+        qDebug() << "Could not map the cache file " << file.fileName();
+        return false;
+    }
+
+    // check that the cache file is valid and up to date with the source files
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+    const quint64 max_elements = static_cast<quint64>(size);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+            || header.version != VERSION
+            || header.n_spots > max_elements
+            || header.n_genes > max_elements
+            || header.n_nonzero > max_elements
+            || header.names_size > max_elements
+            || fileSize(header) != static_cast<quint64>(size)) {
+        qDebug() << "The cache file " << file.fileName() << " is not valid";
+        return false;
+    }
+    if (source != nullptr
+            && (header.data_size != source->data_size || header.data_mtime != source->data_mtime
+                || header.spots_size != source->spots_size
+                || header.spots_mtime != source->spots_mtime
+                || header.features_size != source->features_size
+                || header.features_mtime != source->features_mtime
+                || header.barcodes_size != source->barcodes_size
+                || header.barcodes_mtime != source->barcodes_mtime)) {
+        qDebug() << "The cache file " << file.fileName() << " is outdated";
+        return false;
+    }
+
+    // returns the current section and moves to the next one
+    const uchar *pos = mapped + align(sizeof(Header));
+    const auto section = [&pos](const quint64 section_size) {
+        const uchar *current = pos;
+        pos += align(section_size);
+        return current;
+    };
+
+    const uword n_spots = header.n_spots;
+    const uword n_genes = header.n_genes;
+    const uword n_nonzero = header.n_nonzero;
+    entry.spot_totals = colvec(reinterpret_cast<const double *>(section(n_spots * sizeof(double))),
+                               n_spots);
+    entry.gene_totals = rowvec(reinterpret_cast<const double *>(section(n_genes * sizeof(double))),
+                               n_genes);
+    const float *coordinates = reinterpret_cast<const float *>(section(coordinatesSize(header)));
+    entry.coordinates.resize(static_cast<int>(n_spots));
+    for (uword i = 0; i < n_spots; ++i) {
+        entry.coordinates[static_cast<int>(i)] = Spot::SpotType(coordinates[3 * i],
+                                                                coordinates[3 * i + 1],
+                                                                coordinates[3 * i + 2]);
+    }
+
+    entry.data = STData::STDataFrame();
+    entry.data.is_sparse = header.is_sparse != 0;
+    try {
+        if (entry.data.is_sparse) {
+            const quint64 *col_ptrs = reinterpret_cast<const quint64 *>(
+                        section((n_genes + 1) * sizeof(quint64)));
+            const quint64 *row_indices = reinterpret_cast<const quint64 *>(
+                        section(n_nonzero * sizeof(quint64)));
+            const double *values = reinterpret_cast<const double *>(
+                        section(n_nonzero * sizeof(double)));
+            if (!validSparse(col_ptrs, row_indices, n_spots, n_genes, n_nonzero)) {
+                qDebug() << "The cache file " << file.fileName() << " is not valid";
+                return false;
+            }
+            uvec sp_col_ptrs(n_genes + 1);
+            uvec sp_row_indices(n_nonzero);
+            std::copy(col_ptrs, col_ptrs + n_genes + 1, sp_col_ptrs.begin());
+            std::copy(row_indices, row_indices + n_nonzero, sp_row_indices.begin());
+            entry.data.sp_counts = sp_mat(sp_row_indices, sp_col_ptrs, vec(values, n_nonzero),
+                                          n_spots, n_genes);
+        } else {
+            const double *counts = reinterpret_cast<const double *>(
+                        section(n_spots * n_genes * sizeof(double)));
+            entry.data.counts = mat(counts, n_spots, n_genes);
+        }
+    } catch (const std::exception &e) {
+        qDebug() << "The cache file " << file.fileName() << " is not valid " << e.what();
+        return false;
+    }
+
+    const uchar *names_end = pos + header.names_size;
+    if (!parseNames(pos, names_end, header.n_spots, entry.data.spots)
+            || !parseNames(pos, names_end, header.n_genes, entry.data.genes)) {
+        qDebug() << "The cache file " << file.fileName() << " is not valid";
+        return false;
+    }
+
+    qDebug() << "Loaded cached dataset " << file.fileName();
+    return true;
+}
+
+// writes the cache file, the header contains the information of the source files
+bool saveFile(const QString &filename, Header header, const DatasetCache::Entry &entry)
+{
+    const STData::STDataFrame &data = entry.data;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.is_sparse = data.is_sparse;
+    header.n_spots = data.n_rows();
+    header.n_genes = data.n_cols();
+    header.n_nonzero = data.is_sparse ? data.sp_counts.n_nonzero : 0;
+
+    Q_ASSERT(entry.coordinates.size() == data.spots.size());
+    Q_ASSERT(entry.spot_totals.n_elem == header.n_spots);
+    Q_ASSERT(entry.gene_totals.n_elem == header.n_genes);
+
+    std::vector<float> coordinates;
+    coordinates.reserve(3 * header.n_spots);
+    for (const auto &coordinate : entry.coordinates) {
+        coordinates.push_back(coordinate.x());
+        coordinates.push_back(coordinate.y());
+        coordinates.push_back(coordinate.z());
+    }
+
+    QByteArray names;
+    for (const auto &spot : data.spots) {
+        appendName(names, spot);
+    }
+    for (const auto &gene : data.genes) {
+        appendName(names, gene);
+    }
+    header.names_size = names.size();
+
+    // the file is written to a temporary file that replaces the cache file when committed
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not create the cache file " << file.fileName();
+        return false;
+    }
+
+    bool written = writeSection(file, &header, sizeof(Header))
+            && writeSection(file, entry.spot_totals.memptr(), header.n_spots * sizeof(double))
+            && writeSection(file, entry.gene_totals.memptr(), header.n_genes * sizeof(double))
+            && writeSection(file, coordinates.data(), coordinatesSize(header));
+    if (written && data.is_sparse) {
+        data.sp_counts.sync();
+        const std::vector<quint64> col_ptrs(data.sp_counts.col_ptrs,
+                                            data.sp_counts.col_ptrs + header.n_genes + 1);
+        const std::vector<quint64> row_indices(data.sp_counts.row_indices,
+                                               data.sp_counts.row_indices + header.n_nonzero);
+        written = writeSection(file, col_ptrs.data(), col_ptrs.size() * sizeof(quint64))
+                && writeSection(file, row_indices.data(), row_indices.size() * sizeof(quint64))
+                && writeSection(file, data.sp_counts.values, header.n_nonzero * sizeof(double));
+    } else if (written) {
+        written = writeSection(file, data.counts.memptr(),
+                               header.n_spots * header.n_genes * sizeof(double));
+    }
+    written = written && file.write(names) == names.size();
+
+    if (!written) {
+        qDebug() << "Could not write the cache file " << file.fileName();
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+}
+
+namespace DatasetCache
+{
+
+QString directory()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+            .filePath(QStringLiteral("datasets"));
+}
+
+bool load(const QString &data_file, const QString &spots_file, Entry &entry)
+{
+    Header source;
+    sourceInfo(data_file, spots_file, source);
+    return loadFile(cacheFile(data_file, spots_file), &source, entry);
+}
+
+bool save(const QString &data_file, const QString &spots_file, const Entry &entry)
+{
+    if (!QDir().mkpath(directory())) {
+        qDebug() << "Could not create the cache directory " << directory();
+        return false;
+    }
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    sourceInfo(data_file, spots_file, header);
+    return saveFile(cacheFile(data_file, spots_file), header, entry);
+}
+
+bool isCacheFile(const QString &filename)
+{
+    return filename.endsWith(SUFFIX, Qt::CaseInsensitive);
+}
+
+bool read(const QString &filename, Entry &entry)
+{
+    return loadFile(filename, nullptr, entry);
+}
+
+bool write(const QString &filename, const Entry &entry)
+{
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    return saveFile(filename, header, entry);
+}
+
+void clear()
+{
+    qDebug() << "Removing the cached datasets in " << directory();
+    QDir(directory()).removeRecursively();
+}
+
+}
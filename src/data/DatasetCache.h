@@ -0,0 +1,55 @@
+#ifndef DATASETCACHE_H
+#define DATASETCACHE_H
+
+#include <QString>
+#include <QVector>
+
+#include "data/STData.h"
+
+// DatasetCache is a convenience namespace which contains the functions used to
+// store parsed datasets in a binary file so they do not need to be parsed again.
+// The cache files are stored in the cache directory of the application and they
+// are memory-mapped when loaded, the sections of the file are copied into the
+// matrices of the entry (so the dataset is not parsed again but it is copied).
+// A cache file is only valid while the size and the modification time of the source
+// files (counts and spots, and the features and barcodes of Matrix Market files)
+// do not change.
+namespace DatasetCache
+{
+
+// the content of a cached dataset, the matrix of counts (dense or sparse) with
+// the spots and genes that are kept and the coordinates and total counts of them
+struct Entry {
+    STData::STDataFrame data;
+    QVector<Spot::SpotType> coordinates;
+    colvec spot_totals;
+    rowvec gene_totals;
+};
+
+// loads the cached dataset of the given source files
+// returns false if there is no cache for the files or it is outdated or not valid
+bool load(const QString &data_file, const QString &spots_file, Entry &entry);
+
+// writes the cache of the given source files, returns false if it could not be written
+bool save(const QString &data_file, const QString &spots_file, const Entry &entry);
+
+// true if the file is a cache file (*.stcache)
+bool isCacheFile(const QString &filename);
+
+// loads a cache file (an exported dataset) without checking its source files
+// returns false if the file is not valid
+bool read(const QString &filename, Entry &entry);
+
+// writes the entry to a cache file (used to export datasets in binary format)
+// returns false if the file could not be written
+bool write(const QString &filename, const Entry &entry);
+
+// removes all the cached datasets
+void clear();
+
+// the directory where the cache files are stored
+QString directory();
+
+}
+
+#endif // DATASETCACHE_H
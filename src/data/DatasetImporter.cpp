@@ -11,6 +11,7 @@
 #include <QStandardPaths>
 
 #include "Dataset.h"
+#include "MatrixParser.h"
 
 #include "ui_datasetImporter.h"
 
@@ -125,7 +126,7 @@ void DatasetImporter::slotLoadSTDataFile()
             = QFileDialog::getOpenFileName(this,
                                            tr("Open ST Data File"),
                                            QDir::homePath(),
-                                           QString("%1").arg(tr("TSV|TXT Files (*.tsv *.txt)")));
+                                           QString("%1").arg(tr("TSV|TXT|MTX|H5|STCACHE Files (*.tsv *.txt *.mtx *.h5 *.h5ad *.stcache *.tsv.gz *.txt.gz *.mtx.gz *.tsv.zst *.txt.zst *.mtx.zst)")));
     // early out
     if (filename.isEmpty()) {
         return;
@@ -185,7 +186,7 @@ void DatasetImporter::slotLoadSpotsMapFile()
             = QFileDialog::getOpenFileName(this,
                                            tr("Open Coordinates File"),
                                            QDir::homePath(),
-                                           QString("%1").arg(tr("TSV|TXT Files (*.txt *.tsv)")));
+                                           QString("%1").arg(tr("TSV|TXT Files (*.txt *.tsv *.txt.gz *.tsv.gz *.txt.zst *.tsv.zst)")));
     // early out
     if (filename.isEmpty()) {
         return;
@@ -233,12 +234,30 @@ void DatasetImporter::slotParseFolder()
     if (dialog.exec()) {
         QDir selectedDir = dialog.directory();
         selectedDir.setFilter(QDir::Files);
+        // a Matrix Market file (10x Genomics format) is used as the data instead of
+        // the TSV files (its features and barcodes are also TSV files)
+        const QString mtx_file = MatrixParser::findMTX(selectedDir.absolutePath());
+        if (!mtx_file.isEmpty()) {
+            m_ui->stDataFile->setText(mtx_file);
+        }
+        bool has_h5_file = false;
         QDirIterator it(selectedDir, QDirIterator::NoIteratorFlags);
         while (it.hasNext()) {
             const QString file = it.next();
             qDebug() << "Parsing dataset file from folder " << file;
-            if (file.contains(".tsv")) {
-                m_ui->stDataFile->setText(file);
+            // compressed files (e.g. .tsv.gz or .txt.zst) are matched by the same extensions
+            if (file.contains(".mtx")) {
+                continue;
+            } else if (file.endsWith(".h5") || file.endsWith(".h5ad")) {
+                // HDF5 files are preferred over the TSV files
+                if (mtx_file.isEmpty()) {
+                    m_ui->stDataFile->setText(file);
+                    has_h5_file = true;
+                }
+            } else if (file.contains(".tsv")) {
+                if (mtx_file.isEmpty() && !has_h5_file) {
+                    m_ui->stDataFile->setText(file);
+                }
             } else if (file.contains(".jpg") || file.contains(".jpeg") || file.contains(".png")) {
                 m_ui->mainImageFile->setText(file);
             } else if (file.contains(".obj")) {
@@ -37,7 +37,7 @@ public:
     // To import a dataset from a folder
     // the function assumes that
     // the image is called *.jpg or *.jpeg or *.png
-    // the data is called *.tsv
+    // the data is called *.tsv, *.h5, *.h5ad or *.mtx (with features and barcodes files)
     // the spots file is called *.txt
     // the metadata is present in a JSON file called info.json
     void slotParseFolder();
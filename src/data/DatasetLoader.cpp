@@ -0,0 +1,122 @@
+#include "DatasetLoader.h"
+
+#include <QDebug>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include "Dataset.h"
+
+DatasetLoader::DatasetLoader(QObject *parent)
+    : QObject(parent)
+    , m_dataset(nullptr)
+    , m_loaded(nullptr)
+    , m_progress(nullptr)
+    , m_fractions(LoadingProgress::N_STAGES, 0.0)
+    , m_loading_id(0)
+    , m_watcher()
+    , m_cancelled()
+{
+    // the progress is sent from the loading threads (queued connection)
+    connect(this, &DatasetLoader::signalStageProgress,
+            this, &DatasetLoader::slotStageProgress, Qt::QueuedConnection);
+    connect(&m_watcher, &QFutureWatcher<QString>::finished,
+            this, &DatasetLoader::slotLoadingFinished);
+}
+
+DatasetLoader::~DatasetLoader()
+{
+    // the loading threads use this object to send the progress
+    cancel();
+    for (auto &future : m_cancelled) {
+        future.waitForFinished();
+    }
+}
+
+void DatasetLoader::load(QSharedPointer<Dataset> dataset)
+{
+    cancel();
+
+    // the dataset is loaded in a copy so it is not modified until it is done
+    ++m_loading_id;
+    const int loading_id = m_loading_id;
+    m_fractions.fill(0.0);
+    m_dataset = dataset;
+    m_loaded = QSharedPointer<Dataset>(new Dataset(*dataset));
+    m_progress = QSharedPointer<LoadingProgress>(new LoadingProgress(
+        [this, loading_id](const LoadingProgress::Stage stage, const double fraction) {
+            emit signalStageProgress(loading_id, stage, fraction);
+        }));
+
+    auto loaded = m_loaded;
+    auto progress = m_progress;
+    m_watcher.setFuture(QtConcurrent::run([loaded, progress]() {
+        try {
+            loaded->load_data(progress.data());
+        } catch (const LoadingCancelled &) {
+            qDebug() << "The loading of the dataset was cancelled";
+        } catch (const std::exception &e) {
+            return QString::fromStdString(e.what());
+        }
+        return QString();
+    }));
+}
+
+bool DatasetLoader::isLoading() const
+{
+    return !m_progress.isNull();
+}
+
+void DatasetLoader::cancel()
+{
+    if (m_progress.isNull()) {
+        return;
+    }
+    m_progress->cancel();
+    m_progress.clear();
+    m_loaded.clear();
+    m_dataset.clear();
+
+    // the cancelled loading keeps running until it reaches the next stage
+    m_cancelled.erase(std::remove_if(m_cancelled.begin(), m_cancelled.end(),
+                                     [](const QFuture<QString> &future) {
+                                         return future.isFinished();
+                                     }), m_cancelled.end());
+    m_cancelled.append(m_watcher.future());
+    emit signalCancelled();
+}
+
+void DatasetLoader::slotStageProgress(const int loading_id, const int stage, const double fraction)
+{
+    if (loading_id != m_loading_id || m_progress.isNull()) {
+        return;
+    }
+    m_fractions[stage] = fraction;
+    double total = 0.0;
+    for (const double stage_fraction : m_fractions) {
+        total += stage_fraction;
+    }
+    const int percent = static_cast<int>(100.0 * total / LoadingProgress::N_STAGES);
+    emit signalProgress(LoadingProgress::stageName(static_cast<LoadingProgress::Stage>(stage)),
+                        percent);
+}
+
+void DatasetLoader::slotLoadingFinished()
+{
+    // the loading was cancelled
+    if (m_progress.isNull()) {
+        return;
+    }
+    const QString error = m_watcher.result();
+    auto dataset = m_dataset;
+    auto loaded = m_loaded;
+    m_progress.clear();
+    m_loaded.clear();
+    m_dataset.clear();
+    if (!error.isEmpty()) {
+        emit signalError(error);
+        return;
+    }
+    *dataset = *loaded;
+    emit signalDatasetLoaded(dataset);
+}
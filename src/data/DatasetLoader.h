@@ -0,0 +1,77 @@
+#ifndef DATASETLOADER_H
+#define DATASETLOADER_H
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "data/LoadingProgress.h"
+
+class Dataset;
+
+// DatasetLoader loads datasets (parsing the matrix of counts, the spot
+// coordinates and the tissue image) in a background thread so the user
+// interface stays responsive. The progress of the loading is reported with
+// signals and the loading can be cancelled at any time, the dataset is only
+// updated when the loading has finished without errors.
+class DatasetLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit DatasetLoader(QObject *parent = nullptr);
+    virtual ~DatasetLoader();
+
+    // starts to load the dataset (cancelling the current loading if any)
+    void load(QSharedPointer<Dataset> dataset);
+
+    // true if a dataset is being loaded
+    bool isLoading() const;
+
+public slots:
+
+    // cancels the current loading (the dataset is not modified)
+    void cancel();
+
+signals:
+
+    // the progress of the loading (the name of the current stage and 0-100)
+    void signalProgress(const QString &stage, const int percent);
+
+    // the dataset has been loaded
+    void signalDatasetLoaded(QSharedPointer<Dataset> dataset);
+
+    // the loading failed
+    void signalError(const QString &error);
+
+    // the loading was cancelled
+    void signalCancelled();
+
+    // to send the progress of the stages from the loading threads
+    void signalStageProgress(const int loading_id, const int stage, const double fraction);
+
+private slots:
+
+    void slotStageProgress(const int loading_id, const int stage, const double fraction);
+    void slotLoadingFinished();
+
+private:
+
+    // the dataset being loaded and the copy where the data is loaded
+    QSharedPointer<Dataset> m_dataset;
+    QSharedPointer<Dataset> m_loaded;
+    QSharedPointer<LoadingProgress> m_progress;
+    // the progress of every stage of the current loading
+    QVector<double> m_fractions;
+    // to discard the progress of the loadings that were cancelled
+    int m_loading_id;
+    QFutureWatcher<QString> m_watcher;
+    // the loadings that were cancelled but are still running
+    QVector<QFuture<QString>> m_cancelled;
+
+    Q_DISABLE_COPY(DatasetLoader)
+};
+
+#endif // DATASETLOADER_H
@@ -0,0 +1,478 @@
+#include "HDF5Parser.h"
+#include "MatrixParser.h"
+
+#include "options_cmake.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_HDF5
+#include <hdf5.h>
+#endif
+
+namespace
+{
+
+// the signature at the beginning of the HDF5 files
+constexpr char SIGNATURE[8] = {'\x89', 'H', 'D', 'F', '\r', '\n', '\x1a', '\n'};
+
+#ifdef HAVE_HDF5
+
+// number of entries (values and indices) of a sparse matrix read at once
+constexpr hsize_t WINDOW_SIZE = 1 << 20;
+
+// number of rows of a dense matrix read at once
+constexpr hsize_t ROWS_BLOCK = 256;
+
+// closes the HDF5 object when it goes out of scope
+class Handle
+{
+public:
+    Handle(const hid_t id, herr_t (*close)(hid_t),
+           const char *error = "The HDF5 file does not contain a valid matrix")
+        : m_id(id)
+        , m_close(close)
+    {
+        if (m_id < 0) {
+            throw std::runtime_error(error);
+        }
+    }
+    ~Handle()
+    {
+        m_close(m_id);
+    }
+    operator hid_t() const
+    {
+        return m_id;
+    }
+
+private:
+    hid_t m_id;
+    herr_t (*m_close)(hid_t);
+
+    Q_DISABLE_COPY(Handle)
+};
+
+// true if all the links of the path exist
+bool exists(const hid_t location, const char *path)
+{
+    QByteArray partial;
+    for (const QByteArray &link : QByteArray(path).split('/')) {
+        if (!partial.isEmpty()) {
+            partial.append('/');
+        }
+        partial.append(link);
+        if (H5Lexists(location, partial.constData(), H5P_DEFAULT) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the dimensions of a dataset
+std::vector<hsize_t> dimensions(const hid_t dataset)
+{
+    const Handle space(H5Dget_space(dataset), H5Sclose);
+    const int rank = H5Sget_simple_extent_ndims(space);
+    std::vector<hsize_t> dims(static_cast<size_t>(std::max(rank, 0)));
+    H5Sget_simple_extent_dims(space, dims.data(), nullptr);
+    return dims;
+}
+
+// reads a hyperslab (start and count of each dimension) of a dataset
+void readHyperslab(const hid_t dataset, const hid_t mem_type,
+                   const std::vector<hsize_t> &start, const std::vector<hsize_t> &count,
+                   void *buffer)
+{
+    const Handle file_space(H5Dget_space(dataset), H5Sclose);
+    const Handle mem_space(H5Screate_simple(static_cast<int>(count.size()), count.data(), nullptr),
+                           H5Sclose);
+    if (H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start.data(), nullptr, count.data(), nullptr) < 0
+            || H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT, buffer) < 0) {
+        throw std::runtime_error("Error reading the HDF5 file");
+    }
+}
+
+// reads the whole dataset (the values are converted to the given type)
+template <typename T>
+std::vector<T> readAll(const hid_t location, const char *name, const hid_t mem_type)
+{
+    const Handle dataset(H5Dopen2(location, name, H5P_DEFAULT), H5Dclose);
+    hsize_t size = 1;
+    for (const hsize_t dim : dimensions(dataset)) {
+        size *= dim;
+    }
+    std::vector<T> values(size);
+    if (size > 0 && H5Dread(dataset, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()) < 0) {
+        throw std::runtime_error("Error reading the HDF5 file");
+    }
+    return values;
+}
+
+// reads the strings of a dataset or an attribute (fixed or variable length)
+template <typename Read>
+QList<QString> readStrings(const hid_t type, const hid_t space, Read read)
+{
+    if (H5Tget_class(type) != H5T_STRING) {
+        throw std::runtime_error("The HDF5 file does not contain valid names");
+    }
+    const hssize_t n = std::max<hssize_t>(H5Sget_simple_extent_npoints(space), 0);
+    const Handle mem_type(H5Tcopy(H5T_C_S1), H5Tclose);
+    H5Tset_cset(mem_type, H5Tget_cset(type));
+
+    QList<QString> strings;
+    strings.reserve(static_cast<int>(n));
+    if (H5Tis_variable_str(type) > 0) {
+        H5Tset_size(mem_type, H5T_VARIABLE);
+        std::vector<char *> buffer(static_cast<size_t>(n), nullptr);
+        if (read(static_cast<hid_t>(mem_type), static_cast<void *>(buffer.data())) < 0) {
+            throw std::runtime_error("Error reading the HDF5 file");
+        }
+        for (const char *string : buffer) {
+            strings.append(QString::fromUtf8(string));
+        }
+        H5Dvlen_reclaim(mem_type, space, H5P_DEFAULT, buffer.data());
+    } else {
+        const size_t size = H5Tget_size(type);
+        H5Tset_size(mem_type, size);
+        std::vector<char> buffer(static_cast<size_t>(n) * size);
+        if (read(static_cast<hid_t>(mem_type), static_cast<void *>(buffer.data())) < 0) {
+            throw std::runtime_error("Error reading the HDF5 file");
+        }
+        for (hssize_t i = 0; i < n; ++i) {
+            const char *string = buffer.data() + i * size;
+            strings.append(QString::fromUtf8(string, static_cast<int>(strnlen(string, size))));
+        }
+    }
+    return strings;
+}
+
+QList<QString> readStrings(const hid_t location, const char *name)
+{
+    const Handle dataset(H5Dopen2(location, name, H5P_DEFAULT), H5Dclose);
+    const Handle type(H5Dget_type(dataset), H5Tclose);
+    const Handle space(H5Dget_space(dataset), H5Sclose);
+    return readStrings(type, space, [&dataset](const hid_t mem_type, void *buffer) {
+        return H5Dread(dataset, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer);
+    });
+}
+
+// reads a string attribute of an object (empty if the object has no such attribute)
+QString readStringAttribute(const hid_t object, const char *name)
+{
+    if (H5Aexists(object, name) <= 0) {
+        return QString();
+    }
+    const Handle attribute(H5Aopen(object, name, H5P_DEFAULT), H5Aclose);
+    const Handle type(H5Aget_type(attribute), H5Tclose);
+    const Handle space(H5Aget_space(attribute), H5Sclose);
+    const QList<QString> strings = readStrings(type, space, [&attribute](const hid_t mem_type, void *buffer) {
+        return H5Aread(attribute, mem_type, buffer);
+    });
+    return strings.isEmpty() ? QString() : strings.first();
+}
+
+// returns the indexes of the selected names (all of them if the selection is empty)
+std::vector<uword> selectedIndexes(const QList<QString> &names, const QSet<QString> &selection)
+{
+    std::vector<uword> indexes;
+    for (int i = 0; i < names.size(); ++i) {
+        if (selection.isEmpty() || selection.contains(names.at(i))) {
+            indexes.push_back(static_cast<uword>(i));
+        }
+    }
+    return indexes;
+}
+
+// maps the indexes of all the elements to the selected indexes (-1 if they are not selected)
+std::vector<sword> indexesMap(const std::vector<uword> &indexes, const uword n)
+{
+    std::vector<sword> map(n, -1);
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        map[indexes[i]] = static_cast<sword>(i);
+    }
+    return map;
+}
+
+// reads the selected outer indexes (rows of CSR or columns of CSC) of a compressed sparse
+// matrix (data, indices and indptr arrays), the entries are read by windows of consecutive
+// entries and only the ones of the selected inner indexes are kept (remapped by inner_map)
+// returns a matrix with the selected inner indexes as rows and the outer indexes as columns
+sp_mat readCompressed(const hid_t group,
+                      const std::vector<uword> &outer,
+                      const uword n_outer,
+                      const std::vector<sword> &inner_map,
+                      const uword n_inner)
+{
+    const std::vector<long long> indptr = readAll<long long>(group, "indptr", H5T_NATIVE_LLONG);
+    const Handle data(H5Dopen2(group, "data", H5P_DEFAULT), H5Dclose);
+    const Handle indices(H5Dopen2(group, "indices", H5P_DEFAULT), H5Dclose);
+    const std::vector<hsize_t> data_dims = dimensions(data);
+    if (indptr.size() != n_outer + 1 || data_dims.size() != 1 || dimensions(indices) != data_dims) {
+        throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+    }
+    const hsize_t n_entries = data_dims[0];
+
+    std::vector<double> window_values;
+    std::vector<long long> window_indices;
+    hsize_t window_first = 0;
+    hsize_t window_last = 0;
+    std::vector<std::pair<uword, double>> entries;
+    std::vector<uword> col_ptrs(outer.size() + 1, 0);
+    std::vector<uword> row_indices;
+    std::vector<double> values;
+    for (size_t c = 0; c < outer.size(); ++c) {
+        const long long first = indptr[outer[c]];
+        const long long last = indptr[outer[c] + 1];
+        if (first < 0 || last < first || static_cast<hsize_t>(last) > n_entries) {
+            throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+        }
+        // read the next window of entries if the entries are not in the current one
+        if (static_cast<hsize_t>(first) < window_first || static_cast<hsize_t>(last) > window_last) {
+            window_first = static_cast<hsize_t>(first);
+            window_last = std::min(n_entries, window_first
+                                   + std::max(WINDOW_SIZE, static_cast<hsize_t>(last - first)));
+            const hsize_t size = window_last - window_first;
+            window_values.resize(size);
+            window_indices.resize(size);
+            if (size > 0) {
+                readHyperslab(data, H5T_NATIVE_DOUBLE, {window_first}, {size}, window_values.data());
+                readHyperslab(indices, H5T_NATIVE_LLONG, {window_first}, {size}, window_indices.data());
+            }
+        }
+
+        entries.clear();
+        for (hsize_t k = static_cast<hsize_t>(first); k < static_cast<hsize_t>(last); ++k) {
+            const long long index = window_indices[k - window_first];
+            const double value = window_values[k - window_first];
+            if (index < 0 || static_cast<size_t>(index) >= inner_map.size()) {
+                throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+            }
+            const sword mapped = inner_map[static_cast<size_t>(index)];
+            if (mapped >= 0 && value != 0) {
+                entries.emplace_back(static_cast<uword>(mapped), value);
+            }
+        }
+        if (!std::is_sorted(entries.begin(), entries.end())) {
+            std::sort(entries.begin(), entries.end());
+        }
+        for (const auto &entry : entries) {
+            row_indices.push_back(entry.first);
+            values.push_back(entry.second);
+        }
+        col_ptrs[c + 1] = row_indices.size();
+    }
+
+    return sp_mat(uvec(row_indices), uvec(col_ptrs), vec(values), n_inner, outer.size());
+}
+
+// reads the selected rows and columns of a dense matrix by blocks of rows
+mat readDense(const hid_t dataset, const std::vector<uword> &rows, const std::vector<uword> &cols)
+{
+    const std::vector<hsize_t> dims = dimensions(dataset);
+    if (dims.size() != 2) {
+        throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+    }
+    const hsize_t n_rows = dims[0];
+    const hsize_t n_cols = dims[1];
+
+    mat counts(rows.size(), cols.size());
+    std::vector<double> block;
+    hsize_t block_first = 0;
+    hsize_t block_last = 0;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const hsize_t row = rows[i];
+        if (row >= block_last) {
+            block_first = row;
+            block_last = std::min(n_rows, row + ROWS_BLOCK);
+            block.resize((block_last - block_first) * n_cols);
+            readHyperslab(dataset, H5T_NATIVE_DOUBLE, {block_first, 0},
+                          {block_last - block_first, n_cols}, block.data());
+        }
+        const double *values = block.data() + (row - block_first) * n_cols;
+        for (size_t j = 0; j < cols.size(); ++j) {
+            counts.at(i, j) = values[cols[j]];
+        }
+    }
+    return counts;
+}
+
+// returns a data frame with the names of the selected spots and genes (and no counts)
+STData::STDataFrame selectNames(const QList<QString> &spots, const std::vector<uword> &spot_indexes,
+                                const QList<QString> &genes, const std::vector<uword> &gene_indexes)
+{
+    STData::STDataFrame data;
+    for (const uword i : spot_indexes) {
+        data.spots.append(spots.at(static_cast<int>(i)));
+    }
+    for (const uword j : gene_indexes) {
+        data.genes.append(genes.at(static_cast<int>(j)));
+    }
+    return data;
+}
+
+// true if a matrix with these elements must use sparse storage
+bool isSparse(const uword n_nonzero, const uword n_elem)
+{
+    const double density = n_elem == 0 ? 0.0 : static_cast<double>(n_nonzero)
+                                               / static_cast<double>(n_elem);
+    const bool sparse = density < MatrixParser::SPARSE_MAX_DENSITY;
+    qDebug() << "Density of the matrix of counts " << density
+             << (sparse ? " using sparse storage" : " using dense storage");
+    return sparse;
+}
+
+// returns the data frame of the selected spots and genes choosing the storage by the density
+STData::STDataFrame createFrame(const sp_mat &counts,
+                                const QList<QString> &spots, const std::vector<uword> &spot_indexes,
+                                const QList<QString> &genes, const std::vector<uword> &gene_indexes)
+{
+    STData::STDataFrame data = selectNames(spots, spot_indexes, genes, gene_indexes);
+    data.is_sparse = isSparse(counts.n_nonzero, counts.n_elem);
+    if (data.is_sparse) {
+        data.sp_counts = counts;
+    } else {
+        data.counts = mat(counts);
+    }
+    return data;
+}
+
+// same as above with dense counts, the sparse matrix is only created if it is used
+STData::STDataFrame createFrameFromDense(mat counts,
+                                         const QList<QString> &spots,
+                                         const std::vector<uword> &spot_indexes,
+                                         const QList<QString> &genes,
+                                         const std::vector<uword> &gene_indexes)
+{
+    STData::STDataFrame data = selectNames(spots, spot_indexes, genes, gene_indexes);
+    const auto n_nonzero = std::count_if(counts.begin(), counts.end(),
+                                         [](const double value) { return value != 0.0; });
+    data.is_sparse = isSparse(static_cast<uword>(n_nonzero), counts.n_elem);
+    if (data.is_sparse) {
+        data.sp_counts = sp_mat(counts);
+    } else {
+        data.counts = std::move(counts);
+    }
+    return data;
+}
+
+// the 10x Genomics layout (genes as rows and spots as columns in CSC format)
+STData::STDataFrame parse10x(const hid_t file, const HDF5Parser::Selection &selection)
+{
+    QByteArray group_name = "matrix";
+    if (!exists(file, "matrix")) {
+        // older files (Cell Ranger 2) store the matrix in a group named as the genome
+        char name[256] = {};
+        if (H5Lget_name_by_idx(file, ".", H5_INDEX_NAME, H5_ITER_INC, 0,
+                               name, sizeof(name), H5P_DEFAULT) < 0) {
+            throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+        }
+        group_name = name;
+    }
+    const Handle group(H5Gopen2(file, group_name.constData(), H5P_DEFAULT), H5Gclose);
+
+    const std::vector<long long> shape = readAll<long long>(group, "shape", H5T_NATIVE_LLONG);
+    const QList<QString> spots = readStrings(group, "barcodes");
+    const bool has_features = exists(group, "features/name");
+    QList<QString> genes = readStrings(group, has_features ? "features/name" : "gene_names");
+    const QList<QString> ids = readStrings(group, has_features ? "features/id" : "genes");
+    if (shape.size() != 2 || shape[0] != genes.size() || shape[1] != spots.size()
+            || ids.size() != genes.size()) {
+        throw std::runtime_error("The HDF5 file does not contain a valid matrix");
+    }
+    // the id is used when the gene name is duplicated
+    QSet<QString> gene_names;
+    for (int j = 0; j < genes.size(); ++j) {
+        if (gene_names.contains(genes.at(j))) {
+            genes[j] = ids.at(j);
+        }
+        gene_names.insert(genes.at(j));
+    }
+
+    const std::vector<uword> spot_indexes = selectedIndexes(spots, selection.spots);
+    const std::vector<uword> gene_indexes = selectedIndexes(genes, selection.genes);
+    const sp_mat counts_t = readCompressed(group, spot_indexes, spots.size(),
+                                           indexesMap(gene_indexes, genes.size()),
+                                           gene_indexes.size());
+    return createFrame(counts_t.t(), spots, spot_indexes, genes, gene_indexes);
+}
+
+// the names of the observations or variables of an AnnData file
+QList<QString> readAnnDataIndex(const hid_t file, const char *name)
+{
+    const Handle group(H5Gopen2(file, name, H5P_DEFAULT), H5Gclose);
+    QString index = readStringAttribute(group, "_index");
+    if (index.isEmpty()) {
+        index = QStringLiteral("_index");
+    }
+    return readStrings(group, index.toUtf8().constData());
+}
+
+// the AnnData layout (spots as observations and genes as variables)
+STData::STDataFrame parseAnnData(const hid_t file, const HDF5Parser::Selection &selection)
+{
+    const QList<QString> spots = readAnnDataIndex(file, "obs");
+    const QList<QString> genes = readAnnDataIndex(file, "var");
+    const std::vector<uword> spot_indexes = selectedIndexes(spots, selection.spots);
+    const std::vector<uword> gene_indexes = selectedIndexes(genes, selection.genes);
+
+    const Handle X(H5Oopen(file, "X", H5P_DEFAULT), H5Oclose);
+    if (H5Iget_type(X) == H5I_DATASET) {
+        return createFrameFromDense(readDense(X, spot_indexes, gene_indexes),
+                                    spots, spot_indexes, genes, gene_indexes);
+    }
+
+    // the sparse format is given by the encoding (or the format in older files)
+    const QString encoding = readStringAttribute(X, "encoding-type");
+    const QString format = readStringAttribute(X, "h5sparse_format");
+    if (encoding == "csr_matrix" || format == "csr") {
+        const sp_mat counts_t = readCompressed(X, spot_indexes, spots.size(),
+                                               indexesMap(gene_indexes, genes.size()),
+                                               gene_indexes.size());
+        return createFrame(counts_t.t(), spots, spot_indexes, genes, gene_indexes);
+    } else if (encoding == "csc_matrix" || format == "csc") {
+        const sp_mat counts = readCompressed(X, gene_indexes, genes.size(),
+                                             indexesMap(spot_indexes, spots.size()),
+                                             spot_indexes.size());
+        return createFrame(counts, spots, spot_indexes, genes, gene_indexes);
+    }
+    throw std::runtime_error("The encoding of the matrix of the AnnData file is not supported");
+}
+
+#endif
+
+}
+
+namespace HDF5Parser
+{
+
+bool isHDF5(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file.read(sizeof(SIGNATURE)) == QByteArray(SIGNATURE, sizeof(SIGNATURE));
+}
+
+STData::STDataFrame parseH5(const QString &filename, const Selection &selection)
+{
+#ifdef HAVE_HDF5
+    // the errors are reported with exceptions instead of printing the error stack
+    H5Eset_auto2(H5E_DEFAULT, nullptr, nullptr);
+    const Handle file(H5Fopen(filename.toLocal8Bit().constData(), H5F_ACC_RDONLY, H5P_DEFAULT),
+                      H5Fclose, "Could not open the HDF5 file");
+    return exists(file, "X") ? parseAnnData(file, selection) : parse10x(file, selection);
+#else
+    Q_UNUSED(filename)
+    Q_UNUSED(selection)
+    throw std::runtime_error("Support for HDF5 files is not available in this build");
+#endif
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef HDF5PARSER_H
+#define HDF5PARSER_H
+
+#include <QSet>
+#include <QString>
+
+#include "data/STData.h"
+
+// HDF5Parser is a convenience namespace which contains the functions used to
+// parse matrices of counts stored in HDF5 files. The supported layouts are the
+// 10x Genomics feature-barcode matrices (.h5) and the AnnData files (.h5ad).
+// The sparse arrays (data, indices and indptr) are read by windows of entries
+// and only the selected spots and genes are kept, so the whole matrix is never
+// loaded in memory. Support for HDF5 is optional (HAVE_HDF5).
+namespace HDF5Parser
+{
+
+// the names of the spots and genes to read (all of them if empty)
+struct Selection {
+    QSet<QString> spots;
+    QSet<QString> genes;
+};
+
+// true if the file is an HDF5 file (using its signature)
+bool isHDF5(const QString &filename);
+
+// Parses the matrix of counts of an HDF5 file (10x Genomics or AnnData layout)
+// keeping only the spots and genes of the selection (in the order of the file)
+// it throws exceptions when errors happen during parsing or the layout is not supported
+STData::STDataFrame parseH5(const QString &filename, const Selection &selection = Selection());
+
+}
+
+#endif // HDF5PARSER_H
@@ -0,0 +1,61 @@
+#include "IdTable.h"
+
+IdTable::IdTable()
+    : m_names()
+    , m_ids()
+{
+}
+
+IdTable::~IdTable()
+{
+}
+
+int IdTable::intern(const QString &name)
+{
+    const auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd()) {
+        return it.value();
+    }
+    const int name_id = m_names.size();
+    m_names.append(name);
+    m_ids.insert(name, name_id);
+    return name_id;
+}
+
+int IdTable::add(const QString &name)
+{
+    const int name_id = m_names.size();
+    m_names.append(name);
+    if (!m_ids.contains(name)) {
+        m_ids.insert(name, name_id);
+    }
+    return name_id;
+}
+
+int IdTable::id(const QString &name) const
+{
+    return m_ids.value(name, -1);
+}
+
+const QString &IdTable::name(const int id) const
+{
+    Q_ASSERT(id >= 0 && id < m_names.size());
+    return m_names.at(id);
+}
+
+int IdTable::size() const
+{
+    return m_names.size();
+}
+
+void IdTable::reserve(const int size)
+{
+    m_names.reserve(size);
+    m_ids.reserve(size);
+}
+
+void IdTable::clear()
+{
+    m_names.clear();
+    m_ids.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// IdTable interns the names of the genes or the spots of a dataset so they
+// can be referred to with compact integer ids (0 to size-1, in order of addition)
+// instead of strings. The names are hashed once when they are added (at load time)
+// and the rest of the operations (clusters, selections and colors) work with the ids.
+class IdTable
+{
+
+public:
+
+    IdTable();
+    ~IdTable();
+
+    // adds the name (if it is not present) and returns its id
+    int intern(const QString &name);
+
+    // adds the name with a new id even if it is present (so the ids match the
+    // positions of the names), a duplicated name keeps its first id for lookups
+    int add(const QString &name);
+
+    // returns the id of the name or -1 if the name is not present
+    int id(const QString &name) const;
+
+    // returns the ids of the names (the names that are not present are skipped)
+    template <typename Container>
+    QVector<int> ids(const Container &names) const
+    {
+        QVector<int> ids;
+        ids.reserve(names.size());
+        for (const QString &name : names) {
+            const int name_id = id(name);
+            if (name_id != -1) {
+                ids.append(name_id);
+            }
+        }
+        return ids;
+    }
+
+    // returns the name of the id
+    const QString &name(const int id) const;
+
+    // the number of names in the table
+    int size() const;
+
+    void reserve(const int size);
+    void clear();
+
+private:
+
+    QVector<QString> m_names;
+    QHash<QString, int> m_ids;
+};
+
+#endif // IDTABLE_H
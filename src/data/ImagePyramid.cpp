@@ -0,0 +1,536 @@
+#include "ImagePyramid.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <omp.h>
+
+#include "data/DatasetCache.h"
+#include "data/LoadingProgress.h"
+
+namespace
+{
+
+constexpr char MAGIC[8] = {'S', 'T', 'V', 'T', 'I', 'L', 'E', 'S'};
+constexpr quint32 VERSION = 1;
+constexpr char SUFFIX[] = ".sttiles";
+// the quality of the tiles without transparency (stored as JPEG)
+constexpr int TILE_QUALITY = 90;
+
+// the tile cache file starts with the header followed by the offsets of the tiles
+// (number of tiles + 1, from the start of the file) and the compressed tiles
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 tile_size;
+    quint32 width;
+    quint32 height;
+    quint64 n_tiles;
+    quint64 image_size;
+    qint64 image_mtime;
+};
+
+// the name of the tile cache is a hash of the path of the image, the cache files
+// are stored with the cached datasets (so they are removed with them)
+QString cacheFile(const QString &filename)
+{
+    const QByteArray path = QFileInfo(filename).absoluteFilePath().toUtf8();
+    const QByteArray hash = QCryptographicHash::hash(path, QCryptographicHash::Sha1);
+    return QDir(DatasetCache::directory()).filePath(QString::fromLatin1(hash.toHex()) + SUFFIX);
+}
+
+// fills the header with the size and modification time of the image file
+void imageInfo(const QString &filename, Header &header)
+{
+    const QFileInfo info(filename);
+    header.image_size = static_cast<quint64>(info.size());
+    header.image_mtime = info.lastModified().toMSecsSinceEpoch();
+}
+
+// JPEG is cheaper to decode, the tiles with transparency are stored as PNG
+QByteArray compressTile(const QImage &tile)
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    const bool alpha = tile.hasAlphaChannel();
+    if (!tile.save(&buffer, alpha ? "PNG" : "JPG", alpha ? -1 : TILE_QUALITY)) {
+        bytes.clear();
+    }
+    return bytes;
+}
+
+}
+
+ImagePyramid::ImagePyramid()
+    : m_levels()
+    , m_scale(1.0)
+    , m_filename()
+    , m_cache()
+    , m_cache_data(nullptr)
+    , m_offsets()
+    , m_first_tiles()
+{
+}
+
+ImagePyramid::~ImagePyramid()
+{
+}
+
+void ImagePyramid::build(const QImage &image, const double scale, LoadingProgress *progress)
+{
+    clear();
+    m_scale = scale;
+    createLevels(image.size());
+    tileLevels(image, 0, progress);
+}
+
+bool ImagePyramid::open(const QString &filename, const double scale, LoadingProgress *progress)
+{
+    clear();
+    m_scale = scale;
+
+    // the tiles are read from the cache if the image has been opened before
+    LoadingProgress::update(progress, LoadingProgress::DecodeImage, 0.0);
+    if (mapCache(filename)) {
+        LoadingProgress::update(progress, LoadingProgress::DecodeImage, 1.0);
+        const int n_levels = m_levels.size();
+        const int first_level = firstMemoryLevel();
+        for (int l = first_level; l < n_levels; ++l) {
+            LoadingProgress::update(progress, LoadingProgress::TileImage,
+                                    static_cast<double>(l - first_level) / (n_levels - first_level));
+            Level &current = m_levels[l];
+            const int count = current.tiles.size();
+            #pragma omp parallel for
+            for (int i = 0; i < count; ++i) {
+                current.tiles[i] = tile(l, i);
+            }
+        }
+        LoadingProgress::update(progress, LoadingProgress::TileImage, 1.0);
+        qDebug() << "Loaded image pyramid from the tile cache " << m_cache->fileName();
+        return true;
+    }
+    clear();
+    m_scale = scale;
+
+    // if the format can decode regions and the image does not fit in the memory levels
+    // only the coarse levels are decoded (scaled down) and kept in memory, the tiles of
+    // the fine levels are decoded by rows and written to the cache (or decoded on demand)
+    QImageReader reader(filename);
+    const QSize size = reader.size();
+    QImage image;
+    if (size.isValid() && reader.supportsOption(QImageIOHandler::ScaledClipRect)) {
+        createLevels(size);
+        const int first_level = firstMemoryLevel();
+        if (first_level > 0) {
+            reader.setScaledSize(m_levels.at(first_level).size);
+            if (!reader.read(&image)) {
+                qDebug() << "Tissue image cannot be parsed " << reader.errorString();
+                clear();
+                return false;
+            }
+            LoadingProgress::update(progress, LoadingProgress::DecodeImage, 1.0);
+            m_filename = filename;
+            tileLevels(image, first_level, nullptr);
+            if (!writeCache(filename, progress) || !mapCache(filename)) {
+                qDebug() << "The tiles of the fine levels are decoded on demand";
+            }
+            LoadingProgress::update(progress, LoadingProgress::TileImage, 1.0);
+            return true;
+        }
+        m_levels.clear();
+        reader.setFileName(filename);
+    }
+
+    // the image is small (or the format cannot decode regions) so it is decoded at once
+    if (!reader.read(&image)) {
+        qDebug() << "Tissue image cannot be parsed " << reader.errorString();
+        return false;
+    }
+    LoadingProgress::update(progress, LoadingProgress::DecodeImage, 1.0);
+    build(image, scale, progress);
+    image = QImage();
+    // the tiles of the fine levels are released and read from the cache from now on
+    if (writeCache(filename, nullptr) && mapCache(filename)) {
+        for (int l = 0; l < firstMemoryLevel(); ++l) {
+            m_levels[l].tiles.fill(QImage());
+        }
+    }
+    return true;
+}
+
+QImage ImagePyramid::tile(const int level, const int index) const
+{
+    const QImage &tile = m_levels.at(level).tiles.at(index);
+    if (!tile.isNull()) {
+        return tile;
+    }
+    if (m_cache_data != nullptr) {
+        // the mapped cache is only read so it can be shared between threads
+        const int position = m_first_tiles.at(level) + index;
+        const quint64 offset = m_offsets.at(position);
+        const int size = static_cast<int>(m_offsets.at(position + 1) - offset);
+        const QImage image = QImage::fromData(m_cache_data + offset, size);
+        if (image.isNull()) {
+            qDebug() << "The tile " << index << " of the level " << level
+                     << " cannot be read from the cache";
+        }
+        return image;
+    }
+    if (m_filename.isEmpty()) {
+        return tile;
+    }
+    // decode the region of the tile from the file (scaled to the level)
+    return decodeRegion(level, tilePixels(level, index));
+}
+
+QImage ImagePyramid::decodeRegion(const int level, const QRect &pixels) const
+{
+    QImageReader reader(m_filename);
+    reader.setScaledSize(m_levels.at(level).size);
+    reader.setScaledClipRect(pixels);
+    QImage image;
+    if (!reader.read(&image)) {
+        qDebug() << "The region " << pixels << " of the level " << level
+                 << " cannot be decoded " << reader.errorString();
+    }
+    return image;
+}
+
+bool ImagePyramid::isTileLoaded(const int level, const int index) const
+{
+    return !m_levels.at(level).tiles.at(index).isNull();
+}
+
+int ImagePyramid::firstMemoryLevel() const
+{
+    int first_level = 0;
+    while (first_level < m_levels.size() - 1
+           && std::max(m_levels.at(first_level).size.width(),
+                       m_levels.at(first_level).size.height()) > MEMORY_LEVEL_SIZE) {
+        ++first_level;
+    }
+    return first_level;
+}
+
+bool ImagePyramid::mapCache(const QString &filename)
+{
+    QScopedPointer<QFile> file(new QFile(cacheFile(filename)));
+    if (!file->exists() || !file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 file_size = file->size();
+    if (file_size < static_cast<qint64>(sizeof(Header))) {
+        qDebug() << "The tile cache " << file->fileName() << " is not valid";
+        return false;
+    }
+    // the mapping is released when the file is closed
+    const uchar *mapped = file->map(0, file_size);
+    if (mapped == nullptr) {
+        qDebug() << "Could not map the tile cache " << file->fileName();
+        return false;
+    }
+
+    // check that the cache is valid and up to date with the image
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+    Header image;
+    imageInfo(filename, image);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+            || header.tile_size != static_cast<quint32>(TILE_SIZE)) {
+        qDebug() << "The tile cache " << file->fileName() << " is not valid";
+        return false;
+    }
+    if (header.image_size != image.image_size || header.image_mtime != image.image_mtime) {
+        qDebug() << "The tile cache " << file->fileName() << " is outdated";
+        return false;
+    }
+
+    const QSize size(static_cast<int>(header.width), static_cast<int>(header.height));
+    if (size.isEmpty()) {
+        qDebug() << "The tile cache " << file->fileName() << " is not valid";
+        return false;
+    }
+    if (m_levels.isEmpty()) {
+        createLevels(size);
+    } else if (m_levels.front().size != size) {
+        qDebug() << "The tile cache " << file->fileName() << " does not match the image";
+        return false;
+    }
+
+    QVector<int> first_tiles;
+    int n_tiles = 0;
+    for (const Level &level : m_levels) {
+        first_tiles.append(n_tiles);
+        n_tiles += level.tiles.size();
+    }
+    const quint64 offsets_size = (static_cast<quint64>(n_tiles) + 1) * sizeof(quint64);
+    if (header.n_tiles != static_cast<quint64>(n_tiles)
+            || sizeof(Header) + offsets_size > static_cast<quint64>(file_size)) {
+        qDebug() << "The tile cache " << file->fileName() << " is not valid";
+        return false;
+    }
+    QVector<quint64> offsets(n_tiles + 1);
+    std::memcpy(offsets.data(), mapped + sizeof(Header), offsets_size);
+    if (offsets.front() != sizeof(Header) + offsets_size
+            || offsets.back() != static_cast<quint64>(file_size)
+            || !std::is_sorted(offsets.begin(), offsets.end())) {
+        qDebug() << "The tile cache " << file->fileName() << " is not valid";
+        return false;
+    }
+
+    m_cache.reset(file.take());
+    m_cache_data = mapped;
+    m_offsets = offsets;
+    m_first_tiles = first_tiles;
+    return true;
+}
+
+bool ImagePyramid::writeCache(const QString &filename, LoadingProgress *progress) const
+{
+    if (!QDir().mkpath(DatasetCache::directory())) {
+        qDebug() << "Could not create the cache directory " << DatasetCache::directory();
+        return false;
+    }
+
+    int n_tiles = 0;
+    for (const Level &level : m_levels) {
+        n_tiles += level.tiles.size();
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.tile_size = TILE_SIZE;
+    header.width = m_levels.front().size.width();
+    header.height = m_levels.front().size.height();
+    header.n_tiles = n_tiles;
+    imageInfo(filename, header);
+
+    // the file is written to a temporary file that replaces the cache file when committed
+    // the offsets are written after the tiles (when their sizes are known)
+    QSaveFile file(cacheFile(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not create the tile cache " << file.fileName();
+        return false;
+    }
+    QVector<quint64> offsets(n_tiles + 1, 0);
+    const qint64 offsets_size = offsets.size() * sizeof(quint64);
+    bool written = file.write(reinterpret_cast<const char *>(&header), sizeof(Header))
+                   == static_cast<qint64>(sizeof(Header))
+            && file.write(reinterpret_cast<const char *>(offsets.constData()), offsets_size)
+                   == offsets_size;
+    offsets[0] = sizeof(Header) + offsets_size;
+
+    // the tiles are compressed by rows of tiles, the rows of the levels that are not in
+    // memory are decoded from the image file, a batch of rows is processed in parallel
+    // so only a few rows are kept in memory
+    const int batch_size = omp_get_max_threads();
+    const int n_levels = m_levels.size();
+    int position = 0;
+    for (int l = 0; written && l < n_levels; ++l) {
+        LoadingProgress::update(progress, LoadingProgress::TileImage,
+                                static_cast<double>(l) / n_levels);
+        const Level &current = m_levels.at(l);
+        QVector<QVector<QByteArray>> compressed(std::min(batch_size, current.rows));
+        for (int first = 0; written && first < current.rows; first += batch_size) {
+            const int last = std::min(current.rows, first + batch_size);
+            #pragma omp parallel for schedule(dynamic)
+            for (int row = first; row < last; ++row) {
+                QVector<QByteArray> &tiles = compressed[row - first];
+                tiles.resize(current.columns);
+                const int first_tile = row * current.columns;
+                QImage strip;
+                if (current.tiles.at(first_tile).isNull() && !m_filename.isEmpty()) {
+                    strip = decodeRegion(l, QRect(0, row * TILE_SIZE,
+                                                  current.size.width(),
+                                                  tilePixels(l, first_tile).height()));
+                }
+                for (int column = 0; column < current.columns; ++column) {
+                    const int index = first_tile + column;
+                    const QImage &tile = current.tiles.at(index);
+                    if (!tile.isNull()) {
+                        tiles[column] = compressTile(tile);
+                    } else if (!strip.isNull()) {
+                        const QRect pixels = tilePixels(l, index);
+                        tiles[column] = compressTile(strip.copy(pixels.x(), 0, pixels.width(),
+                                                                pixels.height()));
+                    } else {
+                        tiles[column].clear();
+                    }
+                }
+            }
+            for (int row = first; written && row < last; ++row) {
+                for (const QByteArray &tile : compressed.at(row - first)) {
+                    if (tile.isEmpty()) {
+                        qDebug() << "Could not compress the tiles of the image " << filename;
+                        file.cancelWriting();
+                        return false;
+                    }
+                    written = file.write(tile) == tile.size();
+                    offsets[position + 1] = offsets.at(position) + tile.size();
+                    ++position;
+                }
+            }
+        }
+    }
+    written = written && file.seek(sizeof(Header))
+            && file.write(reinterpret_cast<const char *>(offsets.constData()), offsets_size)
+                   == offsets_size;
+    if (!written) {
+        qDebug() << "Could not write the tile cache " << file.fileName();
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+void ImagePyramid::createLevels(const QSize &size)
+{
+    // every level has half the resolution of the previous one
+    // down to the level that fits in one tile
+    QSize level_size = size;
+    while (true) {
+        Level level;
+        level.size = level_size;
+        level.columns = (level_size.width() + TILE_SIZE - 1) / TILE_SIZE;
+        level.rows = (level_size.height() + TILE_SIZE - 1) / TILE_SIZE;
+        level.tiles.resize(level.columns * level.rows);
+        m_levels.append(level);
+        if (std::max(level_size.width(), level_size.height()) <= TILE_SIZE) {
+            break;
+        }
+        level_size = QSize(std::max(level_size.width() / 2, 1),
+                           std::max(level_size.height() / 2, 1));
+    }
+}
+
+void ImagePyramid::tileLevels(QImage image, const int first_level, LoadingProgress *progress)
+{
+    const int n_levels = m_levels.size();
+    for (int l = first_level; l < n_levels; ++l) {
+        LoadingProgress::update(progress, LoadingProgress::TileImage,
+                                static_cast<double>(l - first_level) / (n_levels - first_level));
+        Level &current = m_levels[l];
+        if (image.size() != current.size) {
+            image = image.scaled(current.size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        const int count = current.tiles.size();
+        #pragma omp parallel for
+        for (int i = 0; i < count; ++i) {
+            // QImage should be thread-safe
+            current.tiles[i] = image.copy(tilePixels(l, i));
+        }
+    }
+    LoadingProgress::update(progress, LoadingProgress::TileImage, 1.0);
+
+    qDebug() << "Created image pyramid with " << n_levels << " levels ("
+             << first_level << " decoded on demand)";
+}
+
+void ImagePyramid::clear()
+{
+    m_levels.clear();
+    m_filename.clear();
+    m_cache_data = nullptr;
+    m_cache.reset();
+    m_offsets.clear();
+    m_first_tiles.clear();
+}
+
+bool ImagePyramid::isEmpty() const
+{
+    return m_levels.isEmpty();
+}
+
+int ImagePyramid::levels() const
+{
+    return m_levels.size();
+}
+
+const ImagePyramid::Level &ImagePyramid::level(const int level) const
+{
+    Q_ASSERT(level >= 0 && level < m_levels.size());
+    return m_levels.at(level);
+}
+
+double ImagePyramid::levelScale(const int level) const
+{
+    // the sizes of the levels are rounded down so the actual ratio is used
+    const double ratio = static_cast<double>(m_levels.front().size.width())
+            / std::max(m_levels.at(level).size.width(), 1);
+    return m_scale * ratio;
+}
+
+QRectF ImagePyramid::bounds() const
+{
+    if (m_levels.isEmpty()) {
+        return QRectF();
+    }
+    const QSize &size = m_levels.front().size;
+    return QRectF(0, 0, size.width() * m_scale, size.height() * m_scale);
+}
+
+int ImagePyramid::levelForZoom(const double zoom) const
+{
+    if (m_levels.isEmpty() || zoom <= 0) {
+        return 0;
+    }
+    // the pixels of the level l cover 2^l * scale * zoom pixels of the screen
+    const double pixels = m_scale * zoom;
+    const int level = static_cast<int>(std::floor(std::log2(1.0 / pixels)));
+    return std::clamp(level, 0, m_levels.size() - 1);
+}
+
+QVector<int> ImagePyramid::visibleTiles(const int level, const QRectF &rect) const
+{
+    QVector<int> tiles;
+    if (level < 0 || level >= m_levels.size()) {
+        return tiles;
+    }
+    const Level &tiled = m_levels.at(level);
+    const double level_scale = levelScale(level);
+    const double tile_size = TILE_SIZE * level_scale;
+    const int first_column = std::max(static_cast<int>(std::floor(rect.left() / tile_size)), 0);
+    const int last_column = std::min(static_cast<int>(std::floor(rect.right() / tile_size)),
+                                     tiled.columns - 1);
+    const int first_row = std::max(static_cast<int>(std::floor(rect.top() / tile_size)), 0);
+    const int last_row = std::min(static_cast<int>(std::floor(rect.bottom() / tile_size)),
+                                  tiled.rows - 1);
+    for (int row = first_row; row <= last_row; ++row) {
+        for (int column = first_column; column <= last_column; ++column) {
+            tiles.append(row * tiled.columns + column);
+        }
+    }
+    return tiles;
+}
+
+QRect ImagePyramid::tilePixels(const int level, const int index) const
+{
+    const Level &tiled = m_levels.at(level);
+    const int x = TILE_SIZE * (index % tiled.columns);
+    const int y = TILE_SIZE * (index / tiled.columns);
+    return QRect(x, y,
+                 std::min(tiled.size.width() - x, TILE_SIZE),
+                 std::min(tiled.size.height() - y, TILE_SIZE));
+}
+
+QRectF ImagePyramid::tileRect(const int level, const int index) const
+{
+    const QRect pixels = tilePixels(level, index);
+    const double level_scale = levelScale(level);
+    return QRectF(pixels.x() * level_scale, pixels.y() * level_scale,
+                  pixels.width() * level_scale, pixels.height() * level_scale);
+}
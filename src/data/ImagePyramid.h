@@ -0,0 +1,132 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QScopedPointer>
+#include <QString>
+#include <QVector>
+
+class LoadingProgress;
+class QFile;
+
+// ImagePyramid stores the tissue image as a pyramid of tiled levels, the level 0
+// has the full resolution of the image and every level has half the resolution
+// of the previous one down to a thumbnail that fits in one tile. The levels share
+// the same scene coordinates (the pixels of the image multiplied by the scale)
+// so the renderer can pick the level that matches the zoom and draw only the
+// tiles of that level that are visible.
+// The tiles of an image file are stored (compressed) in a tile cache the first time
+// the image is opened, the next times only the coarse levels are read from the cache
+// and the tiles of the rest of the levels are read when they are requested (so the
+// image is not decoded again). A cache is valid while the size and the modification
+// time of the image do not change. When the image is larger than the memory levels
+// and its format supports decoding regions (JPEG) the image is never decoded at full
+// resolution, only the coarse levels are decoded (scaled down) and the tiles of the
+// fine levels are decoded by rows of tiles directly into the tile cache (or from the
+// image file when they are requested if the cache cannot be written).
+class ImagePyramid
+{
+
+public:
+
+    // the size (width and height) of the tiles
+    static constexpr int TILE_SIZE = 256;
+
+    // the levels up to this size (width and height) are kept in memory
+    static constexpr int MEMORY_LEVEL_SIZE = 2048;
+
+    // a level of the pyramid, the tiles are stored by rows
+    // (the tiles that are decoded on demand are null)
+    struct Level {
+        QSize size;
+        int columns = 0;
+        int rows = 0;
+        QVector<QImage> tiles;
+    };
+
+    ImagePyramid();
+    ~ImagePyramid();
+
+    // creates the levels of the pyramid from the image (full resolution)
+    // scale is the size (in scene units) of the pixels of the image
+    // the progress is reported to progress (if given) as TileImage
+    void build(const QImage &image, const double scale, LoadingProgress *progress = nullptr);
+
+    // creates the levels of the pyramid from the image file (or its tile cache)
+    // only the coarse levels are kept in memory if the tiles can be read on demand
+    // returns false if the image could not be decoded
+    bool open(const QString &filename, const double scale, LoadingProgress *progress = nullptr);
+
+    // returns the tile of the level, it is read from the cache (or decoded from the
+    // image file) if it is not in memory
+    // (it can be called from different threads), returns a null image on errors
+    QImage tile(const int level, const int index) const;
+
+    // true if the tile is in memory (no decoding is needed)
+    bool isTileLoaded(const int level, const int index) const;
+
+    void clear();
+    bool isEmpty() const;
+
+    // the number of levels
+    int levels() const;
+    const Level &level(const int level) const;
+
+    // the size (in scene units) of the pixels of the level
+    double levelScale(const int level) const;
+
+    // the bounds of the image in scene units
+    QRectF bounds() const;
+
+    // the level to render when one scene unit covers zoom pixels of the screen
+    // (the coarsest level whose pixels are not larger than the pixels of the screen)
+    int levelForZoom(const double zoom) const;
+
+    // the indexes of the tiles of the level that intersect the rect (in scene units)
+    QVector<int> visibleTiles(const int level, const QRectF &rect) const;
+
+    // the rect of the tile (in pixels of its level and in scene units)
+    QRect tilePixels(const int level, const int index) const;
+    QRectF tileRect(const int level, const int index) const;
+
+private:
+
+    // creates the levels sizes down to the level that fits in one tile
+    void createLevels(const QSize &size);
+
+    // creates the tiles of the levels from first_level (the image of the level) to the last
+    void tileLevels(QImage image, const int first_level, LoadingProgress *progress);
+
+    // the first level that is kept in memory
+    int firstMemoryLevel() const;
+
+    // maps the tile cache of the image file (the levels are created if they are empty)
+    // returns false if there is no cache for the image or it is outdated or not valid
+    bool mapCache(const QString &filename);
+
+    // decodes the region (in pixels of the level) of the image file scaled to the level
+    // returns a null image on errors
+    QImage decodeRegion(const int level, const QRect &pixels) const;
+
+    // writes the tiles of all the levels to the tile cache of the image file, the tiles
+    // that are not in memory are decoded from the image file (by rows of tiles)
+    // the progress is reported to progress (if given) as TileImage
+    bool writeCache(const QString &filename, LoadingProgress *progress) const;
+
+    QVector<Level> m_levels;
+    double m_scale;
+    // the image file (when the tiles are decoded on demand)
+    QString m_filename;
+    // the mapped tile cache, the tiles of all the levels (by levels) are between
+    // consecutive offsets, m_first_tiles is the position of the first tile of each level
+    QScopedPointer<QFile> m_cache;
+    const uchar *m_cache_data;
+    QVector<quint64> m_offsets;
+    QVector<int> m_first_tiles;
+
+    Q_DISABLE_COPY(ImagePyramid)
+};
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,102 @@
+#ifndef LOADINGPROGRESS_H
+#define LOADINGPROGRESS_H
+
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+
+// exception thrown by the loading stages when the loading has been cancelled
+class LoadingCancelled : public std::runtime_error
+{
+public:
+    LoadingCancelled()
+        : std::runtime_error("The loading of the dataset has been cancelled")
+    {
+    }
+};
+
+// LoadingProgress is shared between the stages that load a dataset (they can run
+// on different threads) and the object that started the loading. The stages report
+// their progress with update() and the loading can be cancelled with cancel(), the
+// stages stop (throwing LoadingCancelled) the next time they report their progress
+class LoadingProgress
+{
+
+public:
+
+    enum Stage {
+        ParseMatrix = 0,
+        ParseSpots = 1,
+        Filter = 2,
+        DecodeImage = 3,
+        TileImage = 4,
+        LoadMesh = 5
+    };
+    static constexpr int N_STAGES = 6;
+
+    // the callback is called with the stage and its progress (0 to 1)
+    // it can be called from any of the threads that load the dataset
+    typedef std::function<void(Stage, double)> Callback;
+
+    explicit LoadingProgress(const Callback &callback = Callback())
+        : m_callback(callback)
+        , m_cancelled(false)
+    {
+    }
+
+    void cancel()
+    {
+        m_cancelled = true;
+    }
+
+    bool cancelled() const
+    {
+        return m_cancelled;
+    }
+
+    // reports the progress of a stage (progress can be nullptr)
+    // it throws LoadingCancelled if the loading has been cancelled
+    static void update(LoadingProgress *progress, const Stage stage, const double fraction)
+    {
+        if (progress == nullptr) {
+            return;
+        }
+        if (progress->m_cancelled) {
+            throw LoadingCancelled();
+        }
+        if (progress->m_callback) {
+            progress->m_callback(stage, fraction);
+        }
+    }
+
+    // the name of the stage to show to the users
+    static QString stageName(const Stage stage)
+    {
+        switch (stage) {
+        case ParseMatrix:
+            return QStringLiteral("Parsing the matrix of counts");
+        case ParseSpots:
+            return QStringLiteral("Parsing the spot coordinates");
+        case Filter:
+            return QStringLiteral("Filtering the spots and genes");
+        case DecodeImage:
+            return QStringLiteral("Decoding the tissue image");
+        case TileImage:
+            return QStringLiteral("Creating the tiles of the tissue image");
+        case LoadMesh:
+            return QStringLiteral("Loading the 3D mesh");
+        }
+        return QString();
+    }
+
+private:
+
+    Callback m_callback;
+    std::atomic<bool> m_cancelled;
+
+    Q_DISABLE_COPY(LoadingProgress)
+};
+
+#endif // LOADINGPROGRESS_H
@@ -0,0 +1,1023 @@
+#include "MatrixParser.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include <omp.h>
+
+namespace
+{
+
+// number of rows that are parsed before they are written to the matrix of counts,
+// armadillo matrices are column-major so writing blocks of rows keeps the writes contiguous
+constexpr uword ROWS_BLOCK = 16;
+
+// number of rows at the beginning of each chunk that are used to estimate the density
+constexpr uword ROWS_SAMPLE = 8;
+
+// minimum size (in bytes) of the chunks of the file that are parsed in parallel
+constexpr size_t MIN_CHUNK_SIZE = 1 << 16;
+
+inline bool isBlank(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// returns the end of the line that starts at first (position of '\n' or last)
+inline const char *lineEnd(const char *first, const char *last)
+{
+    const void *pos = std::memchr(first, '\n', static_cast<size_t>(last - first));
+    return pos == nullptr ? last : static_cast<const char *>(pos);
+}
+
+// true if the line has only white spaces
+inline bool isEmptyLine(const char *first, const char *last)
+{
+    return std::all_of(first, last, isBlank);
+}
+
+// parses a real value and returns the position after it or nullptr if the value is not valid
+inline const char *parseValue(const char *first, const char *last, double &value)
+{
+    while (first != last && *first == ' ') {
+        ++first;
+    }
+    if (first != last && *first == '+') {
+        ++first;
+    }
+#if defined(__cpp_lib_to_chars)
+    const auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+    // std::from_chars for real values is not available in all the compilers
+    const char *token_end = first;
+    while (token_end != last && !isBlank(*token_end)) {
+        ++token_end;
+    }
+    bool ok = false;
+    value = QByteArray::fromRawData(first, static_cast<int>(token_end - first)).toDouble(&ok);
+    return ok ? token_end : nullptr;
+#endif
+}
+
+// parses the header of the matrix (the genes)
+QList<QString> parseHeader(const char *first, const char *last)
+{
+    QList<QString> genes;
+    const char *pos = first;
+    while (true) {
+        const char *tab = static_cast<const char *>(
+                    std::memchr(pos, '\t', static_cast<size_t>(last - pos)));
+        const char *token_end = tab == nullptr ? last : tab;
+        const QString gene = QString::fromUtf8(pos, static_cast<int>(token_end - pos)).trimmed();
+        if (!gene.isEmpty()) {
+            genes.append(gene);
+        }
+        if (tab == nullptr) {
+            break;
+        }
+        pos = tab + 1;
+    }
+    return genes;
+}
+
+// parses a row of the matrix (spot followed by the values)
+// returns false if the row does not contain exactly n_values values
+bool parseRow(const char *first, const char *last, const uword n_values,
+              QString &spot, double *values)
+{
+    const char *tab = static_cast<const char *>(
+                std::memchr(first, '\t', static_cast<size_t>(last - first)));
+    const char *pos = tab == nullptr ? last : tab;
+    spot = QString::fromUtf8(first, static_cast<int>(pos - first)).trimmed();
+    if (spot.isEmpty()) {
+        return false;
+    }
+    for (uword j = 0; j < n_values; ++j) {
+        if (pos == last || *pos != '\t') {
+            return false;
+        }
+        pos = parseValue(pos + 1, last, values[j]);
+        if (pos == nullptr) {
+            return false;
+        }
+        while (pos != last && (*pos == ' ' || *pos == '\r')) {
+            ++pos;
+        }
+    }
+    // only white spaces (or trailing separators) are allowed after the last value
+    return std::all_of(pos, last, isBlank);
+}
+
+// calls f(first, last) for each non-empty line of the chunk until f returns false
+template <typename F>
+void forEachLine(const char *first, const char *last, F f)
+{
+    while (first < last) {
+        const char *eol = lineEnd(first, last);
+        if (!isEmptyLine(first, eol) && !f(first, eol)) {
+            return;
+        }
+        if (eol == last) {
+            return;
+        }
+        first = eol + 1;
+    }
+}
+
+// parses the rows of the chunks directly into a dense matrix of counts
+bool parseDense(const std::vector<const char *> &chunks,
+                const std::vector<uword> &row_offsets,
+                const uword n_genes,
+                std::vector<QString> &spots,
+                mat &counts)
+{
+    const size_t n_chunks = chunks.size() - 1;
+    const uword n_spots = row_offsets.back();
+    counts.set_size(n_spots, n_genes);
+    double *counts_ptr = counts.memptr();
+    std::atomic<bool> parsed(true);
+    #pragma omp parallel
+    {
+        std::vector<double> block(ROWS_BLOCK * n_genes);
+        const auto flush = [&](const uword first_row, const uword n_rows) {
+            for (uword j = 0; j < n_genes; ++j) {
+                double *column = counts_ptr + j * n_spots + first_row;
+                for (uword i = 0; i < n_rows; ++i) {
+                    column[i] = block[i * n_genes + j];
+                }
+            }
+        };
+
+        #pragma omp for schedule(dynamic)
+        for (size_t c = 0; c < n_chunks; ++c) {
+            uword row = row_offsets[c];
+            uword block_rows = 0;
+            forEachLine(chunks[c], chunks[c + 1], [&](const char *first, const char *last) {
+                if (!parsed || !parseRow(first, last, n_genes, spots[row + block_rows],
+                                         &block[block_rows * n_genes])) {
+                    parsed = false;
+                    return false;
+                }
+                if (++block_rows == ROWS_BLOCK) {
+                    flush(row, block_rows);
+                    row += block_rows;
+                    block_rows = 0;
+                }
+                return true;
+            });
+            flush(row, block_rows);
+        }
+    }
+    return parsed;
+}
+
+// splits the data in (at most) max_chunks chunks that start at the beginning of a line
+// returns the boundaries of the chunks (the last one is end)
+std::vector<const char *> splitChunks(const char *begin, const char *end, const size_t max_chunks)
+{
+    const size_t size = static_cast<size_t>(end - begin);
+    const size_t n_chunks = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, max_chunks);
+    std::vector<const char *> chunks;
+    chunks.push_back(begin);
+    for (size_t i = 1; i < n_chunks; ++i) {
+        const char *pos = std::max(begin + (size * i) / n_chunks, chunks.back());
+        pos = lineEnd(pos, end);
+        chunks.push_back(pos == end ? end : pos + 1);
+    }
+    chunks.push_back(end);
+    return chunks;
+}
+
+// the rows parsed from a chunk of the file, the counts are stored in compressed
+// rows (number of non-zero counts of each row and their columns and values)
+struct RowsChunk {
+    std::vector<QString> spots;
+    std::vector<uword> row_nonzeros;
+    std::vector<uword> cols;
+    std::vector<double> values;
+};
+
+// parses the rows of a chunk in compressed rows, returns false if a row is not valid
+bool parseRows(const char *first, const char *last, const uword n_genes, RowsChunk &rows)
+{
+    std::vector<double> row(n_genes);
+    QString spot;
+    bool parsed = true;
+    forEachLine(first, last, [&](const char *line, const char *line_end) {
+        if (!parseRow(line, line_end, n_genes, spot, row.data())) {
+            parsed = false;
+            return false;
+        }
+        const size_t n_values = rows.cols.size();
+        for (uword j = 0; j < n_genes; ++j) {
+            if (row[j] != 0) {
+                rows.cols.push_back(j);
+                rows.values.push_back(row[j]);
+            }
+        }
+        rows.row_nonzeros.push_back(rows.cols.size() - n_values);
+        rows.spots.push_back(spot);
+        return true;
+    });
+    return parsed;
+}
+
+// returns the spots of the parsed chunks (in order)
+QList<QString> chunksSpots(const std::vector<RowsChunk> &chunks)
+{
+    QList<QString> spots;
+    for (const auto &chunk : chunks) {
+        for (const auto &spot : chunk.spots) {
+            spots.append(spot);
+        }
+    }
+    return spots;
+}
+
+// creates the sparse matrix of counts from the parsed chunks (their counts are released)
+// the compressed rows of the matrix are the compressed columns (CSC) of its transpose
+sp_mat chunksToSparse(std::vector<RowsChunk> &chunks, const uword n_genes)
+{
+    const size_t n_chunks = chunks.size();
+    std::vector<uword> row_offsets(n_chunks + 1, 0);
+    std::vector<uword> value_offsets(n_chunks + 1, 0);
+    for (size_t c = 0; c < n_chunks; ++c) {
+        row_offsets[c + 1] = row_offsets[c] + chunks[c].row_nonzeros.size();
+        value_offsets[c + 1] = value_offsets[c] + chunks[c].values.size();
+    }
+    const uword n_spots = row_offsets.back();
+    const uword n_nonzero = value_offsets.back();
+
+    uvec row_ptrs(n_spots + 1);
+    uvec col_indices(n_nonzero);
+    vec values(n_nonzero);
+    row_ptrs[0] = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < n_chunks; ++c) {
+        RowsChunk &chunk = chunks[c];
+        uword ptr = value_offsets[c];
+        for (size_t i = 0; i < chunk.row_nonzeros.size(); ++i) {
+            ptr += chunk.row_nonzeros[i];
+            row_ptrs[row_offsets[c] + i + 1] = ptr;
+        }
+        std::copy(chunk.cols.begin(), chunk.cols.end(), col_indices.begin() + value_offsets[c]);
+        std::copy(chunk.values.begin(), chunk.values.end(), values.begin() + value_offsets[c]);
+        std::vector<uword>().swap(chunk.row_nonzeros);
+        std::vector<uword>().swap(chunk.cols);
+        std::vector<double>().swap(chunk.values);
+    }
+    const sp_mat counts_t(col_indices, row_ptrs, values, n_genes, n_spots);
+    return counts_t.t();
+}
+
+// creates the dense matrix of counts from the parsed chunks (their counts are released)
+mat chunksToDense(std::vector<RowsChunk> &chunks, const uword n_genes)
+{
+    const size_t n_chunks = chunks.size();
+    std::vector<uword> row_offsets(n_chunks + 1, 0);
+    for (size_t c = 0; c < n_chunks; ++c) {
+        row_offsets[c + 1] = row_offsets[c] + chunks[c].row_nonzeros.size();
+    }
+
+    mat counts(row_offsets.back(), n_genes, fill::zeros);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < n_chunks; ++c) {
+        RowsChunk &chunk = chunks[c];
+        size_t k = 0;
+        for (size_t i = 0; i < chunk.row_nonzeros.size(); ++i) {
+            const uword row = row_offsets[c] + i;
+            for (uword n = 0; n < chunk.row_nonzeros[i]; ++n, ++k) {
+                counts.at(row, chunk.cols[k]) = chunk.values[k];
+            }
+        }
+        std::vector<uword>().swap(chunk.row_nonzeros);
+        std::vector<uword>().swap(chunk.cols);
+        std::vector<double>().swap(chunk.values);
+    }
+    return counts;
+}
+
+// memory-maps the whole file, the mapping is released when the file is closed
+const char *mapFile(QFile &file)
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Could not open the matrix of counts file");
+    }
+    if (file.size() <= 0) {
+        throw std::runtime_error("The file does not contain a valid matrix");
+    }
+    const uchar *mapped = file.map(0, file.size());
+    if (mapped == nullptr) {
+        throw std::runtime_error("Could not map the matrix of counts file in memory");
+    }
+    return reinterpret_cast<const char *>(mapped);
+}
+
+// decompresses the file by blocks and calls f(first, last) with the complete lines of
+// each block, the next blocks are decompressed on another thread in the meantime
+template <typename F>
+void forEachBlock(const QString &filename, const int block_size, F f)
+{
+    CompressedFile file(filename, block_size);
+
+    // the data that has not been parsed yet (incomplete lines of the previous blocks)
+    QByteArray buffer;
+    bool last_block = false;
+    while (!last_block) {
+        const QByteArray block = file.nextBlock();
+        last_block = block.isEmpty();
+        buffer.append(block);
+
+        // only the complete lines are parsed (unless it is the end of the file)
+        const char *begin = buffer.constData();
+        const char *end = begin + buffer.size();
+        if (!last_block) {
+            const int last_eol = buffer.lastIndexOf('\n');
+            if (last_eol == -1) {
+                continue;
+            }
+            end = begin + last_eol + 1;
+        }
+        f(begin, end);
+        buffer.remove(0, static_cast<int>(end - begin));
+    }
+}
+
+// the header of a Matrix Market file (banner and size lines)
+struct MTXHeader {
+    bool banner = false;
+    bool size = false;
+    bool pattern = false;
+    uword n_rows = 0;
+    uword n_cols = 0;
+    uword n_entries = 0;
+};
+
+// parses the header lines (banner, comments and size) at the beginning of the data
+// returns the position after the header lines that were parsed
+const char *parseMTXHeader(const char *first, const char *last, MTXHeader &header)
+{
+    while (first < last && !header.size) {
+        const char *eol = lineEnd(first, last);
+        const QByteArray line = QByteArray(first, static_cast<int>(eol - first)).simplified();
+        if (!header.banner) {
+            // only sparse (coordinate) general matrices of real values are supported
+            const QList<QByteArray> fields = line.toLower().split(' ');
+            if (fields.size() != 5 || fields.at(0) != "%%matrixmarket" || fields.at(1) != "matrix"
+                    || fields.at(2) != "coordinate" || fields.at(4) != "general"
+                    || (fields.at(3) != "real" && fields.at(3) != "integer"
+                        && fields.at(3) != "pattern")) {
+                throw std::runtime_error("The file is not a supported Matrix Market file");
+            }
+            header.pattern = fields.at(3) == "pattern";
+            header.banner = true;
+        } else if (!line.isEmpty() && !line.startsWith('%')) {
+            const QList<QByteArray> fields = line.split(' ');
+            bool ok = fields.size() == 3;
+            if (ok) {
+                bool ok_rows, ok_cols, ok_entries;
+                header.n_rows = fields.at(0).toULongLong(&ok_rows);
+                header.n_cols = fields.at(1).toULongLong(&ok_cols);
+                header.n_entries = fields.at(2).toULongLong(&ok_entries);
+                ok = ok_rows && ok_cols && ok_entries;
+            }
+            if (!ok) {
+                throw std::runtime_error("The file does not contain a valid matrix");
+            }
+            header.size = true;
+        }
+        first = eol == last ? last : eol + 1;
+    }
+    return first;
+}
+
+// parses an (1-based) index and returns the position after it or nullptr if it is not valid
+inline const char *parseIndex(const char *first, const char *last, const uword max, uword &index)
+{
+    while (first != last && isBlank(*first)) {
+        ++first;
+    }
+    const auto result = std::from_chars(first, last, index);
+    if (result.ec != std::errc() || index == 0 || index > max) {
+        return nullptr;
+    }
+    --index;
+    return result.ptr;
+}
+
+// the entries of the matrix parsed from a chunk of the file
+struct TripletsChunk {
+    std::vector<uword> rows;
+    std::vector<uword> cols;
+    std::vector<double> values;
+};
+
+// parses the entries (row, column and value) of a chunk, returns false if an entry is not valid
+bool parseTriplets(const char *first, const char *last, const MTXHeader &header,
+                   TripletsChunk &triplets)
+{
+    bool parsed = true;
+    forEachLine(first, last, [&](const char *line, const char *line_end) {
+        uword row, col;
+        double value = 1.0;
+        const char *pos = parseIndex(line, line_end, header.n_rows, row);
+        pos = pos == nullptr ? nullptr : parseIndex(pos, line_end, header.n_cols, col);
+        if (pos != nullptr && !header.pattern) {
+            while (pos != line_end && isBlank(*pos)) {
+                ++pos;
+            }
+            pos = parseValue(pos, line_end, value);
+        }
+        if (pos == nullptr || !std::all_of(pos, line_end, isBlank)) {
+            parsed = false;
+            return false;
+        }
+        if (value != 0) {
+            triplets.rows.push_back(row);
+            triplets.cols.push_back(col);
+            triplets.values.push_back(value);
+        }
+        return true;
+    });
+    return parsed;
+}
+
+// creates the sparse matrix of counts (spots as rows and genes as columns) from the
+// entries of the Matrix Market file (genes as rows and spots as columns)
+// duplicated entries are added up, the entries of the chunks are released
+sp_mat tripletsToSparse(std::vector<TripletsChunk> &chunks, const uword n_spots, const uword n_genes)
+{
+    // bucket the entries by gene (the columns of the matrix of counts)
+    std::vector<uword> bucket_ptrs(n_genes + 1, 0);
+    for (const auto &chunk : chunks) {
+        for (const uword gene : chunk.rows) {
+            ++bucket_ptrs[gene + 1];
+        }
+    }
+    std::partial_sum(bucket_ptrs.begin(), bucket_ptrs.end(), bucket_ptrs.begin());
+    std::vector<std::pair<uword, double>> entries(bucket_ptrs.back());
+    std::vector<uword> next(bucket_ptrs.begin(), bucket_ptrs.end() - 1);
+    for (auto &chunk : chunks) {
+        for (size_t k = 0; k < chunk.values.size(); ++k) {
+            entries[next[chunk.rows[k]]++] = std::make_pair(chunk.cols[k], chunk.values[k]);
+        }
+        std::vector<uword>().swap(chunk.rows);
+        std::vector<uword>().swap(chunk.cols);
+        std::vector<double>().swap(chunk.values);
+    }
+
+    // sort the spots of each gene and add up the duplicated entries
+    std::vector<uword> col_ptrs(n_genes + 1, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (uword j = 0; j < n_genes; ++j) {
+        const auto first = entries.begin() + bucket_ptrs[j];
+        const auto last = entries.begin() + bucket_ptrs[j + 1];
+        if (!std::is_sorted(first, last)) {
+            std::sort(first, last);
+        }
+        auto out = first;
+        for (auto it = first; it != last; ++it) {
+            if (out != first && (out - 1)->first == it->first) {
+                (out - 1)->second += it->second;
+            } else {
+                *out++ = *it;
+            }
+        }
+        col_ptrs[j + 1] = static_cast<uword>(out - first);
+    }
+    std::partial_sum(col_ptrs.begin(), col_ptrs.end(), col_ptrs.begin());
+
+    uvec sp_col_ptrs(col_ptrs);
+    uvec row_indices(col_ptrs.back());
+    vec values(col_ptrs.back());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (uword j = 0; j < n_genes; ++j) {
+        for (uword k = col_ptrs[j]; k < col_ptrs[j + 1]; ++k) {
+            const auto &entry = entries[bucket_ptrs[j] + k - col_ptrs[j]];
+            row_indices[k] = entry.first;
+            values[k] = entry.second;
+        }
+    }
+    return sp_mat(row_indices, sp_col_ptrs, values, n_spots, n_genes);
+}
+
+// reads the non-empty lines of a (possibly compressed) text file
+QList<QByteArray> readLines(const QString &filename)
+{
+    QByteArray content;
+    if (CompressedFile::isCompressed(filename)) {
+        content = CompressedFile::readAll(filename);
+    } else {
+        QFile file(filename);
+        if (!file.open(QIODevice::ReadOnly)) {
+            throw std::runtime_error("Could not open the features or barcodes file");
+        }
+        content = file.readAll();
+    }
+    QList<QByteArray> lines;
+    for (const QByteArray &line : content.split('\n')) {
+        const QByteArray trimmed = line.trimmed();
+        if (!trimmed.isEmpty()) {
+            lines.append(trimmed);
+        }
+    }
+    return lines;
+}
+
+// returns the first of the files (plain or compressed) that exists in the folder
+QString findFile(const QDir &dir, const QStringList &names)
+{
+    for (const QString &name : names) {
+        for (const QString &suffix : {QString(), QStringLiteral(".gz"), QStringLiteral(".zst")}) {
+            if (dir.exists(name + suffix)) {
+                return dir.filePath(name + suffix);
+            }
+        }
+    }
+    return QString();
+}
+
+// the layouts of the spot coordinates files (number of columns)
+// 3 = spot x y, 4 = spot x y z, 5 = spot - - x y and 6 = x y - - pixel_x pixel_y
+constexpr int MIN_SPOT_FIELDS = 3;
+constexpr int MAX_SPOT_FIELDS = 6;
+
+// the spots (and their coordinates) parsed from a chunk of a spot coordinates file
+struct SpotsChunk {
+    std::vector<QString> spots;
+    std::vector<Spot::SpotType> coordinates;
+};
+
+// the lines of the spot coordinates file starting with x are headers
+inline bool isSpotsHeader(const char *first, const char *last)
+{
+    return first != last && *first == 'x';
+}
+
+// returns the number of fields of the line (separated by tabs)
+int countFields(const char *first, const char *last)
+{
+    while (first != last && isBlank(*(last - 1))) {
+        --last;
+    }
+    return static_cast<int>(std::count(first, last, '\t')) + 1;
+}
+
+// parses a coordinate of the spot (only white spaces are allowed around it)
+inline bool parseCoordinate(const char *first, const char *last, float &coordinate)
+{
+    double value = 0;
+    const char *pos = parseValue(first, last, value);
+    if (pos == nullptr || !std::all_of(pos, last, isBlank)) {
+        return false;
+    }
+    coordinate = static_cast<float>(value);
+    return true;
+}
+
+// parses a line of the spot coordinates file with n_fields fields
+// returns false if the line does not have n_fields fields or they are not valid
+bool parseSpotLine(const char *first, const char *last, const int n_fields,
+                   QString &spot, Spot::SpotType &coordinates)
+{
+    // the beginning of the fields (each field ends one position before the next one)
+    const char *starts[MAX_SPOT_FIELDS + 1];
+    int n = 0;
+    starts[n++] = first;
+    for (const char *pos = first; pos != last; ++pos) {
+        if (*pos == '\t') {
+            if (n == n_fields) {
+                // only white spaces (or trailing separators) are allowed after the last field
+                if (!std::all_of(pos, last, isBlank)) {
+                    return false;
+                }
+                last = pos;
+                break;
+            }
+            starts[n++] = pos + 1;
+        }
+    }
+    if (n != n_fields) {
+        return false;
+    }
+    starts[n] = last + 1;
+    const auto text = [&starts](const int i) {
+        return QString::fromUtf8(starts[i], static_cast<int>(starts[i + 1] - 1 - starts[i])).trimmed();
+    };
+    const auto coordinate = [&starts](const int i, float &value) {
+        return parseCoordinate(starts[i], starts[i + 1] - 1, value);
+    };
+
+    float x = 0;
+    float y = 0;
+    float z = 0;
+    bool valid = false;
+    if (n_fields == 3) {
+        // 2D format
+        spot = text(0);
+        valid = coordinate(1, x) && coordinate(2, y);
+    } else if (n_fields == 4) {
+        // 3D format
+        spot = text(0);
+        valid = coordinate(1, x) && coordinate(2, y) && coordinate(3, z);
+    } else if (n_fields == 5) {
+        // 2D format
+        spot = text(0);
+        valid = coordinate(3, x) && coordinate(4, y);
+    } else if (n_fields == 6) {
+        // 2D format (ST Spot detector)
+        spot = text(0) + "x" + text(1);
+        valid = coordinate(4, x) && coordinate(5, y);
+    }
+    coordinates = Spot::SpotType(x, y, z);
+    return valid && !spot.isEmpty();
+}
+
+}
+
+namespace MatrixParser
+{
+
+STData::STDataFrame parseTSV(const QString &filename)
+{
+    // compressed files are decompressed and parsed by blocks
+    if (CompressedFile::isCompressed(filename)) {
+        return parseCompressedTSV(filename);
+    }
+
+    QFile file(filename);
+    const char *begin = mapFile(file);
+    return parseTSV(begin, begin + file.size());
+}
+
+STData::STDataFrame parseTSV(const char *begin, const char *end)
+{
+    STData::STDataFrame data;
+
+    // the first line contains the genes
+    const char *header_end = lineEnd(begin, end);
+    data.genes = parseHeader(begin, header_end);
+    const uword n_genes = data.genes.size();
+    const char *body = header_end == end ? end : header_end + 1;
+
+    // split the rows in chunks that start at the beginning of a line
+    const size_t max_chunks = static_cast<size_t>(omp_get_max_threads()) * 8;
+    const std::vector<const char *> chunks = splitChunks(body, end, max_chunks);
+    const size_t n_chunks = chunks.size() - 1;
+
+    // count the rows of each chunk to know where each chunk starts in the matrix
+    // the first rows of each chunk are also parsed to estimate the density of the matrix
+    std::vector<uword> row_offsets(n_chunks + 1, 0);
+    std::vector<uword> sampled_values(n_chunks, 0);
+    std::vector<uword> sampled_nonzeros(n_chunks, 0);
+    #pragma omp parallel
+    {
+        std::vector<double> row(n_genes);
+        QString spot;
+        #pragma omp for schedule(dynamic)
+        for (size_t c = 0; c < n_chunks; ++c) {
+            uword rows = 0;
+            forEachLine(chunks[c], chunks[c + 1], [&](const char *first, const char *last) {
+                if (rows < ROWS_SAMPLE && parseRow(first, last, n_genes, spot, row.data())) {
+                    sampled_values[c] += n_genes;
+                    sampled_nonzeros[c] += std::count_if(row.begin(), row.end(),
+                                                         [](const double value) { return value != 0; });
+                }
+                ++rows;
+                return true;
+            });
+            row_offsets[c + 1] = rows;
+        }
+    }
+    std::partial_sum(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
+    const uword n_spots = row_offsets.back();
+
+    if (n_spots == 0 || n_genes == 0) {
+        throw std::runtime_error("The file does not contain a valid matrix");
+    }
+
+    // choose the storage of the matrix of counts
+    const uword n_sampled = std::accumulate(sampled_values.begin(), sampled_values.end(), uword(0));
+    const uword n_nonzero = std::accumulate(sampled_nonzeros.begin(), sampled_nonzeros.end(), uword(0));
+    const double density = n_sampled > 0 ? static_cast<double>(n_nonzero) / n_sampled : 1.0;
+    data.is_sparse = density < SPARSE_MAX_DENSITY;
+    qDebug() << "Estimated density of the matrix of counts " << density
+             << (data.is_sparse ? " using sparse storage" : " using dense storage");
+
+    if (data.is_sparse) {
+        // the rows are parsed in compressed rows and then converted to the sparse matrix
+        std::vector<RowsChunk> rows(n_chunks);
+        std::atomic<bool> parsed(true);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t c = 0; c < n_chunks; ++c) {
+            if (parsed && !parseRows(chunks[c], chunks[c + 1], n_genes, rows[c])) {
+                parsed = false;
+            }
+        }
+        if (!parsed) {
+            throw std::runtime_error("The file does not contain a valid matrix");
+        }
+        data.spots = chunksSpots(rows);
+        data.sp_counts = chunksToSparse(rows, n_genes);
+    } else {
+        std::vector<QString> spots(n_spots);
+        if (!parseDense(chunks, row_offsets, n_genes, spots, data.counts)) {
+            throw std::runtime_error("The file does not contain a valid matrix");
+        }
+        data.spots = QList<QString>(spots.begin(), spots.end());
+    }
+
+    return data;
+}
+
+STData::STDataFrame parseCompressedTSV(const QString &filename, const int block_size)
+{
+    STData::STDataFrame data;
+    uword n_genes = 0;
+    bool header_parsed = false;
+    const size_t max_chunks = static_cast<size_t>(omp_get_max_threads()) * 4;
+    std::vector<RowsChunk> rows;
+
+    // the blocks are decompressed on another thread while the previous blocks are parsed
+    forEachBlock(filename, block_size, [&](const char *begin, const char *end) {
+        // the first line contains the genes
+        if (!header_parsed) {
+            const char *header_end = lineEnd(begin, end);
+            data.genes = parseHeader(begin, header_end);
+            n_genes = data.genes.size();
+            begin = header_end == end ? end : header_end + 1;
+            header_parsed = true;
+        }
+
+        // parse the rows of the block in parallel
+        const std::vector<const char *> chunks = splitChunks(begin, end, max_chunks);
+        const size_t n_chunks = chunks.size() - 1;
+        const size_t first_chunk = rows.size();
+        rows.resize(first_chunk + n_chunks);
+        std::atomic<bool> parsed(true);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t c = 0; c < n_chunks; ++c) {
+            if (parsed && !parseRows(chunks[c], chunks[c + 1], n_genes, rows[first_chunk + c])) {
+                parsed = false;
+            }
+        }
+        if (!parsed) {
+            throw std::runtime_error("The file does not contain a valid matrix");
+        }
+    });
+
+    uword n_spots = 0;
+    uword n_nonzero = 0;
+    for (const auto &chunk : rows) {
+        n_spots += chunk.row_nonzeros.size();
+        n_nonzero += chunk.values.size();
+    }
+    if (n_spots == 0 || n_genes == 0) {
+        throw std::runtime_error("The file does not contain a valid matrix");
+    }
+
+    // choose the storage of the matrix of counts (the density is known after parsing)
+    const double density = static_cast<double>(n_nonzero) / (static_cast<double>(n_spots) * n_genes);
+    data.is_sparse = density < SPARSE_MAX_DENSITY;
+    qDebug() << "Density of the matrix of counts " << density
+             << (data.is_sparse ? " using sparse storage" : " using dense storage");
+
+    data.spots = chunksSpots(rows);
+    if (data.is_sparse) {
+        data.sp_counts = chunksToSparse(rows, n_genes);
+    } else {
+        data.counts = chunksToDense(rows, n_genes);
+    }
+    return data;
+}
+
+SpotsMap parseSpots(const QString &filename)
+{
+    // spots files are small so the compressed ones are decompressed in memory
+    if (CompressedFile::isCompressed(filename)) {
+        const QByteArray content = CompressedFile::readAll(filename);
+        return parseSpots(content.constData(), content.constData() + content.size());
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Could not open the spot coordinates file");
+    }
+    if (file.size() <= 0) {
+        throw std::runtime_error("No valid spots found in the spot coordinates file");
+    }
+    const uchar *mapped = file.map(0, file.size());
+    if (mapped == nullptr) {
+        throw std::runtime_error("Could not map the spot coordinates file in memory");
+    }
+    const char *begin = reinterpret_cast<const char *>(mapped);
+    return parseSpots(begin, begin + file.size());
+}
+
+SpotsMap parseSpots(const char *begin, const char *end)
+{
+    // the layout is detected from the first line that is not a header
+    int n_fields = 0;
+    forEachLine(begin, end, [&](const char *first, const char *last) {
+        if (isSpotsHeader(first, last)) {
+            return true;
+        }
+        n_fields = countFields(first, last);
+        return false;
+    });
+    if (n_fields < MIN_SPOT_FIELDS || n_fields > MAX_SPOT_FIELDS) {
+        throw std::runtime_error("No valid spots found in the spot coordinates file");
+    }
+
+    // parse the lines in chunks that start at the beginning of a line
+    const size_t max_chunks = static_cast<size_t>(omp_get_max_threads()) * 8;
+    const std::vector<const char *> chunks = splitChunks(begin, end, max_chunks);
+    const size_t n_chunks = chunks.size() - 1;
+    std::vector<SpotsChunk> parsed_chunks(n_chunks);
+    std::atomic<bool> parsed(true);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < n_chunks; ++c) {
+        if (!parsed) {
+            continue;
+        }
+        SpotsChunk &chunk = parsed_chunks[c];
+        QString spot;
+        Spot::SpotType coordinates;
+        forEachLine(chunks[c], chunks[c + 1], [&](const char *first, const char *last) {
+            if (isSpotsHeader(first, last)) {
+                return true;
+            }
+            if (!parseSpotLine(first, last, n_fields, spot, coordinates)) {
+                parsed = false;
+                return false;
+            }
+            chunk.spots.push_back(spot);
+            chunk.coordinates.push_back(coordinates);
+            return true;
+        });
+    }
+    if (!parsed) {
+        throw std::runtime_error("No valid spots found in the spot coordinates file");
+    }
+
+    // the spots are added in order of the file (a duplicated spot keeps its last coordinates)
+    SpotsMap spots_map;
+    size_t n_spots = 0;
+    for (const auto &chunk : parsed_chunks) {
+        n_spots += chunk.spots.size();
+    }
+    spots_map.spots.reserve(static_cast<int>(n_spots));
+    spots_map.coordinates.reserve(static_cast<int>(n_spots));
+    for (auto &chunk : parsed_chunks) {
+        for (size_t i = 0; i < chunk.spots.size(); ++i) {
+            const int spot_id = spots_map.spots.intern(chunk.spots[i]);
+            if (spot_id == spots_map.coordinates.size()) {
+                spots_map.coordinates.append(chunk.coordinates[i]);
+            } else {
+                spots_map.coordinates[spot_id] = chunk.coordinates[i];
+            }
+        }
+        std::vector<QString>().swap(chunk.spots);
+    }
+    if (spots_map.coordinates.isEmpty()) {
+        throw std::runtime_error("No valid spots found in the spot coordinates file");
+    }
+
+    return spots_map;
+}
+
+bool isMatrixMarket(const QString &filename)
+{
+    QString name = QFileInfo(filename).fileName().toLower();
+    if (name.endsWith(".gz")) {
+        name.chop(3);
+    } else if (name.endsWith(".zst")) {
+        name.chop(4);
+    }
+    return name.endsWith(".mtx");
+}
+
+QString findMTX(const QString &folder)
+{
+    const QStringList files = QDir(folder).entryList(QDir::Files, QDir::Name);
+    for (const QString &file : files) {
+        if (isMatrixMarket(file)) {
+            return QDir(folder).filePath(file);
+        }
+    }
+    return QString();
+}
+
+bool findMTXNames(const QString &filename, QString &features_file, QString &barcodes_file)
+{
+    // the files of the features and barcodes have the same prefix than the matrix
+    // (e.g. sample_matrix.mtx.gz, sample_features.tsv.gz and sample_barcodes.tsv.gz)
+    const QFileInfo info(filename);
+    const QString name = info.fileName();
+    const int prefix_size = name.indexOf(QStringLiteral("matrix.mtx"), 0, Qt::CaseInsensitive);
+    const QString prefix = name.left(std::max(prefix_size, 0));
+    features_file = findFile(info.dir(), {prefix + "features.tsv", prefix + "genes.tsv"});
+    barcodes_file = findFile(info.dir(), {prefix + "barcodes.tsv"});
+    return !features_file.isEmpty() && !barcodes_file.isEmpty();
+}
+
+STData::STDataFrame parseMTX(const QString &filename)
+{
+    QString features_file;
+    QString barcodes_file;
+    if (!findMTXNames(filename, features_file, barcodes_file)) {
+        throw std::runtime_error("The features or barcodes file of the matrix could not be found");
+    }
+    return parseMTX(filename, features_file, barcodes_file);
+}
+
+STData::STDataFrame parseMTX(const QString &filename,
+                             const QString &features_file,
+                             const QString &barcodes_file,
+                             const int block_size)
+{
+    MTXHeader header;
+    const size_t max_chunks = static_cast<size_t>(omp_get_max_threads()) * 4;
+    std::vector<TripletsChunk> triplets;
+
+    // parses the header and then the entries of the data in parallel
+    const auto parseEntries = [&](const char *begin, const char *end) {
+        if (!header.size) {
+            begin = parseMTXHeader(begin, end, header);
+        }
+        const std::vector<const char *> chunks = splitChunks(begin, end, max_chunks);
+        const size_t n_chunks = chunks.size() - 1;
+        const size_t first_chunk = triplets.size();
+        triplets.resize(first_chunk + n_chunks);
+        std::atomic<bool> parsed(true);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t c = 0; c < n_chunks; ++c) {
+            if (parsed && !parseTriplets(chunks[c], chunks[c + 1], header, triplets[first_chunk + c])) {
+                parsed = false;
+            }
+        }
+        if (!parsed) {
+            throw std::runtime_error("The file does not contain a valid matrix");
+        }
+    };
+
+    if (CompressedFile::isCompressed(filename)) {
+        forEachBlock(filename, block_size, parseEntries);
+    } else {
+        QFile file(filename);
+        const char *begin = mapFile(file);
+        parseEntries(begin, begin + file.size());
+    }
+    if (!header.size || header.n_rows == 0 || header.n_cols == 0) {
+        throw std::runtime_error("The file does not contain a valid matrix");
+    }
+
+    // the genes (features) are the rows of the file and the spots (barcodes) the columns
+    STData::STDataFrame data;
+    const QList<QByteArray> features = readLines(features_file);
+    const QList<QByteArray> barcodes = readLines(barcodes_file);
+    if (static_cast<uword>(features.size()) != header.n_rows
+            || static_cast<uword>(barcodes.size()) != header.n_cols) {
+        throw std::runtime_error("The features or barcodes do not match the matrix of counts");
+    }
+    // the features contain the gene id and (optionally) the gene name,
+    // the id is used when the gene name is duplicated
+    QSet<QString> gene_names;
+    for (const QByteArray &feature : features) {
+        const QList<QByteArray> fields = feature.split('\t');
+        QString gene = QString::fromUtf8(fields.size() > 1 ? fields.at(1) : fields.at(0));
+        if (gene_names.contains(gene)) {
+            gene = QString::fromUtf8(fields.at(0));
+        }
+        gene_names.insert(gene);
+        data.genes.append(gene);
+    }
+    for (const QByteArray &barcode : barcodes) {
+        data.spots.append(QString::fromUtf8(barcode.split('\t').at(0)));
+    }
+
+    const sp_mat counts = tripletsToSparse(triplets, header.n_cols, header.n_rows);
+    const double density = static_cast<double>(counts.n_nonzero)
+            / (static_cast<double>(counts.n_rows) * counts.n_cols);
+    data.is_sparse = density < SPARSE_MAX_DENSITY;
+    qDebug() << "Density of the matrix of counts " << density
+             << (data.is_sparse ? " using sparse storage" : " using dense storage");
+    if (data.is_sparse) {
+        data.sp_counts = counts;
+    } else {
+        data.counts = mat(counts);
+    }
+    return data;
+}
+
+}
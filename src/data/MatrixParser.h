@@ -0,0 +1,77 @@
+#ifndef MATRIXPARSER_H
+#define MATRIXPARSER_H
+
+#include "data/STData.h"
+#include "data/CompressedFile.h"
+
+// MatrixParser is a convenience namespace which contains the functions
+// used to parse matrices of counts from files. The parsers memory-map
+// the files and parse them on all the available cores.
+namespace MatrixParser
+{
+
+// matrices with a fraction of non-zero counts below this value are stored sparse
+constexpr double SPARSE_MAX_DENSITY = 0.3;
+
+// the coordinates of the spots of a spot coordinates file, the ids of
+// the spots (in order of the file) are the indexes of the coordinates
+struct SpotsMap {
+    IdTable spots;
+    QVector<Spot::SpotType> coordinates;
+};
+
+// Parses a matrix of counts in TSV format (genes as columns and spots as rows)
+// the file is memory-mapped and the rows are parsed in parallel
+// compressed files (gzip or zstd) are parsed with parseCompressedTSV()
+// the storage (dense or sparse) is chosen by the density of a sample of the rows
+// it throws exceptions when errors happen during parsing or an empty file
+STData::STDataFrame parseTSV(const QString &filename);
+
+// Same as above but parsing an in-memory buffer
+STData::STDataFrame parseTSV(const char *begin, const char *end);
+
+// Parses a compressed (gzip or zstd) matrix of counts in TSV format
+// the file is decompressed by blocks on a separate thread while the rows of the
+// previous blocks are parsed in parallel, the whole file is never decompressed in memory
+// the storage (dense or sparse) is chosen by the density of the parsed matrix
+// it throws exceptions when errors happen during decompression or parsing
+STData::STDataFrame parseCompressedTSV(const QString &filename,
+                                       const int block_size = CompressedFile::DEFAULT_BLOCK_SIZE);
+
+// Parses a spot coordinates file (spot followed by the coordinates, tab separated)
+// the layout (3, 4, 5 or 6 columns) is detected from the first line and the file is
+// memory-mapped and parsed in parallel, compressed files are decompressed in memory
+// it throws exceptions when errors happen during parsing or no spots are found
+SpotsMap parseSpots(const QString &filename);
+
+// Same as above but parsing an in-memory buffer
+SpotsMap parseSpots(const char *begin, const char *end);
+
+// true if the file is a Matrix Market file (*.mtx, which can be compressed)
+bool isMatrixMarket(const QString &filename);
+
+// returns the Matrix Market file in the given folder (empty if there is none)
+QString findMTX(const QString &folder);
+
+// finds the features.tsv (or genes.tsv) and barcodes.tsv files of a Matrix Market file
+// (in the folder of the matrix and with the same prefix than the matrix)
+// returns false if any of them could not be found
+bool findMTXNames(const QString &filename, QString &features_file, QString &barcodes_file);
+
+// Parses a sparse matrix of counts in Matrix Market format (10x Genomics layout
+// with genes as rows and spots as columns). The names of the genes and spots are
+// parsed from the features.tsv (or genes.tsv) and barcodes.tsv files of the folder
+// of the matrix, these files can be compressed and have the same prefix than the matrix
+// the entries are parsed in parallel directly into a sparse matrix (no dense copy)
+// it throws exceptions when errors happen during parsing
+STData::STDataFrame parseMTX(const QString &filename);
+
+// Same as above but with the files of the features and barcodes given
+STData::STDataFrame parseMTX(const QString &filename,
+                             const QString &features_file,
+                             const QString &barcodes_file,
+                             const int block_size = CompressedFile::DEFAULT_BLOCK_SIZE);
+
+}
+
+#endif // MATRIXPARSER_H
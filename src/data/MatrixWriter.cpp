@@ -0,0 +1,297 @@
+#include "MatrixWriter.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocale>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include "data/DatasetCache.h"
+#include "math/SparseMatrix.h"
+
+namespace
+{
+
+// number of rows (or columns) of the matrix that are formatted in each block
+constexpr uword BLOCK_SIZE = 64;
+
+// number of blocks per thread that are formatted before they are written to the file
+constexpr uword BLOCKS_PER_THREAD = 4;
+
+// appends a real value (using the shortest representation)
+inline void appendValue(std::string &buffer, const double value)
+{
+    if (value == 0) {
+        buffer += '0';
+        return;
+    }
+#if defined(__cpp_lib_to_chars)
+    char chars[32];
+    const auto result = std::to_chars(chars, chars + sizeof(chars), value);
+    buffer.append(chars, result.ptr);
+#else
+    // std::to_chars for real values is not available in all the compilers
+    const QByteArray chars = QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+    buffer.append(chars.constData(), static_cast<size_t>(chars.size()));
+#endif
+}
+
+// appends a (1-based) index
+inline void appendIndex(std::string &buffer, const uword index)
+{
+    char chars[24];
+    const auto result = std::to_chars(chars, chars + sizeof(chars), index + 1);
+    buffer.append(chars, result.ptr);
+}
+
+inline void appendName(std::string &buffer, const QString &name)
+{
+    const QByteArray bytes = name.toUtf8();
+    buffer.append(bytes.constData(), static_cast<size_t>(bytes.size()));
+}
+
+// the file is written to a temporary file that replaces it when it is committed
+void openFile(QSaveFile &file)
+{
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not create the file " << file.fileName();
+        throw std::runtime_error("Could not create the file");
+    }
+}
+
+void writeBuffer(QSaveFile &file, const std::string &buffer)
+{
+    if (file.write(buffer.data(), static_cast<qint64>(buffer.size()))
+            != static_cast<qint64>(buffer.size())) {
+        qDebug() << "Could not write the file " << file.fileName() << " " << file.errorString();
+        file.cancelWriting();
+        throw std::runtime_error("Could not write the file");
+    }
+}
+
+void commitFile(QSaveFile &file)
+{
+    if (!file.commit()) {
+        qDebug() << "Could not write the file " << file.fileName() << " " << file.errorString();
+        throw std::runtime_error("Could not write the file");
+    }
+}
+
+// formats the blocks with format_block(block, buffer) in parallel and writes them in order,
+// the blocks are formatted in batches so only a few blocks are kept in memory
+template <typename F>
+void writeBlocks(QSaveFile &file, const uword n_blocks, F format_block)
+{
+    const uword batch_size = static_cast<uword>(omp_get_max_threads()) * BLOCKS_PER_THREAD;
+    std::vector<std::string> buffers(std::min(batch_size, n_blocks));
+    for (uword first = 0; first < n_blocks; first += batch_size) {
+        const uword last = std::min(n_blocks, first + batch_size);
+        #pragma omp parallel for schedule(dynamic)
+        for (uword block = first; block < last; ++block) {
+            std::string &buffer = buffers[block - first];
+            buffer.clear();
+            format_block(block, buffer);
+        }
+        for (uword block = first; block < last; ++block) {
+            writeBuffer(file, buffers[block - first]);
+        }
+    }
+}
+
+// writes the names (one per line), the features are written in the 10x layout
+// (id, name and type) using the name of the gene as its id
+void writeNames(const QString &filename, const QList<QString> &names, const bool features)
+{
+    QSaveFile file(filename);
+    openFile(file);
+    std::string buffer;
+    for (const QString &name : names) {
+        appendName(buffer, name);
+        if (features) {
+            buffer += '\t';
+            appendName(buffer, name);
+            buffer += "\tGene Expression";
+        }
+        buffer += '\n';
+    }
+    writeBuffer(file, buffer);
+    commitFile(file);
+}
+
+}
+
+namespace MatrixWriter
+{
+
+Format format(const QString &filename)
+{
+    if (filename.endsWith(QStringLiteral(".mtx"), Qt::CaseInsensitive)) {
+        return MatrixMarket;
+    }
+    if (DatasetCache::isCacheFile(filename)) {
+        return Binary;
+    }
+    return TSV;
+}
+
+void write(const QString &filename, const STData::STDataFrame &data)
+{
+    switch (format(filename)) {
+    case MatrixMarket:
+        writeMTX(filename, data);
+        break;
+    case Binary:
+        writeBinary(filename, data);
+        break;
+    case TSV:
+        writeTSV(filename, data);
+        break;
+    }
+}
+
+void writeTSV(const QString &filename, const STData::STDataFrame &data)
+{
+    QSaveFile file(filename);
+    openFile(file);
+
+    // write genes (1st row)
+    std::string header;
+    for (const auto &gene : data.genes) {
+        header += '\t';
+        appendName(header, gene);
+    }
+    header += '\n';
+    writeBuffer(file, header);
+
+    // write spots (1st column and the rest of the rows (counts)) by blocks of rows
+    const uword n_spots = data.n_rows();
+    const uword n_genes = data.n_cols();
+    const uword n_blocks = (n_spots + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (data.is_sparse) {
+        // the spots are the columns of the transposed matrix (the zeros are written too)
+        const sp_mat counts = data.sp_counts.t();
+        writeBlocks(file, n_blocks, [&](const uword block, std::string &buffer) {
+            const uword last = std::min(n_spots, (block + 1) * BLOCK_SIZE);
+            for (uword i = block * BLOCK_SIZE; i < last; ++i) {
+                appendName(buffer, data.spots.at(static_cast<int>(i)));
+                uword k = counts.col_ptrs[i];
+                for (uword j = 0; j < n_genes; ++j) {
+                    buffer += '\t';
+                    if (k < counts.col_ptrs[i + 1] && counts.row_indices[k] == j) {
+                        appendValue(buffer, counts.values[k++]);
+                    } else {
+                        buffer += '0';
+                    }
+                }
+                buffer += '\n';
+            }
+        });
+    } else {
+        writeBlocks(file, n_blocks, [&](const uword block, std::string &buffer) {
+            const uword first = block * BLOCK_SIZE;
+            const uword last = std::min(n_spots, first + BLOCK_SIZE);
+            // the rows are transposed so the counts of each spot are contiguous
+            const mat rows = data.counts.rows(first, last - 1).t();
+            for (uword i = 0; i < rows.n_cols; ++i) {
+                appendName(buffer, data.spots.at(static_cast<int>(first + i)));
+                const double *values = rows.colptr(i);
+                for (uword j = 0; j < n_genes; ++j) {
+                    buffer += '\t';
+                    appendValue(buffer, values[j]);
+                }
+                buffer += '\n';
+            }
+        });
+    }
+
+    commitFile(file);
+}
+
+void writeMTX(const QString &filename, const STData::STDataFrame &data)
+{
+    // the files of the features and barcodes have the same prefix than the matrix
+    const QFileInfo info(filename);
+    const QString name = info.fileName();
+    const int prefix_size = name.indexOf(QStringLiteral("matrix.mtx"), 0, Qt::CaseInsensitive);
+    const QString prefix = name.left(std::max(prefix_size, 0));
+    writeNames(info.dir().filePath(prefix + "features.tsv"), data.genes, true);
+    writeNames(info.dir().filePath(prefix + "barcodes.tsv"), data.spots, false);
+
+    QSaveFile file(filename);
+    openFile(file);
+
+    // the genes are the rows of the file and the spots the columns
+    const uword n_spots = data.n_rows();
+    const uword n_genes = data.n_cols();
+    const uword n_nonzero = data.is_sparse ? data.sp_counts.n_nonzero
+                                           : static_cast<uword>(accu(data.counts != 0));
+    std::string header("%%MatrixMarket matrix coordinate real general\n");
+    header += std::to_string(n_genes) + " " + std::to_string(n_spots)
+            + " " + std::to_string(n_nonzero) + "\n";
+    writeBuffer(file, header);
+
+    // the entries are written by blocks of genes (columns of the matrix)
+    const uword n_blocks = (n_genes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (data.is_sparse) {
+        data.sp_counts.sync();
+        writeBlocks(file, n_blocks, [&](const uword block, std::string &buffer) {
+            const uword last = std::min(n_genes, (block + 1) * BLOCK_SIZE);
+            for (uword j = block * BLOCK_SIZE; j < last; ++j) {
+                for (uword k = data.sp_counts.col_ptrs[j]; k < data.sp_counts.col_ptrs[j + 1]; ++k) {
+                    appendIndex(buffer, j);
+                    buffer += ' ';
+                    appendIndex(buffer, data.sp_counts.row_indices[k]);
+                    buffer += ' ';
+                    appendValue(buffer, data.sp_counts.values[k]);
+                    buffer += '\n';
+                }
+            }
+        });
+    } else {
+        writeBlocks(file, n_blocks, [&](const uword block, std::string &buffer) {
+            const uword last = std::min(n_genes, (block + 1) * BLOCK_SIZE);
+            for (uword j = block * BLOCK_SIZE; j < last; ++j) {
+                const double *values = data.counts.colptr(j);
+                for (uword i = 0; i < n_spots; ++i) {
+                    if (values[i] != 0) {
+                        appendIndex(buffer, j);
+                        buffer += ' ';
+                        appendIndex(buffer, i);
+                        buffer += ' ';
+                        appendValue(buffer, values[i]);
+                        buffer += '\n';
+                    }
+                }
+            }
+        });
+    }
+
+    commitFile(file);
+}
+
+void writeBinary(const QString &filename, const STData::STDataFrame &data)
+{
+    // the exported datasets have no coordinates (the frames only have counts)
+    DatasetCache::Entry entry;
+    entry.data = data;
+    entry.coordinates = QVector<Spot::SpotType>(data.spots.size());
+    if (data.is_sparse) {
+        entry.spot_totals = STMath::rowSums(data.sp_counts);
+        entry.gene_totals = STMath::colSums(data.sp_counts);
+    } else {
+        entry.spot_totals = STMath::rowSums(data.counts);
+        entry.gene_totals = STMath::colSums(data.counts);
+    }
+    if (!DatasetCache::write(filename, entry)) {
+        throw std::runtime_error("Could not write the file");
+    }
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef MATRIXWRITER_H
+#define MATRIXWRITER_H
+
+#include "data/STData.h"
+
+// MatrixWriter is a convenience namespace which contains the functions
+// used to export matrices of counts to files. The rows (or columns) of the
+// matrix are formatted by blocks in parallel and written in order through
+// large buffers, so the exports are limited by the speed of the disk.
+namespace MatrixWriter
+{
+
+// the formats that the matrices of counts can be exported to
+enum Format {
+    // genes as columns and spots as rows (the zeros are written)
+    TSV,
+    // sparse triplets (10x Genomics layout with features and barcodes files)
+    MatrixMarket,
+    // the binary format of the datasets cache (*.stcache)
+    Binary
+};
+
+// the format of the file given its extension (*.mtx, *.stcache or TSV otherwise)
+Format format(const QString &filename);
+
+// Writes the matrix of counts in the format given by the extension of the file
+// it throws exceptions when errors happen during writing
+void write(const QString &filename, const STData::STDataFrame &data);
+
+// Writes the matrix of counts in TSV format
+void writeTSV(const QString &filename, const STData::STDataFrame &data);
+
+// Writes the matrix of counts in Matrix Market format (genes as rows and spots
+// as columns), the genes and the spots are written to the features.tsv and barcodes.tsv
+// files of the folder of the matrix (with the same prefix than the matrix)
+void writeMTX(const QString &filename, const STData::STDataFrame &data);
+
+// Writes the matrix of counts in the binary format of the datasets cache
+void writeBinary(const QString &filename, const STData::STDataFrame &data);
+
+}
+
+#endif // MATRIXWRITER_H
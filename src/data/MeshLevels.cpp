@@ -0,0 +1,961 @@
+#include "MeshLevels.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "data/DatasetCache.h"
+#include "data/LoadingProgress.h"
+
+namespace
+{
+
+constexpr char MAGIC[8] = {'S', 'T', 'V', 'M', 'E', 'S', 'H', 'S'};
+constexpr quint32 VERSION = 1;
+constexpr char SUFFIX[] = ".stmesh";
+
+// minimum size (in bytes) of the chunks of the file that are parsed in parallel
+constexpr size_t MIN_CHUNK_SIZE = 1 << 16;
+
+// the weight of the planes that keep the boundaries of the mesh in place
+constexpr double BOUNDARY_WEIGHT = 100.0;
+
+// the minimum cosine between the normal of a triangle before and after a collapse
+// (the collapses that fold the triangles are not done)
+constexpr double MIN_NORMAL_COSINE = 0.2;
+
+// the simplification stops when a level keeps more than this fraction
+// of the triangles of the previous level (the mesh cannot be simplified more)
+constexpr double MAX_LEVEL_FRACTION = 0.75;
+
+// the mesh cache starts with the header followed by the vertices and the normals (x,y,z)
+// and the indexes of the triangles of the levels
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 n_levels;
+    quint64 n_vertices;
+    quint64 mesh_size;
+    qint64 mesh_mtime;
+    quint64 level_sizes[MeshLevels::MAX_LEVELS];
+};
+
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be three floats");
+
+// the name of the mesh cache is a hash of the path of the mesh file, the cache files
+// are stored with the cached datasets (so they are removed with them)
+QString cacheFile(const QString &filename)
+{
+    const QByteArray path = QFileInfo(filename).absoluteFilePath().toUtf8();
+    const QByteArray hash = QCryptographicHash::hash(path, QCryptographicHash::Sha1);
+    return QDir(DatasetCache::directory()).filePath(QString::fromLatin1(hash.toHex()) + SUFFIX);
+}
+
+// fills the header with the size and modification time of the mesh file
+void meshInfo(const QString &filename, Header &header)
+{
+    const QFileInfo info(filename);
+    header.mesh_size = static_cast<quint64>(info.size());
+    header.mesh_mtime = info.lastModified().toMSecsSinceEpoch();
+}
+
+inline bool isBlank(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char *skipBlanks(const char *first, const char *last)
+{
+    while (first != last && isBlank(*first)) {
+        ++first;
+    }
+    return first;
+}
+
+// returns the end of the line that starts at first (position of '\n' or last)
+inline const char *lineEnd(const char *first, const char *last)
+{
+    const void *pos = std::memchr(first, '\n', static_cast<size_t>(last - first));
+    return pos == nullptr ? last : static_cast<const char *>(pos);
+}
+
+// splits the data in (at most) max_chunks chunks that start at the beginning of a line
+// returns the boundaries of the chunks (the last one is end)
+std::vector<const char *> splitChunks(const char *begin, const char *end, const size_t max_chunks)
+{
+    const size_t size = static_cast<size_t>(end - begin);
+    const size_t n_chunks = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, max_chunks);
+    std::vector<const char *> chunks;
+    chunks.push_back(begin);
+    for (size_t i = 1; i < n_chunks; ++i) {
+        const char *pos = std::max(begin + (size * i) / n_chunks, chunks.back());
+        pos = lineEnd(pos, end);
+        chunks.push_back(pos == end ? end : pos + 1);
+    }
+    chunks.push_back(end);
+    return chunks;
+}
+
+// parses a real value and returns the position after it or nullptr if the value is not valid
+inline const char *parseFloat(const char *first, const char *last, float &value)
+{
+    first = skipBlanks(first, last);
+    if (first != last && *first == '+') {
+        ++first;
+    }
+    const char *token_end = first;
+    while (token_end != last && !isBlank(*token_end)) {
+        ++token_end;
+    }
+#if defined(__cpp_lib_to_chars)
+    const auto result = std::from_chars(first, token_end, value);
+    return result.ec == std::errc() && result.ptr == token_end ? token_end : nullptr;
+#else
+    // std::from_chars for real values is not available in all the compilers
+    bool ok = false;
+    value = QByteArray::fromRawData(first, static_cast<int>(token_end - first)).toFloat(&ok);
+    return ok ? token_end : nullptr;
+#endif
+}
+
+// parses the index of the vertex of a corner of a face (v, v/vt, v//vn or v/vt/vn)
+// the indexes of the texture coordinates and the normals are skipped
+inline const char *parseIndex(const char *first, const char *last, qint64 &index)
+{
+    const auto result = std::from_chars(first, last, index);
+    if (result.ec != std::errc() || index == 0) {
+        return nullptr;
+    }
+    const char *pos = result.ptr;
+    while (pos != last && !isBlank(*pos)) {
+        if (*pos != '/' && *pos != '-' && (*pos < '0' || *pos > '9')) {
+            return nullptr;
+        }
+        ++pos;
+    }
+    return pos;
+}
+
+// the vertices, normals and triangles parsed from a chunk of the file, the relative
+// (negative) indexes of the faces are stored from the first vertex of the chunk
+struct Chunk {
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<qint64> indexes;
+    // the positions of the relative indexes
+    std::vector<size_t> relative;
+    // the corners of the face that is being parsed (index and relative)
+    std::vector<std::pair<qint64, bool>> face;
+};
+
+// parses a line of the OBJ file, returns false if the line is not valid
+// only the vertices, normals and faces are parsed (the rest of the lines are ignored)
+bool parseLine(const char *first, const char *last, Chunk &chunk)
+{
+    first = skipBlanks(first, last);
+    if (first == last || *first == '#') {
+        return true;
+    }
+    const char *keyword_end = first;
+    while (keyword_end != last && !isBlank(*keyword_end)) {
+        ++keyword_end;
+    }
+    const long keyword_size = keyword_end - first;
+
+    if ((keyword_size == 1 && first[0] == 'v')
+            || (keyword_size == 2 && first[0] == 'v' && first[1] == 'n')) {
+        std::vector<float> &values = keyword_size == 1 ? chunk.vertices : chunk.normals;
+        float x = 0;
+        float y = 0;
+        float z = 0;
+        const char *pos = parseFloat(keyword_end, last, x);
+        pos = pos == nullptr ? nullptr : parseFloat(pos, last, y);
+        pos = pos == nullptr ? nullptr : parseFloat(pos, last, z);
+        if (pos == nullptr) {
+            return false;
+        }
+        values.push_back(x);
+        values.push_back(y);
+        values.push_back(z);
+    } else if (keyword_size == 1 && first[0] == 'f') {
+        const qint64 n_local = static_cast<qint64>(chunk.vertices.size() / 3);
+        chunk.face.clear();
+        const char *pos = skipBlanks(keyword_end, last);
+        while (pos != last) {
+            qint64 index = 0;
+            pos = parseIndex(pos, last, index);
+            if (pos == nullptr) {
+                return false;
+            }
+            chunk.face.emplace_back(index > 0 ? index - 1 : n_local + index, index < 0);
+            pos = skipBlanks(pos, last);
+        }
+        if (chunk.face.size() < 3) {
+            return false;
+        }
+        // the polygons are split in triangles (fan)
+        const auto append = [&chunk](const std::pair<qint64, bool> &corner) {
+            if (corner.second) {
+                chunk.relative.push_back(chunk.indexes.size());
+            }
+            chunk.indexes.push_back(corner.first);
+        };
+        for (size_t i = 1; i + 1 < chunk.face.size(); ++i) {
+            append(chunk.face[0]);
+            append(chunk.face[i]);
+            append(chunk.face[i + 1]);
+        }
+    }
+    return true;
+}
+
+// a symmetric 4x4 matrix (its upper triangle) that measures the sum of the squared
+// distances of a position to a set of planes
+struct Quadric {
+    std::array<double, 10> q{};
+
+    void addPlane(const double a, const double b, const double c, const double d,
+                  const double weight)
+    {
+        q[0] += weight * a * a;
+        q[1] += weight * a * b;
+        q[2] += weight * a * c;
+        q[3] += weight * a * d;
+        q[4] += weight * b * b;
+        q[5] += weight * b * c;
+        q[6] += weight * b * d;
+        q[7] += weight * c * c;
+        q[8] += weight * c * d;
+        q[9] += weight * d * d;
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    {
+        for (size_t i = 0; i < q.size(); ++i) {
+            q[i] += other.q[i];
+        }
+        return *this;
+    }
+
+    double error(const QVector3D &position) const
+    {
+        const double x = position.x();
+        const double y = position.y();
+        const double z = position.z();
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+                + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+                + q[7] * z * z + 2 * q[8] * z
+                + q[9];
+    }
+};
+
+// simplifies a triangle mesh collapsing its edges into one of their vertices
+// in order of the quadric error of the collapses (the vertices are not moved)
+class Simplifier
+{
+
+public:
+
+    Simplifier(const QVector<QVector3D> &vertices, const QVector<quint32> &indexes);
+
+    // collapses edges until the mesh has at most n_triangles triangles
+    // (or no more edges can be collapsed)
+    void simplify(const int n_triangles);
+
+    // the number of triangles of the mesh
+    int triangles() const;
+
+    // the indexes of the vertices of the triangles of the mesh
+    QVector<quint32> indexes() const;
+
+private:
+
+    // the collapse of the vertex from into the vertex to, the collapse is
+    // outdated if the versions of the vertices have changed
+    struct Collapse {
+        double error;
+        int from;
+        int to;
+        quint32 from_version;
+        quint32 to_version;
+
+        bool operator>(const Collapse &other) const
+        {
+            return error > other.error;
+        }
+    };
+
+    // adds the collapse of the edge (in the direction with the lowest error)
+    void addCollapse(const int u, const int v);
+
+    // true if the collapse keeps the mesh manifold and does not fold any triangle
+    bool isValid(const int from, const int to);
+
+    void collapse(const int from, const int to);
+
+    // the vertices connected to the vertex (sorted)
+    void neighbors(const int vertex, std::vector<int> &result) const;
+
+    bool contains(const int triangle, const int vertex) const;
+
+    // the positions are centered in the mesh so the quadrics are precise
+    std::vector<QVector3D> m_positions;
+    std::vector<std::array<int, 3>> m_triangles;
+    // the (unit) normals of the triangles in the original mesh
+    std::vector<QVector3D> m_normals;
+    std::vector<char> m_removed_triangles;
+    std::vector<std::vector<int>> m_vertex_triangles;
+    std::vector<Quadric> m_quadrics;
+    std::vector<quint32> m_versions;
+    std::vector<char> m_removed;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+    int m_n_triangles;
+    std::vector<int> m_from_neighbors;
+    std::vector<int> m_to_neighbors;
+};
+
+Simplifier::Simplifier(const QVector<QVector3D> &vertices, const QVector<quint32> &indexes)
+    : m_positions(vertices.size())
+    , m_triangles(indexes.size() / 3)
+    , m_normals(indexes.size() / 3)
+    , m_removed_triangles(indexes.size() / 3, 0)
+    , m_vertex_triangles(vertices.size())
+    , m_quadrics(vertices.size())
+    , m_versions(vertices.size(), 0)
+    , m_removed(vertices.size(), 0)
+    , m_queue()
+    , m_n_triangles(0)
+{
+    QVector3D center;
+    for (const QVector3D &vertex : vertices) {
+        center += vertex / vertices.size();
+    }
+    for (int i = 0; i < vertices.size(); ++i) {
+        m_positions[i] = vertices.at(i) - center;
+    }
+
+    // the quadrics of the vertices are the planes of their triangles (weighted by area)
+    // the edges are stored by their vertices (sorted) with one of their triangles
+    std::vector<std::pair<quint64, int>> edges;
+    edges.reserve(indexes.size());
+    const int n_triangles = static_cast<int>(m_triangles.size());
+    for (int t = 0; t < n_triangles; ++t) {
+        auto &triangle = m_triangles[t];
+        triangle = {static_cast<int>(indexes.at(3 * t)), static_cast<int>(indexes.at(3 * t + 1)),
+                    static_cast<int>(indexes.at(3 * t + 2))};
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2]
+                || triangle[0] == triangle[2]) {
+            m_removed_triangles[t] = 1;
+            continue;
+        }
+        ++m_n_triangles;
+        const QVector3D &p0 = m_positions[triangle[0]];
+        const QVector3D normal = QVector3D::crossProduct(m_positions[triangle[1]] - p0,
+                                                         m_positions[triangle[2]] - p0);
+        const double length = normal.length();
+        m_normals[t] = normal.normalized();
+        for (int k = 0; k < 3; ++k) {
+            const int u = triangle[k];
+            const int v = triangle[(k + 1) % 3];
+            m_vertex_triangles[u].push_back(t);
+            edges.emplace_back((static_cast<quint64>(std::min(u, v)) << 32)
+                               | static_cast<quint64>(std::max(u, v)), t);
+            if (length > 0) {
+                const QVector3D n = normal / length;
+                m_quadrics[u].addPlane(n.x(), n.y(), n.z(), -QVector3D::dotProduct(n, p0),
+                                       length / 2);
+            }
+        }
+    }
+
+    // the edges of one triangle are on the boundary, they are kept in place with
+    // planes perpendicular to their triangles
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j].first == edges[i].first) {
+            ++j;
+        }
+        const int u = static_cast<int>(edges[i].first >> 32);
+        const int v = static_cast<int>(edges[i].first & 0xffffffffu);
+        if (j - i == 1) {
+            const auto &triangle = m_triangles[edges[i].second];
+            const QVector3D &p0 = m_positions[triangle[0]];
+            const QVector3D normal = QVector3D::crossProduct(m_positions[triangle[1]] - p0,
+                                                             m_positions[triangle[2]] - p0);
+            const QVector3D edge = m_positions[v] - m_positions[u];
+            const QVector3D n = QVector3D::crossProduct(edge, normal).normalized();
+            if (!n.isNull()) {
+                const double d = -QVector3D::dotProduct(n, m_positions[u]);
+                const double weight = BOUNDARY_WEIGHT * edge.lengthSquared();
+                m_quadrics[u].addPlane(n.x(), n.y(), n.z(), d, weight);
+                m_quadrics[v].addPlane(n.x(), n.y(), n.z(), d, weight);
+            }
+        }
+        addCollapse(u, v);
+        i = j;
+    }
+}
+
+void Simplifier::simplify(const int n_triangles)
+{
+    while (m_n_triangles > n_triangles && !m_queue.empty()) {
+        const Collapse next = m_queue.top();
+        m_queue.pop();
+        if (m_removed[next.from] || m_removed[next.to]
+                || m_versions[next.from] != next.from_version
+                || m_versions[next.to] != next.to_version
+                || !isValid(next.from, next.to)) {
+            continue;
+        }
+        collapse(next.from, next.to);
+    }
+}
+
+int Simplifier::triangles() const
+{
+    return m_n_triangles;
+}
+
+QVector<quint32> Simplifier::indexes() const
+{
+    QVector<quint32> indexes;
+    indexes.reserve(3 * m_n_triangles);
+    for (size_t t = 0; t < m_triangles.size(); ++t) {
+        if (!m_removed_triangles[t]) {
+            for (const int vertex : m_triangles[t]) {
+                indexes.append(static_cast<quint32>(vertex));
+            }
+        }
+    }
+    return indexes;
+}
+
+void Simplifier::addCollapse(const int u, const int v)
+{
+    Quadric quadric = m_quadrics[u];
+    quadric += m_quadrics[v];
+    const double error_v = quadric.error(m_positions[v]);
+    const double error_u = quadric.error(m_positions[u]);
+    if (error_v <= error_u) {
+        m_queue.push({error_v, u, v, m_versions[u], m_versions[v]});
+    } else {
+        m_queue.push({error_u, v, u, m_versions[v], m_versions[u]});
+    }
+}
+
+bool Simplifier::isValid(const int from, const int to)
+{
+    // the vertices connected to both vertices must be the vertices opposite to the edge
+    // (one for each triangle of the edge), otherwise the mesh would not be manifold
+    int shared_triangles = 0;
+    for (const int t : m_vertex_triangles[from]) {
+        if (!m_removed_triangles[t] && contains(t, to)) {
+            ++shared_triangles;
+        }
+    }
+    if (shared_triangles == 0) {
+        return false;
+    }
+    neighbors(from, m_from_neighbors);
+    neighbors(to, m_to_neighbors);
+    std::vector<int> common;
+    std::set_intersection(m_from_neighbors.begin(), m_from_neighbors.end(),
+                          m_to_neighbors.begin(), m_to_neighbors.end(),
+                          std::back_inserter(common));
+    if (static_cast<int>(common.size()) != shared_triangles) {
+        return false;
+    }
+
+    // the triangles that are kept must not be folded or become degenerate, their normals
+    // are compared with the current ones and the original ones (so the small rotations
+    // of the collapses do not add up to a fold)
+    for (const int t : m_vertex_triangles[from]) {
+        if (m_removed_triangles[t] || contains(t, to)) {
+            continue;
+        }
+        std::array<QVector3D, 3> before;
+        std::array<QVector3D, 3> after;
+        for (int k = 0; k < 3; ++k) {
+            const int vertex = m_triangles[t][k];
+            before[k] = m_positions[vertex];
+            after[k] = m_positions[vertex == from ? to : vertex];
+        }
+        const QVector3D normal_before = QVector3D::crossProduct(before[1] - before[0],
+                                                                before[2] - before[0]);
+        const QVector3D normal_after = QVector3D::crossProduct(after[1] - after[0],
+                                                               after[2] - after[0]);
+        const double length = normal_after.length();
+        if (length == 0 || QVector3D::dotProduct(normal_before, normal_after)
+                < MIN_NORMAL_COSINE * normal_before.length() * length
+                || QVector3D::dotProduct(m_normals[t], normal_after) < MIN_NORMAL_COSINE * length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Simplifier::collapse(const int from, const int to)
+{
+    m_quadrics[to] += m_quadrics[from];
+    m_removed[from] = 1;
+    for (const int t : m_vertex_triangles[from]) {
+        if (m_removed_triangles[t]) {
+            continue;
+        }
+        if (contains(t, to)) {
+            m_removed_triangles[t] = 1;
+            --m_n_triangles;
+        } else {
+            std::replace(m_triangles[t].begin(), m_triangles[t].end(), from, to);
+            m_vertex_triangles[to].push_back(t);
+        }
+    }
+    std::vector<int>().swap(m_vertex_triangles[from]);
+    auto &triangles = m_vertex_triangles[to];
+    triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [this](const int t) {
+        return m_removed_triangles[t] != 0;
+    }), triangles.end());
+
+    // the errors of the collapses of the edges of the vertex have changed
+    ++m_versions[to];
+    neighbors(to, m_to_neighbors);
+    for (const int neighbor : m_to_neighbors) {
+        addCollapse(to, neighbor);
+    }
+}
+
+void Simplifier::neighbors(const int vertex, std::vector<int> &result) const
+{
+    result.clear();
+    for (const int t : m_vertex_triangles[vertex]) {
+        if (m_removed_triangles[t]) {
+            continue;
+        }
+        for (const int other : m_triangles[t]) {
+            if (other != vertex) {
+                result.push_back(other);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+bool Simplifier::contains(const int triangle, const int vertex) const
+{
+    const auto &vertices = m_triangles[triangle];
+    return vertices[0] == vertex || vertices[1] == vertex || vertices[2] == vertex;
+}
+
+}
+
+MeshLevels::MeshLevels()
+    : m_vertices()
+    , m_normals()
+    , m_levels()
+    , m_min()
+    , m_max()
+{
+}
+
+MeshLevels::~MeshLevels()
+{
+}
+
+void MeshLevels::open(const QString &filename, LoadingProgress *progress)
+{
+    clear();
+
+    // the mesh is read from the cache if the file has been opened before
+    LoadingProgress::update(progress, LoadingProgress::LoadMesh, 0.0);
+    if (readCache(filename)) {
+        computeBounds();
+        LoadingProgress::update(progress, LoadingProgress::LoadMesh, 1.0);
+        return;
+    }
+    clear();
+
+    // the mapping is released when the file is closed
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Could not open the mesh file");
+    }
+    if (file.size() <= 0) {
+        throw std::runtime_error("The mesh file does not contain a valid mesh");
+    }
+    const uchar *mapped = file.map(0, file.size());
+    if (mapped == nullptr) {
+        throw std::runtime_error("Could not map the mesh file in memory");
+    }
+    const char *begin = reinterpret_cast<const char *>(mapped);
+    parse(begin, begin + file.size(), progress);
+    qDebug() << "Loaded mesh with " << m_vertices.size() << " vertices and "
+             << m_levels.front().indexes.size() / 3 << " triangles in "
+             << m_levels.size() << " levels";
+
+    writeCache(filename);
+    LoadingProgress::update(progress, LoadingProgress::LoadMesh, 1.0);
+}
+
+void MeshLevels::parse(const char *begin, const char *end, LoadingProgress *progress)
+{
+    clear();
+
+    // the lines of the chunks are parsed in parallel
+    const size_t max_chunks = static_cast<size_t>(omp_get_max_threads()) * 8;
+    const std::vector<const char *> boundaries = splitChunks(begin, end, max_chunks);
+    const size_t n_chunks = boundaries.size() - 1;
+    std::vector<Chunk> chunks(n_chunks);
+    std::atomic<bool> parsed(true);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < n_chunks; ++c) {
+        const char *first = boundaries[c];
+        const char *last = boundaries[c + 1];
+        while (first < last && parsed) {
+            const char *eol = lineEnd(first, last);
+            if (!parseLine(first, eol, chunks[c])) {
+                parsed = false;
+            }
+            if (eol == last) {
+                break;
+            }
+            first = eol + 1;
+        }
+    }
+    if (!parsed) {
+        throw std::runtime_error("The mesh file contains lines that are not valid");
+    }
+
+    // the positions of the vertices, normals and indexes of each chunk in the mesh
+    std::vector<qint64> vertex_offsets(n_chunks + 1, 0);
+    std::vector<qint64> normal_offsets(n_chunks + 1, 0);
+    std::vector<qint64> index_offsets(n_chunks + 1, 0);
+    for (size_t c = 0; c < n_chunks; ++c) {
+        vertex_offsets[c + 1] = vertex_offsets[c] + chunks[c].vertices.size() / 3;
+        normal_offsets[c + 1] = normal_offsets[c] + chunks[c].normals.size() / 3;
+        index_offsets[c + 1] = index_offsets[c] + chunks[c].indexes.size();
+    }
+    const qint64 n_vertices = vertex_offsets.back();
+    const qint64 n_normals = normal_offsets.back();
+    const qint64 n_indexes = index_offsets.back();
+    if (n_vertices == 0 || n_indexes == 0) {
+        throw std::runtime_error("The mesh file does not contain a valid mesh");
+    }
+    if (n_vertices > std::numeric_limits<int>::max() / 3
+            || n_indexes > std::numeric_limits<int>::max()) {
+        throw std::runtime_error("The mesh file is too large");
+    }
+
+    // the vertex normals of the file are used if there is one for each vertex
+    const bool has_normals = n_normals == n_vertices;
+    m_vertices.resize(static_cast<int>(n_vertices));
+    m_normals.resize(has_normals ? static_cast<int>(n_normals) : 0);
+    QVector<quint32> indexes(static_cast<int>(n_indexes));
+    QVector3D *vertices = m_vertices.data();
+    QVector3D *normals = m_normals.data();
+    quint32 *triangles = indexes.data();
+    std::atomic<bool> valid(true);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < n_chunks; ++c) {
+        Chunk &chunk = chunks[c];
+        std::memcpy(vertices + vertex_offsets[c], chunk.vertices.data(),
+                    chunk.vertices.size() * sizeof(float));
+        if (has_normals) {
+            std::memcpy(normals + normal_offsets[c], chunk.normals.data(),
+                        chunk.normals.size() * sizeof(float));
+        }
+        for (const size_t position : chunk.relative) {
+            chunk.indexes[position] += vertex_offsets[c];
+        }
+        for (size_t i = 0; i < chunk.indexes.size(); ++i) {
+            const qint64 index = chunk.indexes[i];
+            if (index < 0 || index >= n_vertices) {
+                valid = false;
+            }
+            triangles[index_offsets[c] + i] = static_cast<quint32>(index);
+        }
+        chunk = Chunk();
+    }
+    if (!valid) {
+        throw std::runtime_error("The mesh file contains faces with vertices that are not valid");
+    }
+    LoadingProgress::update(progress, LoadingProgress::LoadMesh, 0.25);
+
+    Level level;
+    level.indexes = indexes;
+    m_levels.append(level);
+    if (!has_normals) {
+        computeNormals();
+    }
+    createLevels(progress);
+    computeBounds();
+}
+
+void MeshLevels::clear()
+{
+    m_vertices.clear();
+    m_normals.clear();
+    m_levels.clear();
+    m_min = QVector3D();
+    m_max = QVector3D();
+}
+
+bool MeshLevels::isEmpty() const
+{
+    return m_levels.isEmpty();
+}
+
+const QVector<QVector3D> &MeshLevels::vertices() const
+{
+    return m_vertices;
+}
+
+const QVector<QVector3D> &MeshLevels::normals() const
+{
+    return m_normals;
+}
+
+int MeshLevels::levels() const
+{
+    return m_levels.size();
+}
+
+const MeshLevels::Level &MeshLevels::level(const int level) const
+{
+    Q_ASSERT(level >= 0 && level < m_levels.size());
+    return m_levels.at(level);
+}
+
+QVector3D MeshLevels::min() const
+{
+    return m_min;
+}
+
+QVector3D MeshLevels::max() const
+{
+    return m_max;
+}
+
+int MeshLevels::levelForDistance(const double distance, const double pixel_scale) const
+{
+    int level = 0;
+    for (int l = 1; l < m_levels.size(); ++l) {
+        if (distance <= 0
+                || m_levels.at(l).edge_length * pixel_scale / distance > MAX_EDGE_PIXELS) {
+            break;
+        }
+        level = l;
+    }
+    return level;
+}
+
+void MeshLevels::createLevels(LoadingProgress *progress)
+{
+    // every level has (at most) a quarter of the triangles of the previous level
+    const int n_triangles = m_levels.front().indexes.size() / 3;
+    if (n_triangles / 4 < MIN_LEVEL_TRIANGLES) {
+        return;
+    }
+    Simplifier simplifier(m_vertices, m_levels.front().indexes);
+    while (m_levels.size() < MAX_LEVELS) {
+        const int previous = m_levels.back().indexes.size() / 3;
+        const int target = previous / 4;
+        if (target < MIN_LEVEL_TRIANGLES) {
+            break;
+        }
+        simplifier.simplify(target);
+        if (simplifier.triangles() > previous * MAX_LEVEL_FRACTION) {
+            break;
+        }
+        Level level;
+        level.indexes = simplifier.indexes();
+        m_levels.append(level);
+        LoadingProgress::update(progress, LoadingProgress::LoadMesh,
+                                0.25 + 0.75 * m_levels.size() / MAX_LEVELS);
+    }
+}
+
+void MeshLevels::computeNormals()
+{
+    // the normals of the triangles (their length is twice their area) are added to their vertices
+    m_normals.fill(QVector3D(), m_vertices.size());
+    const QVector<quint32> &indexes = m_levels.front().indexes;
+    for (int i = 0; i + 2 < indexes.size(); i += 3) {
+        const QVector3D &p0 = m_vertices.at(indexes.at(i));
+        const QVector3D normal = QVector3D::crossProduct(m_vertices.at(indexes.at(i + 1)) - p0,
+                                                         m_vertices.at(indexes.at(i + 2)) - p0);
+        m_normals[indexes.at(i)] += normal;
+        m_normals[indexes.at(i + 1)] += normal;
+        m_normals[indexes.at(i + 2)] += normal;
+    }
+    QVector3D *normals = m_normals.data();
+    const int n_normals = m_normals.size();
+    #pragma omp parallel for
+    for (int i = 0; i < n_normals; ++i) {
+        normals[i].normalize();
+    }
+}
+
+void MeshLevels::computeBounds()
+{
+    if (m_vertices.isEmpty()) {
+        return;
+    }
+    m_min = m_vertices.front();
+    m_max = m_vertices.front();
+    for (const QVector3D &vertex : m_vertices) {
+        m_min = QVector3D(std::min(m_min.x(), vertex.x()), std::min(m_min.y(), vertex.y()),
+                          std::min(m_min.z(), vertex.z()));
+        m_max = QVector3D(std::max(m_max.x(), vertex.x()), std::max(m_max.y(), vertex.y()),
+                          std::max(m_max.z(), vertex.z()));
+    }
+
+    for (Level &level : m_levels) {
+        const QVector<quint32> &indexes = level.indexes;
+        const int n_triangles = indexes.size() / 3;
+        double total = 0.0;
+        #pragma omp parallel for reduction(+:total)
+        for (int t = 0; t < n_triangles; ++t) {
+            const QVector3D &p0 = m_vertices.at(indexes.at(3 * t));
+            const QVector3D &p1 = m_vertices.at(indexes.at(3 * t + 1));
+            const QVector3D &p2 = m_vertices.at(indexes.at(3 * t + 2));
+            total += (p0.distanceToPoint(p1) + p1.distanceToPoint(p2) + p2.distanceToPoint(p0)) / 3;
+        }
+        level.edge_length = n_triangles > 0 ? static_cast<float>(total / n_triangles) : 0.0f;
+    }
+}
+
+bool MeshLevels::readCache(const QString &filename)
+{
+    QFile file(cacheFile(filename));
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 file_size = file.size();
+    if (file_size < static_cast<qint64>(sizeof(Header))) {
+        qDebug() << "The mesh cache " << file.fileName() << " is not valid";
+        return false;
+    }
+    // the mapping is released when the file is closed
+    const uchar *mapped = file.map(0, file_size);
+    if (mapped == nullptr) {
+        qDebug() << "Could not map the mesh cache " << file.fileName();
+        return false;
+    }
+
+    // check that the cache is valid and up to date with the mesh file
+    Header header;
+    std::memcpy(&header, mapped, sizeof(Header));
+    Header mesh;
+    meshInfo(filename, mesh);
+    const quint64 max_elements = static_cast<quint64>(file_size);
+    bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+            && header.version == VERSION
+            && header.n_levels >= 1 && header.n_levels <= MAX_LEVELS
+            && header.n_vertices > 0 && header.n_vertices <= max_elements;
+    quint64 expected_size = sizeof(Header) + 2 * header.n_vertices * sizeof(QVector3D);
+    for (quint32 l = 0; valid && l < header.n_levels; ++l) {
+        valid = header.level_sizes[l] <= max_elements && header.level_sizes[l] % 3 == 0;
+        expected_size += header.level_sizes[l] * sizeof(quint32);
+    }
+    if (!valid || expected_size != static_cast<quint64>(file_size)) {
+        qDebug() << "The mesh cache " << file.fileName() << " is not valid";
+        return false;
+    }
+    if (header.mesh_size != mesh.mesh_size || header.mesh_mtime != mesh.mesh_mtime) {
+        qDebug() << "The mesh cache " << file.fileName() << " is outdated";
+        return false;
+    }
+
+    const int n_vertices = static_cast<int>(header.n_vertices);
+    const uchar *pos = mapped + sizeof(Header);
+    m_vertices.resize(n_vertices);
+    std::memcpy(m_vertices.data(), pos, n_vertices * sizeof(QVector3D));
+    pos += n_vertices * sizeof(QVector3D);
+    m_normals.resize(n_vertices);
+    std::memcpy(m_normals.data(), pos, n_vertices * sizeof(QVector3D));
+    pos += n_vertices * sizeof(QVector3D);
+    for (quint32 l = 0; l < header.n_levels; ++l) {
+        Level level;
+        level.indexes.resize(static_cast<int>(header.level_sizes[l]));
+        std::memcpy(level.indexes.data(), pos, level.indexes.size() * sizeof(quint32));
+        pos += level.indexes.size() * sizeof(quint32);
+        if (!std::all_of(level.indexes.cbegin(), level.indexes.cend(),
+                         [n_vertices](const quint32 index) {
+                             return index < static_cast<quint32>(n_vertices);
+                         })) {
+            qDebug() << "The mesh cache " << file.fileName() << " is not valid";
+            clear();
+            return false;
+        }
+        m_levels.append(level);
+    }
+
+    qDebug() << "Loaded mesh from the mesh cache " << file.fileName();
+    return true;
+}
+
+bool MeshLevels::writeCache(const QString &filename) const
+{
+    if (!QDir().mkpath(DatasetCache::directory())) {
+        qDebug() << "Could not create the cache directory " << DatasetCache::directory();
+        return false;
+    }
+    Q_ASSERT(m_normals.size() == m_vertices.size());
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.n_levels = m_levels.size();
+    header.n_vertices = m_vertices.size();
+    for (int l = 0; l < m_levels.size(); ++l) {
+        header.level_sizes[l] = m_levels.at(l).indexes.size();
+    }
+    meshInfo(filename, header);
+
+    // the file is written to a temporary file that replaces the cache file when committed
+    QSaveFile file(cacheFile(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Could not create the mesh cache " << file.fileName();
+        return false;
+    }
+    const auto write = [&file](const void *data, const qint64 size) {
+        return file.write(static_cast<const char *>(data), size) == size;
+    };
+    const qint64 vertices_size = m_vertices.size() * sizeof(QVector3D);
+    bool written = write(&header, sizeof(Header))
+            && write(m_vertices.constData(), vertices_size)
+            && write(m_normals.constData(), vertices_size);
+    for (const Level &level : m_levels) {
+        written = written && write(level.indexes.constData(),
+                                   level.indexes.size() * sizeof(quint32));
+    }
+    if (!written) {
+        qDebug() << "Could not write the mesh cache " << file.fileName();
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
@@ -0,0 +1,100 @@
+#ifndef MESHLEVELS_H
+#define MESHLEVELS_H
+
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+
+class LoadingProgress;
+
+// MeshLevels stores the 3D mesh of the tissue (OBJ file) with several levels of detail,
+// the level 0 has all the triangles of the mesh and every level has about a quarter of
+// the triangles of the previous one. The levels are simplified with quadric error metrics
+// collapsing the edges of the mesh into one of their vertices, so all the levels share
+// the vertices (and normals) of the mesh and only their triangles change. The renderer
+// picks the coarsest level whose edges are still small on the screen.
+// The OBJ file is memory-mapped and its lines are parsed in parallel. The mesh and its
+// levels are stored in a mesh cache the first time the file is opened, the next times
+// the cache is read instead (the mesh is not parsed and simplified again). A cache is
+// valid while the size and the modification time of the mesh file do not change.
+class MeshLevels
+{
+
+public:
+
+    // the maximum number of levels (including the full mesh)
+    static constexpr int MAX_LEVELS = 5;
+
+    // the meshes with less triangles than this are not simplified further
+    static constexpr int MIN_LEVEL_TRIANGLES = 2048;
+
+    // the coarsest level whose (mean) edges are not larger than these pixels is rendered
+    static constexpr double MAX_EDGE_PIXELS = 4.0;
+
+    // a level of the mesh, the indexes of the vertices of its triangles
+    struct Level {
+        QVector<quint32> indexes;
+        // the mean length of the edges of the triangles
+        float edge_length = 0.0f;
+    };
+
+    MeshLevels();
+    ~MeshLevels();
+
+    // parses the mesh file (or reads its mesh cache) and creates the levels
+    // the progress is reported to progress (if given) as LoadMesh
+    // it throws exceptions when errors happen during parsing
+    void open(const QString &filename, LoadingProgress *progress = nullptr);
+
+    // parses an OBJ mesh (in-memory buffer) and creates the levels
+    // it throws exceptions when errors happen during parsing
+    void parse(const char *begin, const char *end, LoadingProgress *progress = nullptr);
+
+    void clear();
+    bool isEmpty() const;
+
+    // the vertices and (vertex) normals shared by all the levels
+    const QVector<QVector3D> &vertices() const;
+    const QVector<QVector3D> &normals() const;
+
+    // the number of levels
+    int levels() const;
+    const Level &level(const int level) const;
+
+    // the bounding box of the vertices
+    QVector3D min() const;
+    QVector3D max() const;
+
+    // the level to render when the mesh is at the distance of the camera and one unit at
+    // distance 1 covers pixel_scale pixels of the screen (the coarsest level whose edges
+    // are not larger than MAX_EDGE_PIXELS)
+    int levelForDistance(const double distance, const double pixel_scale) const;
+
+private:
+
+    // creates the levels (from the level 0) simplifying the mesh
+    void createLevels(LoadingProgress *progress);
+
+    // computes the normals of the vertices (weighted by the area of the triangles)
+    void computeNormals();
+
+    // computes the bounding box and the edge lengths of the levels
+    void computeBounds();
+
+    // reads the mesh cache of the mesh file
+    // returns false if there is no cache for the file or it is outdated or not valid
+    bool readCache(const QString &filename);
+
+    // writes the mesh and the levels to the mesh cache of the mesh file
+    bool writeCache(const QString &filename) const;
+
+    QVector<QVector3D> m_vertices;
+    QVector<QVector3D> m_normals;
+    QVector<Level> m_levels;
+    QVector3D m_min;
+    QVector3D m_max;
+
+    Q_DISABLE_COPY(MeshLevels)
+};
+
+#endif // MESHLEVELS_H
@@ -0,0 +1,358 @@
+#include "PointOctree.h"
+
+#include <QVector4D>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// true if the rects do not overlap (the rects can be empty, e.g. the rect of one point)
+bool disjoint(const QRectF &a, const QRectF &b)
+{
+    return a.right() < b.left() || b.right() < a.left()
+            || a.bottom() < b.top() || b.bottom() < a.top();
+}
+
+}
+
+bool PointOctree::Node::isLeaf() const
+{
+    return std::all_of(children.begin(), children.end(), [](const int child) {
+        return child == -1;
+    });
+}
+
+PointOctree::PointOctree()
+    : m_nodes()
+    , m_order()
+{
+}
+
+PointOctree::~PointOctree()
+{
+}
+
+void PointOctree::build(const QVector<QVector3D> &points)
+{
+    clear();
+    if (points.isEmpty()) {
+        return;
+    }
+    m_order.resize(points.size());
+    for (int i = 0; i < points.size(); ++i) {
+        m_order[i] = i;
+    }
+    createNode(points, 0, points.size(), 0);
+}
+
+void PointOctree::clear()
+{
+    m_nodes.clear();
+    m_order.clear();
+}
+
+bool PointOctree::isEmpty() const
+{
+    return m_nodes.empty();
+}
+
+int PointOctree::createNode(const QVector<QVector3D> &points, const int begin, const int end,
+                            const int depth)
+{
+    const int node_index = static_cast<int>(m_nodes.size());
+    m_nodes.push_back(Node());
+    Node node;
+    node.children.fill(-1);
+    node.begin = begin;
+    node.end = end;
+    node.min = points.at(m_order[begin]);
+    node.max = node.min;
+    for (int i = begin; i < end; ++i) {
+        const QVector3D &point = points.at(m_order[i]);
+        node.min = QVector3D(std::min(node.min.x(), point.x()),
+                             std::min(node.min.y(), point.y()),
+                             std::min(node.min.z(), point.z()));
+        node.max = QVector3D(std::max(node.max.x(), point.x()),
+                             std::max(node.max.y(), point.y()),
+                             std::max(node.max.z(), point.z()));
+    }
+
+    if (end - begin > LEAF_SIZE && depth < MAX_DEPTH && node.min != node.max) {
+        // split the points in the octants of the center of the node (counting sort)
+        const QVector3D center = (node.min + node.max) / 2.0f;
+        const auto octant = [&](const int point_index) {
+            const QVector3D &point = points.at(point_index);
+            return (point.x() > center.x() ? 1 : 0)
+                    | (point.y() > center.y() ? 2 : 0)
+                    | (point.z() > center.z() ? 4 : 0);
+        };
+        std::array<int, 9> offsets;
+        offsets.fill(0);
+        for (int i = begin; i < end; ++i) {
+            ++offsets[octant(m_order[i]) + 1];
+        }
+        for (int k = 0; k < 8; ++k) {
+            offsets[k + 1] += offsets[k];
+        }
+        std::array<int, 8> next;
+        std::copy(offsets.begin(), offsets.begin() + 8, next.begin());
+        std::vector<int> sorted(end - begin);
+        for (int i = begin; i < end; ++i) {
+            sorted[next[octant(m_order[i])]++] = m_order[i];
+        }
+        std::copy(sorted.begin(), sorted.end(), m_order.begin() + begin);
+        for (int k = 0; k < 8; ++k) {
+            if (offsets[k + 1] > offsets[k]) {
+                node.children[k] = createNode(points, begin + offsets[k], begin + offsets[k + 1],
+                                              depth + 1);
+            }
+        }
+    }
+    m_nodes[node_index] = node;
+    return node_index;
+}
+
+QVector<quint32> PointOctree::computeIndexes(const std::function<bool(int)> &visible,
+                                             NodeRanges &ranges) const
+{
+    QVector<quint32> indexes;
+    ranges.visible.assign(m_nodes.size(), Range(0, 0));
+    ranges.sample.assign(m_nodes.size(), Range(0, 0));
+    if (m_nodes.empty()) {
+        return indexes;
+    }
+    indexes.reserve(static_cast<int>(m_order.size()));
+    appendVisible(0, visible, indexes, ranges);
+
+    // the representative sample of the nodes with more visible points than the sample
+    // (evenly spaced points of the visible range, so they are spread over the children)
+    for (size_t n = 0; n < m_nodes.size(); ++n) {
+        const Range &node_visible = ranges.visible[n];
+        ranges.sample[n] = node_visible;
+        if (node_visible.second > REPRESENTATIVE_POINTS) {
+            ranges.sample[n] = Range(indexes.size(), REPRESENTATIVE_POINTS);
+            for (int k = 0; k < REPRESENTATIVE_POINTS; ++k) {
+                const qint64 offset = static_cast<qint64>(k) * node_visible.second
+                        / REPRESENTATIVE_POINTS;
+                indexes.append(indexes.at(node_visible.first + static_cast<int>(offset)));
+            }
+        }
+    }
+    return indexes;
+}
+
+void PointOctree::appendVisible(const int node_index, const std::function<bool(int)> &visible,
+                                QVector<quint32> &indexes, NodeRanges &ranges) const
+{
+    const int first = indexes.size();
+    const Node &node = m_nodes[node_index];
+    if (node.isLeaf()) {
+        for (int i = node.begin; i < node.end; ++i) {
+            if (visible(m_order[i])) {
+                indexes.append(static_cast<quint32>(m_order[i]));
+            }
+        }
+    } else {
+        // the children are created in the order of their points
+        for (const int child : node.children) {
+            if (child != -1) {
+                appendVisible(child, visible, indexes, ranges);
+            }
+        }
+    }
+    ranges.visible[node_index] = Range(first, indexes.size() - first);
+}
+
+QVector<PointOctree::Range> PointOctree::drawRanges(const NodeRanges &node_ranges,
+                                                    const QMatrix4x4 &mvp,
+                                                    const double pixel_scale,
+                                                    const double point_size) const
+{
+    QVector<Range> ranges;
+    if (m_nodes.empty() || node_ranges.visible.size() != m_nodes.size()) {
+        return ranges;
+    }
+
+    // the nodes smaller (on the screen) than this are drawn with their sample
+    const double sample_pixels = std::sqrt(static_cast<double>(REPRESENTATIVE_POINTS)) * point_size;
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const int node_index = stack.back();
+        const Node &node = m_nodes[node_index];
+        const Range &visible = node_ranges.visible[node_index];
+        stack.pop_back();
+        if (visible.second == 0 || !isInsideFrustum(node, mvp)) {
+            continue;
+        }
+        if (visible.second <= REPRESENTATIVE_POINTS) {
+            ranges.append(visible);
+            continue;
+        }
+        // the size on the screen of the bounding sphere of the node
+        const QVector3D center = (node.min + node.max) / 2.0f;
+        const double radius = (node.max - node.min).length() / 2.0;
+        const double distance = (mvp * QVector4D(center, 1.0f)).w();
+        if (distance > radius && 2.0 * radius * pixel_scale / distance <= sample_pixels) {
+            ranges.append(node_ranges.sample[node_index]);
+            continue;
+        }
+        if (node.isLeaf()) {
+            ranges.append(visible);
+            continue;
+        }
+        // the children are pushed in reverse order so the ranges are mostly sorted
+        for (auto child = node.children.rbegin(); child != node.children.rend(); ++child) {
+            if (*child != -1) {
+                stack.push_back(*child);
+            }
+        }
+    }
+
+    // merge the adjacent ranges (the visible ranges of sibling nodes are contiguous)
+    std::sort(ranges.begin(), ranges.end());
+    QVector<Range> merged;
+    for (const Range &range : ranges) {
+        if (!merged.isEmpty() && merged.last().first + merged.last().second == range.first) {
+            merged.last().second += range.second;
+        } else {
+            merged.append(range);
+        }
+    }
+    return merged;
+}
+
+QVector<int> PointOctree::pointsInside(const QPainterPath &path,
+                                       const QMatrix4x4 &window_mvp,
+                                       const QVector<QVector3D> &points) const
+{
+    QVector<int> inside;
+    if (m_nodes.empty() || path.isEmpty()) {
+        return inside;
+    }
+    const QRectF path_rect = path.boundingRect();
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node &node = m_nodes[stack.back()];
+        stack.pop_back();
+        QRectF rect;
+        const bool projected = projectedRect(node, window_mvp, rect);
+        if (projected && disjoint(rect, path_rect)) {
+            continue;
+        }
+        if (projected && path.contains(rect)) {
+            // all the points of the node are inside
+            for (int i = node.begin; i < node.end; ++i) {
+                inside.append(m_order[i]);
+            }
+        } else if (node.isLeaf()) {
+            for (int i = node.begin; i < node.end; ++i) {
+                const QVector4D point = window_mvp * QVector4D(points.at(m_order[i]), 1.0f);
+                if (point.w() > 0.0f
+                        && path.contains(QPointF(point.x() / point.w(), point.y() / point.w()))) {
+                    inside.append(m_order[i]);
+                }
+            }
+        } else {
+            for (const int child : node.children) {
+                if (child != -1) {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+    return inside;
+}
+
+int PointOctree::nearestPoint(const QPointF &position,
+                              const double radius,
+                              const QMatrix4x4 &window_mvp,
+                              const QVector<QVector3D> &points,
+                              const std::function<bool(int)> &accept) const
+{
+    int nearest = -1;
+    float nearest_depth = 0.0f;
+    if (m_nodes.empty()) {
+        return nearest;
+    }
+    const QRectF pick_rect(position.x() - radius, position.y() - radius, 2 * radius, 2 * radius);
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const Node &node = m_nodes[stack.back()];
+        stack.pop_back();
+        QRectF rect;
+        if (projectedRect(node, window_mvp, rect) && disjoint(rect, pick_rect)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            for (int i = node.begin; i < node.end; ++i) {
+                const int point_index = m_order[i];
+                const QVector4D point = window_mvp * QVector4D(points.at(point_index), 1.0f);
+                if (point.w() <= 0.0f || (nearest != -1 && point.w() >= nearest_depth)) {
+                    continue;
+                }
+                const QPointF delta = QPointF(point.x() / point.w(), point.y() / point.w())
+                        - position;
+                if (QPointF::dotProduct(delta, delta) <= radius * radius
+                        && (!accept || accept(point_index))) {
+                    nearest = point_index;
+                    nearest_depth = point.w();
+                }
+            }
+        } else {
+            for (const int child : node.children) {
+                if (child != -1) {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+    return nearest;
+}
+
+bool PointOctree::projectedRect(const Node &node, const QMatrix4x4 &window_mvp,
+                                QRectF &rect) const
+{
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    for (int k = 0; k < 8; ++k) {
+        const QVector4D corner = window_mvp * QVector4D(k & 1 ? node.max.x() : node.min.x(),
+                                                        k & 2 ? node.max.y() : node.min.y(),
+                                                        k & 4 ? node.max.z() : node.min.z(),
+                                                        1.0f);
+        if (corner.w() <= 0.0f) {
+            return false;
+        }
+        min_x = std::min<double>(min_x, corner.x() / corner.w());
+        min_y = std::min<double>(min_y, corner.y() / corner.w());
+        max_x = std::max<double>(max_x, corner.x() / corner.w());
+        max_y = std::max<double>(max_y, corner.y() / corner.w());
+    }
+    rect = QRectF(QPointF(min_x, min_y), QPointF(max_x, max_y));
+    return true;
+}
+
+bool PointOctree::isInsideFrustum(const Node &node, const QMatrix4x4 &mvp) const
+{
+    // the box is outside if all its corners are outside one of the planes of the frustum
+    std::array<QVector4D, 8> corners;
+    for (int k = 0; k < 8; ++k) {
+        corners[k] = mvp * QVector4D(k & 1 ? node.max.x() : node.min.x(),
+                                     k & 2 ? node.max.y() : node.min.y(),
+                                     k & 4 ? node.max.z() : node.min.z(),
+                                     1.0f);
+    }
+    const auto outside = [&](const auto &predicate) {
+        return std::all_of(corners.begin(), corners.end(), predicate);
+    };
+    return !outside([](const QVector4D &c) { return c.x() < -c.w(); })
+            && !outside([](const QVector4D &c) { return c.x() > c.w(); })
+            && !outside([](const QVector4D &c) { return c.y() < -c.w(); })
+            && !outside([](const QVector4D &c) { return c.y() > c.w(); })
+            && !outside([](const QVector4D &c) { return c.z() < -c.w(); })
+            && !outside([](const QVector4D &c) { return c.z() > c.w(); });
+}
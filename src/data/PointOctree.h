@@ -0,0 +1,119 @@
+#ifndef POINTOCTREE_H
+#define POINTOCTREE_H
+
+#include <QMatrix4x4>
+#include <QPainterPath>
+#include <QPair>
+#include <QVector>
+#include <QVector3D>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+// PointOctree is an octree over the points (spots) of a 3D dataset used to draw only
+// the points inside the view frustum with a density that matches their size on the screen.
+// The octree is built once and it gives the indexes of the index (element) buffer of a
+// view: the visible points in the order of the octree (so the points of a node are a
+// contiguous range) followed by a representative sample of the points of each large node.
+// The octree is not modified after it is built so it can be shared by the views, each view
+// keeps the ranges of the nodes in its index buffer (NodeRanges).
+// The nodes that are small on the screen are drawn with their sample instead of all their points
+// The octree is also used to find the points that are projected inside a selection path
+// or near a position of the view (picking) testing only the points of the nodes near them
+class PointOctree
+{
+
+public:
+
+    // the maximum number of points of a leaf
+    static constexpr int LEAF_SIZE = 1024;
+    // the number of representative points of a node
+    static constexpr int REPRESENTATIVE_POINTS = 256;
+    // the maximum depth of the tree (points in the same position are kept in one leaf)
+    static constexpr int MAX_DEPTH = 16;
+
+    // a range of the index buffer (first index and number of indexes)
+    typedef QPair<int, int> Range;
+
+    // the ranges of the nodes (by node index) in the index buffer of a view, the visible
+    // points of each node and its representative sample
+    struct NodeRanges {
+        std::vector<Range> visible;
+        std::vector<Range> sample;
+    };
+
+    PointOctree();
+    ~PointOctree();
+
+    // builds the octree with the points (the index of a point is its position)
+    void build(const QVector<QVector3D> &points);
+    void clear();
+    bool isEmpty() const;
+
+    // computes the indexes of the index buffer with the points accepted by the filter
+    // (the visible points) and the ranges of the nodes in it
+    QVector<quint32> computeIndexes(const std::function<bool(int)> &visible,
+                                    NodeRanges &ranges) const;
+
+    // returns the ranges of the index buffer (with the ranges of the nodes given by
+    // computeIndexes) to draw with the mvp matrix, only the nodes
+    // inside the frustum are drawn and the nodes that are smaller on the screen than
+    // the representative points (with the given size in pixels) are drawn with them
+    // pixel_scale is the size in pixels of one unit at distance one (projection and viewport)
+    QVector<Range> drawRanges(const NodeRanges &ranges,
+                              const QMatrix4x4 &mvp,
+                              const double pixel_scale,
+                              const double point_size) const;
+
+    // returns the indexes of the points (the points the octree was built with) that the
+    // matrix (from the points to the coordinates of the view) projects inside the path
+    // the points behind the camera are not included
+    QVector<int> pointsInside(const QPainterPath &path,
+                              const QMatrix4x4 &window_mvp,
+                              const QVector<QVector3D> &points) const;
+
+    // returns the index of the point nearest to the camera among the points that the matrix
+    // projects within the radius of the position (a ray cast from the position of the view)
+    // only the points accepted by the filter (if given) are considered (-1 if none)
+    int nearestPoint(const QPointF &position,
+                     const double radius,
+                     const QMatrix4x4 &window_mvp,
+                     const QVector<QVector3D> &points,
+                     const std::function<bool(int)> &accept = std::function<bool(int)>()) const;
+
+private:
+
+    struct Node {
+        // the bounding box of the points of the node
+        QVector3D min;
+        QVector3D max;
+        // the indexes of the children (-1 if empty), all -1 for the leaves
+        std::array<int, 8> children;
+        // the points of the node in m_order
+        int begin = 0;
+        int end = 0;
+
+        bool isLeaf() const;
+    };
+
+    // creates the node of the points between begin and end of m_order (and its children)
+    int createNode(const QVector<QVector3D> &points, const int begin, const int end,
+                   const int depth);
+
+    // appends the visible points of the node (and its children) to the indexes
+    void appendVisible(const int node, const std::function<bool(int)> &visible,
+                       QVector<quint32> &indexes, NodeRanges &ranges) const;
+
+    // true if the bounding box of the node is (maybe) inside the frustum of the mvp matrix
+    bool isInsideFrustum(const Node &node, const QMatrix4x4 &mvp) const;
+
+    // the rect of the bounding box of the node projected to the view, false if
+    // the box is not in front of the camera (it cannot be projected)
+    bool projectedRect(const Node &node, const QMatrix4x4 &window_mvp, QRectF &rect) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<int> m_order;
+};
+
+#endif // POINTOCTREE_H
@@ -3,199 +3,653 @@
 #include <QMessageBox>
 #include <QtConcurrent>
 #include "math/Common.h"
+#include "math/SparseMatrix.h"
 #include "color/HeatMap.h"
+#include "data/MatrixParser.h"
+#include "data/MatrixWriter.h"
+#include "data/DatasetCache.h"
+#include "data/HDF5Parser.h"
+#include "data/LoadingProgress.h"
 
 #include <future>
 #include <thread>
+#include <type_traits>
 #include <variant>
-#include <fstream>
-#include <sstream>
 #include <omp.h>
 
 constexpr int ROW = 1;
 constexpr int COLUMN = 0;
 
+static_assert(sizeof(STData::RenderingVertex) == 24,
+              "the vertex of a spot must match the layout of the buffer of the view");
+
 namespace  {
-inline QVector4D fromQtColor(const QColor &color)
+// sets the color (RGBA8), the value and the flags of the vertex of a spot
+inline void setVertex(STData::RenderingVertex &vertex, const QColor &color, const double value,
+                      const bool visible, const bool selected)
 {
-    return QVector4D(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+    vertex.color[0] = static_cast<quint8>(color.red());
+    vertex.color[1] = static_cast<quint8>(color.green());
+    vertex.color[2] = static_cast<quint8>(color.blue());
+    vertex.color[3] = static_cast<quint8>(color.alpha());
+    vertex.value = static_cast<float>(value);
+    vertex.flags = static_cast<quint8>((visible ? STData::Visible : 0)
+                                       | (visible && selected ? STData::Selected : 0));
 }
+
+// creates the vertices of the spots (white and not visible)
+QVector<STData::RenderingVertex> createVertices(const QVector<Spot::SpotType> &coordinates)
+{
+    QVector<STData::RenderingVertex> vertices(coordinates.size());
+    for (int i = 0; i < coordinates.size(); ++i) {
+        vertices[i].x = coordinates.at(i).x();
+        vertices[i].y = coordinates.at(i).y();
+        vertices[i].z = coordinates.at(i).z();
+    }
+    return vertices;
 }
 
+// helper functions that compute the sums and the counts of the rows (spots)
+// and columns (genes) of a data frame with a dense or a sparse matrix of counts
+inline colvec rowSums(const STData::STDataFrame &data)
+{
+    return data.is_sparse ? STMath::rowSums(data.sp_counts) : STMath::rowSums(data.counts);
+}
 
-STData::STData()
-    : m_is3D(false)
+inline rowvec colSums(const STData::STDataFrame &data)
 {
+    return data.is_sparse ? STMath::colSums(data.sp_counts) : STMath::colSums(data.counts);
+}
 
+template <typename Pred>
+inline ucolvec rowCount(const STData::STDataFrame &data, Pred pred)
+{
+    return data.is_sparse ? STMath::rowCount(data.sp_counts, pred) : STMath::rowCount(data.counts, pred);
 }
 
-STData::~STData()
+template <typename Pred>
+inline urowvec colCount(const STData::STDataFrame &data, Pred pred)
 {
+    return data.is_sparse ? STMath::colCount(data.sp_counts, pred) : STMath::colCount(data.counts, pred);
+}
 
+// normalizes the counts of each spot (row) in place
+void normalize(mat &counts, const SettingsWidget::NormalizationMode mode)
+{
+    if (mode == SettingsWidget::REL) {
+        //TODO add a try catch
+        counts.each_col() /= sum(counts, ROW);
+    } else if (mode == SettingsWidget::CPM) {
+        //TODO add a try catch
+        const colvec sums = sum(counts, ROW);
+        const double means = mean(sums);
+        counts = (counts.each_col() / sums) * means;
+    }
 }
 
-STData::STDataFrame STData::read(const QString &filename)
+void normalize(sp_mat &counts, const SettingsWidget::NormalizationMode mode)
 {
-    // open file
-    std::ifstream f(filename.toStdString(), std::ios::in);
-    qDebug() << "Opening ST Data file " << filename;
+    if (mode == SettingsWidget::REL || mode == SettingsWidget::CPM) {
+        // only the non-zero counts are scaled (spots with no counts have no elements)
+        const colvec sums = STMath::rowSums(counts);
+        const double scale = mode == SettingsWidget::CPM ? mean(sums) : 1.0;
+        const colvec factors = scale / sums;
+        counts = STMath::scaleRows(counts, factors);
+    }
+}
 
-    // parse the file and extra spots/genes and values
-    STDataFrame data;
-    std::vector<double> values;
-    unsigned row_number = 0;
-    unsigned col_number = 0;
-    char sep = '\t';
-    bool parsed = true;
-    for (std::string line; std::getline(f, line);) {
-        std::istringstream iss(line);
-        std::string token;
-        col_number = 0;
-        while (std::getline(iss, token, sep)) {
-            if (row_number == 0) {
-                const QString gene = QString::fromStdString(token).trimmed();
-                if (!gene.isNull() && !gene.isEmpty()) {
-                    data.genes.append(gene);
+// applies log(1 + x) to the counts in place
+void logScale(mat &counts)
+{
+    counts = log1p(counts);
+}
+
+void logScale(sp_mat &counts)
+{
+    counts = STMath::transformNonZeros(counts, [](const double value, const uword) {
+        return std::log1p(value);
+    });
+}
+
+// applies the standard transformation to each gene (column) in place
+void zscore(mat &counts)
+{
+    //TODO add a try catch
+    const rowvec means = mean(counts, COLUMN);
+    const rowvec sdev = stddev(counts, 0, COLUMN);
+    counts = (counts.each_row() - means).each_row() / sdev;
+}
+
+// computes the means and the standard deviations (normalized by n - 1) of each gene
+// (column) visiting only the non-zero counts, the zeros of each column add n_zeros * mean^2
+// to the sum of squared deviations
+void columnStats(const sp_mat &counts, rowvec &means, rowvec &sdev)
+{
+    counts.sync();
+    const double n = static_cast<double>(counts.n_rows);
+    means = STMath::colSums(counts) / std::max(n, 1.0);
+    sdev.set_size(counts.n_cols);
+    #pragma omp parallel for
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        const double mean = means[j];
+        const uword first = counts.col_ptrs[j];
+        const uword last = counts.col_ptrs[j + 1];
+        double squares = (n - static_cast<double>(last - first)) * mean * mean;
+        for (uword k = first; k < last; ++k) {
+            const double deviation = counts.values[k] - mean;
+            squares += deviation * deviation;
+        }
+        sdev[j] = n > 1.0 ? std::sqrt(squares / (n - 1.0)) : 0.0;
+    }
+}
+
+// returns the sum of each spot (row) of the standard transformation of the counts
+colvec zscoreSums(const mat &counts)
+{
+    mat zcounts(counts);
+    zscore(zcounts);
+    return sum(zcounts, ROW);
+}
+
+// the transformed counts are not sparse so the sums are computed from the non-zero counts:
+// sum_j (x_ij - mean_j) / sdev_j = sum_nz x_ij / sdev_j - sum_j mean_j / sdev_j
+colvec zscoreSums(const sp_mat &counts)
+{
+    rowvec means;
+    rowvec sdev;
+    columnStats(counts, means, sdev);
+    const rowvec factors = 1.0 / sdev;
+    colvec sums(counts.n_rows, fill::zeros);
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+            sums[counts.row_indices[k]] += counts.values[k] * factors[j];
+        }
+    }
+    sums -= accu(means % factors);
+    return sums;
+}
+
+// the changed elements separated by less than this number of elements are
+// merged in the same dirty range (fewer and larger uploads)
+constexpr int DIRTY_RANGE_GAP = 64;
+
+// returns the ranges of the elements that differ between the vectors (coalesced)
+// all the elements are dirty if the sizes of the vectors differ
+template <typename T>
+STData::RenderingRanges dirtyRanges(const QVector<T> &previous, const QVector<T> &current)
+{
+    STData::RenderingRanges ranges;
+    const int size = current.size();
+    if (previous.size() != size) {
+        if (size > 0) {
+            ranges.append(qMakePair(0, size));
+        }
+        return ranges;
+    }
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < size; ++i) {
+        if (previous.at(i) == current.at(i)) {
+            continue;
+        }
+        if (first != -1 && i - last > DIRTY_RANGE_GAP) {
+            ranges.append(qMakePair(first, last - first + 1));
+            first = -1;
+        }
+        if (first == -1) {
+            first = i;
+        }
+        last = i;
+    }
+    if (first != -1) {
+        ranges.append(qMakePair(first, last - first + 1));
+    }
+    return ranges;
+}
+
+// returns a data frame with the given rows (spots) and columns (genes)
+STData::STDataFrame sliceFrame(const STData::STDataFrame &data,
+                               const uvec &rows,
+                               const uvec &cols)
+{
+    STData::STDataFrame sliced_data;
+    sliced_data.is_sparse = data.is_sparse;
+    if (data.is_sparse) {
+        sliced_data.sp_counts = STMath::submat(data.sp_counts, rows, cols);
+    } else {
+        sliced_data.counts = data.counts.submat(rows, cols);
+    }
+    for (const auto &j : cols) {
+        sliced_data.genes.append(data.genes.at(j));
+    }
+    for (const auto &i : rows) {
+        sliced_data.spots.append(data.spots.at(i));
+    }
+    return sliced_data;
+}
+
+}
+
+
+// the stages of the rendering data (threshold filter -> slice -> normalise ->
+// gene visibility -> transform -> reduce), the colour stage is computed by STData
+// every stage keeps its output with the settings it depends on and it is only
+// computed again when they change or the output of the previous stage changes
+struct STData::RenderingPipeline
+{
+    // the version of the output of a stage and the version of the output of the
+    // previous stage it was computed from (0 if it has not been computed)
+    // the counts of the output are dense or sparse as the data
+    struct Stage {
+        quint64 version = 0;
+        quint64 input = 0;
+        mat counts;
+        sp_mat sp_counts;
+
+        template <typename M>
+        M &output()
+        {
+            if constexpr (std::is_same<M, sp_mat>::value) {
+                return sp_counts;
+            } else {
+                return counts;
+            }
+        }
+    };
+
+    quint64 last_version = 0;
+
+    // threshold filter: the spots (mask) and genes (indexes) that pass the thresholds
+    Stage threshold;
+    int reads_threshold = 0;
+    int genes_threshold = 0;
+    int spots_threshold = 0;
+    uvec threshold_rows;
+    uvec threshold_cols;
+
+    // slice: the counts of the visible spots that pass the thresholds
+    Stage slice;
+    std::vector<char> spots_visible;
+    uvec rows;
+
+    // normalise: the normalized counts (the counts of the slice if they are not normalized)
+    Stage normalise;
+    SettingsWidget::NormalizationMode normalization = SettingsWidget::RAW;
+
+    // gene visibility: the counts of the visible genes (the counts of the normalise stage
+    // if all the genes are visible) and the genes detected in each spot (the genes of the
+    // spot i are between detected_ptrs(i) and detected_ptrs(i + 1), computed if needed)
+    Stage genes;
+    std::vector<char> genes_visible;
+    bool all_genes = true;
+    uvec cols;
+    quint64 detected_version = 0;
+    uvec detected_ptrs;
+    uvec detected_genes;
+
+    // transform: the log scaled counts (the counts of the gene visibility stage if not scaled)
+    Stage transform;
+    bool log_scale = false;
+
+    // reduce: the value of each spot (total sum of the counts or the z-scores of its genes)
+    Stage reduce;
+    bool do_values = false;
+    bool standardize = false;
+    vec values;
+
+    // sets the stage as computed from the given input
+    void computed(Stage &stage, const quint64 input)
+    {
+        stage.version = ++last_version;
+        stage.input = input;
+    }
+
+    // computes the stages that are outdated, returns false if no spots are shown
+    template <typename M>
+    bool update(const M &counts,
+                const std::vector<char> &spots_visible_now,
+                const std::vector<char> &genes_visible_now,
+                const SettingsWidget::Rendering &settings,
+                const bool merge_genes);
+};
+
+template <typename M>
+bool STData::RenderingPipeline::update(const M &counts,
+                                       const std::vector<char> &spots_visible_now,
+                                       const std::vector<char> &genes_visible_now,
+                                       const SettingsWidget::Rendering &settings,
+                                       const bool merge_genes)
+{
+    const bool do_values_now = settings.visual_mode != SettingsWidget::VisualMode::Normal;
+
+    // threshold filter
+    if (threshold.version == 0
+            || reads_threshold != settings.reads_threshold
+            || genes_threshold != settings.genes_threshold
+            || spots_threshold != settings.spots_threshold) {
+        const double reads = settings.reads_threshold;
+        const auto above_threshold = [=](const double value) { return value > reads; };
+        threshold_rows = ones<uvec>(counts.n_rows);
+        if (settings.genes_threshold > 0) {
+            threshold_rows = STMath::rowCount(counts, above_threshold) >= settings.genes_threshold;
+        }
+        uvec pass_cols = ones<uvec>(counts.n_cols);
+        if (settings.spots_threshold > 0) {
+            pass_cols = conv_to<uvec>::from(STMath::colCount(counts, above_threshold)
+                                            >= settings.spots_threshold);
+        }
+        threshold_cols = find(pass_cols);
+        reads_threshold = settings.reads_threshold;
+        genes_threshold = settings.genes_threshold;
+        spots_threshold = settings.spots_threshold;
+        computed(threshold, 0);
+    }
+    if (threshold_cols.is_empty()) {
+        return false;
+    }
+
+    // slice
+    if (slice.input != threshold.version || spots_visible != spots_visible_now) {
+        uvec rows_to_keep = threshold_rows;
+        #pragma omp parallel for
+        for (uword i = 0; i < rows_to_keep.n_elem; ++i) {
+            rows_to_keep.at(i) = spots_visible_now[i] && rows_to_keep.at(i);
+        }
+        rows = find(rows_to_keep);
+        slice.output<M>() = rows.is_empty() ? M() : STMath::submat(counts, rows, threshold_cols);
+        spots_visible = spots_visible_now;
+        computed(slice, threshold.version);
+    }
+    if (rows.is_empty()) {
+        return false;
+    }
+
+    // normalise (only the visual modes that show values use the normalized counts)
+    const auto normalization_now = do_values_now ? settings.normalization_mode : SettingsWidget::RAW;
+    if (normalise.input != slice.version || normalization != normalization_now) {
+        if (normalization_now != SettingsWidget::RAW) {
+            normalise.output<M>() = slice.output<M>();
+            normalize(normalise.output<M>(), normalization_now);
+        } else {
+            normalise.output<M>() = M();
+        }
+        normalization = normalization_now;
+        computed(normalise, slice.version);
+    }
+    const M &normalized = normalization == SettingsWidget::RAW ? slice.output<M>()
+                                                                : normalise.output<M>();
+
+    // gene visibility
+    std::vector<char> threshold_genes_visible(threshold_cols.n_elem);
+    #pragma omp parallel for
+    for (uword j = 0; j < threshold_cols.n_elem; ++j) {
+        threshold_genes_visible[j] = genes_visible_now[threshold_cols.at(j)];
+    }
+    if (genes.input != normalise.version || genes_visible != threshold_genes_visible) {
+        uvec visible_genes(threshold_cols.n_elem);
+        for (uword j = 0; j < visible_genes.n_elem; ++j) {
+            visible_genes.at(j) = threshold_genes_visible[j];
+        }
+        visible_genes = find(visible_genes);
+        all_genes = visible_genes.n_elem == threshold_cols.n_elem;
+        genes.output<M>() = all_genes || visible_genes.is_empty()
+                ? M() : STMath::selectCols(normalized, visible_genes);
+        cols = threshold_cols.elem(visible_genes);
+        genes_visible.swap(threshold_genes_visible);
+        computed(genes, normalise.version);
+    }
+    if (cols.is_empty()) {
+        return false;
+    }
+    const M &visible_counts = all_genes ? normalized : genes.output<M>();
+
+    // the genes detected in each spot (used to merge the colors of the genes)
+    if (merge_genes && detected_version != genes.version) {
+        std::vector<uword> ptrs(1, 0);
+        std::vector<uword> detected;
+        ptrs.reserve(visible_counts.n_rows + 1);
+        if constexpr (std::is_same<M, sp_mat>::value) {
+            // the matrix is transposed to have the non-zero counts of each spot contiguous
+            sp_mat counts_t = visible_counts.t();
+            counts_t.sync();
+            detected.reserve(counts_t.n_nonzero);
+            for (uword i = 0; i < counts_t.n_cols; ++i) {
+                for (uword k = counts_t.col_ptrs[i]; k < counts_t.col_ptrs[i + 1]; ++k) {
+                    if (counts_t.values[k] > 0) {
+                        detected.push_back(counts_t.row_indices[k]);
+                    }
                 }
-            } else if (col_number == 0) {
-                const QString spot = QString::fromStdString(token).trimmed();
-                if (!spot.isNull() && !spot.isEmpty()) {
-                    data.spots.append(spot);
+                ptrs.push_back(detected.size());
+            }
+        } else {
+            for (uword i = 0; i < visible_counts.n_rows; ++i) {
+                for (uword j = 0; j < visible_counts.n_cols; ++j) {
+                    if (visible_counts.at(i, j) > 0) {
+                        detected.push_back(j);
+                    }
                 }
-            } else {
-                values.push_back(std::stod(token));
+                ptrs.push_back(detected.size());
             }
-            ++col_number;
         }
-        ++row_number;
+        detected_ptrs = uvec(ptrs);
+        detected_genes = uvec(detected);
+        detected_version = genes.version;
     }
-    f.close();
 
-    if (!parsed || data.spots.empty() || data.genes.empty()) {
-        throw std::runtime_error("The file does not contain a valid matrix");
+    // transform
+    const bool log_scale_now = do_values_now && settings.log_scale;
+    if (transform.input != genes.version || log_scale != log_scale_now) {
+        if (log_scale_now) {
+            transform.output<M>() = visible_counts;
+            logScale(transform.output<M>());
+        } else {
+            transform.output<M>() = M();
+        }
+        log_scale = log_scale_now;
+        computed(transform, genes.version);
+    }
+    const M &transformed = log_scale ? transform.output<M>() : visible_counts;
+
+    // reduce (compute total sum per spot)
+    // the standard transformation (by genes) is applied if requested
+    const bool standardize_now = do_values_now && settings.zscore;
+    if (reduce.input != transform.version || do_values != do_values_now
+            || standardize != standardize_now) {
+        if (!do_values_now) {
+            values.reset();
+        } else if (standardize_now) {
+            values = zscoreSums(transformed);
+        } else {
+            values = STMath::rowSums(transformed);
+        }
+        do_values = do_values_now;
+        standardize = standardize_now;
+        computed(reduce, transform.version);
     }
+    return true;
+}
+
+STData::STData()
+    : m_pipeline(new RenderingPipeline())
+    , m_is3D(false)
+{
 
-    const uword n_spots = data.spots.size();
-    const uword n_genes = data.genes.size();
-    qDebug() << "Parsed data file with " << n_genes << " genes and " << n_spots << " spots";
-    // TODO add a try-catch here
-    data.counts = mat(values.data(), n_genes, n_spots).t();
-    return data;
 }
 
-void STData::init(const QString &filename, const QString &spots_coordinates) {
+STData::~STData()
+{
 
-    // first parse the matrix with counts
-    try {
-        m_data = read(filename);
-    } catch (const std::exception &e) {
-        qDebug() << "Error parsing the matrix of counts " << e.what();
-        throw;
+}
+
+STData::STDataFrame STData::read(const QString &filename)
+{
+    qDebug() << "Opening ST Data file " << filename;
+    STDataFrame data;
+    if (HDF5Parser::isHDF5(filename)) {
+        data = HDF5Parser::parseH5(filename);
+    } else if (DatasetCache::isCacheFile(filename)) {
+        DatasetCache::Entry entry;
+        if (!DatasetCache::read(filename, entry)) {
+            throw std::runtime_error("The file does not contain a valid matrix");
+        }
+        data = entry.data;
+    } else if (MatrixParser::isMatrixMarket(filename)) {
+        data = MatrixParser::parseMTX(filename);
+    } else {
+        data = MatrixParser::parseTSV(filename);
     }
+    qDebug() << "Parsed data file with " << data.genes.size() << " genes and "
+             << data.spots.size() << " spots";
+    return data;
+}
 
-    // parse the spot coordinates file
-    QMap<QString, Spot::SpotType> spots_dict;
-    try {
-        spots_dict = parseSpotsMap(spots_coordinates);
-    } catch (const std::exception &e) {
-        qDebug() << "Error parsing the spots file " << e.what();
-        throw;
+void STData::init(const QString &filename, const QString &spots_coordinates,
+                  LoadingProgress *progress) {
+
+    // load the dataset from the cache if it was parsed before
+    // otherwise parse it and store it in the cache for the next time
+    DatasetCache::Entry entry;
+    if (!DatasetCache::load(filename, spots_coordinates, entry)) {
+        entry = parseDataset(filename, spots_coordinates, progress);
+        if (!DatasetCache::save(filename, spots_coordinates, entry)) {
+            qDebug() << "The dataset could not be stored in the cache";
+        }
+    } else {
+        LoadingProgress::update(progress, LoadingProgress::ParseSpots, 1.0);
+        LoadingProgress::update(progress, LoadingProgress::ParseMatrix, 1.0);
     }
+    LoadingProgress::update(progress, LoadingProgress::Filter, 0.5);
 
-    // create the spot objects (only spots in the spots coordiantes file will be included)
-    // compute the total sum of the spot to add it to the spot objects
-    // and if the total sum == 0 the spot is discarded
+    m_data = std::move(entry.data);
+    m_pipeline.reset(new RenderingPipeline());
+    const int n_spots = m_data.spots.size();
+    const int n_genes = m_data.genes.size();
+
+    // create the spot objects with their coordinates and total counts
     // also initialize the rendering data
-    std::vector<uword> to_keep_spots;
     m_spots.clear();
-    m_spot_index.clear();
+    m_spot_ids.clear();
+    m_rendering_coords = entry.coordinates;
+    m_rendering = RenderingData();
+    m_rendering.vertices = createVertices(m_rendering_coords);
     QFuture<void> future1 = QtConcurrent::run([&]() {
-        const auto old_spots = m_data.spots;
-        m_data.spots.clear();
-        const colvec row_sum = arma::sum(m_data.counts, ROW);
-        int index_spot = 0;
-        for (uword i = 0; i < m_data.counts.n_rows; ++i) {
-            const auto &spot = old_spots.at(i);
-            if (spots_dict.contains(spot)) {
-                const auto adj_spot = spots_dict[spot];
-                const double row_sum_value = row_sum.at(i);
-                if (row_sum_value > 0) {
-                    to_keep_spots.push_back(i);
-                    auto spot_obj = SpotObjectType(new Spot(spot));
-                    spot_obj->adj_coordinates(adj_spot);
-                    spot_obj->totalCount(row_sum_value);
-                    m_spots.push_back(spot_obj);
-                    m_data.spots.push_back(spot);
-                    m_spot_index.insert(spot, index_spot++);
-                    m_rendering_coords.append(spot_obj->adj_coordinates());
-                    m_rendering_colors.append(QVector4D(1.0, 1.0, 1.0, 1.0));
-                    m_rendering_visible.append(0);
-                    m_rendering_selected.append(0);
-                }
-            }
+        m_spots.reserve(n_spots);
+        m_spot_ids.reserve(n_spots);
+        for (int i = 0; i < n_spots; ++i) {
+            const auto &spot = m_data.spots.at(i);
+            auto spot_obj = SpotObjectType(new Spot(spot));
+            spot_obj->adj_coordinates(entry.coordinates.at(i));
+            spot_obj->totalCount(entry.spot_totals.at(i));
+            m_spots.push_back(spot_obj);
+            m_spot_ids.add(spot);
         }
     });
 
-    // create the gene objects
-    // compute the total sum of the gene to add it to the gene objects
-    // and if the total sum == 0 the gene is discarded
-    std::vector<uword> to_keep_genes;
-    m_gene_index.clear();
+    // create the gene objects with their total counts
+    m_gene_ids.clear();
     m_genes.clear();
     QFuture<void> future2 = QtConcurrent::run([&]() {
-        const auto old_genes = m_data.genes;
-        m_data.genes.clear();
-        const rowvec col_sum = sum(m_data.counts, COLUMN);
-        int index_gene = 0;
-        for (uword j = 0; j < m_data.counts.n_cols; ++j) {
-            const double col_sum_value = col_sum.at(j);
-            if (col_sum_value > 0) {
-                const auto &gene = old_genes.at(j);
-                auto gene_obj = GeneObjectType(new Gene(gene));
-                gene_obj->totalCount(col_sum_value);
-                m_data.genes.push_back(gene);
-                to_keep_genes.push_back(j);
-                m_genes.push_back(gene_obj);
-                m_gene_index.insert(gene, index_gene++);
-            }
+        m_genes.reserve(n_genes);
+        m_gene_ids.reserve(n_genes);
+        for (int j = 0; j < n_genes; ++j) {
+            const auto &gene = m_data.genes.at(j);
+            auto gene_obj = GeneObjectType(new Gene(gene));
+            gene_obj->totalCount(entry.gene_totals.at(j));
+            m_genes.push_back(gene_obj);
+            m_gene_ids.add(gene);
         }
     });
 
+    // the spatial index of the spots (used for the selections)
+    QFuture<void> future3 = QtConcurrent::run([&]() {
+        m_spot_index.build(m_rendering_coords);
+    });
+
     future1.waitForFinished();
     future2.waitForFinished();
+    future3.waitForFinished();
+    LoadingProgress::update(progress, LoadingProgress::Filter, 1.0);
 
-    if (m_spots.empty() || m_genes.empty()) {
+    qDebug() << "Spots and genes present " << m_spots.size() << " " << m_genes.size();
+}
+
+DatasetCache::Entry STData::parseDataset(const QString &filename,
+                                         const QString &spots_coordinates,
+                                         LoadingProgress *progress) const
+{
+    // first parse the spot coordinates file
+    MatrixParser::SpotsMap spots_map;
+    LoadingProgress::update(progress, LoadingProgress::ParseSpots, 0.0);
+    try {
+        qDebug() << "Parsing spots file " << spots_coordinates;
+        spots_map = MatrixParser::parseSpots(spots_coordinates);
+    } catch (const std::exception &e) {
+        qDebug() << "Error parsing the spots file " << e.what();
+        throw;
+    }
+
+    // parse the matrix with counts, only the spots with coordinates are
+    // read from the HDF5 files (the rest of the spots are skipped while reading)
+    LoadingProgress::update(progress, LoadingProgress::ParseSpots, 1.0);
+    LoadingProgress::update(progress, LoadingProgress::ParseMatrix, 0.0);
+    DatasetCache::Entry entry;
+    try {
+        if (HDF5Parser::isHDF5(filename)) {
+            HDF5Parser::Selection selection;
+            for (int i = 0; i < spots_map.spots.size(); ++i) {
+                selection.spots.insert(spots_map.spots.name(i));
+            }
+            entry.data = HDF5Parser::parseH5(filename, selection);
+        } else {
+            entry.data = read(filename);
+        }
+    } catch (const std::exception &e) {
+        qDebug() << "Error parsing the matrix of counts " << e.what();
+        throw;
+    }
+
+    // keep the spots in the spots coordinates file
+    // compute the total sum of the spots and if the total sum == 0 the spot is discarded
+    LoadingProgress::update(progress, LoadingProgress::ParseMatrix, 1.0);
+    LoadingProgress::update(progress, LoadingProgress::Filter, 0.0);
+    const colvec row_sum = rowSums(entry.data);
+    const rowvec col_sum = colSums(entry.data);
+    // the ids of the coordinates of the spots (aligned with the rows, -1 if none)
+    const int n_rows = entry.data.spots.size();
+    std::vector<int> coordinates_ids(n_rows);
+    #pragma omp parallel for
+    for (int i = 0; i < n_rows; ++i) {
+        coordinates_ids[i] = spots_map.spots.id(entry.data.spots.at(i));
+    }
+    std::vector<uword> to_keep_spots;
+    for (uword i = 0; i < row_sum.n_elem; ++i) {
+        const int coordinates_id = coordinates_ids[i];
+        if (coordinates_id != -1 && row_sum.at(i) > 0) {
+            to_keep_spots.push_back(i);
+            entry.coordinates.append(spots_map.coordinates.at(coordinates_id));
+        }
+    }
+
+    // compute the total sum of the genes and if the total sum == 0 the gene is discarded
+    const uvec to_keep_genes = find(col_sum > 0);
+
+    if (to_keep_spots.empty() || to_keep_genes.empty()) {
         qDebug() << "No valid spots or genes could be found in the file.";
         throw std::runtime_error("No valid spots or genes could be found in the file.");
     }
 
     // slice data
-    m_data.counts = m_data.counts.submat(uvec(to_keep_spots),
-                                         uvec(to_keep_genes));
+    const uvec rows(to_keep_spots);
+    entry.data = sliceFrame(entry.data, rows, to_keep_genes);
+    entry.spot_totals = row_sum.elem(rows);
+    entry.gene_totals = col_sum.elem(to_keep_genes).t();
 
-    qDebug() << "Spots and genes present " << m_spots.size() << " " << m_genes.size();
+    return entry;
 }
 
 void STData::save(const QString &filename, const STData::STDataFrame &data)
 {
-    QFile file(filename);
-    if (file.open(QIODevice::WriteOnly)) {
-        QTextStream stream(&file);
-        // write genes (1st row)
-        for (const auto &gene : data.genes) {
-            stream << "\t" << gene;
-        }
-        stream << endl;
-        // write spots (1st column and the rest of the rows (counts))
-        for (uword i = 0; i < data.counts.n_rows; ++i) {
-            const auto spot = data.spots.at(i);
-            stream <<  spot;
-            for (uword j = 0; j < data.counts.n_cols; ++j) {
-                stream << "\t" << data.counts(i,j);
-            }
-            stream << endl;
-        }
-    }
+    MatrixWriter::write(filename, data);
 }
 
 STData::STDataFrame STData::data() const
@@ -213,164 +667,227 @@ const STData::SpotListType &STData::spots() const
     return m_spots;
 }
 
-void STData::computeRenderingData(SettingsWidget::Rendering &rendering_settings)
+const IdTable &STData::spotIds() const
 {
-    const bool do_values = rendering_settings.visual_mode != SettingsWidget::VisualMode::Normal;
-    const bool drange = rendering_settings.visual_mode == SettingsWidget::VisualMode::DynamicRange;
-
-    // make a local copy of the data to apply filters, normalize and so
-    STDataFrame data = m_data;
+    return m_spot_ids;
+}
 
-    // to keep the indices and the row values for visualization
-    uvec cols_to_keep;
-    uvec rows_to_keep;
-    vec values;
+const IdTable &STData::geneIds() const
+{
+    return m_gene_ids;
+}
 
-    if (!rendering_settings.show_spots) {
+const SpotIndex &STData::spotIndex() const
+{
+    return m_spot_index;
+}
 
-        // get the spots that pass the filters
-        rows_to_keep = ones<uvec>(data.counts.n_rows);
-        uvec rows_to_keep_tmp = ones<uvec>(data.counts.n_rows - 1);
-        if (rendering_settings.genes_threshold > 0) {
-            rows_to_keep = sum(data.counts > rendering_settings.reads_threshold, ROW)
-                    >= rendering_settings.genes_threshold;
-        }
+int STData::nearestVisibleSpot(const QPointF &position, const double radius) const
+{
+    const auto &vertices = m_rendering.vertices;
+    return m_spot_index.nearestSpot(position, radius, [&](const int spot) {
+        return spot < vertices.size() && (vertices.at(spot).flags & Visible);
+    });
+}
 
-        // early out if no visible spots after filtering
-        if (!any(rows_to_keep)) {
-            return;
-        }
+const PointOctree &STData::spotOctree() const
+{
+    return m_spot_octree;
+}
 
-        // obtain the spots that are visible
-        #pragma omp parallel for
-        for (uword i = 0; i < data.counts.n_rows; ++i) {
-            // reset visible/selected rendering arrays to false
-            m_rendering_visible[i] = false;
-            m_rendering_selected[i] = false;
-            rows_to_keep.at(i) = m_spots.at(i)->visible() && rows_to_keep.at(i);
-        }
+int STData::nearestVisibleSpot(const QPointF &position,
+                               const double radius,
+                               const QMatrix4x4 &window_mvp) const
+{
+    const auto &vertices = m_rendering.vertices;
+    return m_spot_octree.nearestPoint(position, radius, window_mvp, m_rendering_coords,
+                                      [&](const int spot) {
+        return spot < vertices.size() && (vertices.at(spot).flags & Visible);
+    });
+}
 
-        // early out if no visible spots
-        if (!any(rows_to_keep)) {
+QVector<QPair<int, double>> STData::topGenes(const int spot, const int n) const
+{
+    // a min-heap with the n highest counts of the spot
+    std::vector<QPair<double, int>> heap;
+    if (spot < 0 || spot >= static_cast<int>(m_data.n_rows()) || n <= 0) {
+        return QVector<QPair<int, double>>();
+    }
+    heap.reserve(n + 1);
+    const auto addCount = [&](const int gene, const double count) {
+        if (count <= 0.0 || (static_cast<int>(heap.size()) == n && count <= heap.front().first)) {
             return;
         }
-
-        // get the genes that pass the filters
-        cols_to_keep = ones<uvec>(data.counts.n_cols);
-        if (rendering_settings.spots_threshold > 0) {
-            cols_to_keep = conv_to<uvec>::from(sum(data.counts > rendering_settings.reads_threshold, COLUMN)
-                                               >= rendering_settings.spots_threshold);
+        heap.push_back(qMakePair(count, gene));
+        std::push_heap(heap.begin(), heap.end(), std::greater<QPair<double, int>>());
+        if (static_cast<int>(heap.size()) > n) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<QPair<double, int>>());
+            heap.pop_back();
         }
-
-        // early out if no genes after filtering
-        if (!any(cols_to_keep)) {
-            return;
+    };
+    if (m_data.is_sparse) {
+        // the count of the spot in each gene (column) is found by a binary search
+        // of its row in the sorted row indices of the column
+        const sp_mat &counts = m_data.sp_counts;
+        counts.sync();
+        const uword row = static_cast<uword>(spot);
+        for (uword j = 0; j < counts.n_cols; ++j) {
+            const uword *first = counts.row_indices + counts.col_ptrs[j];
+            const uword *last = counts.row_indices + counts.col_ptrs[j + 1];
+            const uword *found = std::lower_bound(first, last, row);
+            if (found != last && *found == row) {
+                addCount(static_cast<int>(j), counts.values[found - counts.row_indices]);
+            }
         }
-
-        // get indexes of spots/genes (rows/columns)
-        rows_to_keep = find(rows_to_keep);
-        cols_to_keep = find(cols_to_keep);
-
-        // slice the dataset
-        data.counts = data.counts.submat(rows_to_keep, cols_to_keep);
-
-        if (do_values) {
-            // normalize
-            data = normalizeCounts(data, rendering_settings.normalization_mode);
+    } else {
+        for (uword j = 0; j < m_data.counts.n_cols; ++j) {
+            addCount(static_cast<int>(j), m_data.counts.at(spot, j));
         }
+    }
 
-        // get the genes that are visible
-        #pragma omp parallel for
-        for (const auto j : cols_to_keep) {
-            cols_to_keep.at(j) = m_genes.at(j)->visible();
-        }
+    std::sort_heap(heap.begin(), heap.end(), std::greater<QPair<double, int>>());
+    QVector<QPair<int, double>> genes;
+    genes.reserve(static_cast<int>(heap.size()));
+    for (const auto &count : heap) {
+        genes.append(qMakePair(count.second, count.first));
+    }
+    return genes;
+}
 
-        // early out if no genes after visible
-        if (!any(cols_to_keep)) {
-            return;
-        }
+void STData::computeRenderingData(SettingsWidget::Rendering &rendering_settings)
+{
+    computeRenderingData(renderingInput(rendering_settings), m_rendering);
+    rendering_settings.legend_min = m_rendering.legend_min;
+    rendering_settings.legend_max = m_rendering.legend_max;
+}
 
-        // keep only visible genes
-        cols_to_keep = find(cols_to_keep);
-        data.counts = data.counts.cols(cols_to_keep);
+STData::RenderingInput STData::renderingInput(const SettingsWidget::Rendering &rendering_settings) const
+{
+    const int n_spots = m_spots.size();
+    const int n_genes = m_genes.size();
+    RenderingInput input;
+    input.settings = rendering_settings;
+    input.spots_visible.resize(n_spots);
+    input.spots_selected.resize(n_spots);
+    input.spots_colors.resize(n_spots);
+    #pragma omp parallel for
+    for (int i = 0; i < n_spots; ++i) {
+        const auto &spot_obj = m_spots.at(i);
+        input.spots_visible[i] = spot_obj->visible();
+        input.spots_selected[i] = spot_obj->selected();
+        input.spots_colors[i] = spot_obj->color();
+    }
+    input.genes_visible.resize(n_genes);
+    input.genes_colors.resize(n_genes);
+    #pragma omp parallel for
+    for (int j = 0; j < n_genes; ++j) {
+        const auto &gene_obj = m_genes.at(j);
+        input.genes_visible[j] = gene_obj->visible();
+        input.genes_colors[j] = gene_obj->color();
+    }
+    return input;
+}
 
-        if (do_values) {
-            // log scale
-            if (rendering_settings.log_scale) {
-                data.counts = log1p(data.counts);
-            }
+void STData::computeRenderingData(const RenderingInput &input, RenderingData &data)
+{
+    computeRenderingColors(input, data);
 
-            // apply standard transformation if requested (by genes)
-            if (rendering_settings.zscore) {
-                data = ztransform(data);
-            }
+    // the rendering data is compared with the current one (the data in the buffers)
+    if (&data == &m_rendering) {
+        data.dirty = RenderingRanges({qMakePair(0, data.vertices.size())});
+    } else {
+        data.dirty = dirtyRanges(m_rendering.vertices, data.vertices);
+    }
+}
 
-            // compute total sum (per spot)
-            values = sum(data.counts, ROW);
-            rendering_settings.legend_min = values.min();
-            rendering_settings.legend_max = values.max();
+void STData::computeRenderingColors(const RenderingInput &input, RenderingData &data)
+{
+    const SettingsWidget::Rendering &rendering_settings = input.settings;
+    const int n_spots = input.spots_visible.size();
+    if (data.vertices.size() != n_spots) {
+        data.vertices = createVertices(m_rendering_coords);
+    }
+    data.legend_min = rendering_settings.legend_min;
+    data.legend_max = rendering_settings.legend_max;
+    data.visual_mode = rendering_settings.show_spots ? SettingsWidget::Normal
+                                                     : rendering_settings.visual_mode;
+
+    // the spots are shown with their own colors (the counts are not used)
+    if (rendering_settings.show_spots) {
+        #pragma omp parallel for
+        for (int i = 0; i < n_spots; ++i) {
+            setVertex(data.vertices[i], input.spots_colors.at(i), 0.0,
+                      input.spots_visible[i], input.spots_selected[i]);
         }
+        return;
+    }
 
-    } else {
-        cols_to_keep = linspace<uvec>(0, data.counts.n_cols - 1, data.counts.n_cols);
-        rows_to_keep = linspace<uvec>(0, data.counts.n_rows - 1, data.counts.n_rows);
+    const bool do_values = rendering_settings.visual_mode != SettingsWidget::VisualMode::Normal;
+    const bool drange = rendering_settings.visual_mode == SettingsWidget::VisualMode::DynamicRange;
+    const bool merge_genes = !do_values || drange;
+
+    // only the stages that are outdated are computed
+    const bool shown = m_data.is_sparse
+            ? m_pipeline->update(m_data.sp_counts, input.spots_visible, input.genes_visible,
+                                 rendering_settings, merge_genes)
+            : m_pipeline->update(m_data.counts, input.spots_visible, input.genes_visible,
+                                 rendering_settings, merge_genes);
+
+    // reset visible/selected flags to false
+    for (RenderingVertex &vertex : data.vertices) {
+        vertex.flags = 0;
+    }
+    if (!shown) {
+        return;
+    }
+
+    const RenderingPipeline &pipeline = *m_pipeline;
+    if (do_values) {
+        data.legend_min = pipeline.values.min();
+        data.legend_max = pipeline.values.max();
     }
 
-    // iterate spots to assign color, selected and visible status to each of them
-    // and also update the rendering vectors so the data can be visualized
+    // colour: iterate spots to assign color, value, selected and visible status to each
+    // of them and also update the rendering vectors so the data can be visualized
+    // the values are mapped to colors by the view (so the color map, the legend range
+    // and the intensity can change without computing and uploading the rendering data)
+    const uvec &rows = pipeline.rows;
+    const uvec &cols = pipeline.cols;
     #pragma omp parallel for
-    for (uword i = 0; i < data.counts.n_rows; ++i) {
-        const auto spot_index = rows_to_keep.at(i);
-        const auto spot_obj = m_spots.at(spot_index);
-        int visible = false;
+    for (uword i = 0; i < rows.n_elem; ++i) {
+        const auto spot_index = rows.at(i);
         int num_genes = 0;
-        double value = 0;
         QColor merged_color = Qt::white;
-        if (rendering_settings.show_spots) {
-            merged_color = spot_obj->color();
-            visible = spot_obj->visible();
-        } else {
-            if (!do_values || drange) {
-                // iterate only genes with expression in the spot
-                const rowvec row_vec = data.counts.row(i);
-                const uvec detected_genes = find(row_vec);
-                for (const auto &j : detected_genes) {
-                    const auto gene_obj = m_genes.at(cols_to_keep.at(j));
-                    if (row_vec.at(j) > 0 && gene_obj->color() != merged_color) {
-                        // merge colors (genes) in the same spot using linear interpolation
-                        merged_color = STMath::lerp(1.0 / ++num_genes, merged_color, gene_obj->color());
-                    }
+        if (merge_genes) {
+            // iterate only genes with expression in the spot
+            for (uword k = pipeline.detected_ptrs.at(i); k < pipeline.detected_ptrs.at(i + 1); ++k) {
+                const QColor &gene_color =
+                        input.genes_colors.at(cols.at(pipeline.detected_genes.at(k)));
+                if (gene_color != merged_color) {
+                    // merge colors (genes) in the same spot using linear interpolation
+                    merged_color = STMath::lerp(1.0 / ++num_genes, merged_color, gene_color);
                 }
-            } else if (do_values) {
-                value = values.at(i);
-                merged_color = Color::adjustVisualMode(
-                            merged_color,
-                            value,
-                            rendering_settings.legend_min,
-                            rendering_settings.legend_max,
-                            rendering_settings.visual_mode);
             }
-            visible = do_values || num_genes > 0;
         }
-        m_rendering_selected[spot_index] = visible && spot_obj->selected();
-        m_rendering_colors[spot_index] = fromQtColor(merged_color);
-        m_rendering_visible[spot_index] = visible;
+        setVertex(data.vertices[spot_index], merged_color,
+                  do_values ? pipeline.values.at(i) : 0.0,
+                  do_values || num_genes > 0, input.spots_selected[spot_index]);
     }
 }
 
-const QVector<int> &STData::renderingVisible() const
+void STData::swapRenderingData(RenderingData &data)
 {
-    return m_rendering_visible;
+    std::swap(m_rendering, data);
 }
 
-const QVector<QVector4D> &STData::renderingColors() const
+const STData::RenderingData &STData::renderingData() const
 {
-    return m_rendering_colors;
+    return m_rendering;
 }
 
-const QVector<int> &STData::renderingSelected() const
+const QVector<STData::RenderingVertex> &STData::renderingVertices() const
 {
-    return m_rendering_selected;
+    return m_rendering.vertices;
 }
 
 const QVector<Spot::SpotType> &STData::renderingCoords() const
@@ -378,96 +895,45 @@ const QVector<Spot::SpotType> &STData::renderingCoords() const
     return m_rendering_coords;
 }
 
-QMap<QString, Spot::SpotType> STData::parseSpotsMap(const QString &spots_file) const
-{
-    qDebug() << "Parsing spots file " << spots_file;
-
-    QMap<QString, Spot::SpotType> spotMap;
-    QFile file(spots_file);
-    // Parse the spots map = old_spot -> pixel coordinates
-    if (file.open(QIODevice::ReadOnly)) {
-        QTextStream in(&file);
-        QString line;
-        QStringList fields;
-        bool parsed = true;
-        while (!in.atEnd()) {
-            line = in.readLine();
-            if (!line.startsWith("x")) {
-                fields = line.split("\t");
-                QString old_spot;
-                Spot::SpotType new_spot;
-                const int n_fields = fields.length();
-                if (n_fields == 3) {
-                    // 2D format
-                    old_spot = fields.at(0);
-                    new_spot = Spot::SpotType(fields.at(1).toFloat(),
-                                              fields.at(2).toFloat(),
-                                              0);
-                } else if (n_fields == 4) {
-                    // 3D format
-                    old_spot = fields.at(0);
-                    new_spot = Spot::SpotType(fields.at(1).toFloat(),
-                                              fields.at(2).toFloat(),
-                                              fields.at(3).toFloat());
-                } else if (n_fields == 5) {
-                    // 2D format
-                    old_spot = fields.at(0);
-                    new_spot = Spot::SpotType(fields.at(3).toFloat(),
-                                              fields.at(4).toFloat(),
-                                              0);
-                } else if (n_fields == 6) {
-                    // 2D format (ST Spot detector)
-                    old_spot = fields.at(0) + "x" + fields.at(1);
-                    new_spot = Spot::SpotType(fields.at(4).toFloat(),
-                                              fields.at(5).toFloat(),
-                                              0);
-                } else {
-                    parsed = false;
-                    break;
-                }
-                spotMap.insert(old_spot, new_spot);
-            }
-        }
-
-        if (spotMap.empty() || !parsed) {
-            qDebug() << "No valid spots were found in the spots file";
-            file.close();
-            throw std::runtime_error("No valid spots found in the spot coordinates file");
-        }
-
-    } else {
-        qDebug() << "Could not open spots file";
-        file.close();
-        throw std::runtime_error("Coult not open/parse the spot coordinates file");
-    }
-    file.close();
-
-    return spotMap;
-}
-
 STData::STDataFrame STData::normalizeCounts(const STDataFrame &data,
                                             SettingsWidget::NormalizationMode mode)
 {
     STDataFrame norm_counts = data;
-    if (mode == SettingsWidget::REL) {
-        //TODO add a try catch
-        norm_counts.counts.each_col() /= sum(norm_counts.counts, ROW);
-    } else if (mode == SettingsWidget::CPM) {
-        //TODO add a try catch
-        const auto sums = sum(norm_counts.counts, ROW);
-        const auto means = mean(sums);
-        norm_counts.counts = (norm_counts.counts.each_col() / sums) * means;
+    if (norm_counts.is_sparse) {
+        normalize(norm_counts.sp_counts, mode);
+    } else {
+        normalize(norm_counts.counts, mode);
     }
     return norm_counts;
 }
 
 STData::STDataFrame STData::ztransform(const STDataFrame &data)
 {
-    STDataFrame norm_counts = data;
-    //TODO add a try catch
-    const auto means = mean(norm_counts.counts, COLUMN);
-    const auto sdev = stddev(norm_counts.counts, COLUMN);
-    norm_counts.counts = (norm_counts.counts.each_row() - means).each_row() / sdev;
+    // the transformed counts are not sparse anymore
+    STDataFrame norm_counts;
+    norm_counts.genes = data.genes;
+    norm_counts.spots = data.spots;
+    if (!data.is_sparse) {
+        norm_counts.counts = data.counts;
+        zscore(norm_counts.counts);
+        return norm_counts;
+    }
+
+    // the sparse counts are transformed directly into the dense matrix (the zeros
+    // of each gene become -mean / sdev) without a dense copy of the counts
+    const sp_mat &counts = data.sp_counts;
+    rowvec means;
+    rowvec sdev;
+    columnStats(counts, means, sdev);
+    norm_counts.counts.set_size(counts.n_rows, counts.n_cols);
+    #pragma omp parallel for
+    for (uword j = 0; j < counts.n_cols; ++j) {
+        double *column = norm_counts.counts.colptr(j);
+        std::fill_n(column, counts.n_rows, -means[j] / sdev[j]);
+        for (uword k = counts.col_ptrs[j]; k < counts.col_ptrs[j + 1]; ++k) {
+            column[counts.row_indices[k]] = (counts.values[k] - means[j]) / sdev[j];
+        }
+    }
     return norm_counts;
 }
 
@@ -476,41 +942,25 @@ STData::STDataFrame STData::filterCounts(const STDataFrame &data,
                                          const int min_genes,
                                          const int min_spots)
 {
-    if (data.counts.n_cols == 0 || data.counts.n_rows == 0
+    if (data.n_cols() == 0 || data.n_rows() == 0
             || (min_reads == 0 && min_genes == 0 && min_spots == 0)) {
         return data;
     }
 
+    const auto pass = [=](const double value) { return value >= min_reads; };
+
     // get columns (genes) >= min_genes
-    const urowvec num_genes = sum(data.counts >= min_reads, COLUMN);
+    const urowvec num_genes = colCount(data, pass);
     const uvec cols_to_keep = find(num_genes >= min_spots);
 
     // get rows (spots) >= min_spots
-    const ucolvec num_spots = sum(data.counts >= min_reads, ROW);
+    const ucolvec num_spots = rowCount(data, pass);
     const uvec rows_to_keep = find(num_spots >= min_genes);
 
     // create filtered_matrix
-    if (rows_to_keep.size() != data.counts.n_rows
-            || cols_to_keep.size() != data.counts.n_cols) {
-
-        STDataFrame sliced_data;
-        sliced_data.counts = data.counts.submat(rows_to_keep, cols_to_keep);
-        QFuture<void> future1 = QtConcurrent::run([&] {
-            for (const auto &i : cols_to_keep) {
-                sliced_data.genes.append(data.genes.at(i));
-            }
-        });
-
-        QFuture<void> future2 = QtConcurrent::run([&]() {
-            for (const auto &j : rows_to_keep) {
-                sliced_data.spots.append(data.spots.at(j));
-            }
-        });
-
-        future1.waitForFinished();
-        future2.waitForFinished();
-
-        return sliced_data;
+    if (rows_to_keep.size() != data.n_rows()
+            || cols_to_keep.size() != data.n_cols()) {
+        return sliceFrame(data, rows_to_keep, cols_to_keep);
     } else {
         return data;
     }
@@ -518,41 +968,63 @@ STData::STDataFrame STData::filterCounts(const STDataFrame &data,
 
 const STData::STDataFrame STData::sliceDataSpots(const QList<QString> &spots)
 {
-    STDataFrame sliced_data;
-    std::vector<int> to_keep_rows;
-    for (int i = 0; i < spots.size(); ++i) {
-        const auto &spot = spots.at(i);
-        const int index = m_spot_index.value(spot, -1);
-        if (index != -1) {
-            to_keep_rows.push_back(index);
-            sliced_data.spots.append(spot);
+    return sliceDataSpots(m_spot_ids.ids(spots));
+}
+
+const STData::STDataFrame STData::sliceDataSpots(const QVector<int> &spots_ids)
+{
+    std::vector<uword> to_keep_rows;
+    to_keep_rows.reserve(spots_ids.size());
+    for (const int id : spots_ids) {
+        if (id >= 0 && id < m_spots.size()) {
+            to_keep_rows.push_back(id);
         }
     }
 
-    sliced_data.genes = m_data.genes;
-    sliced_data.counts = m_data.counts.rows(conv_to<uvec>::from(to_keep_rows));
-
     // Return the sliced data frame
-    return sliced_data;
+    return sliceRows(m_data, uvec(to_keep_rows));
 }
 
 const STData::STDataFrame STData::sliceDataGenes(const QList<QString> &genes)
 {
-    STDataFrame sliced_data;
-    std::vector<int> to_keep_cols;
-    for (int i = 0; i < genes.size(); ++i) {
-        const auto &gene = genes.at(i);
-        const int index = m_gene_index.value(gene, -1);
-        if (index != -1) {
-            to_keep_cols.push_back(index);
-            sliced_data.genes.append(gene);
-        }
+    std::vector<uword> to_keep_cols;
+    for (const int id : m_gene_ids.ids(genes)) {
+        to_keep_cols.push_back(id);
     }
 
-    sliced_data.spots = m_data.spots;
-    sliced_data.counts = m_data.counts.cols(conv_to<uvec>::from(to_keep_cols));
-
     // Return the sliced data frame
+    return sliceColumns(m_data, uvec(to_keep_cols));
+}
+
+STData::STDataFrame STData::sliceRows(const STDataFrame &data, const uvec &rows)
+{
+    STDataFrame sliced_data;
+    sliced_data.is_sparse = data.is_sparse;
+    if (data.is_sparse) {
+        sliced_data.sp_counts = STMath::selectRows(data.sp_counts, rows);
+    } else {
+        sliced_data.counts = data.counts.rows(rows);
+    }
+    sliced_data.genes = data.genes;
+    for (const auto &i : rows) {
+        sliced_data.spots.append(data.spots.at(i));
+    }
+    return sliced_data;
+}
+
+STData::STDataFrame STData::sliceColumns(const STDataFrame &data, const uvec &columns)
+{
+    STDataFrame sliced_data;
+    sliced_data.is_sparse = data.is_sparse;
+    if (data.is_sparse) {
+        sliced_data.sp_counts = STMath::selectCols(data.sp_counts, columns);
+    } else {
+        sliced_data.counts = data.counts.cols(columns);
+    }
+    sliced_data.spots = data.spots;
+    for (const auto &j : columns) {
+        sliced_data.genes.append(data.genes.at(j));
+    }
     return sliced_data;
 }
 
@@ -565,44 +1037,84 @@ STData::STDataFrame STData::aggregate(const QList<STDataFrame> &dataframes)
         return dataframes.first();
     }
 
-    // first merge genes and add index to spots (dataset)
-    QSet<QString> merged_genes;
-    QList<QString> merged_spots;
+    // first merge genes (in order of appearance) and add index to spots (dataset)
+    // the merged matrix is sparse if any of the data frames is sparse
+    STDataFrame merged;
+    IdTable merged_genes;
+    std::vector<uvec> gene_indexes;
+    std::vector<uword> row_offsets;
+    uword n_nonzero = 0;
     for (int i = 0; i < dataframes.size(); ++i) {
-        const auto data = dataframes.at(i);
-        merged_genes += QSet<QString>(data.genes.begin(), data.genes.end());
-        QList<QString> adj_spots;
-        std::transform(data.spots.begin(),
-                       data.spots.end(),
-                       std::back_inserter(adj_spots),
-                       [=](const auto &spot) { return QString::number(i) + "_" + spot; });
-        merged_spots += adj_spots;
+        const auto &data = dataframes.at(i);
+        uvec indexes(data.genes.size());
+        for (int j = 0; j < data.genes.size(); ++j) {
+            const auto &gene = data.genes.at(j);
+            const int gene_id = merged_genes.intern(gene);
+            if (gene_id == merged.genes.size()) {
+                merged.genes.append(gene);
+            }
+            indexes.at(j) = gene_id;
+        }
+        gene_indexes.push_back(indexes);
+        row_offsets.push_back(merged.spots.size());
+        for (const auto &spot : data.spots) {
+            merged.spots.append(QString::number(i) + "_" + spot);
+        }
+        merged.is_sparse = merged.is_sparse || data.is_sparse;
+        n_nonzero += data.is_sparse ? data.sp_counts.n_nonzero : accu(data.counts != 0);
     }
 
-    // create merged data frame
-    STDataFrame merged;
-    merged.genes = merged_genes.values();
-    merged.spots = merged_spots;
-    const uword n_rows = merged_spots.size();
-    const uword n_cols = merged_genes.size();
-    merged.counts = mat(n_rows, n_cols);
-    merged.counts.fill(0.0);
-
     // populate it with the counts
-    for (const auto &data : dataframes) {
-        std::vector<uword> gene_indexes;
-        for (uword i = 0; i < data.counts.n_rows; ++i) {
-            for (uword j = 0; j < n_cols; ++j) {
-                const auto &gene = merged.genes.at(j);
-                int index;
-                if (i == 0) {
-                    index = data.genes.indexOf(gene);
-                    gene_indexes.push_back(index);
-                } else {
-                    index = gene_indexes.at(j);
+    const uword n_rows = merged.spots.size();
+    const uword n_cols = merged.genes.size();
+    if (merged.is_sparse) {
+        umat locations(2, n_nonzero);
+        vec values(n_nonzero);
+        uword k = 0;
+        for (int i = 0; i < dataframes.size(); ++i) {
+            const auto &data = dataframes.at(i);
+            const auto add = [&](const uword row, const uword col, const double value) {
+                locations.at(0, k) = row_offsets[i] + row;
+                locations.at(1, k) = gene_indexes[i].at(col);
+                values.at(k++) = value;
+            };
+            if (data.is_sparse) {
+                for (auto it = data.sp_counts.begin(); it != data.sp_counts.end(); ++it) {
+                    add(it.row(), it.col(), *it);
                 }
-                if (index != -1) {
-                    merged.counts.at(i, j) = data.counts(i, index);
+            } else {
+                for (uword col = 0; col < data.counts.n_cols; ++col) {
+                    for (uword row = 0; row < data.counts.n_rows; ++row) {
+                        const double value = data.counts.at(row, col);
+                        if (value != 0) {
+                            add(row, col, value);
+                        }
+                    }
+                }
+            }
+        }
+        // the counts of a gene repeated in a data frame are added (as in the dense matrix)
+        merged.sp_counts = sp_mat(true, locations, values, n_rows, n_cols);
+    } else {
+        merged.counts = zeros<mat>(n_rows, n_cols);
+        for (int i = 0; i < dataframes.size(); ++i) {
+            const auto &data = dataframes.at(i);
+            if (data.counts.n_rows == 0) {
+                continue;
+            }
+            const uword first_row = row_offsets[i];
+            const uword last_row = first_row + data.counts.n_rows - 1;
+            // the columns of the data frame of each merged column (a gene can be repeated
+            // in a data frame and its counts are added), the loop goes through the merged
+            // columns so each column is written by one thread
+            std::vector<std::vector<uword>> columns(n_cols);
+            for (uword j = 0; j < data.counts.n_cols; ++j) {
+                columns[gene_indexes[i].at(j)].push_back(j);
+            }
+            #pragma omp parallel for
+            for (uword col = 0; col < n_cols; ++col) {
+                for (const uword j : columns[col]) {
+                    merged.counts.col(col).subvec(first_row, last_row) += data.counts.col(j);
                 }
             }
         }
@@ -626,28 +1138,40 @@ void STData::selectSpots(const SelectionEvent &event)
     }
 
     // update selection if spot inside the selection event
+    // (only the spots near the path are tested using the spatial index)
     const bool remove = (mode == SelectionEvent::SelectionMode::ExcludeSelection);
-    QtConcurrent::blockingMap(m_spots, [&](auto spot) {
-        const auto &coord = spot->adj_coordinates();
-        if (path.contains(QPointF(coord.x(), coord.y()))) {
-            spot->selected(!remove);
-        }
-    });
+    const QVector<int> spots_inside = m_spot_index.spotsInside(path);
+    #pragma omp parallel for
+    for (int i = 0; i < spots_inside.size(); ++i) {
+        m_spots.at(spots_inside.at(i))->selected(!remove);
+    }
 }
 
-void STData::selectSpots(const QVector<QString> &spots)
+void STData::selectSpots(const SelectionEvent &event, const QMatrix4x4 &window_mvp)
 {
-    clearSelection();
+    const QPainterPath path = event.path();
+    const auto mode = event.mode();
+
+    if (mode == SelectionEvent::SelectionMode::NewSelection) {
+        clearSelection();
+    }
+
+    // update selection if spot projected inside the selection event
+    // (only the spots of the octree nodes near the path are projected)
+    const bool remove = (mode == SelectionEvent::SelectionMode::ExcludeSelection);
+    const QVector<int> spots_inside = m_spot_octree.pointsInside(path, window_mvp,
+                                                                 m_rendering_coords);
     #pragma omp parallel for
-    for (int i = 0; i < spots.size(); ++i) {
-        const auto &spot = spots.at(i);
-        const int spot_index = m_spot_index.value(spot, -1);
-        if (spot_index != -1) {
-            m_spots.at(spot_index)->selected(true);
-        }
+    for (int i = 0; i < spots_inside.size(); ++i) {
+        m_spots.at(spots_inside.at(i))->selected(!remove);
     }
 }
 
+void STData::selectSpots(const QVector<QString> &spots)
+{
+    selectSpots(m_spot_ids.ids(spots));
+}
+
 void STData::selectSpots(const QVector<int> &spots_indexes)
 {
     clearSelection();
@@ -667,12 +1191,11 @@ void STData::loadClusters(const ClusterListType &clusters)
         const auto cluster_obj = clusters.at(i);
         const auto &spots = cluster_obj->spots();
         const QColor &color = cluster_obj->color();
-        for (int j = 0; j < spots.size(); ++j) {
-            const int spot_index = m_spot_index.value(spots.at(j), -1);
-            if (spot_index != -1) {
+        for (const int spot_id : spots) {
+            if (spot_id >= 0 && spot_id < m_spots.size()) {
                 // Reading should be thread-safe
-                m_spots.at(spot_index)->color(color);
-                m_spots.at(spot_index)->visible(true);
+                m_spots.at(spot_id)->color(color);
+                m_spots.at(spot_id)->visible(true);
             }
         }
     }
@@ -687,37 +1210,40 @@ void STData::updateClusters()
         const auto &spots = cluster_obj->spots();
         const QColor &color = cluster_obj->color();
         const bool &visible = cluster_obj->visible();
-        for (int j = 0; j < spots.size(); ++j) {
-            const int spot_index = m_spot_index.value(spots.at(j), -1);
-            if (spot_index != -1) {
+        for (const int spot_id : spots) {
+            if (spot_id >= 0 && spot_id < m_spots.size()) {
                 // Reading should be thread-safe
-                m_spots.at(spot_index)->color(color);
-                m_spots.at(spot_index)->visible(visible);
+                m_spots.at(spot_id)->color(color);
+                m_spots.at(spot_id)->visible(visible);
             }
         }
     }
 }
 
-void STData::loadGeneColors(const QVector<QString> &genes,
+void STData::loadGeneColors(const QVector<int> &genes_ids,
                             const QVector<int> &colors)
 {
-    Q_ASSERT(genes.size() == colors.size());
+    Q_ASSERT(genes_ids.size() == colors.size());
+    if (colors.empty()) {
+        return;
+    }
     const auto min_max = std::minmax_element(colors.begin(), colors.end());
     const int min = *min_max.first;
     const int max = *min_max.second;
+    // map all the values to colors at once with the lookup table of the gradient
+    const std::vector<float> values(colors.begin(), colors.end());
+    std::vector<QRgb> rgbs(values.size());
+    Color::ColorLookupTable::get(QCPColorGradient::gpJet).rgb(values.data(),
+                                                              static_cast<int>(values.size()),
+                                                              min, max, rgbs.data());
     #pragma omp parallel for
-    for (int i = 0; i < genes.size(); ++i) {
-        const QString &gene = genes.at(i);
-        const int color_value = colors.at(i);
-        const QColor color = Color::createCMapColor(color_value,
-                                                    min,
-                                                    max,
-                                                    QCPColorGradient::gpJet);
-        const int gene_index = m_gene_index.value(gene, -1);
-        if (gene_index != -1) {
+    for (int i = 0; i < genes_ids.size(); ++i) {
+        const int gene_id = genes_ids.at(i);
+        const QColor color(rgbs[i]);
+        if (gene_id >= 0 && gene_id < m_genes.size()) {
             // Reading should be thread-safe
-            m_genes.at(gene_index)->color(color);
-            m_genes.at(gene_index)->visible(true);
+            m_genes.at(gene_id)->color(color);
+            m_genes.at(gene_id)->visible(true);
         }
     }
 }
@@ -749,4 +1275,9 @@ bool STData::is3D() const
 void STData::is3D(bool is3D)
 {
     m_is3D = is3D;
+    if (m_is3D) {
+        m_spot_octree.build(m_rendering_coords);
+    } else {
+        m_spot_octree.clear();
+    }
 }
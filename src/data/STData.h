@@ -2,22 +2,35 @@
 #define STDATA_H
 
 #include <QSharedPointer>
+#include <QScopedPointer>
 #include <QList>
+#include <QPair>
 #include <QVector2D>
 #include <QVector3D>
-#include <QVector4D>
+#include <QMatrix4x4>
 #include <QColor>
 
 #include "data/Gene.h"
 #include "data/Spot.h"
 #include "data/Cluster.h"
+#include "data/IdTable.h"
+#include "data/SpotIndex.h"
+#include "data/PointOctree.h"
 #include "viewPages/SettingsWidget.h"
 #include "viewRenderer/SelectionEvent.h"
 
 #include <armadillo>
+#include <algorithm>
+#include <vector>
 
 using namespace arma;
 
+namespace DatasetCache
+{
+struct Entry;
+}
+class LoadingProgress;
+
 class STData
 {
 
@@ -30,19 +43,88 @@ public:
     typedef QVector<GeneObjectType> GeneListType;
     typedef QVector<ClusterObjectType> ClusterListType;
 
+    // the matrix of counts (spots as rows and genes as columns) is stored
+    // either dense (counts) or sparse (sp_counts) as indicated by is_sparse
     struct STDataFrame {
         mat counts;
+        sp_mat sp_counts;
+        bool is_sparse = false;
         QList<QString> genes;
         QList<QString> spots;
+
+        uword n_rows() const { return is_sparse ? sp_counts.n_rows : counts.n_rows; }
+        uword n_cols() const { return is_sparse ? sp_counts.n_cols : counts.n_cols; }
+        // returns the counts as a dense matrix (the sparse storage is converted)
+        mat dense() const { return is_sparse ? mat(sp_counts) : counts; }
+    };
+
+    // the settings and the state of the spots and genes used to compute the rendering
+    // data, it is taken on the GUI thread so the data can be computed on another thread
+    struct RenderingInput {
+        SettingsWidget::Rendering settings;
+        std::vector<char> spots_visible;
+        std::vector<char> spots_selected;
+        QVector<QColor> spots_colors;
+        std::vector<char> genes_visible;
+        QVector<QColor> genes_colors;
+    };
+
+    // the ranges (first spot and number of spots) of the rendering data that changed
+    typedef QVector<QPair<int, int>> RenderingRanges;
+
+    // the flags of the vertex of a spot
+    enum RenderingFlag {
+        Visible = 1,
+        Selected = 2
+    };
+
+    // the (interleaved) vertex of a spot in the buffer of the view (24 bytes)
+    // the position, the color (RGBA8), the value of the spot (mapped to a color
+    // by the view in the visual modes that show values) and the flags (visible and selected)
+    struct RenderingVertex {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+        quint8 color[4] = {255, 255, 255, 255};
+        float value = 0.0f;
+        quint8 flags = 0;
+        quint8 padding[3] = {0, 0, 0};
+
+        bool operator==(const RenderingVertex &other) const
+        {
+            return x == other.x && y == other.y && z == other.z
+                    && std::equal(color, color + 4, other.color)
+                    && value == other.value && flags == other.flags;
+        }
+        bool operator!=(const RenderingVertex &other) const { return !(*this == other); }
+    };
+
+    // the rendering (OpenGL) vertices, the range of the values of the spots and the
+    // visual mode they were computed with (Normal if the values are not used)
+    // the dirty ranges are the spots that changed from the previous rendering data
+    // (so only them need to be uploaded to the buffer)
+    struct RenderingData {
+        QVector<RenderingVertex> vertices;
+        double legend_min = 0.0;
+        double legend_max = 0.0;
+        SettingsWidget::VisualMode visual_mode = SettingsWidget::Normal;
+        RenderingRanges dirty;
     };
 
     STData();
     ~STData();
 
     // parses the dataset (counts matrix and spot coordinates)
-    void init(const QString &filename, const QString &spots_coordinates);
+    // the parsed dataset is cached so next time it is loaded from the cache
+    // the progress of the stages is reported to progress (if given) and the
+    // parsing stops with LoadingCancelled when it is cancelled
+    void init(const QString &filename, const QString &spots_coordinates,
+              LoadingProgress *progress = nullptr);
 
     // functions to import/export a counts matrix
+    // the matrix can be a TSV file, a Matrix Market file (10x Genomics format),
+    // an HDF5 file (10x Genomics or AnnData format) or a binary file (*.stcache)
+    // the format of the export is given by the extension (see MatrixWriter)
     static STDataFrame read(const QString &filename);
     static void save(const QString &filename, const STDataFrame &data);
 
@@ -53,16 +135,49 @@ public:
     const GeneListType &genes() const;
     const SpotListType &spots() const;
 
+    // returns the tables of the spot/gene ids (the ids are the indexes in the data matrix)
+    const IdTable &spotIds() const;
+    const IdTable &geneIds() const;
+
+    // returns the spatial index of the spots (the ids are the indexes in the data matrix)
+    const SpotIndex &spotIndex() const;
+
+    // returns the index of the visible spot (in the rendering data) nearest to the
+    // position (adjusted coordinates) within the radius (-1 if none)
+    int nearestVisibleSpot(const QPointF &position, const double radius) const;
+
+    // returns the octree of the (rendering) coordinates of the spots (only for 3D datasets)
+    const PointOctree &spotOctree() const;
+
+    // returns the index of the visible spot nearest to the camera among the spots that the
+    // matrix (from the rendering coordinates to the coordinates of the view) projects within
+    // the radius of the position (a ray cast for 3D datasets, -1 if none)
+    int nearestVisibleSpot(const QPointF &position,
+                           const double radius,
+                           const QMatrix4x4 &window_mvp) const;
+
+    // returns the (at most n) genes with the highest counts in the spot (gene index and count)
+    // sorted by count, only the counts of the spot are read (not the whole matrix)
+    QVector<QPair<int, double>> topGenes(const int spot, const int n) const;
+
     // returns the clusters if any
     const ClusterListType &clusters() const;
 
-    // updates the rendering (OpenGL) data
+    // updates the rendering (OpenGL) data, the data is computed in stages that cache
+    // their outputs so only the stages affected by the changes are computed again
     void computeRenderingData(SettingsWidget::Rendering &rendering_settings);
 
-    // returns the rendering (OpenGL) data vectors
-    const QVector<int> &renderingVisible() const;
-    const QVector<QVector4D> &renderingColors() const;
-    const QVector<int> &renderingSelected() const;
+    // functions to compute the rendering data on a worker thread, the input is taken
+    // on the GUI thread and the data is computed into a buffer (only one computation
+    // can run at a time) that replaces the rendering data with swapRenderingData()
+    // (the buffer gets the previous rendering data so its memory is reused)
+    RenderingInput renderingInput(const SettingsWidget::Rendering &rendering_settings) const;
+    void computeRenderingData(const RenderingInput &input, RenderingData &data);
+    void swapRenderingData(RenderingData &data);
+
+    // returns the rendering (OpenGL) data and the coordinates of the spots
+    const RenderingData &renderingData() const;
+    const QVector<RenderingVertex> &renderingVertices() const;
     const QVector<Spot::SpotType> &renderingCoords() const;
 
     // helper function that normalizes a data frame and returns it
@@ -79,7 +194,10 @@ public:
                                     const int min_genes,
                                     const int min_spots);
     const STDataFrame sliceDataSpots(const QList<QString> &spots);
+    const STDataFrame sliceDataSpots(const QVector<int> &spots_ids);
     const STDataFrame sliceDataGenes(const QList<QString> &genes);
+    static STDataFrame sliceRows(const STDataFrame &data, const uvec &rows);
+    static STDataFrame sliceColumns(const STDataFrame &data, const uvec &columns);
 
     // helper function that merges a list of data matrices
     static STDataFrame aggregate(const QList<STDataFrame> &dataframes);
@@ -87,6 +205,9 @@ public:
     // functions to select spots
     void clearSelection();
     void selectSpots(const SelectionEvent &event);
+    // selects the spots that the matrix (from the rendering coordinates to the coordinates
+    // of the view) projects inside the path of the event (3D datasets)
+    void selectSpots(const SelectionEvent &event, const QMatrix4x4 &window_mvp);
     void selectSpots(const QVector<QString> &spots);
     void selectSpots(const QVector<int> &spots_indexes);
 
@@ -96,8 +217,8 @@ public:
     // to notify that the clusters have been updated
     void updateClusters();
 
-    // Load gene colours
-    void loadGeneColors(const QVector<QString> &genes,
+    // Load gene colours (genes are given by their ids)
+    void loadGeneColors(const QVector<int> &genes_ids,
                         const QVector<int> &colors);
 
     // returns the boundaries of the spots in the data matrix (min spot and max spot coordinates)
@@ -109,10 +230,18 @@ public:
 
 private:
 
-    // parses a file with spots coordinates
-    // it returns a map of spot -> pixel coordinates
-    // it throws exceptions when errors happen during parsing or an empty file
-    QMap<QString, Spot::SpotType> parseSpotsMap(const QString &spots_file) const;
+    // parses the matrix of counts and the spot coordinates and keeps
+    // the spots with coordinates and the spots/genes with counts
+    // it throws exceptions when errors happen during parsing
+    DatasetCache::Entry parseDataset(const QString &filename,
+                                     const QString &spots_coordinates,
+                                     LoadingProgress *progress) const;
+
+    // the stages of the rendering data with their cached outputs
+    struct RenderingPipeline;
+
+    // computes the visible, colors and selected vectors of the rendering data
+    void computeRenderingColors(const RenderingInput &input, RenderingData &data);
 
     // the ST data frame (matrix of counts, genes and spots)
     STDataFrame m_data;
@@ -127,15 +256,20 @@ private:
     // of the spots belonging to the clusters
     ClusterListType m_clusters;
 
-    // convenience hash tables (gene name -> index) and (spot name -> index)
-    QHash<QString, int> m_spot_index;
-    QHash<QString, int> m_gene_index;
+    // the interned names of the spots and genes (name -> id where id is the index in m_data)
+    IdTable m_spot_ids;
+    IdTable m_gene_ids;
+
+    // the spatial index of the (adjusted) coordinates of the spots
+    SpotIndex m_spot_index;
+
+    // the octree of the rendering coordinates of the spots (built for 3D datasets)
+    PointOctree m_spot_octree;
 
     // rendering data
-    QVector<int> m_rendering_visible;
-    QVector<QVector4D> m_rendering_colors;
+    QScopedPointer<RenderingPipeline> m_pipeline;
+    RenderingData m_rendering;
     QVector<Spot::SpotType> m_rendering_coords;
-    QVector<int> m_rendering_selected;
 
     // whether the data is in 3D or not
     bool m_is3D;
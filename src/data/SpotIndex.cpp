@@ -0,0 +1,243 @@
+#include "SpotIndex.h"
+
+#include <QPolygonF>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// the margin (in cells) added to the segments when the cells they cross are marked
+// so the cells that a segment touches by rounding errors are tested exactly
+constexpr double SEGMENT_MARGIN = 1e-6;
+
+SpotIndex::SpotIndex()
+    : m_bounds()
+    , m_columns(0)
+    , m_rows(0)
+    , m_cell_size(1.0)
+    , m_cell_ptrs()
+    , m_spots()
+    , m_positions()
+{
+}
+
+SpotIndex::~SpotIndex()
+{
+}
+
+void SpotIndex::build(const QVector<Spot::SpotType> &coordinates)
+{
+    clear();
+    const int n_spots = coordinates.size();
+    if (n_spots == 0) {
+        return;
+    }
+
+    // the bounds of the spots
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    for (const auto &coordinate : coordinates) {
+        min_x = std::min<double>(min_x, coordinate.x());
+        min_y = std::min<double>(min_y, coordinate.y());
+        max_x = std::max<double>(max_x, coordinate.x());
+        max_y = std::max<double>(max_y, coordinate.y());
+    }
+    m_bounds = QRectF(QPointF(min_x, min_y), QPointF(max_x, max_y));
+
+    // square cells with SPOTS_PER_CELL spots on average
+    const int n_cells = std::max(1, n_spots / SPOTS_PER_CELL);
+    const double width = m_bounds.width();
+    const double height = m_bounds.height();
+    if (width > 0.0 && height > 0.0) {
+        m_cell_size = std::sqrt(width * height / n_cells);
+    } else if (width > 0.0 || height > 0.0) {
+        m_cell_size = std::max(width, height) / n_cells;
+    }
+    m_columns = static_cast<int>(width / m_cell_size) + 1;
+    m_rows = static_cast<int>(height / m_cell_size) + 1;
+
+    // sort the spots by cell (counting sort)
+    std::vector<int> spot_cells(n_spots);
+    m_cell_ptrs.assign(m_columns * m_rows + 1, 0);
+    for (int i = 0; i < n_spots; ++i) {
+        const auto &coordinate = coordinates.at(i);
+        spot_cells[i] = cellRow(coordinate.y()) * m_columns + cellColumn(coordinate.x());
+        ++m_cell_ptrs[spot_cells[i] + 1];
+    }
+    std::partial_sum(m_cell_ptrs.begin(), m_cell_ptrs.end(), m_cell_ptrs.begin());
+    std::vector<int> next(m_cell_ptrs.begin(), m_cell_ptrs.end() - 1);
+    m_spots.resize(n_spots);
+    m_positions.resize(n_spots);
+    for (int i = 0; i < n_spots; ++i) {
+        const int position = next[spot_cells[i]]++;
+        m_spots[position] = i;
+        m_positions[position] = QPointF(coordinates.at(i).x(), coordinates.at(i).y());
+    }
+}
+
+void SpotIndex::clear()
+{
+    m_bounds = QRectF();
+    m_columns = 0;
+    m_rows = 0;
+    m_cell_size = 1.0;
+    m_cell_ptrs.clear();
+    m_spots.clear();
+    m_positions.clear();
+}
+
+QVector<int> SpotIndex::spotsInside(const QPainterPath &path) const
+{
+    QVector<int> spots;
+    const QRectF rect = path.boundingRect();
+    if (m_spots.empty() || path.isEmpty()
+            || rect.right() < m_bounds.left() || rect.left() > m_bounds.right()
+            || rect.bottom() < m_bounds.top() || rect.top() > m_bounds.bottom()) {
+        return spots;
+    }
+
+    // the cells of the bounding rect of the path, the cells crossed by the path are marked
+    const QRect cells(QPoint(cellColumn(rect.left()), cellRow(rect.top())),
+                      QPoint(cellColumn(rect.right()), cellRow(rect.bottom())));
+    std::vector<char> crossed(cells.width() * cells.height(), 0);
+    for (const QPolygonF &polygon : path.toSubpathPolygons()) {
+        // the subpaths are closed when they are filled
+        for (int i = 0; i < polygon.size(); ++i) {
+            markSegment(polygon.at(i), polygon.at((i + 1) % polygon.size()), cells, crossed);
+        }
+    }
+
+    const auto appendCells = [&](const int row, const int first, const int last) {
+        const int begin = m_cell_ptrs[row * m_columns + first];
+        const int end = m_cell_ptrs[row * m_columns + last + 1];
+        for (int k = begin; k < end; ++k) {
+            spots.append(m_spots[k]);
+        }
+    };
+
+    for (int row = cells.top(); row <= cells.bottom(); ++row) {
+        const char *crossed_row = crossed.data() + (row - cells.top()) * cells.width();
+        int column = cells.left();
+        while (column <= cells.right()) {
+            if (crossed_row[column - cells.left()]) {
+                // the spots of a crossed cell are tested exactly
+                const int cell = row * m_columns + column;
+                for (int k = m_cell_ptrs[cell]; k < m_cell_ptrs[cell + 1]; ++k) {
+                    if (path.contains(m_positions[k])) {
+                        spots.append(m_spots[k]);
+                    }
+                }
+                ++column;
+                continue;
+            }
+            // a run of cells not crossed by the path is inside or outside as a whole
+            int last = column;
+            while (last < cells.right() && !crossed_row[last + 1 - cells.left()]) {
+                ++last;
+            }
+            const QPointF center(m_bounds.left() + (column + 0.5) * m_cell_size,
+                                 m_bounds.top() + (row + 0.5) * m_cell_size);
+            if (path.contains(center)) {
+                appendCells(row, column, last);
+            }
+            column = last + 1;
+        }
+    }
+    return spots;
+}
+
+int SpotIndex::nearestSpot(const QPointF &position, const double radius,
+                           const std::function<bool(int)> &accept) const
+{
+    if (m_spots.empty()
+            || position.x() + radius < m_bounds.left() || position.x() - radius > m_bounds.right()
+            || position.y() + radius < m_bounds.top() || position.y() - radius > m_bounds.bottom()) {
+        return -1;
+    }
+    int nearest = -1;
+    double nearest_distance = radius * radius;
+    const int last_column = cellColumn(position.x() + radius);
+    const int last_row = cellRow(position.y() + radius);
+    for (int row = cellRow(position.y() - radius); row <= last_row; ++row) {
+        for (int column = cellColumn(position.x() - radius); column <= last_column; ++column) {
+            const int cell = row * m_columns + column;
+            for (int k = m_cell_ptrs[cell]; k < m_cell_ptrs[cell + 1]; ++k) {
+                const QPointF delta = m_positions[k] - position;
+                const double distance = QPointF::dotProduct(delta, delta);
+                if (distance <= nearest_distance
+                        && (nearest == -1 || distance < nearest_distance || m_spots[k] < nearest)
+                        && (!accept || accept(m_spots[k]))) {
+                    nearest = m_spots[k];
+                    nearest_distance = distance;
+                }
+            }
+        }
+    }
+    return nearest;
+}
+
+const QRectF &SpotIndex::bounds() const
+{
+    return m_bounds;
+}
+
+int SpotIndex::size() const
+{
+    return static_cast<int>(m_spots.size());
+}
+
+int SpotIndex::cellColumn(const double x) const
+{
+    const double column = std::floor((x - m_bounds.left()) / m_cell_size);
+    return static_cast<int>(std::clamp(column, 0.0, static_cast<double>(m_columns - 1)));
+}
+
+int SpotIndex::cellRow(const double y) const
+{
+    const double row = std::floor((y - m_bounds.top()) / m_cell_size);
+    return static_cast<int>(std::clamp(row, 0.0, static_cast<double>(m_rows - 1)));
+}
+
+void SpotIndex::markSegment(const QPointF &p0, const QPointF &p1,
+                            const QRect &cells, std::vector<char> &marked) const
+{
+    // the segment in cell units (from left to right)
+    double x0 = (p0.x() - m_bounds.left()) / m_cell_size;
+    double y0 = (p0.y() - m_bounds.top()) / m_cell_size;
+    double x1 = (p1.x() - m_bounds.left()) / m_cell_size;
+    double y1 = (p1.y() - m_bounds.top()) / m_cell_size;
+    if (x0 > x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+    const auto clampColumn = [&](const double x) {
+        return static_cast<int>(std::clamp(std::floor(x), static_cast<double>(cells.left()),
+                                           static_cast<double>(cells.right())));
+    };
+    const auto clampRow = [&](const double y) {
+        return static_cast<int>(std::clamp(std::floor(y), static_cast<double>(cells.top()),
+                                           static_cast<double>(cells.bottom())));
+    };
+
+    // every column the segment spans marks the rows of the segment within the column
+    const int first_column = clampColumn(x0 - SEGMENT_MARGIN);
+    const int last_column = clampColumn(x1 + SEGMENT_MARGIN);
+    for (int column = first_column; column <= last_column; ++column) {
+        double ya = y0;
+        double yb = y1;
+        if (x1 > x0) {
+            const double xa = std::clamp<double>(column, x0, x1);
+            const double xb = std::clamp<double>(column + 1, x0, x1);
+            ya = y0 + (y1 - y0) * (xa - x0) / (x1 - x0);
+            yb = y0 + (y1 - y0) * (xb - x0) / (x1 - x0);
+        }
+        const int first_row = clampRow(std::min(ya, yb) - SEGMENT_MARGIN);
+        const int last_row = clampRow(std::max(ya, yb) + SEGMENT_MARGIN);
+        for (int row = first_row; row <= last_row; ++row) {
+            marked[(row - cells.top()) * cells.width() + (column - cells.left())] = 1;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SPOTINDEX_H
+#define SPOTINDEX_H
+
+#include <QPainterPath>
+#include <QPointF>
+#include <QRect>
+#include <QRectF>
+#include <QVector>
+
+#include <functional>
+#include <vector>
+
+#include "data/Spot.h"
+
+// SpotIndex is a uniform grid over the 2D coordinates (x and y) of the spots, it is
+// built once when the dataset is loaded and it is used to find the spots inside a
+// selection path or near a position without testing all the spots.
+// Only the spots of the cells crossed by the path are tested exactly, the rest of
+// the cells are inside or outside the path as a whole (one test per run of cells)
+class SpotIndex
+{
+
+public:
+
+    // the average number of spots in a cell of the grid
+    static constexpr int SPOTS_PER_CELL = 4;
+
+    SpotIndex();
+    ~SpotIndex();
+
+    // builds the grid with the coordinates of the spots (the index of a spot is its position)
+    void build(const QVector<Spot::SpotType> &coordinates);
+    void clear();
+
+    // returns the indexes of the spots inside the path (using its fill rule)
+    QVector<int> spotsInside(const QPainterPath &path) const;
+
+    // returns the index of the spot nearest to the position within the radius (-1 if none)
+    // only the spots accepted by the filter (if given) are considered
+    int nearestSpot(const QPointF &position, const double radius,
+                    const std::function<bool(int)> &accept = std::function<bool(int)>()) const;
+
+    // the bounding rect of the spots
+    const QRectF &bounds() const;
+
+    // the number of spots in the grid
+    int size() const;
+
+private:
+
+    // the column and the row of the cell of a position (clamped to the grid)
+    int cellColumn(const double x) const;
+    int cellRow(const double y) const;
+
+    // marks the cells (within the given range) crossed by the segment
+    void markSegment(const QPointF &p0, const QPointF &p1,
+                     const QRect &cells, std::vector<char> &marked) const;
+
+    QRectF m_bounds;
+    int m_columns;
+    int m_rows;
+    double m_cell_size;
+
+    // the spots of the cell i are between m_cell_ptrs[i] and m_cell_ptrs[i + 1]
+    // the positions of the spots are stored in the same order (so the cells are contiguous)
+    std::vector<int> m_cell_ptrs;
+    std::vector<int> m_spots;
+    std::vector<QPointF> m_positions;
+};
+
+#endif // SPOTINDEX_H
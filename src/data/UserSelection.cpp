@@ -67,12 +67,12 @@ const QString UserSelection::comment() const
 
 int UserSelection::totalGenes() const
 {
-    return m_data.counts.n_cols;
+    return m_data.n_cols();
 }
 
 int UserSelection::totalSpots() const
 {
-    return m_data.counts.n_rows;
+    return m_data.n_rows();
 }
 
 void UserSelection::name(const QString &name)
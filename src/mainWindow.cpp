@@ -22,6 +22,7 @@
 #include <QFont>
 #include <QDir>
 #include <QFileDialog>
+#include <QProgressDialog>
 
 #include "dialogs/AboutDialog.h"
 #include "viewPages/DatasetPage.h"
@@ -30,6 +31,9 @@
 #include "viewPages/GenesWidget.h"
 #include "viewPages/SpotsWidget.h"
 #include "viewPages/ClustersWidget.h"
+#include "data/DatasetCache.h"
+#include "data/DatasetLoader.h"
+#include "data/Dataset.h"
 #include "config/Configuration.h"
 #include "SettingsStyle.h"
 
@@ -53,6 +57,8 @@ MainWindow::MainWindow(QWidget *parent)
     , m_genes(nullptr)
     , m_spots(nullptr)
     , m_clusters(nullptr)
+    , m_loader(nullptr)
+    , m_progress_dialog(nullptr)
 {
     setUnifiedTitleAndToolBarOnMac(true);
 
@@ -74,6 +80,9 @@ MainWindow::MainWindow(QWidget *parent)
 
     m_cellview.reset(new CellViewPage(m_spots, m_genes, m_clusters, m_user_selections));
     Q_ASSERT(m_cellview);
+
+    m_loader.reset(new DatasetLoader());
+    Q_ASSERT(m_loader);
 }
 
 MainWindow::~MainWindow()
@@ -137,6 +146,14 @@ void MainWindow::setupUi()
     setMinimumSize(QSize(1024, 768));
     setWindowIcon(QIcon(QStringLiteral(":/images/st_icon.png")));
 
+    // progress of the loading of the datasets
+    m_progress_dialog.reset(new QProgressDialog(this));
+    m_progress_dialog->setWindowTitle(tr("Load Dataset"));
+    m_progress_dialog->setRange(0, 100);
+    m_progress_dialog->setMinimumDuration(0);
+    m_progress_dialog->setAutoClose(false);
+    m_progress_dialog->reset();
+
     // create main widget
     QWidget *centralwidget = new QWidget(this);
     // NOTE important to set the style to this widget only to avoid propagation
@@ -258,7 +275,8 @@ void MainWindow::slotClearCache()
                                             QMessageBox::No | QMessageBox::Escape);
 
     if (answer == QMessageBox::Yes) {
-        //NOTE nothing for now
+        // remove the cached datasets (they will be parsed again when opened)
+        DatasetCache::clear();
     }
 }
 
@@ -321,6 +339,31 @@ void MainWindow::createConnections()
             &DatasetPage::signalDatasetRemoved,
             this,
             &MainWindow::slotDatasetRemoved);
+
+    // the loading of the datasets (progress, cancel, done and errors)
+    connect(m_loader.data(),
+            &DatasetLoader::signalProgress,
+            this,
+            [this](const QString &stage, const int percent) {
+        m_progress_dialog->setLabelText(stage);
+        m_progress_dialog->setValue(percent);
+    });
+    connect(m_progress_dialog.data(),
+            &QProgressDialog::canceled,
+            m_loader.data(),
+            &DatasetLoader::cancel);
+    connect(m_loader.data(),
+            &DatasetLoader::signalCancelled,
+            m_progress_dialog.data(),
+            &QProgressDialog::reset);
+    connect(m_loader.data(),
+            &DatasetLoader::signalDatasetLoaded,
+            this,
+            &MainWindow::slotDatasetLoaded);
+    connect(m_loader.data(),
+            &DatasetLoader::signalError,
+            this,
+            &MainWindow::slotDatasetLoadingError);
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
@@ -354,21 +397,34 @@ void MainWindow::saveSettings() const
 
 void MainWindow::slotDatasetOpen(const QString &datasetname)
 {
+    // the dataset is loaded in the background (the previous loading is cancelled)
+    qDebug() << "Opening dataset " << datasetname;
+    m_loader->load(m_datasets->getCurrentDataset());
+    m_progress_dialog->setLabelText(tr("Loading dataset ") + datasetname);
+    m_progress_dialog->setValue(0);
+    m_progress_dialog->show();
+}
+
+void MainWindow::slotDatasetLoaded(QSharedPointer<Dataset> dataset)
+{
+    m_progress_dialog->reset();
     QGuiApplication::setOverrideCursor(Qt::WaitCursor);
-    auto dataset = m_datasets->getCurrentDataset();
     try {
-        // first load the dataset
-        dataset->load_data();
-        qDebug() << "Dataset opened " << datasetname;
+        qDebug() << "Dataset opened " << dataset->name();
         m_cellview->loadDataset(*(dataset.data()));
     } catch (const std::exception &e) {
-        const QString ex_message = QString::fromStdString(e.what());
-        const QString message = "Error opening ST Dataset " + ex_message;
-        QMessageBox::critical(this, tr("Load Dataset"), message);
+        slotDatasetLoadingError(QString::fromStdString(e.what()));
     }
     QGuiApplication::restoreOverrideCursor();
 }
 
+void MainWindow::slotDatasetLoadingError(const QString &error)
+{
+    m_progress_dialog->reset();
+    const QString message = "Error opening ST Dataset " + error;
+    QMessageBox::critical(this, tr("Load Dataset"), message);
+}
+
 void MainWindow::slotDatasetUpdated(const QString &datasetname)
 {
     //NOTE we re-open the dataset even if it is just being updated
@@ -379,6 +435,7 @@ void MainWindow::slotDatasetUpdated(const QString &datasetname)
 void MainWindow::slotDatasetRemoved(const QString &datasetname)
 {
     qDebug() << "Dataset removed " << datasetname;
+    m_loader->cancel();
     m_genes->clear();
     m_spots->clear();
     m_cellview->clear();
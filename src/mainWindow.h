@@ -2,6 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QSharedPointer>
 
 class QSettings;
 class QCloseEvent;
@@ -10,6 +11,9 @@ class QStatusBar;
 class QMenu;
 class QVBoxLayout;
 class QWidget;
+class QProgressDialog;
+class Dataset;
+class DatasetLoader;
 class DatasetPage;
 class CellViewPage;
 class UserSelectionsPage;
@@ -58,6 +62,12 @@ private slots:
     // a dataset has been removed (the current open)
     void slotDatasetRemoved(const QString &datasetname);
 
+    // the dataset has been loaded in the background
+    void slotDatasetLoaded(QSharedPointer<Dataset> dataset);
+
+    // the loading of the dataset failed
+    void slotDatasetLoadingError(const QString &error);
+
 private:
 
     // create all the widgets
@@ -91,6 +101,10 @@ private:
     QSharedPointer<GenesWidget> m_genes;
     QSharedPointer<SpotsWidget> m_spots;
     QSharedPointer<ClustersWidget> m_clusters;
+
+    // to load the datasets in the background and show the progress
+    QScopedPointer<DatasetLoader> m_loader;
+    QScopedPointer<QProgressDialog> m_progress_dialog;
 };
 
 #endif // MAINWINDOW_H
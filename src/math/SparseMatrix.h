@@ -0,0 +1,252 @@
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+#include <armadillo>
+
+using namespace arma;
+
+// This namespace provides functions to operate on the matrices of counts
+// without visiting the zero elements of the sparse (CSC) matrices.
+// The sparse functions access the compressed storage of sp_mat directly
+// (values, row_indices and col_ptrs) so their cost depends on the number
+// of non-zero elements. Dense overloads are provided so the same code can
+// be used for both storages.
+namespace STMath
+{
+
+// returns the fraction of non-zero elements of the matrix
+inline double density(const sp_mat &X)
+{
+    const double n_elem = static_cast<double>(X.n_rows) * static_cast<double>(X.n_cols);
+    return n_elem > 0 ? X.n_nonzero / n_elem : 0.0;
+}
+
+// returns the sum of the elements of each row
+inline colvec rowSums(const sp_mat &X)
+{
+    X.sync();
+    colvec sums(X.n_rows, fill::zeros);
+    for (uword k = 0; k < X.n_nonzero; ++k) {
+        sums[X.row_indices[k]] += X.values[k];
+    }
+    return sums;
+}
+
+inline colvec rowSums(const mat &X)
+{
+    return sum(X, 1);
+}
+
+// returns the sum of the elements of each column
+inline rowvec colSums(const sp_mat &X)
+{
+    X.sync();
+    rowvec sums(X.n_cols);
+    #pragma omp parallel for
+    for (uword j = 0; j < X.n_cols; ++j) {
+        double sum = 0.0;
+        for (uword k = X.col_ptrs[j]; k < X.col_ptrs[j + 1]; ++k) {
+            sum += X.values[k];
+        }
+        sums[j] = sum;
+    }
+    return sums;
+}
+
+inline rowvec colSums(const mat &X)
+{
+    return sum(X, 0);
+}
+
+// returns the number of elements of each row that satisfy the predicate
+// (the zeros of the sparse matrix are included if pred(0) is true)
+template <typename Pred>
+inline ucolvec rowCount(const sp_mat &X, Pred pred)
+{
+    X.sync();
+    ucolvec count(X.n_rows, fill::zeros);
+    ucolvec nonzeros(X.n_rows, fill::zeros);
+    for (uword k = 0; k < X.n_nonzero; ++k) {
+        const uword i = X.row_indices[k];
+        ++nonzeros[i];
+        if (pred(X.values[k])) {
+            ++count[i];
+        }
+    }
+    if (pred(0.0)) {
+        count += X.n_cols - nonzeros;
+    }
+    return count;
+}
+
+template <typename Pred>
+inline ucolvec rowCount(const mat &X, Pred pred)
+{
+    ucolvec count(X.n_rows, fill::zeros);
+    for (uword j = 0; j < X.n_cols; ++j) {
+        const double *column = X.colptr(j);
+        for (uword i = 0; i < X.n_rows; ++i) {
+            count[i] += pred(column[i]);
+        }
+    }
+    return count;
+}
+
+// returns the number of elements of each column that satisfy the predicate
+// (the zeros of the sparse matrix are included if pred(0) is true)
+template <typename Pred>
+inline urowvec colCount(const sp_mat &X, Pred pred)
+{
+    X.sync();
+    const bool zeros = pred(0.0);
+    urowvec count(X.n_cols);
+    #pragma omp parallel for
+    for (uword j = 0; j < X.n_cols; ++j) {
+        const uword first = X.col_ptrs[j];
+        const uword last = X.col_ptrs[j + 1];
+        const uword n = std::count_if(X.values + first, X.values + last, pred);
+        count[j] = zeros ? n + X.n_rows - (last - first) : n;
+    }
+    return count;
+}
+
+template <typename Pred>
+inline urowvec colCount(const mat &X, Pred pred)
+{
+    urowvec count(X.n_cols);
+    #pragma omp parallel for
+    for (uword j = 0; j < X.n_cols; ++j) {
+        count[j] = std::count_if(X.begin_col(j), X.end_col(j), pred);
+    }
+    return count;
+}
+
+// returns a new matrix with the given columns (in the given order)
+inline sp_mat selectCols(const sp_mat &X, const uvec &cols)
+{
+    X.sync();
+    uvec col_ptrs(cols.n_elem + 1);
+    col_ptrs[0] = 0;
+    for (uword k = 0; k < cols.n_elem; ++k) {
+        const uword j = cols[k];
+        col_ptrs[k + 1] = col_ptrs[k] + X.col_ptrs[j + 1] - X.col_ptrs[j];
+    }
+    uvec row_indices(col_ptrs[cols.n_elem]);
+    vec values(col_ptrs[cols.n_elem]);
+    #pragma omp parallel for
+    for (uword k = 0; k < cols.n_elem; ++k) {
+        const uword j = cols[k];
+        const uword first = X.col_ptrs[j];
+        const uword n = X.col_ptrs[j + 1] - first;
+        std::copy_n(X.row_indices + first, n, row_indices.memptr() + col_ptrs[k]);
+        std::copy_n(X.values + first, n, values.memptr() + col_ptrs[k]);
+    }
+    return sp_mat(row_indices, col_ptrs, values, X.n_rows, cols.n_elem);
+}
+
+inline mat selectCols(const mat &X, const uvec &cols)
+{
+    return X.cols(cols);
+}
+
+// returns a new matrix with the given rows (in the given order)
+// the rows must not contain duplicates
+inline sp_mat selectRows(const sp_mat &X, const uvec &rows)
+{
+    X.sync();
+    // position of each row in the new matrix (or -1 if the row is not selected)
+    std::vector<sword> new_index(X.n_rows, -1);
+    for (uword k = 0; k < rows.n_elem; ++k) {
+        new_index[rows[k]] = static_cast<sword>(k);
+    }
+    const bool sorted = std::is_sorted(rows.begin(), rows.end());
+
+    // count the elements that are kept in each column
+    uvec col_ptrs(X.n_cols + 1);
+    col_ptrs[0] = 0;
+    #pragma omp parallel for
+    for (uword j = 0; j < X.n_cols; ++j) {
+        uword n = 0;
+        for (uword k = X.col_ptrs[j]; k < X.col_ptrs[j + 1]; ++k) {
+            n += new_index[X.row_indices[k]] != -1;
+        }
+        col_ptrs[j + 1] = n;
+    }
+    std::partial_sum(col_ptrs.begin(), col_ptrs.end(), col_ptrs.begin());
+
+    uvec row_indices(col_ptrs[X.n_cols]);
+    vec values(col_ptrs[X.n_cols]);
+    #pragma omp parallel
+    {
+        std::vector<std::pair<uword, double>> column;
+        #pragma omp for
+        for (uword j = 0; j < X.n_cols; ++j) {
+            column.clear();
+            for (uword k = X.col_ptrs[j]; k < X.col_ptrs[j + 1]; ++k) {
+                const sword i = new_index[X.row_indices[k]];
+                if (i != -1) {
+                    column.emplace_back(static_cast<uword>(i), X.values[k]);
+                }
+            }
+            // the row indices of each column must be sorted in the CSC format
+            if (!sorted) {
+                std::sort(column.begin(), column.end());
+            }
+            uword pos = col_ptrs[j];
+            for (const auto &element : column) {
+                row_indices[pos] = element.first;
+                values[pos] = element.second;
+                ++pos;
+            }
+        }
+    }
+    return sp_mat(row_indices, col_ptrs, values, rows.n_elem, X.n_cols);
+}
+
+inline mat selectRows(const mat &X, const uvec &rows)
+{
+    return X.rows(rows);
+}
+
+// returns a new matrix with the given rows and columns
+inline sp_mat submat(const sp_mat &X, const uvec &rows, const uvec &cols)
+{
+    return selectRows(selectCols(X, cols), rows);
+}
+
+inline mat submat(const mat &X, const uvec &rows, const uvec &cols)
+{
+    return X.submat(rows, cols);
+}
+
+// returns a new matrix where each non-zero element is replaced by f(value, row)
+// the zero elements are not visited so f(0, row) must be 0
+template <typename F>
+inline sp_mat transformNonZeros(const sp_mat &X, F f)
+{
+    X.sync();
+    const uvec row_indices(const_cast<uword *>(X.row_indices), X.n_nonzero, false, true);
+    const uvec col_ptrs(const_cast<uword *>(X.col_ptrs), X.n_cols + 1, false, true);
+    vec values(X.n_nonzero);
+    #pragma omp parallel for
+    for (uword k = 0; k < X.n_nonzero; ++k) {
+        values[k] = f(X.values[k], X.row_indices[k]);
+    }
+    return sp_mat(row_indices, col_ptrs, values, X.n_rows, X.n_cols);
+}
+
+// returns a new matrix where each row is multiplied by the given factor
+inline sp_mat scaleRows(const sp_mat &X, const colvec &factors)
+{
+    return transformNonZeros(X, [&](const double value, const uword row) {
+        return value * factors[row];
+    });
+}
+
+}
+
+#endif // SPARSEMATRIX_H
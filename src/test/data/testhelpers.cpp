@@ -0,0 +1,61 @@
+#include "testhelpers.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <random>
+
+namespace unit
+{
+
+// writes a random matrix of counts to the given file (zeros is the percentage of zeros)
+// returns false if the file could not be written
+bool writeRandomMatrix(const QString &filename, const int n_spots, const int n_genes,
+                       const int zeros, const QString &eol)
+{
+    std::mt19937 generator(n_spots * n_genes);
+    std::uniform_int_distribution<int> counts(0, 99);
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QTextStream stream(&file);
+    for (int j = 0; j < n_genes; ++j) {
+        stream << "\t" << "gene_" << j;
+    }
+    stream << eol;
+    for (int i = 0; i < n_spots; ++i) {
+        stream << i << "x" << (i * 7) % 33;
+        for (int j = 0; j < n_genes; ++j) {
+            const int value = counts(generator);
+            if (value < zeros) {
+                stream << "\t0";
+            } else if (value < 95 || zeros >= 95) {
+                stream << "\t" << value;
+            } else {
+                stream << "\t" << QString::number(value / 7.0, 'g', 17);
+            }
+        }
+        stream << eol;
+    }
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+// writes the coordinates of every other spot of the matrix written by writeRandomMatrix
+// returns false if the file could not be written
+bool writeSpots(const QString &filename, const int n_spots)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QTextStream stream(&file);
+    for (int i = 0; i < n_spots; i += 2) {
+        stream << i << "x" << (i * 7) % 33 << "\t" << i * 10.5 << "\t" << i * 2.0 << "\n";
+    }
+    stream.flush();
+    return stream.status() == QTextStream::Ok;
+}
+
+} // namespace unit //
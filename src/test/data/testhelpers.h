@@ -0,0 +1,21 @@
+#ifndef TESTHELPERS_H
+#define TESTHELPERS_H
+
+#include <QString>
+
+// functions shared by the tests of the data module to write the input files
+namespace unit
+{
+
+// writes a random matrix of counts to the given file (zeros is the percentage of zeros)
+// returns false if the file could not be written
+bool writeRandomMatrix(const QString &filename, const int n_spots, const int n_genes,
+                       const int zeros, const QString &eol);
+
+// writes the coordinates of every other spot of the matrix written by writeRandomMatrix
+// returns false if the file could not be written
+bool writeSpots(const QString &filename, const int n_spots);
+
+} // namespace unit //
+
+#endif // TESTHELPERS_H
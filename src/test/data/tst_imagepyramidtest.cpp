@@ -0,0 +1,98 @@
+#include <QtTest/QTest>
+#include <QColor>
+#include <QDir>
+#include <QImage>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include "data/ImagePyramid.h"
+#include "data/DatasetCache.h"
+#include "tst_imagepyramidtest.h"
+
+namespace unit
+{
+
+ImagePyramidTest::ImagePyramidTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void ImagePyramidTest::initTestCase()
+{
+    // the tile caches are stored (with the cached datasets) in a test location
+    QStandardPaths::setTestModeEnabled(true);
+    DatasetCache::clear();
+}
+
+void ImagePyramidTest::cleanupTestCase()
+{
+    DatasetCache::clear();
+}
+
+void ImagePyramidTest::testImagePyramid()
+{
+    QImage image(1000, 600, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    ImagePyramid pyramid;
+    pyramid.build(image, 0.5);
+
+    // the levels go down to a thumbnail that fits in one tile
+    QCOMPARE(pyramid.levels(), 3);
+    QCOMPARE(pyramid.level(0).size, QSize(1000, 600));
+    QCOMPARE(pyramid.level(0).tiles.size(), 4 * 3);
+    QCOMPARE(pyramid.level(0).tiles.last().size(), QSize(1000 - 3 * 256, 600 - 2 * 256));
+    QCOMPARE(pyramid.level(2).size, QSize(250, 150));
+    QCOMPARE(pyramid.level(2).tiles.size(), 1);
+    QCOMPARE(pyramid.bounds(), QRectF(0, 0, 500, 300));
+
+    // the level matches the zoom (pixels of the screen per scene unit)
+    QCOMPARE(pyramid.levelForZoom(4.0), 0);
+    QCOMPARE(pyramid.levelForZoom(2.0), 0);
+    QCOMPARE(pyramid.levelForZoom(1.0), 1);
+    QCOMPARE(pyramid.levelForZoom(0.5), 2);
+    QCOMPARE(pyramid.levelForZoom(0.01), 2);
+
+    // only the tiles that intersect the rect are visible
+    QCOMPARE(pyramid.visibleTiles(0, QRectF(0, 0, 100, 100)), QVector<int>({0}));
+    QCOMPARE(pyramid.visibleTiles(0, QRectF(200, 100, 100, 100)), QVector<int>({1, 2, 5, 6}));
+    QCOMPARE(pyramid.visibleTiles(2, QRectF(-100, -100, 1000, 1000)), QVector<int>({0}));
+    QVERIFY(pyramid.visibleTiles(0, QRectF(600, 400, 10, 10)).isEmpty());
+    QCOMPARE(pyramid.tileRect(0, 5), QRectF(128, 128, 128, 128));
+
+    // the tiles are stored in the tile cache and the fine levels are read on demand
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString image_file = dir.filePath("image.jpg");
+    QImage large_image(5000, 1200, QImage::Format_RGB32);
+    large_image.fill(Qt::blue);
+    if (!large_image.save(image_file, "JPG")) {
+        QSKIP("JPEG images are not supported in this build");
+    }
+    ImagePyramid lazy_pyramid;
+    QVERIFY(lazy_pyramid.open(image_file, 1.0));
+    QCOMPARE(lazy_pyramid.levels(), 6);
+    QCOMPARE(lazy_pyramid.bounds(), QRectF(0, 0, 5000, 1200));
+    QVERIFY(!lazy_pyramid.isTileLoaded(0, 0));
+    QVERIFY(!lazy_pyramid.isTileLoaded(1, 0));
+    QVERIFY(lazy_pyramid.isTileLoaded(2, 0));
+    const QImage tile = lazy_pyramid.tile(0, 19);
+    QCOMPARE(tile.size(), QSize(5000 - 19 * 256, 256));
+    QCOMPARE(QColor(tile.pixel(10, 10)).blue() > 200, true);
+    QCOMPARE(QDir(DatasetCache::directory()).entryList({"*.sttiles"}, QDir::Files).size(), 1);
+
+    // the second time the tiles are read from the cache
+    ImagePyramid cached_pyramid;
+    QVERIFY(cached_pyramid.open(image_file, 1.0));
+    QCOMPARE(cached_pyramid.levels(), 6);
+    QVERIFY(!cached_pyramid.isTileLoaded(0, 0));
+    QVERIFY(cached_pyramid.isTileLoaded(2, 0));
+    QCOMPARE(cached_pyramid.level(2).tiles.first().size(), QSize(256, 256));
+    const QImage cached_tile = cached_pyramid.tile(0, 19);
+    QCOMPARE(cached_tile.size(), QSize(5000 - 19 * 256, 256));
+    QCOMPARE(QColor(cached_tile.pixel(10, 10)).blue() > 200, true);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::ImagePyramidTest)
+#include "tst_imagepyramidtest.moc"
@@ -0,0 +1,25 @@
+#ifndef TST_IMAGEPYRAMIDTEST_H
+#define TST_IMAGEPYRAMIDTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class ImagePyramidTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImagePyramidTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testImagePyramid();
+};
+
+} // namespace unit //
+
+#endif // TST_IMAGEPYRAMIDTEST_H
@@ -0,0 +1,156 @@
+#include <QtTest/QTest>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector3D>
+#include <QtMath>
+
+#include <cmath>
+#include <stdexcept>
+
+#include "data/MeshLevels.h"
+#include "data/DatasetCache.h"
+#include "tst_meshlevelstest.h"
+
+namespace unit
+{
+
+MeshLevelsTest::MeshLevelsTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void MeshLevelsTest::initTestCase()
+{
+    // the simplified meshes are stored (with the cached datasets) in a test location
+    QStandardPaths::setTestModeEnabled(true);
+    DatasetCache::clear();
+}
+
+void MeshLevelsTest::cleanupTestCase()
+{
+    DatasetCache::clear();
+}
+
+void MeshLevelsTest::testReadMesh()
+{
+    // a quad and a triangle with relative indexes, the texture coordinates and
+    // the indexes of the normals are skipped (the normals are computed)
+    const QByteArray obj = "# mesh\r\n"
+                           "v 0 0 0\r\n"
+                           "v 1 0 0\n"
+                           "v 1.0 1.0 0.0\n"
+                           "  v 0 1 +0\n"
+                           "vt 0.5 0.5\n"
+                           "vn 0 0 1\n"
+                           "o surface\n"
+                           "f 1//1 2//1 3//1 4//1\n"
+                           "v 2 0 0\n"
+                           "f -3/1/1 -1/2/1 2/3/1\n";
+    MeshLevels mesh;
+    mesh.parse(obj.constData(), obj.constData() + obj.size());
+    QCOMPARE(mesh.levels(), 1);
+    QCOMPARE(mesh.vertices().size(), 5);
+    QCOMPARE(mesh.vertices().at(2), QVector3D(1.0f, 1.0f, 0.0f));
+    QCOMPARE(mesh.level(0).indexes, QVector<quint32>({0, 1, 2, 0, 2, 3, 2, 4, 1}));
+    QCOMPARE(mesh.normals().size(), 5);
+    QCOMPARE(mesh.normals().at(0), QVector3D(0.0f, 0.0f, 1.0f));
+    QCOMPARE(mesh.min(), QVector3D(0.0f, 0.0f, 0.0f));
+    QCOMPARE(mesh.max(), QVector3D(2.0f, 1.0f, 0.0f));
+
+    // the lines that are not valid and the faces with vertices that do not exist
+    for (const QByteArray &invalid : {QByteArray("v 0 0 0\nv 1 a 0\nv 0 1 0\nf 1 2 3\n"),
+                                      QByteArray("v 0 0 0\nv 1 0 0\nf 1 2\n"),
+                                      QByteArray("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n"),
+                                      QByteArray("v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 2 3\n"),
+                                      QByteArray("# no faces\nv 0 0 0\n")}) {
+        MeshLevels invalid_mesh;
+        QVERIFY_EXCEPTION_THROWN(invalid_mesh.parse(invalid.constData(),
+                                                    invalid.constData() + invalid.size()),
+                                 std::runtime_error);
+    }
+}
+
+void MeshLevelsTest::testMeshLevels()
+{
+    // a torus (closed surface) made of quads facing outwards
+    const int n_u = 200;
+    const int n_v = 100;
+    const double R = 10.0;
+    const double r = 3.0;
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString mesh_file = dir.filePath("mesh.obj");
+    QFile file(mesh_file);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QTextStream stream(&file);
+    for (int i = 0; i < n_u; ++i) {
+        for (int j = 0; j < n_v; ++j) {
+            const double u = 2 * M_PI * i / n_u;
+            const double v = 2 * M_PI * j / n_v;
+            stream << "v " << (R + r * std::cos(v)) * std::cos(u) << " "
+                   << (R + r * std::cos(v)) * std::sin(u) << " " << r * std::sin(v) << "\n";
+        }
+    }
+    const auto vertex = [](const int i, const int j) {
+        return (i % n_u) * n_v + (j % n_v) + 1;
+    };
+    for (int i = 0; i < n_u; ++i) {
+        for (int j = 0; j < n_v; ++j) {
+            stream << "f " << vertex(i, j) << " " << vertex(i + 1, j) << " "
+                   << vertex(i + 1, j + 1) << " " << vertex(i, j + 1) << "\n";
+        }
+    }
+    stream.flush();
+    file.close();
+
+    MeshLevels mesh;
+    mesh.open(mesh_file);
+    QCOMPARE(mesh.vertices().size(), n_u * n_v);
+    QCOMPARE(mesh.level(0).indexes.size(), 6 * n_u * n_v);
+    QCOMPARE(mesh.levels(), 3);
+    for (int l = 1; l < mesh.levels(); ++l) {
+        const QVector<quint32> &indexes = mesh.level(l).indexes;
+        QVERIFY(indexes.size() / 3 <= mesh.level(l - 1).indexes.size() / 3 / 4);
+        QVERIFY(mesh.level(l).edge_length > mesh.level(l - 1).edge_length);
+        for (int t = 0; t < indexes.size() / 3; ++t) {
+            const quint32 a = indexes.at(3 * t);
+            const quint32 b = indexes.at(3 * t + 1);
+            const quint32 c = indexes.at(3 * t + 2);
+            QVERIFY(a < static_cast<quint32>(mesh.vertices().size())
+                    && b < static_cast<quint32>(mesh.vertices().size())
+                    && c < static_cast<quint32>(mesh.vertices().size()));
+            QVERIFY(a != b && b != c && a != c);
+            // the simplified triangles still face outwards (no folds)
+            const QVector3D &p0 = mesh.vertices().at(a);
+            const QVector3D normal = QVector3D::crossProduct(mesh.vertices().at(b) - p0,
+                                                             mesh.vertices().at(c) - p0);
+            const QVector3D centroid = (p0 + mesh.vertices().at(b) + mesh.vertices().at(c)) / 3;
+            const QVector3D axis = QVector3D(centroid.x(), centroid.y(), 0.0f).normalized() * R;
+            QVERIFY(QVector3D::dotProduct(normal, centroid - axis) > 0);
+        }
+    }
+
+    // close to the camera the full mesh is rendered and far from it the coarsest level
+    QCOMPARE(mesh.levelForDistance(1.0, 1000.0), 0);
+    QCOMPARE(mesh.levelForDistance(1e6, 1000.0), mesh.levels() - 1);
+
+    // the second time the mesh is read from the cache
+    QCOMPARE(QDir(DatasetCache::directory()).entryList({"*.stmesh"}, QDir::Files).size(), 1);
+    MeshLevels cached;
+    cached.open(mesh_file);
+    QCOMPARE(cached.vertices(), mesh.vertices());
+    QCOMPARE(cached.normals(), mesh.normals());
+    QCOMPARE(cached.levels(), mesh.levels());
+    for (int l = 0; l < mesh.levels(); ++l) {
+        QCOMPARE(cached.level(l).indexes, mesh.level(l).indexes);
+        QCOMPARE(cached.level(l).edge_length, mesh.level(l).edge_length);
+    }
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::MeshLevelsTest)
+#include "tst_meshlevelstest.moc"
@@ -0,0 +1,26 @@
+#ifndef TST_MESHLEVELSTEST_H
+#define TST_MESHLEVELSTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class MeshLevelsTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MeshLevelsTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testReadMesh();
+    void testMeshLevels();
+};
+
+} // namespace unit //
+
+#endif // TST_MESHLEVELSTEST_H
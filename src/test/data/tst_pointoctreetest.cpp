@@ -0,0 +1,177 @@
+#include <QtTest/QTest>
+#include <QMatrix4x4>
+#include <QPainterPath>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <algorithm>
+#include <random>
+
+#include "data/PointOctree.h"
+#include "tst_pointoctreetest.h"
+
+namespace unit
+{
+
+PointOctreeTest::PointOctreeTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void PointOctreeTest::initTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void PointOctreeTest::cleanupTestCase()
+{
+    QVERIFY2(true, "Empty");
+}
+
+void PointOctreeTest::testPointOctree()
+{
+    std::mt19937 generator(11);
+    std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+    QVector<QVector3D> points;
+    for (int i = 0; i < 50000; ++i) {
+        points.append(QVector3D(coordinate(generator), coordinate(generator),
+                                coordinate(generator)));
+    }
+    // points in the same position are kept in one leaf
+    for (int i = 0; i < 2 * PointOctree::LEAF_SIZE; ++i) {
+        points.append(QVector3D(1.0f, 2.0f, 3.0f));
+    }
+    PointOctree octree;
+    octree.build(points);
+    QVERIFY(!octree.isEmpty());
+
+    // the visible points are the first indexes (once) followed by the samples
+    const auto visible = [](const int point) { return point % 3 != 0; };
+    PointOctree::NodeRanges ranges;
+    const QVector<quint32> indexes = octree.computeIndexes(visible, ranges);
+    int n_visible = 0;
+    for (int i = 0; i < points.size(); ++i) {
+        n_visible += visible(i) ? 1 : 0;
+    }
+    QVERIFY(indexes.size() > n_visible);
+    QVector<quint32> visible_indexes = indexes.mid(0, n_visible);
+    std::sort(visible_indexes.begin(), visible_indexes.end());
+    for (int i = 0; i < n_visible; ++i) {
+        QVERIFY(visible(static_cast<int>(visible_indexes.at(i))));
+        QVERIFY(i == 0 || visible_indexes.at(i) != visible_indexes.at(i - 1));
+    }
+
+    const auto drawn = [](const QVector<PointOctree::Range> &ranges) {
+        int n_drawn = 0;
+        for (const auto &range : ranges) {
+            n_drawn += range.second;
+        }
+        return n_drawn;
+    };
+
+    // close to the camera all the visible points are drawn
+    QMatrix4x4 projection;
+    projection.perspective(60.0f, 1.0f, 0.1f, 10000.0f);
+    QMatrix4x4 view;
+    view.lookAt(QVector3D(0.0f, 0.0f, 200.0f), QVector3D(0.0f, 0.0f, 0.0f),
+                QVector3D(0.0f, 1.0f, 0.0f));
+    const double pixel_scale = projection(1, 1) * 1000.0 / 2.0;
+    QCOMPARE(drawn(octree.drawRanges(ranges, projection * view, pixel_scale, 1.0)), n_visible);
+
+    // far from the camera only the samples are drawn
+    QMatrix4x4 far_view;
+    far_view.lookAt(QVector3D(0.0f, 0.0f, 5000.0f), QVector3D(0.0f, 0.0f, 0.0f),
+                    QVector3D(0.0f, 1.0f, 0.0f));
+    const auto far_ranges = octree.drawRanges(ranges, projection * far_view, pixel_scale, 10.0);
+    QVERIFY(drawn(far_ranges) > 0);
+    QVERIFY(drawn(far_ranges) < n_visible / 10);
+    for (const auto &range : far_ranges) {
+        QVERIFY(range.first >= 0 && range.first + range.second <= indexes.size());
+    }
+
+    // looking away from the points nothing is drawn
+    QMatrix4x4 away_view;
+    away_view.lookAt(QVector3D(0.0f, 0.0f, 200.0f), QVector3D(0.0f, 0.0f, 400.0f),
+                     QVector3D(0.0f, 1.0f, 0.0f));
+    QVERIFY(octree.drawRanges(ranges, projection * away_view, pixel_scale, 1.0).isEmpty());
+}
+
+void PointOctreeTest::testPointOctreeSelection()
+{
+    std::mt19937 generator(13);
+    std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+    QVector<QVector3D> points;
+    for (int i = 0; i < 30000; ++i) {
+        points.append(QVector3D(coordinate(generator), coordinate(generator),
+                                coordinate(generator)));
+    }
+    PointOctree octree;
+    octree.build(points);
+
+    // from the points to the coordinates of a view of 800x600 (y pointing down)
+    QMatrix4x4 window;
+    window.translate(400.0f, 300.0f);
+    window.scale(400.0f, -300.0f);
+    QMatrix4x4 projection;
+    projection.perspective(60.0f, 800.0f / 600.0f, 0.1f, 10000.0f);
+
+    QPainterPath lasso;
+    lasso.moveTo(100.0, 100.0);
+    lasso.lineTo(700.0, 150.0);
+    lasso.lineTo(350.0, 550.0);
+    lasso.closeSubpath();
+
+    // the camera outside and inside the points (the points behind are not selected)
+    for (const float distance : {200.0f, 20.0f}) {
+        QMatrix4x4 view;
+        view.lookAt(QVector3D(10.0f, 5.0f, distance), QVector3D(0.0f, 0.0f, 0.0f),
+                    QVector3D(0.0f, 1.0f, 0.0f));
+        const QMatrix4x4 window_mvp = window * projection * view;
+
+        // the same points as projecting all of them
+        QVector<int> expected;
+        for (int i = 0; i < points.size(); ++i) {
+            const QVector4D point = window_mvp * QVector4D(points.at(i), 1.0f);
+            if (point.w() > 0.0f
+                    && lasso.contains(QPointF(point.x() / point.w(), point.y() / point.w()))) {
+                expected.append(i);
+            }
+        }
+        QVector<int> inside = octree.pointsInside(lasso, window_mvp, points);
+        std::sort(inside.begin(), inside.end());
+        QVERIFY(!expected.isEmpty());
+        QCOMPARE(inside, expected);
+
+        // picking returns the accepted point nearest to the camera within the radius
+        const QPointF position(400.0, 300.0);
+        const double radius = 6.0;
+        const auto accept = [](const int point) { return point % 2 == 0; };
+        int expected_nearest = -1;
+        float nearest_depth = 0.0f;
+        for (int i = 0; i < points.size(); ++i) {
+            const QVector4D point = window_mvp * QVector4D(points.at(i), 1.0f);
+            const QPointF delta = QPointF(point.x() / point.w(), point.y() / point.w()) - position;
+            if (point.w() > 0.0f && accept(i) && QPointF::dotProduct(delta, delta) <= radius * radius
+                    && (expected_nearest == -1 || point.w() < nearest_depth)) {
+                expected_nearest = i;
+                nearest_depth = point.w();
+            }
+        }
+        QVERIFY(expected_nearest != -1);
+        QCOMPARE(octree.nearestPoint(position, radius, window_mvp, points, accept),
+                 expected_nearest);
+    }
+
+    // nothing is selected or picked behind the camera
+    QMatrix4x4 away_view;
+    away_view.lookAt(QVector3D(0.0f, 0.0f, 200.0f), QVector3D(0.0f, 0.0f, 400.0f),
+                     QVector3D(0.0f, 1.0f, 0.0f));
+    const QMatrix4x4 away_mvp = window * projection * away_view;
+    QVERIFY(octree.pointsInside(lasso, away_mvp, points).isEmpty());
+    QCOMPARE(octree.nearestPoint(QPointF(400.0, 300.0), 6.0, away_mvp, points), -1);
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::PointOctreeTest)
+#include "tst_pointoctreetest.moc"
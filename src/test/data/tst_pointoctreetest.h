@@ -0,0 +1,26 @@
+#ifndef TST_POINTOCTREETEST_H
+#define TST_POINTOCTREETEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class PointOctreeTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PointOctreeTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testPointOctree();
+    void testPointOctreeSelection();
+};
+
+} // namespace unit //
+
+#endif // TST_POINTOCTREETEST_H
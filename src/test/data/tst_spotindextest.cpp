@@ -0,0 +1,177 @@
+#include <QtTest/QTest>
+#include <QPainterPath>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "data/SpotIndex.h"
+#include "data/STData.h"
+#include "data/DatasetCache.h"
+#include "testhelpers.h"
+#include "tst_spotindextest.h"
+
+namespace unit
+{
+
+SpotIndexTest::SpotIndexTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SpotIndexTest::initTestCase()
+{
+    // the cached datasets are stored in a test location
+    QStandardPaths::setTestModeEnabled(true);
+    DatasetCache::clear();
+}
+
+void SpotIndexTest::cleanupTestCase()
+{
+    DatasetCache::clear();
+}
+
+void SpotIndexTest::testSpotIndex()
+{
+    // random spots (some of them in the same position)
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<double> coordinate(0.0, 100.0);
+    QVector<Spot::SpotType> coordinates;
+    for (int i = 0; i < 5000; ++i) {
+        coordinates.append(Spot::SpotType(coordinate(generator), coordinate(generator), 0.0));
+    }
+    coordinates.append(coordinates.at(10));
+    SpotIndex index;
+    index.build(coordinates);
+    QCOMPARE(index.size(), coordinates.size());
+
+    // a lasso (star polygon), an ellipse, a rectangle and paths partially outside the spots
+    QPolygonF star;
+    for (int i = 0; i < 40; ++i) {
+        const double angle = i * M_PI / 20.0;
+        const double radius = i % 2 == 0 ? 45.0 : 15.0;
+        star << QPointF(50.0 + radius * std::cos(angle), 50.0 + radius * std::sin(angle));
+    }
+    QList<QPainterPath> paths;
+    paths.append(QPainterPath());
+    paths.last().addPolygon(star);
+    paths.append(QPainterPath());
+    paths.last().addEllipse(QPointF(30.0, 60.0), 25.0, 12.5);
+    paths.append(QPainterPath());
+    paths.last().addRect(QRectF(10.25, 20.5, 40.0, 30.0));
+    paths.append(QPainterPath());
+    paths.last().addEllipse(QPointF(-10.0, 100.0), 40.0, 40.0);
+    paths.append(QPainterPath());
+    paths.last().addRect(QRectF(200.0, 200.0, 10.0, 10.0));
+
+    // the spots inside the paths are the ones found testing all the spots
+    for (const QPainterPath &path : paths) {
+        QVector<int> expected;
+        for (int i = 0; i < coordinates.size(); ++i) {
+            if (path.contains(QPointF(coordinates.at(i).x(), coordinates.at(i).y()))) {
+                expected.append(i);
+            }
+        }
+        QVector<int> inside = index.spotsInside(path);
+        std::sort(inside.begin(), inside.end());
+        QCOMPARE(inside, expected);
+    }
+
+    // the nearest spot is the one found testing all the spots
+    for (int k = 0; k < 100; ++k) {
+        const QPointF position(coordinate(generator), coordinate(generator));
+        const double radius = k % 2 == 0 ? 0.5 : 3.0;
+        int expected = -1;
+        double expected_distance = radius * radius;
+        for (int i = 0; i < coordinates.size(); ++i) {
+            const QPointF delta = QPointF(coordinates.at(i).x(), coordinates.at(i).y()) - position;
+            const double distance = QPointF::dotProduct(delta, delta);
+            if (distance < expected_distance || (distance == expected_distance && expected == -1)) {
+                expected = i;
+                expected_distance = distance;
+            }
+        }
+        QCOMPARE(index.nearestSpot(position, radius), expected);
+    }
+    QCOMPARE(index.nearestSpot(QPointF(500.0, 500.0), 10.0), -1);
+
+    // the spots in a line (the bounds have no height)
+    QVector<Spot::SpotType> line;
+    for (int i = 0; i < 100; ++i) {
+        line.append(Spot::SpotType(i, 5.0, 0.0));
+    }
+    index.build(line);
+    QPainterPath rect;
+    rect.addRect(QRectF(9.5, 0.0, 10.0, 10.0));
+    QVector<int> inside = index.spotsInside(rect);
+    std::sort(inside.begin(), inside.end());
+    QCOMPARE(inside, QVector<int>({10, 11, 12, 13, 14, 15, 16, 17, 18, 19}));
+}
+
+void SpotIndexTest::testSpotInspector()
+{
+    QFETCH(int, zeros);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 200, 80, zeros, "\n"));
+    QVERIFY(writeSpots(spots_file, 200));
+    STData data;
+    data.init(matrix_file, spots_file);
+    const mat counts = data.data().dense();
+
+    // the top genes of a spot are its highest counts (sorted)
+    for (int spot = 0; spot < data.spots().size(); spot += 7) {
+        const auto genes = data.topGenes(spot, 5);
+        const rowvec row = counts.row(spot);
+        const uvec nonzero = find(row > 0);
+        QCOMPARE(genes.size(), std::min<int>(5, nonzero.n_elem));
+        const vec sorted = sort(row.elem(nonzero).t(), "descend");
+        for (int k = 0; k < genes.size(); ++k) {
+            QCOMPARE(genes.at(k).second, sorted.at(k));
+            QCOMPARE(row.at(genes.at(k).first), genes.at(k).second);
+        }
+    }
+    QVERIFY(data.topGenes(-1, 5).isEmpty());
+
+    // only the visible spots are found
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 0;
+    settings.genes_threshold = 0;
+    settings.spots_threshold = 0;
+    settings.legend_min = 0;
+    settings.legend_max = 0;
+    settings.intensity = 1.0;
+    settings.size = 1;
+    settings.visual_mode = SettingsWidget::Normal;
+    settings.normalization_mode = SettingsWidget::RAW;
+    settings.gene_cutoff = false;
+    settings.show_spots = true;
+    settings.log_scale = false;
+    settings.zscore = false;
+    data.spots().at(3)->visible(false);
+    data.computeRenderingData(settings);
+    const auto &coordinates = data.renderingCoords();
+    const QPointF position(coordinates.at(3).x(), coordinates.at(3).y());
+    QCOMPARE(data.spotIndex().nearestSpot(position, 0.01), 3);
+    QVERIFY(data.nearestVisibleSpot(position, 0.01) != 3);
+    const QPointF visible_position(coordinates.at(4).x(), coordinates.at(4).y());
+    QCOMPARE(data.nearestVisibleSpot(visible_position, 0.01), 4);
+}
+
+void SpotIndexTest::testSpotInspector_data()
+{
+    QTest::addColumn<int>("zeros");
+    QTest::newRow("dense") << 50;
+    QTest::newRow("sparse") << 95;
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::SpotIndexTest)
+#include "tst_spotindextest.moc"
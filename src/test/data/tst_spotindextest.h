@@ -0,0 +1,27 @@
+#ifndef TST_SPOTINDEXTEST_H
+#define TST_SPOTINDEXTEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class SpotIndexTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpotIndexTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testSpotIndex();
+    void testSpotInspector();
+    void testSpotInspector_data();
+};
+
+} // namespace unit //
+
+#endif // TST_SPOTINDEXTEST_H
@@ -0,0 +1,772 @@
+#include <QtTest/QTest>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QStandardPaths>
+#include <QDir>
+
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_HDF5
+#include <hdf5.h>
+#endif
+
+#include "data/STData.h"
+#include "data/DatasetCache.h"
+#include "data/MatrixParser.h"
+#include "data/MatrixWriter.h"
+#include "data/HDF5Parser.h"
+#include "data/IdTable.h"
+#include "data/LoadingProgress.h"
+#include "options_cmake.h"
+#include "testhelpers.h"
+#include "tst_stdatatest.h"
+
+namespace unit
+{
+
+namespace
+{
+
+// the original line by line parser, used as a reference for the parallel parser
+STData::STDataFrame referenceRead(const QString &filename)
+{
+    std::ifstream f(filename.toStdString(), std::ios::in);
+    STData::STDataFrame data;
+    std::vector<double> values;
+    unsigned row_number = 0;
+    unsigned col_number = 0;
+    for (std::string line; std::getline(f, line);) {
+        std::istringstream iss(line);
+        std::string token;
+        col_number = 0;
+        while (std::getline(iss, token, '\t')) {
+            if (row_number == 0) {
+                const QString gene = QString::fromStdString(token).trimmed();
+                if (!gene.isEmpty()) {
+                    data.genes.append(gene);
+                }
+            } else if (col_number == 0) {
+                const QString spot = QString::fromStdString(token).trimmed();
+                if (!spot.isEmpty()) {
+                    data.spots.append(spot);
+                }
+            } else {
+                values.push_back(std::stod(token));
+            }
+            ++col_number;
+        }
+        ++row_number;
+    }
+    data.counts = mat(values.data(), data.genes.size(), data.spots.size()).t();
+    return data;
+}
+
+#ifdef HAVE_ZLIB
+// compresses the given file with gzip, returns false on errors
+bool gzipFile(const QString &filename, const QString &compressed_filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray content = file.readAll();
+    gzFile compressed = gzopen(compressed_filename.toLocal8Bit().constData(), "wb");
+    if (compressed == nullptr) {
+        return false;
+    }
+    const int written = gzwrite(compressed, content.constData(),
+                                static_cast<unsigned>(content.size()));
+    return gzclose(compressed) == Z_OK && written == content.size();
+}
+#endif
+
+// writes a data frame in Matrix Market format with its features and barcodes files
+// (10x Genomics layout with genes as rows and spots as columns)
+// returns false if the files could not be written
+bool writeMatrixMarket(const QString &folder, const STData::STDataFrame &data)
+{
+    const mat counts = data.dense();
+    const uvec nonzeros = find(counts);
+    QFile matrix(QDir(folder).filePath("matrix.mtx"));
+    QFile features(QDir(folder).filePath("features.tsv"));
+    QFile barcodes(QDir(folder).filePath("barcodes.tsv"));
+    if (!matrix.open(QIODevice::WriteOnly) || !features.open(QIODevice::WriteOnly)
+            || !barcodes.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QTextStream stream(&matrix);
+    stream << "%%MatrixMarket matrix coordinate real general\n";
+    stream << "% written by the unit tests\n";
+    stream << counts.n_cols << " " << counts.n_rows << " " << nonzeros.n_elem << "\n";
+    for (const uword index : nonzeros) {
+        const uword row = index % counts.n_rows;
+        const uword col = index / counts.n_rows;
+        stream << col + 1 << " " << row + 1 << " "
+               << QString::number(counts.at(row, col), 'g', 17) << "\n";
+    }
+    QTextStream features_stream(&features);
+    for (const QString &gene : data.genes) {
+        features_stream << "ID_" << gene << "\t" << gene << "\tGene Expression\n";
+    }
+    QTextStream barcodes_stream(&barcodes);
+    for (const QString &spot : data.spots) {
+        barcodes_stream << spot << "\n";
+    }
+    stream.flush();
+    features_stream.flush();
+    barcodes_stream.flush();
+    return stream.status() == QTextStream::Ok && features_stream.status() == QTextStream::Ok
+            && barcodes_stream.status() == QTextStream::Ok;
+}
+
+#ifdef HAVE_HDF5
+// writes a one dimensional dataset to the HDF5 file, returns false on errors
+bool writeH5Dataset(const hid_t location, const char *name, const hid_t type,
+                    const hsize_t size, const void *values)
+{
+    const hid_t space = H5Screate_simple(1, &size, nullptr);
+    const hid_t dataset = H5Dcreate2(location, name, type, space,
+                                     H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    const bool written = dataset >= 0
+            && H5Dwrite(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values) >= 0;
+    if (dataset >= 0) {
+        H5Dclose(dataset);
+    }
+    H5Sclose(space);
+    return written;
+}
+
+// writes the names as fixed length strings to the HDF5 file, returns false on errors
+bool writeH5Names(const hid_t location, const char *name, const QList<QString> &names)
+{
+    const size_t size = 32;
+    std::vector<char> buffer(names.size() * size, 0);
+    for (int i = 0; i < names.size(); ++i) {
+        const QByteArray bytes = names.at(i).toUtf8().left(size);
+        std::copy(bytes.begin(), bytes.end(), buffer.begin() + i * size);
+    }
+    const hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, size);
+    const bool written = writeH5Dataset(location, name, type, names.size(), buffer.data());
+    H5Tclose(type);
+    return written;
+}
+
+// writes a data frame in the 10x Genomics HDF5 layout (genes as rows and spots as columns)
+// returns false if the file could not be written
+bool write10xH5(const QString &filename, const STData::STDataFrame &data)
+{
+    const sp_mat counts_t = sp_mat(data.dense()).t();
+    const std::vector<double> values(counts_t.values, counts_t.values + counts_t.n_nonzero);
+    const std::vector<long long> indices(counts_t.row_indices,
+                                         counts_t.row_indices + counts_t.n_nonzero);
+    const std::vector<long long> indptr(counts_t.col_ptrs, counts_t.col_ptrs + counts_t.n_cols + 1);
+    const long long shape[2] = {static_cast<long long>(counts_t.n_rows),
+                                static_cast<long long>(counts_t.n_cols)};
+    QList<QString> ids;
+    for (const QString &gene : data.genes) {
+        ids.append("ID_" + gene);
+    }
+
+    const hid_t file = H5Fcreate(filename.toLocal8Bit().constData(), H5F_ACC_TRUNC,
+                                 H5P_DEFAULT, H5P_DEFAULT);
+    if (file < 0) {
+        return false;
+    }
+    const hid_t matrix = H5Gcreate2(file, "matrix", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    const hid_t features = H5Gcreate2(matrix, "features", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    const bool written =
+            writeH5Dataset(matrix, "data", H5T_NATIVE_DOUBLE, values.size(), values.data())
+            && writeH5Dataset(matrix, "indices", H5T_NATIVE_LLONG, indices.size(), indices.data())
+            && writeH5Dataset(matrix, "indptr", H5T_NATIVE_LLONG, indptr.size(), indptr.data())
+            && writeH5Dataset(matrix, "shape", H5T_NATIVE_LLONG, 2, shape)
+            && writeH5Names(matrix, "barcodes", data.spots)
+            && writeH5Names(features, "name", data.genes)
+            && writeH5Names(features, "id", ids);
+    H5Gclose(features);
+    H5Gclose(matrix);
+    H5Fclose(file);
+    return written;
+}
+#endif
+
+// returns a random data frame with the given storage
+STData::STDataFrame randomFrame(const int n_spots, const int n_genes, const bool sparse)
+{
+    arma_rng::set_seed(n_spots * n_genes);
+    STData::STDataFrame data;
+    mat counts = floor(randu<mat>(n_spots, n_genes) * 20);
+    counts.elem(find(randu<mat>(n_spots, n_genes) < 0.8)).zeros();
+    for (int i = 0; i < n_spots; ++i) {
+        data.spots.append(QString::number(i) + "x" + QString::number(i));
+    }
+    for (int j = 0; j < n_genes; ++j) {
+        data.genes.append("gene_" + QString::number(j));
+    }
+    data.is_sparse = sparse;
+    if (sparse) {
+        data.sp_counts = sp_mat(counts);
+    } else {
+        data.counts = counts;
+    }
+    return data;
+}
+
+// compares two data frames (regardless of their storage)
+bool equalFrames(const STData::STDataFrame &data1, const STData::STDataFrame &data2)
+{
+    const mat counts1 = data1.dense();
+    const mat counts2 = data2.dense();
+    return data1.genes == data2.genes && data1.spots == data2.spots
+            && counts1.n_rows == counts2.n_rows && counts1.n_cols == counts2.n_cols
+            && approx_equal(counts1, counts2, "absdiff", 1e-9);
+}
+
+}
+
+STDataTest::STDataTest(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void STDataTest::initTestCase()
+{
+    // the cached datasets are stored in a test location
+    QStandardPaths::setTestModeEnabled(true);
+    DatasetCache::clear();
+}
+
+void STDataTest::cleanupTestCase()
+{
+    DatasetCache::clear();
+}
+
+void STDataTest::testReadMatrix()
+{
+    QFETCH(int, spots);
+    QFETCH(int, genes);
+    QFETCH(int, zeros);
+    QFETCH(QString, eol);
+    QFETCH(bool, sparse);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filename = dir.filePath("matrix.tsv");
+    QVERIFY(writeRandomMatrix(filename, spots, genes, zeros, eol));
+
+    const STData::STDataFrame data = STData::read(filename);
+    const STData::STDataFrame expected = referenceRead(filename);
+    QCOMPARE(data.is_sparse, sparse);
+    QCOMPARE(data.genes, expected.genes);
+    QCOMPARE(data.spots, expected.spots);
+    QCOMPARE(data.n_rows(), expected.counts.n_rows);
+    QCOMPARE(data.n_cols(), expected.counts.n_cols);
+    QVERIFY(approx_equal(data.dense(), expected.counts, "absdiff", 0.0));
+}
+
+void STDataTest::testReadMatrix_data()
+{
+    QTest::addColumn<int>("spots");
+    QTest::addColumn<int>("genes");
+    QTest::addColumn<int>("zeros");
+    QTest::addColumn<QString>("eol");
+    QTest::addColumn<bool>("sparse");
+    QTest::newRow("small") << 3 << 4 << 0 << "\n" << false;
+    QTest::newRow("large") << 1500 << 250 << 50 << "\n" << false;
+    QTest::newRow("windows") << 800 << 120 << 50 << "\r\n" << false;
+    QTest::newRow("sparse") << 1500 << 250 << 95 << "\n" << true;
+    QTest::newRow("empty") << 20 << 10 << 100 << "\n" << true;
+}
+
+void STDataTest::testDatasetCache()
+{
+    // the previous tests have cached their datasets too
+    DatasetCache::clear();
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 200, 50, 90, "\n"));
+    QVERIFY(writeSpots(spots_file, 200));
+
+    // the first time the dataset is parsed and cached
+    STData parsed;
+    parsed.init(matrix_file, spots_file);
+    QCOMPARE(QDir(DatasetCache::directory()).entryList({"*.stcache"}, QDir::Files).size(), 1);
+
+    // the second time it is loaded from the cache
+    STData cached;
+    cached.init(matrix_file, spots_file);
+    QVERIFY(equalFrames(parsed.data(), cached.data()));
+    QCOMPARE(parsed.data().is_sparse, cached.data().is_sparse);
+    QCOMPARE(parsed.renderingCoords(), cached.renderingCoords());
+    for (int i = 0; i < parsed.spots().size(); ++i) {
+        QCOMPARE(parsed.spots().at(i)->totalCount(), cached.spots().at(i)->totalCount());
+    }
+    for (int j = 0; j < parsed.genes().size(); ++j) {
+        QCOMPARE(parsed.genes().at(j)->totalCount(), cached.genes().at(j)->totalCount());
+    }
+
+    // the cache is not used when the source file changes
+    QVERIFY(writeRandomMatrix(matrix_file, 100, 50, 90, "\n"));
+    STData updated;
+    updated.init(matrix_file, spots_file);
+    QVERIFY(updated.data().n_rows() <= 50);
+    QVERIFY(updated.data().n_rows() < parsed.data().n_rows());
+
+    // the cache of a Matrix Market file is not used when its features change
+    DatasetCache::Entry entry;
+    entry.data = randomFrame(20, 10, true);
+    entry.coordinates.fill(Spot::SpotType(), 20);
+    entry.spot_totals.zeros(20);
+    entry.gene_totals.zeros(10);
+    QVERIFY(writeMatrixMarket(dir.path(), entry.data));
+    const QString mtx_file = dir.filePath("matrix.mtx");
+    QVERIFY(DatasetCache::save(mtx_file, spots_file, entry));
+    DatasetCache::Entry loaded;
+    QVERIFY(DatasetCache::load(mtx_file, spots_file, loaded));
+    entry.data.genes[0] = "renamed_gene";
+    QVERIFY(writeMatrixMarket(dir.path(), entry.data));
+    QVERIFY(!DatasetCache::load(mtx_file, spots_file, loaded));
+}
+
+void STDataTest::testRenderingData()
+{
+    QFETCH(int, zeros);
+    QFETCH(int, visual_mode);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 300, 60, zeros, "\n"));
+    QVERIFY(writeSpots(spots_file, 300));
+
+    SettingsWidget::Rendering settings;
+    settings.reads_threshold = 0;
+    settings.genes_threshold = 2;
+    settings.spots_threshold = 0;
+    settings.legend_min = 0;
+    settings.legend_max = 0;
+    settings.intensity = 1.0;
+    settings.size = 1;
+    settings.visual_mode = static_cast<SettingsWidget::VisualMode>(visual_mode);
+    settings.normalization_mode = SettingsWidget::CPM;
+    settings.gene_cutoff = false;
+    settings.show_spots = false;
+    settings.log_scale = true;
+    settings.zscore = false;
+
+    // the stages computed before the changes must give the same rendering data
+    // as computing all the stages with the final settings
+    STData cached;
+    cached.init(matrix_file, spots_file);
+    cached.computeRenderingData(settings);
+    settings.normalization_mode = SettingsWidget::REL;
+    cached.computeRenderingData(settings);
+    cached.genes().at(3)->visible(false);
+    cached.genes().at(7)->color(Qt::red);
+    cached.spots().at(5)->visible(false);
+    cached.computeRenderingData(settings);
+
+    STData computed;
+    computed.init(matrix_file, spots_file);
+    computed.genes().at(3)->visible(false);
+    computed.genes().at(7)->color(Qt::red);
+    computed.spots().at(5)->visible(false);
+    SettingsWidget::Rendering computed_settings = settings;
+    computed.computeRenderingData(computed_settings);
+
+    QCOMPARE(cached.renderingVertices(), computed.renderingVertices());
+    QCOMPARE(settings.legend_min, computed_settings.legend_min);
+    QCOMPARE(settings.legend_max, computed_settings.legend_max);
+    QVERIFY(!(cached.renderingVertices().at(5).flags & STData::Visible));
+    QCOMPARE(cached.renderingVertices().at(5).x, cached.renderingCoords().at(5).x());
+
+    // the data computed into a buffer (as the worker thread of the view does) is the same
+    STData::RenderingData buffer;
+    cached.computeRenderingData(cached.renderingInput(settings), buffer);
+    QCOMPARE(buffer.vertices, computed.renderingVertices());
+    QCOMPARE(buffer.legend_max, computed_settings.legend_max);
+    cached.swapRenderingData(buffer);
+    QCOMPARE(cached.renderingVertices(), computed.renderingVertices());
+
+    // only the spots that change are dirty
+    const auto &vertices = cached.renderingVertices();
+    const auto visible = std::find_if(vertices.begin(), vertices.end(),
+                                      [](const STData::RenderingVertex &vertex) {
+                                          return vertex.flags & STData::Visible;
+                                      });
+    QVERIFY(visible != vertices.end());
+    if (settings.visual_mode != SettingsWidget::Normal) {
+        QVERIFY(visible->value >= static_cast<float>(cached.renderingData().legend_min));
+        QVERIFY(visible->value <= static_cast<float>(cached.renderingData().legend_max));
+    }
+    const int selected = static_cast<int>(std::distance(vertices.begin(), visible));
+    cached.selectSpots(QVector<int>({selected}));
+    cached.computeRenderingData(cached.renderingInput(settings), buffer);
+    QCOMPARE(buffer.dirty, STData::RenderingRanges({qMakePair(selected, 1)}));
+    QVERIFY(buffer.vertices.at(selected).flags & STData::Selected);
+
+    // the values are mapped to colors by the view so changing the color map
+    // does not change the rendering data
+    if (settings.visual_mode == SettingsWidget::HeatMap) {
+        cached.swapRenderingData(buffer);
+        settings.visual_mode = SettingsWidget::ColorRange;
+        cached.computeRenderingData(cached.renderingInput(settings), buffer);
+        QVERIFY(buffer.dirty.isEmpty());
+        QCOMPARE(buffer.visual_mode, SettingsWidget::ColorRange);
+    }
+}
+
+void STDataTest::testRenderingData_data()
+{
+    QTest::addColumn<int>("zeros");
+    QTest::addColumn<int>("visual_mode");
+    QTest::newRow("dense_normal") << 50 << static_cast<int>(SettingsWidget::Normal);
+    QTest::newRow("dense_heatmap") << 50 << static_cast<int>(SettingsWidget::HeatMap);
+    QTest::newRow("sparse_normal") << 95 << static_cast<int>(SettingsWidget::Normal);
+    QTest::newRow("sparse_range") << 95 << static_cast<int>(SettingsWidget::DynamicRange);
+}
+
+void STDataTest::testSparseOperations()
+{
+    const STData::STDataFrame dense = randomFrame(300, 120, false);
+    const STData::STDataFrame sparse = randomFrame(300, 120, true);
+    QVERIFY(equalFrames(dense, sparse));
+
+    QVERIFY(equalFrames(STData::filterCounts(dense, 2, 10, 5),
+                        STData::filterCounts(sparse, 2, 10, 5)));
+    QVERIFY(equalFrames(STData::filterCounts(dense, 0, 10, 5),
+                        STData::filterCounts(sparse, 0, 10, 5)));
+    QVERIFY(equalFrames(STData::normalizeCounts(dense, SettingsWidget::CPM),
+                        STData::normalizeCounts(sparse, SettingsWidget::CPM)));
+    QVERIFY(equalFrames(STData::normalizeCounts(dense, SettingsWidget::REL),
+                        STData::normalizeCounts(sparse, SettingsWidget::REL)));
+    QVERIFY(equalFrames(STData::ztransform(dense), STData::ztransform(sparse)));
+
+    const uvec rows = {250, 3, 17, 42, 0};
+    const uvec columns = {5, 119, 60, 1};
+    QVERIFY(equalFrames(STData::sliceRows(dense, rows), STData::sliceRows(sparse, rows)));
+    QVERIFY(equalFrames(STData::sliceColumns(dense, columns),
+                        STData::sliceColumns(sparse, columns)));
+
+    const STData::STDataFrame other = STData::sliceColumns(randomFrame(50, 150, false),
+                                                           sort(regspace<uvec>(30, 149), "descend"));
+    const STData::STDataFrame merged_dense = STData::aggregate({dense, other});
+    const STData::STDataFrame merged_sparse = STData::aggregate({sparse, other});
+    QVERIFY(!merged_dense.is_sparse);
+    QVERIFY(merged_sparse.is_sparse);
+    QVERIFY(equalFrames(merged_dense, merged_sparse));
+    QCOMPARE(merged_dense.n_rows(), uword(350));
+    QCOMPARE(merged_dense.n_cols(), uword(150));
+    QCOMPARE(accu(merged_dense.counts), accu(dense.counts) + accu(other.counts));
+}
+
+void STDataTest::testReadInvalidMatrix()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filename = dir.filePath("invalid.tsv");
+    QFile file(filename);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("\tgene_1\tgene_2\n1x1\t1\n");
+    file.close();
+    QVERIFY_EXCEPTION_THROWN(STData::read(filename), std::runtime_error);
+}
+
+void STDataTest::testReadCompressedMatrix()
+{
+#ifdef HAVE_ZLIB
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filename = dir.filePath("matrix.tsv");
+    const QString compressed_filename = dir.filePath("matrix.tsv.gz");
+    const QString dense_filename = dir.filePath("dense.tsv");
+    const QString compressed_dense_filename = dir.filePath("dense.tsv.gz");
+    QVERIFY(writeRandomMatrix(filename, 1000, 200, 90, "\n"));
+    QVERIFY(writeRandomMatrix(dense_filename, 300, 100, 10, "\r\n"));
+    QVERIFY(gzipFile(filename, compressed_filename));
+    QVERIFY(gzipFile(dense_filename, compressed_dense_filename));
+    QVERIFY(CompressedFile::isCompressed(compressed_filename));
+    QVERIFY(!CompressedFile::isCompressed(filename));
+
+    // the compressed files give the same matrices than the plain files
+    const STData::STDataFrame expected = STData::read(filename);
+    const STData::STDataFrame data = STData::read(compressed_filename);
+    QCOMPARE(data.is_sparse, expected.is_sparse);
+    QVERIFY(equalFrames(data, expected));
+    const STData::STDataFrame expected_dense = STData::read(dense_filename);
+    const STData::STDataFrame data_dense = STData::read(compressed_dense_filename);
+    QVERIFY(!data_dense.is_sparse);
+    QVERIFY(equalFrames(data_dense, expected_dense));
+
+    // small blocks split the header and the rows between blocks
+    QVERIFY(equalFrames(MatrixParser::parseCompressedTSV(compressed_filename, 1000), expected));
+    QVERIFY(equalFrames(MatrixParser::parseCompressedTSV(compressed_dense_filename, 333),
+                        expected_dense));
+
+    // truncated files are not valid
+    QFile compressed(compressed_filename);
+    QVERIFY(compressed.open(QIODevice::ReadOnly));
+    const QByteArray content = compressed.readAll();
+    compressed.close();
+    const QString truncated_filename = dir.filePath("truncated.tsv.gz");
+    QFile truncated(truncated_filename);
+    QVERIFY(truncated.open(QIODevice::WriteOnly));
+    truncated.write(content.left(content.size() / 2));
+    truncated.close();
+    QVERIFY_EXCEPTION_THROWN(STData::read(truncated_filename), std::runtime_error);
+#else
+    QSKIP("Support for gzip files is not available in this build");
+#endif
+}
+
+void STDataTest::testReadMatrixMarket()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filename = dir.filePath("matrix.tsv");
+    QVERIFY(writeRandomMatrix(filename, 500, 150, 90, "\n"));
+    const STData::STDataFrame expected = STData::read(filename);
+    QVERIFY(writeMatrixMarket(dir.path(), expected));
+
+    const QString mtx_file = MatrixParser::findMTX(dir.path());
+    QCOMPARE(mtx_file, dir.filePath("matrix.mtx"));
+    QVERIFY(MatrixParser::isMatrixMarket(mtx_file));
+    QVERIFY(MatrixParser::isMatrixMarket("matrix.mtx.gz"));
+    QVERIFY(!MatrixParser::isMatrixMarket(filename));
+
+    const STData::STDataFrame data = STData::read(mtx_file);
+    QVERIFY(data.is_sparse);
+    QVERIFY(equalFrames(data, expected));
+
+    // the entries do not need to be sorted and duplicated entries are added up
+    QFile matrix(dir.filePath("matrix.mtx"));
+    QVERIFY(matrix.open(QIODevice::WriteOnly));
+    matrix.write("%%MatrixMarket matrix coordinate integer general\n"
+                 "150 500 4\n"
+                 "3 10 1\n"
+                 "1 2 5\n"
+                 "3 10 2\n"
+                 "150 500 7\n");
+    matrix.close();
+    const STData::STDataFrame unsorted = STData::read(mtx_file);
+    QCOMPARE(unsorted.n_rows(), uword(500));
+    QCOMPARE(unsorted.n_cols(), uword(150));
+    QCOMPARE(unsorted.sp_counts.n_nonzero, uword(3));
+    QCOMPARE(double(unsorted.sp_counts(9, 2)), 3.0);
+    QCOMPARE(double(unsorted.sp_counts(1, 0)), 5.0);
+    QCOMPARE(double(unsorted.sp_counts(499, 149)), 7.0);
+
+    // entries out of the matrix are not valid
+    QVERIFY(matrix.open(QIODevice::WriteOnly));
+    matrix.write("%%MatrixMarket matrix coordinate integer general\n"
+                 "150 500 1\n"
+                 "151 10 1\n");
+    matrix.close();
+    QVERIFY_EXCEPTION_THROWN(STData::read(mtx_file), std::runtime_error);
+}
+
+void STDataTest::testReadHDF5()
+{
+#ifdef HAVE_HDF5
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const STData::STDataFrame expected = randomFrame(400, 120, true);
+    const QString filename = dir.filePath("filtered_feature_bc_matrix.h5");
+    QVERIFY(write10xH5(filename, expected));
+    QVERIFY(HDF5Parser::isHDF5(filename));
+
+    const STData::STDataFrame data = STData::read(filename);
+    QVERIFY(data.is_sparse);
+    QVERIFY(equalFrames(data, expected));
+
+    // only the selected spots and genes are read (in the order of the file)
+    HDF5Parser::Selection selection;
+    const uvec rows = {3, 17, 42, 250, 399};
+    const uvec columns = {0, 5, 60, 119};
+    for (const uword i : rows) {
+        selection.spots.insert(expected.spots.at(static_cast<int>(i)));
+    }
+    for (const uword j : columns) {
+        selection.genes.insert(expected.genes.at(static_cast<int>(j)));
+    }
+    selection.spots.insert("unknown_spot");
+    const STData::STDataFrame selected = HDF5Parser::parseH5(filename, selection);
+    QVERIFY(equalFrames(selected, STData::sliceColumns(STData::sliceRows(expected, rows), columns)));
+#else
+    QSKIP("Support for HDF5 files is not available in this build");
+#endif
+}
+
+void STDataTest::testIdTable()
+{
+    IdTable table;
+    QCOMPARE(table.intern("gene_a"), 0);
+    QCOMPARE(table.intern("gene_b"), 1);
+    QCOMPARE(table.intern("gene_a"), 0);
+    QCOMPARE(table.size(), 2);
+    QCOMPARE(table.id("gene_b"), 1);
+    QCOMPARE(table.id("gene_c"), -1);
+    QCOMPARE(table.name(1), QString("gene_b"));
+
+    // added names always get a new id (the first one is used for lookups)
+    QCOMPARE(table.add("gene_a"), 2);
+    QCOMPARE(table.size(), 3);
+    QCOMPARE(table.id("gene_a"), 0);
+    QCOMPARE(table.ids(QList<QString>({"gene_b", "gene_c", "gene_a"})), QVector<int>({1, 0}));
+
+    // the ids of the dataset are the indexes of the spots and genes
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 100, 30, 50, "\n"));
+    QVERIFY(writeSpots(spots_file, 100));
+    STData data;
+    data.init(matrix_file, spots_file);
+    QCOMPARE(data.spotIds().size(), data.spots().size());
+    QCOMPARE(data.geneIds().size(), data.genes().size());
+    for (int i = 0; i < data.spots().size(); ++i) {
+        QCOMPARE(data.spotIds().id(data.spots().at(i)->name()), i);
+    }
+    for (int j = 0; j < data.genes().size(); ++j) {
+        QCOMPARE(data.geneIds().id(data.genes().at(j)->name()), j);
+    }
+    const QVector<int> selected = {4, 0, 7};
+    const STData::STDataFrame sliced = data.sliceDataSpots(selected);
+    QCOMPARE(sliced.spots.size(), 3);
+    QCOMPARE(sliced.spots.at(0), data.spots().at(4)->name());
+}
+
+void STDataTest::testReadSpots()
+{
+    // the layout is detected from the first line (headers start with x)
+    const QByteArray spots_2d("x\ty\tpixel_x\tpixel_y\n"
+                              "1x1\t10.5\t20\n"
+                              "2x1\t30\t40\r\n"
+                              "\n"
+                              "1x1\t50\t60\n");
+    const auto map_2d = MatrixParser::parseSpots(spots_2d.constData(),
+                                                 spots_2d.constData() + spots_2d.size());
+    QCOMPARE(map_2d.spots.size(), 2);
+    QCOMPARE(map_2d.spots.id("2x1"), 1);
+    QCOMPARE(map_2d.coordinates.at(1), Spot::SpotType(30, 40, 0));
+    // a duplicated spot keeps its last coordinates
+    QCOMPARE(map_2d.coordinates.at(0), Spot::SpotType(50, 60, 0));
+
+    const QByteArray spots_3d("1x1\t1\t2\t3\n");
+    const auto map_3d = MatrixParser::parseSpots(spots_3d.constData(),
+                                                 spots_3d.constData() + spots_3d.size());
+    QCOMPARE(map_3d.coordinates.at(0), Spot::SpotType(1, 2, 3));
+
+    const QByteArray spots_5("1x1\t1\t1\t100\t200\n");
+    const auto map_5 = MatrixParser::parseSpots(spots_5.constData(),
+                                                spots_5.constData() + spots_5.size());
+    QCOMPARE(map_5.coordinates.at(0), Spot::SpotType(100, 200, 0));
+
+    const QByteArray spots_6("3\t4\t3.1\t4.1\t100\t200\n");
+    const auto map_6 = MatrixParser::parseSpots(spots_6.constData(),
+                                                spots_6.constData() + spots_6.size());
+    QCOMPARE(map_6.spots.id("3x4"), 0);
+    QCOMPARE(map_6.coordinates.at(0), Spot::SpotType(100, 200, 0));
+
+    // all the lines must have the layout of the first one
+    const QByteArray invalid("1x1\t1\t2\n2x1\t1\t2\t3\n");
+    QVERIFY_EXCEPTION_THROWN(MatrixParser::parseSpots(invalid.constData(),
+                                                      invalid.constData() + invalid.size()),
+                             std::runtime_error);
+
+    // larger files are parsed in parallel chunks
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeSpots(spots_file, 50000));
+    const auto map = MatrixParser::parseSpots(spots_file);
+    QCOMPARE(map.spots.size(), 25000);
+    QCOMPARE(map.coordinates.size(), 25000);
+    QCOMPARE(map.coordinates.at(map.spots.id("2x14")), Spot::SpotType(21, 4, 0));
+}
+
+void STDataTest::testSaveMatrix()
+{
+    QFETCH(int, zeros);
+    QFETCH(QString, suffix);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 300, 120, zeros, "\n"));
+    STData::STDataFrame data = STData::read(matrix_file);
+    // real values are written with the shortest representation that reads back the same
+    if (data.is_sparse) {
+        data.sp_counts *= 0.1;
+    } else {
+        data.counts *= 0.1;
+    }
+
+    // the file is read back in the same format
+    const QString filename = dir.filePath("exported_matrix" + suffix);
+    STData::save(filename, data);
+    const STData::STDataFrame saved = STData::read(filename);
+    QCOMPARE(saved.genes, data.genes);
+    QCOMPARE(saved.spots, data.spots);
+    QVERIFY(approx_equal(saved.dense(), data.dense(), "absdiff", 0.0));
+}
+
+void STDataTest::testSaveMatrix_data()
+{
+    QTest::addColumn<int>("zeros");
+    QTest::addColumn<QString>("suffix");
+
+    QTest::newRow("dense tsv") << 20 << ".tsv";
+    QTest::newRow("sparse tsv") << 95 << ".tsv";
+    QTest::newRow("dense mtx") << 20 << ".mtx";
+    QTest::newRow("sparse mtx") << 95 << ".mtx";
+    QTest::newRow("dense binary") << 20 << ".stcache";
+    QTest::newRow("sparse binary") << 95 << ".stcache";
+}
+
+void STDataTest::testLoadingProgress()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString matrix_file = dir.filePath("matrix.tsv");
+    const QString spots_file = dir.filePath("spots.tsv");
+    QVERIFY(writeRandomMatrix(matrix_file, 100, 30, 50, "\n"));
+    QVERIFY(writeSpots(spots_file, 100));
+
+    // every stage of the parsing is reported and completed
+    QVector<double> fractions(LoadingProgress::N_STAGES, 0.0);
+    LoadingProgress progress([&fractions](const LoadingProgress::Stage stage,
+                                          const double fraction) {
+        fractions[stage] = fraction;
+    });
+    STData data;
+    data.init(matrix_file, spots_file, &progress);
+    QCOMPARE(fractions[LoadingProgress::ParseSpots], 1.0);
+    QCOMPARE(fractions[LoadingProgress::ParseMatrix], 1.0);
+    QCOMPARE(fractions[LoadingProgress::Filter], 1.0);
+
+    // the parsing stops when the loading is cancelled
+    QVERIFY(writeRandomMatrix(matrix_file, 80, 30, 50, "\n"));
+    LoadingProgress cancelled;
+    cancelled.cancel();
+    STData data_cancelled;
+    QVERIFY_EXCEPTION_THROWN(data_cancelled.init(matrix_file, spots_file, &cancelled),
+                             LoadingCancelled);
+    QVERIFY(data_cancelled.spots().isEmpty());
+}
+
+} // namespace unit //
+
+QTEST_MAIN(unit::STDataTest)
+#include "tst_stdatatest.moc"
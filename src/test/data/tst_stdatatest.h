@@ -0,0 +1,39 @@
+#ifndef TST_STDATATEST_H
+#define TST_STDATATEST_H
+
+#include <QObject>
+
+namespace unit
+{
+
+class STDataTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit STDataTest(QObject *parent = 0);
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testReadMatrix();
+    void testReadMatrix_data();
+    void testReadInvalidMatrix();
+    void testReadCompressedMatrix();
+    void testReadMatrixMarket();
+    void testReadHDF5();
+    void testIdTable();
+    void testReadSpots();
+    void testSaveMatrix();
+    void testSaveMatrix_data();
+    void testLoadingProgress();
+    void testDatasetCache();
+    void testRenderingData();
+    void testRenderingData_data();
+    void testSparseOperations();
+};
+
+} // namespace unit //
+
+#endif // TST_STDATATEST_H
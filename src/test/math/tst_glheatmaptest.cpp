@@ -46,6 +46,43 @@ void GLHeatMapTest::testHeatMap_data()
     QTest::newRow("blue") << qreal(440.0) << QColor4ub(Qt::blue) << true;*/
 }
 
+void GLHeatMapTest::testColorLookupTable()
+{
+    QFETCH(int, cmap);
+    QFETCH(double, min);
+    QFETCH(double, max);
+
+    // the colors of the lookup table are the colors of the gradient
+    const auto gradient_preset = static_cast<Color::ColorGradients>(cmap);
+    const Color::ColorLookupTable &table = Color::ColorLookupTable::get(gradient_preset);
+    QCPColorGradient gradient(gradient_preset);
+    QCOMPARE(table.size(), gradient.levelCount());
+    const QCPRange range(min, max);
+    std::vector<float> values;
+    for (int i = -10; i <= 110; ++i) {
+        const double value = min + (max - min) * (i + 0.25) / 100.0;
+        QCOMPARE(table.rgb(value, min, max), gradient.color(value, range));
+        values.push_back(static_cast<float>(value));
+    }
+
+    // the colors of an array of values are the colors of each value
+    std::vector<QRgb> colors(values.size());
+    table.rgb(values.data(), static_cast<int>(values.size()), min, max, colors.data());
+    for (size_t i = 0; i < values.size(); ++i) {
+        QCOMPARE(colors[i], table.rgb(values[i], min, max));
+    }
+}
+
+void GLHeatMapTest::testColorLookupTable_data()
+{
+    QTest::addColumn<int>("cmap");
+    QTest::addColumn<double>("min");
+    QTest::addColumn<double>("max");
+    QTest::newRow("jet") << static_cast<int>(QCPColorGradient::gpJet) << 1.0 << 10.0;
+    QTest::newRow("hot") << static_cast<int>(QCPColorGradient::gpHot) << 0.0 << 1.0;
+    QTest::newRow("spectrum") << static_cast<int>(QCPColorGradient::gpSpectrum) << -4.0 << 250.0;
+}
+
 } // namespace unit //
 
 QTEST_MAIN(unit::GLHeatMapTest)
@@ -19,6 +19,9 @@ private Q_SLOTS:
 
     void testHeatMap();
     void testHeatMap_data();
+
+    void testColorLookupTable();
+    void testColorLookupTable_data();
 };
 
 } // namespace unit //
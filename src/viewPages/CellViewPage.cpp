@@ -124,8 +124,8 @@ void CellViewPage::loadDataset(const Dataset &dataset)
     m_ui->frame->setEnabled(true);
     m_ui->histogram->setEnabled(!dataset.data()->is3D());
     m_ui->clustering->setEnabled(!dataset.data()->is3D());
-    m_ui->selection->setEnabled(!dataset.data()->is3D());
-    m_ui->lasso_selection->setEnabled(!dataset.data()->is3D());
+    m_ui->selection->setEnabled(true);
+    m_ui->lasso_selection->setEnabled(true);
     m_ui->rotate_left->setEnabled(!dataset.data()->is3D());
     m_ui->rotate_right->setEnabled(!dataset.data()->is3D());
     m_ui->flip->setEnabled(!dataset.data()->is3D());
@@ -397,7 +397,7 @@ void CellViewPage::slotLoadGenesColorsFile()
     }
 
     QFile file(filename);
-    QVector<QString> genes;
+    QVector<int> genes_ids;
     QVector<int> colors;
     bool parsed = true;
     // Parse the genes map = gene -> color
@@ -412,13 +412,16 @@ void CellViewPage::slotLoadGenesColorsFile()
                 parsed = false;
                 break;
             }
-            const QString gene = fields.at(0);
+            // the genes that are not in the dataset are skipped
+            const int gene_id = m_dataset.data()->geneIds().id(fields.at(0));
             const int color = fields.at(1).toInt();
-            genes.append(gene);
-            colors.append(color);
+            if (gene_id != -1) {
+                genes_ids.append(gene_id);
+                colors.append(color);
+            }
         }
 
-        if (genes.empty()) {
+        if (genes_ids.empty()) {
             QMessageBox::warning(this,
                                  tr("Genes File Colors"),
                                  tr("No valid genes could be found in the file"),
@@ -437,7 +440,7 @@ void CellViewPage::slotLoadGenesColorsFile()
 
     // Update gene colors
     if (parsed) {
-        m_dataset.data()->loadGeneColors(genes, colors);
+        m_dataset.data()->loadGeneColors(genes_ids, colors);
         m_genes->update();
         m_ui->view->slotUpdate();
     }
@@ -470,7 +473,7 @@ void CellViewPage::createClusters(const QMultiHash<int, QString> &clusters)
                                                     QCPColorGradient::gpJet);
         cluster_obj->color(color);
         cluster_obj->name(QString::number(cluster));
-        cluster_obj->spots(cluster_spots);
+        cluster_obj->spots(m_dataset.data()->spotIds().ids(cluster_spots));
         cluster_obj->visible(true);
         cluster_objects.append(cluster_obj);
     }
@@ -517,12 +520,14 @@ void CellViewPage::slotCreateClusteringSelections()
 
 void CellViewPage::slotCreateSelection()
 {
-    // get the selected spots
-    QList<QString> selected_spots =
-            QtConcurrent::blockingFilteredReduced<QList<QString> >(
-                m_dataset.data()->spots(),
-                [] (const auto spot) { return spot->selected(); },
-                [] (auto &list, const auto spot) { list.append(spot->name()); });
+    // get the selected spots (their ids are their indexes)
+    const auto &spots = m_dataset.data()->spots();
+    QVector<int> selected_spots;
+    for (int i = 0; i < spots.size(); ++i) {
+        if (spots.at(i)->selected()) {
+            selected_spots.append(i);
+        }
+    }
     // early out
     if (selected_spots.empty()) {
         return;
@@ -6,6 +6,7 @@
 #include <QClipboard>
 
 #include "SettingsStyle.h"
+#include "math/SparseMatrix.h"
 
 #include "ui_genesSelectionWidget.h"
 
@@ -28,9 +29,11 @@ SelectionGenesWidget::SelectionGenesWidget(const UserSelection::STDataFrame &dat
     model->setHorizontalHeaderItem(1, new QStandardItem(QString("Count")));
 
     // populate
-    for (int i = 0; i < data.counts.n_cols; ++i) {
+    const rowvec gene_counts = data.is_sparse ? STMath::colSums(data.sp_counts)
+                                              : STMath::colSums(data.counts);
+    for (uword i = 0; i < gene_counts.n_elem; ++i) {
         const QString gene = data.genes.at(i);
-        const double count = sum(data.counts.col(i));
+        const double count = gene_counts.at(i);
         const QString count_str = QString::number(count);
         QStandardItem *gene_item = new QStandardItem(gene);
         gene_item->setData(gene, Qt::UserRole);
@@ -6,6 +6,7 @@
 #include <QClipboard>
 
 #include "SettingsStyle.h"
+#include "math/SparseMatrix.h"
 
 #include "ui_spotsSelectionWidget.h"
 
@@ -28,9 +29,11 @@ SelectionSpotsWidget::SelectionSpotsWidget(const UserSelection::STDataFrame &dat
     model->setHorizontalHeaderItem(1, new QStandardItem(QString("Count")));
 
     // populate
-    for (int i = 0; i < data.counts.n_rows; ++i) {
+    const colvec spot_counts = data.is_sparse ? STMath::rowSums(data.sp_counts)
+                                              : STMath::rowSums(data.counts);
+    for (uword i = 0; i < spot_counts.n_elem; ++i) {
         const QString spot_str = data.spots.at(i);
-        const double count = sum(data.counts.col(i));
+        const double count = spot_counts.at(i);
         const QString count_str = QString::number(count);
         QStandardItem *spot_item = new QStandardItem(spot_str);
         spot_item->setData(spot_str, Qt::UserRole);
@@ -222,14 +222,23 @@ void UserSelectionsPage::slotExportSelection(QModelIndex index)
 
 void UserSelectionsPage::exportSelection(const UserSelection &selection)
 {
+    // the format of the export is given by the extension of the file
+    QString selected_filter;
     QString filename = QFileDialog::getSaveFileName(this,
                                                     tr("Export Selection"),
                                                     QDir::homePath(),
-                                                    QString("%1").arg(tr("Text Files (*.tsv)")));
+                                                    tr("Text Files (*.tsv);;"
+                                                       "Matrix Market Files (*.mtx);;"
+                                                       "Binary Files (*.stcache)"),
+                                                    &selected_filter);
     // early out
     if (filename.isEmpty()) {
         return;
     }
+    if (QFileInfo(filename).suffix().isEmpty()) {
+        const int suffix_start = selected_filter.indexOf("*.") + 1;
+        filename += selected_filter.mid(suffix_start, selected_filter.indexOf(")") - suffix_start);
+    }
 
     const QFileInfo fileInfo(filename);
     const QFileInfo dirInfo(fileInfo.dir().canonicalPath());
@@ -1,27 +1,63 @@
 #include "CellGLView3D.h"
 #include "color/HeatMap.h"
+#include "config/Configuration.h"
 #include <QDebug>
 #include <QString>
 #include <QOpenGLShaderProgram>
+#include <QImage>
+#include <QLineF>
+#include <QToolTip>
 #include <QKeyEvent>
 #include <QList>
+#include <QtConcurrent>
 #include <random>
 #include <algorithm>
+#include <cstddef>
 
 //TODO replace by Qt weak color
 constexpr QColor lasso_color = QColor(0,0,255,90);
 constexpr int KEY_OFFSET = 2;
 constexpr double DEFAULT_ZOOM_ADJUSTMENT = 10.0;
+constexpr int COLORMAP_SIZE = 256;
+constexpr int INSPECTOR_TOP_GENES = 10;
+constexpr int INSPECTOR_CLICK_DISTANCE = 3;
+
+// the ways the gene shader colors the spots
+enum ColorMode {
+    SpotColors = 0,
+    ColorMap = 1,
+    ValueAlpha = 2
+};
+
+namespace
+{
+
+// writes the ranges of the vector to the buffer (it must be bound)
+template <typename T>
+void writeRanges(QOpenGLBuffer &buffer, const QVector<T> &data,
+                 const STData::RenderingRanges &ranges)
+{
+    for (const auto &range : ranges) {
+        buffer.write(static_cast<int>(range.first * sizeof(T)),
+                     data.constData() + range.first,
+                     static_cast<int>(range.second * sizeof(T)));
+    }
+}
+
+}
 
 CellGLView3D::CellGLView3D(QWidget *parent)
     : QOpenGLWidget(parent)
     , m_rendering_settings(nullptr)
-    , m_pos_buffer(QOpenGLBuffer::VertexBuffer)
-    , m_color_buffer(QOpenGLBuffer::VertexBuffer)
-    , m_visible_buffer(QOpenGLBuffer::VertexBuffer)
-    , m_selected_buffer(QOpenGLBuffer::VertexBuffer)
+    , m_vertex_buffer(QOpenGLBuffer::VertexBuffer)
+    , m_index_buffer(QOpenGLBuffer::IndexBuffer)
+    , m_octree(nullptr)
+    , m_octree_ranges()
     , m_num_points(0)
     , m_initialized(false)
+    , m_heatmap_colormap(0)
+    , m_range_colormap(0)
+    , m_visual_mode(SettingsWidget::Normal)
     , m_legend_show(false)
     , m_image_show(true)
     , m_zoom(1.0)
@@ -37,16 +73,24 @@ CellGLView3D::CellGLView3D(QWidget *parent)
     , m_rubberBanding(false)
     , m_lassoSelection(false)
     , m_rubberband(nullptr)
+    , m_hovered_spot(-1)
     , m_dataset()
+    , m_update_pending(false)
     , m_image(nullptr)
     , m_mesh(nullptr)
     , m_legend(nullptr)
 {
     setFocusPolicy(Qt::StrongFocus);
+    // the spot inspector needs the mouse moves without buttons
+    setMouseTracking(true);
+
+    connect(&m_rendering_watcher, &QFutureWatcher<void>::finished,
+            this, &CellGLView3D::slotRenderingDataComputed);
 }
 
 CellGLView3D::~CellGLView3D()
 {
+    cancelRenderingData();
     m_rendering_settings = nullptr;
 }
 
@@ -54,23 +98,30 @@ void CellGLView3D::teardownGL()
 {
     // Actually destroy our OpenGL information
     m_vao.destroy();
-    m_pos_buffer.destroy();
-    m_color_buffer.destroy();
-    m_selected_buffer.destroy();
-    m_visible_buffer.destroy();
+    m_vertex_buffer.destroy();
+    m_index_buffer.destroy();
+    glDeleteTextures(1, &m_heatmap_colormap);
+    glDeleteTextures(1, &m_range_colormap);
+    m_heatmap_colormap = 0;
+    m_range_colormap = 0;
 }
 
 void CellGLView3D::clearData()
 {
-    m_pos_buffer.destroy();
-    m_color_buffer.destroy();
-    m_visible_buffer.destroy();
-    m_selected_buffer.destroy();
+    cancelRenderingData();
+    // the back buffer has the positions of the spots of the dataset
+    m_rendering_buffer = STData::RenderingData();
+    m_vertex_buffer.destroy();
+    m_index_buffer.destroy();
     m_vao.destroy();
+    m_octree = nullptr;
+    m_octree_ranges = PointOctree::NodeRanges();
     m_num_points = 0;
+    m_visual_mode = SettingsWidget::Normal;
     m_initialized = false;
     m_rubberBanding = false;
     m_lassoSelection = false;
+    m_hovered_spot = -1;
     m_image_show = true;
     m_legend_show = false;
     m_image->clearData();
@@ -119,9 +170,16 @@ void CellGLView3D::initializeGL()
     u_mvp_matrix = m_program.uniformLocation("mvp_matrix");
     u_size = m_program.uniformLocation("size");
     u_alpha = m_program.uniformLocation("alpha");
+    u_mode = m_program.uniformLocation("mode");
+    u_legend_min = m_program.uniformLocation("legend_min");
+    u_legend_max = m_program.uniformLocation("legend_max");
+    u_colormap = m_program.uniformLocation("colormap");
     m_program.link();
     m_program.release();
 
+    // the color maps of the visual modes that show values
+    createColorMaps();
+
     // init rubber band object
     m_rubberband.reset(new QRubberBand(QRubberBand::Rectangle, this));
     QPalette palette;
@@ -129,8 +187,13 @@ void CellGLView3D::initializeGL()
     m_rubberband->setPalette(palette);
 
     // image texture graphical object
+    // the view is refreshed when the tiles of the image are loaded in the background
     m_image.reset(new ImageTextureGL());
     m_image->init();
+    m_image->setMemoryBudget(static_cast<qint64>(Configuration().textureMemoryBudget()) << 20);
+    m_image->setTileLoadedCallback([this]() {
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+    });
 
     // mesh
     m_mesh.reset(new ImageMeshGL());
@@ -140,6 +203,40 @@ void CellGLView3D::initializeGL()
     m_legend.reset(new HeatMapLegendGL());
 }
 
+void CellGLView3D::createColorMaps()
+{
+    const auto create = [this](const Color::ColorGradients cmap) {
+        const QImage image = Color::createColorMap(COLORMAP_SIZE, cmap);
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    };
+    m_heatmap_colormap = create(Color::ColorGradients::gpSpectrum);
+    m_range_colormap = create(Color::ColorGradients::gpHot);
+}
+
+void CellGLView3D::updateIndexes()
+{
+    const auto &vertices = m_dataset.data()->renderingVertices();
+    const QVector<quint32> indexes = m_octree->computeIndexes([&](const int spot) {
+        return (vertices.at(spot).flags & STData::Visible) != 0;
+    }, m_octree_ranges);
+    // the index buffer is bound to the VAO
+    m_vao.bind();
+    m_index_buffer.bind();
+    m_index_buffer.allocate(indexes.constData(), indexes.size() * sizeof(quint32));
+    m_vao.release();
+    m_index_buffer.release();
+}
+
 void CellGLView3D::resizeGL(int width, int height)
 {
     Q_UNUSED(width);
@@ -188,6 +285,17 @@ const QMatrix4x4 CellGLView3D::viewMatrix3D() const
     return tr;
 }
 
+const QMatrix4x4 CellGLView3D::windowMatrix3D() const
+{
+    // the viewport transformation (y pointing down) applied before the perspective division
+    const double w = static_cast<double>(width());
+    const double h = static_cast<double>(height());
+    QMatrix4x4 tr;
+    tr.translate(w / 2.0, h / 2.0);
+    tr.scale(w / 2.0, -h / 2.0);
+    return tr * projectionMatrix3D() * viewMatrix3D();
+}
+
 const QMatrix4x4 CellGLView3D::viewMatrix2D() const
 {
     QTransform tr;
@@ -267,21 +375,34 @@ void CellGLView3D::paintGL()
     const QMatrix4x4 projection = is3D ? projectionMatrix3D() : projectionMatrix2D();
     const QMatrix4x4 mvp = is3D ? projection * view : projection * view * aligment;
 
-    // render image
+    // render image (only the visible tiles of the level that matches the zoom)
     if (!is3D && m_image_show) {
-        m_image->draw(projection * view);
+        m_image->draw(projection * view, m_zoom);
     }
 
-    // render mesh
+    // one unit at distance 1 of the camera covers pixel_scale pixels of the screen (3D)
+    const double pixel_scale = projection(1, 1) * height() * devicePixelRatioF() / 2.0;
+
+    // render mesh (the level of detail that matches the distance of the camera)
     if (is3D && m_image_show) {
-        m_mesh->draw(projection * view);
+        m_mesh->draw(projection * view, cameraPosition(), pixel_scale);
     }
 
-    // alpha value
-    const double alpha =
-            m_rendering_settings->visual_mode == SettingsWidget::DynamicRange ?
+    // alpha value (the dynamic range mode takes it from the values of the spots)
+    const double alpha = m_visual_mode == SettingsWidget::DynamicRange ?
                 -1.0 : m_rendering_settings->intensity;
 
+    // the values of the spots are mapped to colors with the legend range
+    // (the color map of the visual mode or the alpha of the colors of the spots)
+    ColorMode mode = SpotColors;
+    if (m_visual_mode == SettingsWidget::HeatMap || m_visual_mode == SettingsWidget::ColorRange) {
+        mode = ColorMap;
+    } else if (m_visual_mode == SettingsWidget::DynamicRange) {
+        mode = ValueAlpha;
+    }
+    const GLuint colormap = m_visual_mode == SettingsWidget::ColorRange ?
+                m_range_colormap : m_heatmap_colormap;
+
     // make size proportional to the zoom
     const int size = is3D ? m_rendering_settings->size * 2:
                             std::clamp(static_cast<int>(m_rendering_settings->size * 5 * m_zoom), 5, 25);
@@ -291,9 +412,24 @@ void CellGLView3D::paintGL()
     m_program.setUniformValue(u_size, size);
     m_program.setUniformValue(u_alpha, static_cast<GLfloat>(alpha));
     m_program.setUniformValue(u_mvp_matrix, mvp);
+    m_program.setUniformValue(u_mode, static_cast<GLint>(mode));
+    m_program.setUniformValue(u_legend_min, static_cast<GLfloat>(m_rendering_settings->legend_min));
+    m_program.setUniformValue(u_legend_max, static_cast<GLfloat>(m_rendering_settings->legend_max));
+    m_program.setUniformValue(u_colormap, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colormap);
     m_vao.bind();
-    glDrawArrays(GL_POINTS, 0, m_num_points);
+    if (is3D && m_octree != nullptr && !m_octree->isEmpty()) {
+        // only the nodes inside the view with the density that matches their size on the screen
+        for (const auto &range : m_octree->drawRanges(m_octree_ranges, mvp, pixel_scale, size)) {
+            glDrawElements(GL_POINTS, range.second, GL_UNSIGNED_INT,
+                           reinterpret_cast<const void *>(range.first * sizeof(quint32)));
+        }
+    } else {
+        glDrawArrays(GL_POINTS, 0, m_num_points);
+    }
     m_vao.release();
+    glBindTexture(GL_TEXTURE_2D, 0);
     m_program.release();
 
     QPainter painter(this);
@@ -309,7 +445,7 @@ void CellGLView3D::paintGL()
     }
 
     // render selection box/lasso
-    if (!is3D && m_lassoSelection && !m_lasso.isEmpty()) {
+    if (m_lassoSelection && !m_lasso.isEmpty()) {
         painter.setBrush(lasso_color);
         painter.setPen(lasso_color);
         painter.drawPath(m_lasso.simplified());
@@ -436,19 +572,19 @@ void CellGLView3D::mousePressEvent(QMouseEvent *event)
     }
 
     const bool is_left = event->button() == Qt::LeftButton;
-    const bool is3D = m_dataset.is3D();
 
-    if (is_left && m_rubberBanding && !is3D) {
+    if (is_left && m_rubberBanding) {
         // rubberbanding changes cursor to pointing hand
         setCursor(Qt::PointingHandCursor);
         m_originSelection = event->pos();
         m_rubberband->setGeometry(QRect(m_originSelection, QSize()));
         m_rubberband->show();
-    } else if (is_left && m_lassoSelection && !is3D) {
+    } else if (is_left && m_lassoSelection) {
         m_lasso = QPainterPath();
         m_originSelection = event->pos();
         m_lasso.moveTo(m_originSelection);
     } else {
+        m_press_pos = event->pos();
         m_pos = event->globalPos(); // panning needs globalPos
         // panning changes cursor to closed hand
         setCursor(Qt::ClosedHandCursor);
@@ -470,10 +606,10 @@ void CellGLView3D::mouseMoveEvent(QMouseEvent *event)
     m_pos = event->globalPos();
 
     // first check if we are in selection mode
-    if (is_left && m_rubberBanding && !is3D) {
+    if (is_left && m_rubberBanding) {
         // update the rubber band
         m_rubberband->setGeometry(QRect(m_originSelection, event->pos()).normalized());
-    } else if (is_left && m_lassoSelection && !is3D) {
+    } else if (is_left && m_lassoSelection) {
         const QPoint new_point = event->pos();
         if ((new_point - m_originSelection).manhattanLength() > 5) {
             m_lasso.lineTo(new_point);
@@ -481,8 +617,13 @@ void CellGLView3D::mouseMoveEvent(QMouseEvent *event)
         }
     } else if (is_left) {
         setPan(diff.x(), diff.y(), 0, is3D);
-    } else {
+    } else if (event->buttons() != Qt::NoButton) {
         setRotation(-diff.x(), diff.y());
+    } else {
+        // hovering (no buttons) only inspects the spot under the cursor
+        showSpotInfo(event->pos(), event->globalPos());
+        event->ignore();
+        return;
     }
 
     event->ignore();
@@ -498,17 +639,21 @@ void CellGLView3D::mouseReleaseEvent(QMouseEvent *event)
     unsetCursor();
 
     const bool is_left = event->button() == Qt::LeftButton;
-    const bool is3D = m_dataset.is3D();
 
-    if (is_left && m_rubberBanding && !is3D) {
+    if (is_left && m_rubberBanding) {
         const QRectF rubberBandRect = m_rubberband->geometry();
         QPainterPath path;
         path.addRect(rubberBandRect);
         sendSelectionEvent(path, event);
         m_rubberband->hide();
-    } else if (is_left && m_lassoSelection && !is3D) {
+    } else if (is_left && m_lassoSelection) {
         sendSelectionEvent(m_lasso, event);
         m_lasso = QPainterPath();
+    } else if (is_left
+               && (event->pos() - m_press_pos).manhattanLength() <= INSPECTOR_CLICK_DISTANCE) {
+        // a click (without panning) inspects the spot under the cursor
+        m_hovered_spot = -1;
+        showSpotInfo(event->pos(), event->globalPos());
     }
 
     event->ignore();
@@ -517,6 +662,16 @@ void CellGLView3D::mouseReleaseEvent(QMouseEvent *event)
 
 void CellGLView3D::sendSelectionEvent(const QPainterPath &path, const QMouseEvent *event)
 {
+    const SelectionEvent::SelectionMode mode
+            = SelectionEvent::modeFromKeyboardModifiers(event->modifiers());
+
+    // in 3D the spots are projected to the view and tested against the selected area
+    if (m_dataset.is3D()) {
+        m_dataset.data()->selectSpots(SelectionEvent(path, mode), windowMatrix3D());
+        slotUpdate();
+        return;
+    }
+
     // map selected area to node cordinate system
     const QTransform alignment = m_dataset.alignmentMatrix();
     QPainterPath transformed = QTransform(viewMatrix2D().toTransform() * alignment).inverted().map(path);
@@ -528,8 +683,6 @@ void CellGLView3D::sendSelectionEvent(const QPainterPath &path, const QMouseEven
     //}
 
     // Set the new selection area
-    const SelectionEvent::SelectionMode mode
-            = SelectionEvent::modeFromKeyboardModifiers(event->modifiers());
     const SelectionEvent selectionEvent(transformed, mode);
 
     // send selection event to dataset
@@ -537,6 +690,55 @@ void CellGLView3D::sendSelectionEvent(const QPainterPath &path, const QMouseEven
     slotUpdate();
 }
 
+void CellGLView3D::showSpotInfo(const QPoint &pos, const QPoint &global_pos)
+{
+    if (m_dataset.data().isNull()) {
+        return;
+    }
+
+    const auto data = m_dataset.data();
+    int spot = -1;
+    if (m_dataset.is3D()) {
+        // cast a ray from the cursor (the spots are projected to the view, the radius
+        // of the spots is given in pixels of the framebuffer)
+        const double radius = m_rendering_settings->size / devicePixelRatioF();
+        spot = data->nearestVisibleSpot(QPointF(pos), radius, windowMatrix3D());
+    } else {
+        // map the cursor and the radius of the spots to the coordinate system of the spots
+        // (the size of the spots is given in pixels of the framebuffer)
+        const QTransform alignment = m_dataset.alignmentMatrix();
+        const QTransform inverted =
+                QTransform(viewMatrix2D().toTransform() * alignment).inverted();
+        const int size =
+                std::clamp(static_cast<int>(m_rendering_settings->size * 5 * m_zoom), 5, 25);
+        const double pixels = size / 2.0 / devicePixelRatioF();
+        const QPointF position = inverted.map(QPointF(pos));
+        const double radius =
+                QLineF(position, inverted.map(QPointF(pos) + QPointF(pixels, 0.0))).length();
+        spot = data->nearestVisibleSpot(position, radius);
+    }
+    if (spot == m_hovered_spot) {
+        return;
+    }
+    m_hovered_spot = spot;
+    if (spot == -1) {
+        QToolTip::hideText();
+        return;
+    }
+
+    // the name and the total count of the spot and its genes with the highest counts
+    const auto &spot_obj = data->spots().at(spot);
+    QString text = QString("<b>%1</b><br>Total count: %2")
+            .arg(spot_obj->name().toHtmlEscaped())
+            .arg(spot_obj->totalCount());
+    for (const auto &gene : data->topGenes(spot, INSPECTOR_TOP_GENES)) {
+        text += QString("<br>%1: %2")
+                .arg(data->genes().at(gene.first)->name().toHtmlEscaped())
+                .arg(gene.second);
+    }
+    QToolTip::showText(global_pos, text, this);
+}
+
 void CellGLView3D::attachSettings(SettingsWidget::Rendering *rendering_settings)
 {
     m_rendering_settings = rendering_settings;
@@ -544,6 +746,9 @@ void CellGLView3D::attachSettings(SettingsWidget::Rendering *rendering_settings)
 
 void CellGLView3D::attachDataset(const Dataset &dataset)
 {
+    // the back buffer is computed again from the positions of the new dataset
+    cancelRenderingData();
+    m_rendering_buffer = STData::RenderingData();
     m_dataset = dataset;
 
     makeCurrent();
@@ -551,68 +756,59 @@ void CellGLView3D::attachDataset(const Dataset &dataset)
     // If the dataset is not 3D we create textures from the image tiles
     // and load the image alignment
     if (!dataset.is3D() && !dataset.imageFile().isNull() && !dataset.imageFile().isEmpty()) {
-        m_image->createTiles(dataset.image_tiles());
+        m_image->createTiles(dataset.image_pyramid());
         m_centerX = dataset.image_bounds().center().x();
         m_centerY = dataset.image_bounds().center().y();
     }
 
     // Load the 3D mesh if applies
-    if (dataset.is3D() && !dataset.meshFile().isNull() && !dataset.meshFile().isEmpty()) {
-        m_mesh->loadMesh(dataset.meshFile());
+    if (dataset.is3D() && !dataset.mesh().isNull()) {
+        m_mesh->loadMesh(dataset.mesh());
     }
 
     // Create buffers
-    const auto &indexes = dataset.data()->renderingCoords();
-    const auto &colors = dataset.data()->renderingColors();
-    const auto &visibles = dataset.data()->renderingVisible();
-    const auto &selecteds = dataset.data()->renderingSelected();
-    m_num_points = indexes.size();
+    const auto &vertices = dataset.data()->renderingVertices();
+    m_num_points = vertices.size();
+    m_visual_mode = dataset.data()->renderingData().visual_mode;
 
     // Create VAO
     m_vao.create();
     m_vao.bind();
     m_program.bind();
 
-    // Create Buffer (Index)
-    m_pos_buffer.create();
-    m_pos_buffer.bind();
-    m_pos_buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_pos_buffer.allocate(indexes.constData(), indexes.size() * sizeof(QVector3D));
+    // Create Buffer (interleaved position, color and flags)
+    const int stride = sizeof(STData::RenderingVertex);
+    m_vertex_buffer.create();
+    m_vertex_buffer.bind();
+    m_vertex_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_vertex_buffer.allocate(vertices.constData(), vertices.size() * stride);
     m_program.enableAttributeArray(0);
-    m_program.setAttributeBuffer(0, GL_FLOAT, 0, 3, 0);
-
-    // Create Buffer (Color)
-    m_color_buffer.create();
-    m_color_buffer.bind();
-    m_color_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-    m_color_buffer.allocate(colors.constData(), colors.size() * sizeof(QVector4D));
+    m_program.setAttributeBuffer(0, GL_FLOAT, offsetof(STData::RenderingVertex, x), 3, stride);
+    // the color (RGBA8) is normalized to 0-1
     m_program.enableAttributeArray(1);
-    m_program.setAttributeBuffer(1, GL_FLOAT, 0, 4, 0);
-
-    // Create Buffer (Selected)
-    m_selected_buffer.create();
-    m_selected_buffer.bind();
-    m_selected_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-    m_selected_buffer.allocate(selecteds.constData(), selecteds.size() * sizeof(int));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          reinterpret_cast<const void *>(offsetof(STData::RenderingVertex, color)));
+    // the flags are an integer attribute
     m_program.enableAttributeArray(2);
-    m_program.setAttributeBuffer(2, GL_INT, 0, 1, 0);
-
-    // Create Buffer (Visible)
-    m_visible_buffer.create();
-    m_visible_buffer.bind();
-    m_visible_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
-    m_visible_buffer.allocate(visibles.constData(), visibles.size() * sizeof(int));
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, stride,
+                           reinterpret_cast<const void *>(offsetof(STData::RenderingVertex, flags)));
+    // the value is mapped to a color in the shader
     m_program.enableAttributeArray(3);
-    m_program.setAttributeBuffer(3, GL_INT, 0, 1, 0);
+    m_program.setAttributeBuffer(3, GL_FLOAT, offsetof(STData::RenderingVertex, value), 1, stride);
 
     // Release (unbind) all
-    m_pos_buffer.release();
-    m_color_buffer.release();
-    m_selected_buffer.release();
-    m_visible_buffer.release();
+    m_vertex_buffer.release();
     m_program.release();
     m_vao.release();
 
+    // Create Buffer (Indexes) with the octree of the spots
+    if (dataset.is3D()) {
+        m_octree = &dataset.data()->spotOctree();
+        m_index_buffer.create();
+        m_index_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+        updateIndexes();
+    }
+
     doneCurrent();
     m_initialized = true;
     update();
@@ -620,34 +816,83 @@ void CellGLView3D::attachDataset(const Dataset &dataset)
 
 void CellGLView3D::slotUpdate()
 {
-    m_dataset.data()->computeRenderingData(*m_rendering_settings);
-    const auto &colors = m_dataset.data()->renderingColors();
-    const auto &visibles = m_dataset.data()->renderingVisible();
-    const auto &selecteds = m_dataset.data()->renderingSelected();
+    if (m_dataset.data().isNull()) {
+        return;
+    }
 
-    {
-        makeCurrent();
-        m_vao.bind();
+    // the newest request is computed when the one running finishes
+    if (m_rendering_watcher.isRunning()) {
+        m_update_pending = true;
+        return;
+    }
+    m_update_pending = false;
 
-        // Update Buffer (Color)
-        m_color_buffer.bind();
-        m_color_buffer.write(0, colors.constData(), colors.size() * sizeof(QVector4D));
-        m_color_buffer.release();
+    // the input is taken now and the data is computed into the back buffer
+    const QSharedPointer<STData> data = m_dataset.data();
+    const STData::RenderingInput input = data->renderingInput(*m_rendering_settings);
+    STData::RenderingData *buffer = &m_rendering_buffer;
+    m_rendering_source = data;
+    m_rendering_watcher.setFuture(QtConcurrent::run([data, input, buffer]() {
+        data->computeRenderingData(input, *buffer);
+    }));
+}
 
-        // Update Buffer (Selected)
-        m_selected_buffer.bind();
-        m_selected_buffer.write(0, selecteds.constData(), selecteds.size() * sizeof(int));
+void CellGLView3D::cancelRenderingData()
+{
+    m_rendering_watcher.waitForFinished();
+    m_rendering_source.clear();
+    m_update_pending = false;
+}
 
-        // Update Buffer (Visible)
-        m_visible_buffer.bind();
-        m_visible_buffer.write(0, visibles.constData(), visibles.size() * sizeof(int));
-        m_visible_buffer.release();
+void CellGLView3D::slotRenderingDataComputed()
+{
+    // the result is dropped if the dataset has changed (the newest request is still computed)
+    if (m_rendering_source.isNull() || m_rendering_source != m_dataset.data()) {
+        m_rendering_source.clear();
+        if (m_update_pending) {
+            slotUpdate();
+        }
+        return;
+    }
+    m_rendering_source.clear();
+
+    // the back buffer becomes the rendering data of the dataset
+    m_rendering_settings->legend_min = m_rendering_buffer.legend_min;
+    m_rendering_settings->legend_max = m_rendering_buffer.legend_max;
+    m_dataset.data()->swapRenderingData(m_rendering_buffer);
+    const STData::RenderingData &data = m_dataset.data()->renderingData();
+    m_visual_mode = data.visual_mode;
+
+    // the indexes of the octree only change if the visibility of the spots changes
+    // (the back buffer has the previous rendering data now)
+    const auto &previous = m_rendering_buffer.vertices;
+    bool visibility_changed = previous.size() != data.vertices.size();
+    for (const auto &range : data.dirty) {
+        for (int i = range.first; !visibility_changed && i < range.first + range.second; ++i) {
+            visibility_changed = (previous.at(i).flags & STData::Visible)
+                    != (data.vertices.at(i).flags & STData::Visible);
+        }
+    }
 
+    // only the ranges of spots that changed are uploaded
+    if (!data.dirty.isEmpty()) {
+        makeCurrent();
+        m_vao.bind();
+        m_vertex_buffer.bind();
+        writeRanges(m_vertex_buffer, data.vertices, data.dirty);
+        m_vertex_buffer.release();
         m_vao.release();
+        if (visibility_changed && m_octree != nullptr && !m_octree->isEmpty()) {
+            updateIndexes();
+        }
         doneCurrent();
     }
 
     update();
+
+    if (m_update_pending) {
+        slotUpdate();
+    }
 }
 
 const QImage CellGLView3D::grabPixmapGL()
@@ -2,16 +2,18 @@
 #define CELLGLVIEW3D_H
 
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 #include <QMatrix4x4>
+#include <QFutureWatcher>
 
 #include "data/Dataset.h"
 #include "data/STData.h"
 #include "HeatMapLegendGL.h"
 #include "ImageTextureGL.h"
 #include "ImageMeshGL.h"
+#include "data/PointOctree.h"
 
 class QOpenGLShaderProgram;
 class QRubberBand;
@@ -19,7 +21,7 @@ class QRubberBand;
 // An OpenGL widget designed to plot ST data (2D and 3D) and allow the user
 // to interact with it (zoom, panning, selections, etc..).
 // It also renders all the other objects (image, mesh, legend, etc...)
-class CellGLView3D : public QOpenGLWidget, protected QOpenGLFunctions
+class CellGLView3D : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
     Q_OBJECT
 
@@ -55,7 +57,9 @@ protected:
 
 public slots:
 
-    // when the view needs to be refreshed
+    // when the view needs to be refreshed, the rendering data is computed on a
+    // worker thread and uploaded when it finishes (if an update is requested while
+    // it is computed only the last request is computed next)
     void slotUpdate();
 
     void slotZoomIn();
@@ -73,6 +77,9 @@ protected slots:
 
     void teardownGL();
 
+    // swaps the computed rendering data and uploads it to the buffers
+    void slotRenderingDataComputed();
+
 signals:
 
 private:
@@ -80,11 +87,27 @@ private:
     // to handler selection events
     void sendSelectionEvent(const QPainterPath &path, const QMouseEvent *event);
 
+    // shows a tooltip with the info (name, total count and top genes) of the
+    // visible spot under the position of the cursor (if any)
+    void showSpotInfo(const QPoint &pos, const QPoint &global_pos);
+
+    // waits for the computation of the rendering data and drops its result
+    void cancelRenderingData();
+
+    // creates the color maps (lookup textures) of the visual modes that show values
+    void createColorMaps();
+
+    // uploads the indexes of the visible spots in the order of the octree (3D datasets)
+    // the context must be current
+    void updateIndexes();
+
     // OpenGL matrices
     const QMatrix4x4 viewMatrix3D() const;
     const QMatrix4x4 viewMatrix2D() const;
     const QMatrix4x4 projectionMatrix3D() const;
     const QMatrix4x4 projectionMatrix2D() const;
+    // from the coordinates of the spots to the coordinates of the widget (3D datasets)
+    const QMatrix4x4 windowMatrix3D() const;
     const QVector3D cameraPosition();
 
     // to handler panning and rotation
@@ -95,10 +118,13 @@ private:
     SettingsWidget::Rendering *m_rendering_settings;
 
     // OpenGL sutff buffers/shaders/texture
-    QOpenGLBuffer m_pos_buffer;
-    QOpenGLBuffer m_color_buffer;
-    QOpenGLBuffer m_visible_buffer;
-    QOpenGLBuffer m_selected_buffer;
+    QOpenGLBuffer m_vertex_buffer;
+    // the 3D datasets draw the spots through an index buffer with the ranges of the
+    // nodes of the octree that are inside the view (level of detail), the octree is owned
+    // by the data of the dataset and the view keeps the ranges of its nodes in the buffer
+    QOpenGLBuffer m_index_buffer;
+    const PointOctree *m_octree;
+    PointOctree::NodeRanges m_octree_ranges;
     QOpenGLVertexArrayObject m_vao;
     QOpenGLShaderProgram m_program;
     int m_num_points;
@@ -108,6 +134,16 @@ private:
     int u_mvp_matrix;
     int u_size;
     int u_alpha;
+    int u_mode;
+    int u_legend_min;
+    int u_legend_max;
+    int u_colormap;
+
+    // the values of the spots are mapped to colors in the shader with the color map
+    // of the visual mode the rendering data was computed with
+    GLuint m_heatmap_colormap;
+    GLuint m_range_colormap;
+    SettingsWidget::VisualMode m_visual_mode;
 
     // flags to show or not the legend and the tissue image
     bool m_legend_show;
@@ -133,9 +169,20 @@ private:
     QScopedPointer<QRubberBand> m_rubberband;
     QPainterPath m_lasso;
 
+    // helper variables for the spot inspector (hover and click)
+    QPoint m_press_pos;
+    int m_hovered_spot;
+
     // dataset (to be rendered)
     Dataset m_dataset;
 
+    // the rendering data is computed into the back buffer on a worker thread
+    // m_rendering_source is the data being computed (null if the result is dropped)
+    QFutureWatcher<void> m_rendering_watcher;
+    QSharedPointer<STData> m_rendering_source;
+    STData::RenderingData m_rendering_buffer;
+    bool m_update_pending;
+
     // rendering objects
     QScopedPointer<ImageTextureGL> m_image;
     QScopedPointer<ImageMeshGL> m_mesh;
@@ -1,18 +1,21 @@
 #include "ImageMeshGL.h"
 
 
-#include <QByteArray>
 #include <QApplication>
 #include <QOpenGLFunctions>
-#include <QFile>
-#include <QFileInfo>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "data/MeshLevels.h"
 
 ImageMeshGL::ImageMeshGL()
     : m_indexBuf(QOpenGLBuffer::IndexBuffer)
     , m_posBuf(QOpenGLBuffer::VertexBuffer)
     , m_normBuf(QOpenGLBuffer::VertexBuffer)
     , m_program(nullptr)
-    , m_num_triangles(0)
+    , m_mesh(nullptr)
+    , m_level_offsets()
     , m_isInitialized(false)
 {
 
@@ -44,60 +47,53 @@ void ImageMeshGL::clearData()
     m_indexBuf.destroy();
     m_normBuf.destroy();
     m_isInitialized = false;
-    m_num_triangles = 0;
+    m_mesh.clear();
+    m_level_offsets.clear();
 }
 
-void ImageMeshGL::draw(const QMatrix4x4 &mvp_matrx)
+void ImageMeshGL::draw(const QMatrix4x4 &mvp_matrx, const QVector3D &camera,
+                       const double pixel_scale)
 {
     if (!m_isInitialized) {
         return;
     }
 
+    // the level is chosen with the distance from the camera to the bounding box of the mesh
+    const QVector3D min = m_mesh->min();
+    const QVector3D max = m_mesh->max();
+    const QVector3D nearest(std::clamp(camera.x(), min.x(), max.x()),
+                            std::clamp(camera.y(), min.y(), max.y()),
+                            std::clamp(camera.z(), min.z(), max.z()));
+    const int level = m_mesh->levelForDistance(camera.distanceToPoint(nearest), pixel_scale);
+    const int offset = m_level_offsets.at(level);
+
     m_program->bind();
     m_program->setUniformValue("mvp_matrix", mvp_matrx);
     m_vao.bind();
-    glDrawElements(GL_TRIANGLES, m_num_triangles, GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, m_mesh->level(level).indexes.size(), GL_UNSIGNED_INT,
+                   reinterpret_cast<const void *>(offset * sizeof(GLuint)));
     m_vao.release();
     m_program->release();
 }
 
-void ImageMeshGL::loadMesh(const QString &meshFile)
+void ImageMeshGL::loadMesh(const QSharedPointer<MeshLevels> &mesh)
 {
-    qDebug() << "Loading mesh " << meshFile;
-    QVector<QVector3D> vertices;
-    QVector<QVector3D> normal;
-    QVector<GLuint> indices;
-    QFile file(meshFile);
-    if (file.open(QIODevice::ReadOnly)) {
-        QTextStream in(&file);
-        QString line;
-        QStringList fields;
-        while (!in.atEnd()) {
-            line = in.readLine();
-            if (!line.startsWith("#")) {
-                fields = line.split(" ");
-                if (fields.at(0) == "v") {
-                    vertices.append(QVector3D(fields.at(1).toFloat(),
-                                              fields.at(2).toFloat(),
-                                              fields.at(3).toFloat()));
-                } else if (fields.at(0) == "vn") {
-                    normal.append(QVector3D(fields.at(1).toFloat(),
-                                            fields.at(2).toFloat(),
-                                            fields.at(3).toFloat()));
-
-                } else if (fields.at(0) == "f") {
-                    indices.append(fields.at(1).split("//").at(0).toInt() - 1);
-                    indices.append(fields.at(2).split("//").at(0).toInt() - 1);
-                    indices.append(fields.at(3).split("//").at(0).toInt() - 1);
-                } else {
-                    //Ignoring other types
-                }
-            }
-        }
+    if (mesh.isNull() || mesh->isEmpty()) {
+        return;
+    }
+    m_mesh = mesh;
+    const QVector<QVector3D> &vertices = mesh->vertices();
+    const QVector<QVector3D> &normal = mesh->normals();
+
+    // the indexes of the levels are stored one after the other
+    m_level_offsets.clear();
+    int n_indexes = 0;
+    for (int l = 0; l < mesh->levels(); ++l) {
+        m_level_offsets.append(n_indexes);
+        n_indexes += mesh->level(l).indexes.size();
     }
-    m_num_triangles = indices.size();
-    qDebug() << "Loaded mesh with " << vertices.size() / 3
-             << " triangles and " << m_num_triangles / 3 << " faces";
+    qDebug() << "Uploading mesh with " << vertices.size() << " vertices and "
+             << mesh->level(0).indexes.size() / 3 << " faces in " << mesh->levels() << " levels";
 
     m_program->bind();
 
@@ -107,7 +103,12 @@ void ImageMeshGL::loadMesh(const QString &meshFile)
     m_indexBuf.create();
     m_indexBuf.bind();
     m_indexBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_indexBuf.allocate(indices.data(), indices.size() * sizeof(GLuint));
+    m_indexBuf.allocate(n_indexes * sizeof(GLuint));
+    for (int l = 0; l < mesh->levels(); ++l) {
+        const QVector<quint32> &indexes = mesh->level(l).indexes;
+        m_indexBuf.write(m_level_offsets.at(l) * sizeof(GLuint), indexes.constData(),
+                         indexes.size() * sizeof(GLuint));
+    }
 
     // Transfer vertex data to VBO 0
     m_posBuf.create();
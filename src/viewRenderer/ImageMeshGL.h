@@ -1,7 +1,10 @@
 #ifndef IMAGEMESHGL_H
 #define IMAGEMESHGL_H
 
+#include <QVector>
 #include <QVector2D>
+#include <QVector3D>
+#include <QSharedPointer>
 #include <QOpenGLFunctions>
 #include <QRectF>
 #include <QOpenGLTexture>
@@ -9,8 +12,12 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
 
+class MeshLevels;
+
 // This rendering object renders a 3D mesh if the
 // user is using 3D mode and has added the mesh file (.obj format)
+// The triangles of all the levels of detail of the mesh are uploaded
+// (they share the vertices) and the level is chosen when drawing
 class ImageMeshGL : public QOpenGLFunctions
 {
 
@@ -25,11 +32,12 @@ public:
     // will remove and destroy all the buffers
     void clearData();
 
-    // load the mesh object and update the buffers
-    void loadMesh(const QString &meshFile);
+    // load the mesh object (with its levels) and update the buffers
+    void loadMesh(const QSharedPointer<MeshLevels> &mesh);
 
-    // draw the mesh
-    void draw(const QMatrix4x4 &mvp_matrx);
+    // draw the level of the mesh that matches the distance of the camera
+    // (one unit at distance 1 covers pixel_scale pixels of the screen)
+    void draw(const QMatrix4x4 &mvp_matrx, const QVector3D &camera, const double pixel_scale);
 
 private:
 
@@ -40,7 +48,9 @@ private:
     QOpenGLBuffer m_normBuf;
     QOpenGLShaderProgram *m_program;
 
-    int m_num_triangles;
+    // the mesh and the position of the indexes of each level in the index buffer
+    QSharedPointer<MeshLevels> m_mesh;
+    QVector<int> m_level_offsets;
     bool m_isInitialized;
 
     Q_DISABLE_COPY(ImageMeshGL);
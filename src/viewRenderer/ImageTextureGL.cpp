@@ -1,23 +1,80 @@
 #include "ImageTextureGL.h"
 
-#include <QOpenGLTexture>
 #include <QImage>
-#include <QtConcurrent>
-#include <QFuture>
-#include <QByteArray>
-#include <QBuffer>
-#include <QApplication>
-#include <QImageReader>
-#include <QOpenGLFunctions>
+#include <QMatrix4x4>
+#include <QPolygonF>
+#include <QThread>
+#include <QVector4D>
 
+#include "data/ImagePyramid.h"
+
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+
+namespace
+{
+
+// the default memory (in bytes) used by the texture array of the tiles
+constexpr qint64 DEFAULT_MEMORY_BUDGET = qint64(512) << 20;
+
+// the memory of a layer of the texture array (RGBA)
+constexpr qint64 LAYER_BYTES = qint64(ImagePyramid::TILE_SIZE) * ImagePyramid::TILE_SIZE * 4;
+
+// the key of the texture of a tile in a level of the pyramid
+inline quint64 tileKey(const int level, const int index)
+{
+    return (static_cast<quint64>(level) << 32) | static_cast<quint32>(index);
+}
+
+// true if the rect (in the plane z = 0) is not outside one of the planes
+// of the view volume of the mvp matrix
+bool isInsideView(const QMatrix4x4 &mvp, const QRectF &rect)
+{
+    const QVector4D corners[4] = {mvp * QVector4D(rect.left(), rect.top(), 0.0, 1.0),
+                                  mvp * QVector4D(rect.right(), rect.top(), 0.0, 1.0),
+                                  mvp * QVector4D(rect.left(), rect.bottom(), 0.0, 1.0),
+                                  mvp * QVector4D(rect.right(), rect.bottom(), 0.0, 1.0)};
+    const auto outside = [&corners](const auto &isOutside) {
+        return std::all_of(std::begin(corners), std::end(corners), isOutside);
+    };
+    return !outside([](const QVector4D &c) { return c.x() < -c.w(); })
+            && !outside([](const QVector4D &c) { return c.x() > c.w(); })
+            && !outside([](const QVector4D &c) { return c.y() < -c.w(); })
+            && !outside([](const QVector4D &c) { return c.y() > c.w(); });
+}
+
+// decodes a tile in the thread pool
+class TileDecoder : public QRunnable
+{
+public:
+    explicit TileDecoder(const std::function<void()> &decode)
+        : m_decode(decode)
+    {
+    }
+
+    void run() override
+    {
+        m_decode();
+    }
+
+private:
+    std::function<void()> m_decode;
+};
+
+}
 
 
 ImageTextureGL::ImageTextureGL()
-    : m_program(nullptr)
+    : m_texture(0)
+    , m_memory_budget(DEFAULT_MEMORY_BUDGET)
+    , m_frame(0)
+    , m_instanceBuf(QOpenGLBuffer::VertexBuffer)
+    , m_program(nullptr)
     , m_isInitialized(false)
 {
-
+    // the tiles are decoded in the background with half of the cores
+    m_pool.setMaxThreadCount(std::max(QThread::idealThreadCount() / 2, 1));
 }
 
 ImageTextureGL::~ImageTextureGL()
@@ -41,54 +98,164 @@ void ImageTextureGL::init()
 
 void ImageTextureGL::clearData()
 {
+    // wait for the tiles being decoded
+    m_pool.clear();
+    m_pool.waitForDone();
+    m_requested.clear();
+    m_wanted.clear();
+    m_decoded.clear();
     clearTextures();
+    m_pyramid.clear();
     m_vao.destroy();
-    m_textures_pos.clear();
-    m_texture_coords.clear();
-    m_coordBuf.destroy();
-    m_posBuf.destroy();
+    m_instances.clear();
+    m_instanceBuf.destroy();
     m_isInitialized = false;
 }
 
 void ImageTextureGL::clearTextures()
 {
-    for (QOpenGLTexture *texture : m_textures) {
-        if (texture != nullptr) {
-            texture->destroy();
-        }
-        texture = nullptr;
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
     }
-    m_textures.clear();
+    m_layers.clear();
+    m_free_layers.clear();
+}
+
+void ImageTextureGL::setMemoryBudget(const qint64 bytes)
+{
+    m_memory_budget = bytes;
+}
+
+void ImageTextureGL::setTileLoadedCallback(const std::function<void()> &callback)
+{
+    m_tile_loaded = callback;
 }
 
-void ImageTextureGL::draw(const QMatrix4x4 &mvp_matrx)
+void ImageTextureGL::draw(const QMatrix4x4 &mvp_matrx, const double zoom)
 {
     if (!m_isInitialized) {
         return;
     }
 
-    glEnable(GL_TEXTURE_2D);
+    ++m_frame;
+    uploadDecodedTiles();
+
+    // the rect of the scene inside the view (the corners of the clip space
+    // mapped back to the plane of the image)
+    bool invertible = false;
+    const QMatrix4x4 inverse = mvp_matrx.inverted(&invertible);
+    if (!invertible) {
+        return;
+    }
+    QPolygonF view;
+    view << inverse.map(QPointF(-1.0, -1.0)) << inverse.map(QPointF(1.0, -1.0))
+         << inverse.map(QPointF(1.0, 1.0)) << inverse.map(QPointF(-1.0, 1.0));
+    const QRectF visible = view.boundingRect();
+
+    // the tiles of the level that matches the zoom that are visible and the tiles
+    // around them (prefetched), the coarsest level is drawn below them while they load
+    // (the tiles of the bounding rect that are outside the view are culled)
+    const int level = m_pyramid->levelForZoom(zoom);
+    const int coarsest = m_pyramid->levels() - 1;
+    const double margin = ImagePyramid::TILE_SIZE * m_pyramid->levelScale(level);
+    const auto cull = [this, &mvp_matrx](const int tiles_level, QVector<int> tiles) {
+        tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                                   [&](const int index) {
+                                       return !isInsideView(mvp_matrx,
+                                                            m_pyramid->tileRect(tiles_level, index));
+                                   }),
+                    tiles.end());
+        return tiles;
+    };
+    const QVector<int> tiles = cull(level, m_pyramid->visibleTiles(level, visible));
+    const QVector<int> neighbours =
+            m_pyramid->visibleTiles(level, visible.adjusted(-margin, -margin, margin, margin));
+    const QVector<int> background = cull(coarsest, m_pyramid->visibleTiles(coarsest, visible));
+    {
+        QMutexLocker locker(&m_mutex);
+        m_wanted.clear();
+        for (const int index : neighbours) {
+            m_wanted.insert(tileKey(level, index));
+        }
+        for (const int index : background) {
+            m_wanted.insert(tileKey(coarsest, index));
+        }
+    }
+
+    m_instances.clear();
+    if (level != coarsest) {
+        appendTiles(coarsest, background);
+    }
+    appendTiles(level, tiles);
+    if (!m_instances.isEmpty()) {
+        drawInstances(mvp_matrx);
+    }
+
+    // the tiles are requested once the drawn tiles are marked as used (so their
+    // layers are not taken), a new frame is needed if tiles were uploaded directly
+    const bool uploaded = requestTiles(coarsest, background, 2)
+            | requestTiles(level, tiles, 1)
+            | requestTiles(level, neighbours, 0);
+    if (uploaded && m_tile_loaded) {
+        m_tile_loaded();
+    }
+}
+
+void ImageTextureGL::drawInstances(const QMatrix4x4 &mvp_matrx)
+{
     m_program->bind();
     m_program->setUniformValue("mvp_matrix", mvp_matrx);
     m_program->setUniformValue("tex", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
     {
+        // the tiles of the coarsest level are drawn first (below the tiles of the level)
         m_vao.bind();
-        for (int i = 0; i < m_textures.size(); ++i) {
-            QOpenGLTexture *texture = m_textures[i];
-            texture->bind(0);
-            glDrawArrays(GL_TRIANGLE_STRIP, i * 4, 4);
-        }
+        m_instanceBuf.bind();
+        m_instanceBuf.allocate(m_instances.constData(),
+                               m_instances.size() * static_cast<int>(sizeof(TileInstance)));
+        m_instanceBuf.release();
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_instances.size());
         m_vao.release();
     }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     m_program->release();
-    glDisable(GL_TEXTURE_2D);
 }
 
-void ImageTextureGL::createTiles(const QVector<QPair<QImage, QPoint> > &tiles)
+void ImageTextureGL::createTiles(const QSharedPointer<ImagePyramid> &pyramid)
 {
-    for (const auto &tile : tiles) {
-        // create texture from the tile
-        addTexture(tile.first, tile.second.x(), tile.second.y());
+    if (pyramid.isNull() || pyramid->isEmpty()) {
+        return;
+    }
+    m_pyramid = pyramid;
+
+    // the texture array has a layer for every tile of the pyramid unless
+    // the memory budget or the maximum number of layers are exceeded
+    int n_tiles = 0;
+    for (int level = 0; level < m_pyramid->levels(); ++level) {
+        n_tiles += m_pyramid->level(level).tiles.size();
+    }
+    GLint max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    const qint64 budget_layers = std::max(m_memory_budget / LAYER_BYTES, qint64(1));
+    const int n_layers = static_cast<int>(std::min({qint64(n_tiles), budget_layers,
+                                                    qint64(std::max(max_layers, 1))}));
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // the levels of the pyramid are the mipmaps of the tiles
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ImagePyramid::TILE_SIZE,
+                 ImagePyramid::TILE_SIZE, n_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_free_layers.reserve(n_layers);
+    for (int layer = n_layers - 1; layer >= 0; --layer) {
+        m_free_layers.append(layer);
     }
 
     m_program->bind();
@@ -96,49 +263,132 @@ void ImageTextureGL::createTiles(const QVector<QPair<QImage, QPoint> > &tiles)
     m_vao.create();
     m_vao.bind();
 
-    // transfer vertex data to VBO 0
-    m_posBuf.create();
-    m_posBuf.bind();
-    m_posBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_posBuf.allocate(m_textures_pos.constData(), m_textures_pos.size() * sizeof(QVector3D));
+    // the quad of the tiles is created in the vertex shader, the rect and
+    // the layer of every tile are per instance attributes
+    m_instanceBuf.create();
+    m_instanceBuf.bind();
+    m_instanceBuf.setUsagePattern(QOpenGLBuffer::StreamDraw);
     m_program->enableAttributeArray(0);
-    m_program->setAttributeBuffer(0, GL_FLOAT, 0, 3, 0);
-
-    // transfer texture data to VBO 1
-    m_coordBuf.create();
-    m_coordBuf.bind();
-    m_coordBuf.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_coordBuf.allocate(m_texture_coords.constData(), m_texture_coords.size() * sizeof(QVector2D));
+    m_program->setAttributeBuffer(0, GL_FLOAT, offsetof(TileInstance, x), 4, sizeof(TileInstance));
     m_program->enableAttributeArray(1);
-    m_program->setAttributeBuffer(1, GL_FLOAT, 0, 2, 0);
+    m_program->setAttributeBuffer(1, GL_FLOAT, offsetof(TileInstance, layer), 3,
+                                  sizeof(TileInstance));
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
 
-    m_posBuf.release();
-    m_coordBuf.release();
+    m_instanceBuf.release();
     m_vao.release();
     m_program->release();
 
     m_isInitialized = true;
 }
 
-void ImageTextureGL::addTexture(const QImage &image, const int x, const int y)
+void ImageTextureGL::appendTiles(const int level, const QVector<int> &tiles)
 {
-    const float width = static_cast<float>(image.width());
-    const float height = static_cast<float>(image.height());
+    for (const int index : tiles) {
+        const auto it = m_layers.find(tileKey(level, index));
+        if (it == m_layers.end()) {
+            continue;
+        }
+        it->last_used = m_frame;
+        const QRectF rect = m_pyramid->tileRect(level, index);
+        const QRect pixels = m_pyramid->tilePixels(level, index);
+        m_instances.append(TileInstance{static_cast<float>(rect.x()),
+                                        static_cast<float>(rect.y()),
+                                        static_cast<float>(rect.width()),
+                                        static_cast<float>(rect.height()),
+                                        static_cast<float>(it->layer),
+                                        static_cast<float>(pixels.width()) / ImagePyramid::TILE_SIZE,
+                                        static_cast<float>(pixels.height()) / ImagePyramid::TILE_SIZE});
+    }
+}
 
-    m_textures_pos.append(QVector3D(x + width, y + height, 0.0));
-    m_textures_pos.append(QVector3D(x + width, y, 0.0));
-    m_textures_pos.append(QVector3D(x, y + height, 0.0));
-    m_textures_pos.append(QVector3D(x, y, 0.0));
+bool ImageTextureGL::uploadTile(const quint64 key, const QImage &image)
+{
+    const int layer = takeLayer();
+    if (layer == -1) {
+        return false;
+    }
+    // the tiles of the edges of the levels only fill part of the layer
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, rgba.width(), rgba.height(), 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, rgba.constBits());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_layers.insert(key, TileLayer{layer, m_frame});
+    return true;
+}
 
-    m_texture_coords.append(QVector2D(1.0, 1.0));
-    m_texture_coords.append(QVector2D(1.0, 0.0));
-    m_texture_coords.append(QVector2D(0.0, 1.0));
-    m_texture_coords.append(QVector2D(0.0, 0.0));
+void ImageTextureGL::uploadDecodedTiles()
+{
+    // the decoded images are released once they are uploaded
+    QHash<quint64, QImage> decoded;
+    {
+        QMutexLocker locker(&m_mutex);
+        decoded.swap(m_decoded);
+    }
+    for (auto it = decoded.constBegin(); it != decoded.constEnd(); ++it) {
+        m_requested.remove(it.key());
+        if (!it.value().isNull() && !m_layers.contains(it.key())) {
+            uploadTile(it.key(), it.value());
+        }
+    }
+}
+
+bool ImageTextureGL::requestTiles(const int level, const QVector<int> &tiles, const int priority)
+{
+    bool uploaded = false;
+    for (const int index : tiles) {
+        const quint64 key = tileKey(level, index);
+        if (m_layers.contains(key) || m_requested.contains(key)) {
+            continue;
+        }
+        // the tiles in memory are uploaded directly
+        if (m_pyramid->isTileLoaded(level, index)) {
+            uploaded = uploadTile(key, m_pyramid->tile(level, index)) || uploaded;
+            continue;
+        }
+        m_requested.insert(key);
+        const QSharedPointer<ImagePyramid> pyramid = m_pyramid;
+        m_pool.start(new TileDecoder([this, pyramid, key, level, index]() {
+            // the tile is skipped if it is not wanted anymore (the view has moved)
+            {
+                QMutexLocker locker(&m_mutex);
+                if (!m_wanted.contains(key)) {
+                    m_decoded.insert(key, QImage());
+                    return;
+                }
+            }
+            const QImage image = pyramid->tile(level, index);
+            {
+                QMutexLocker locker(&m_mutex);
+                m_decoded.insert(key, image);
+            }
+            if (m_tile_loaded) {
+                m_tile_loaded();
+            }
+        }), priority);
+    }
+    return uploaded;
+}
 
-    QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapNearest);
-    texture->setMagnificationFilter(QOpenGLTexture::Linear);
-    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
-    texture->setData(image);
-    m_textures.append(texture);
+int ImageTextureGL::takeLayer()
+{
+    if (!m_free_layers.isEmpty()) {
+        return m_free_layers.takeLast();
+    }
+    // the tiles drawn in the current frame are not removed
+    auto lru = m_layers.end();
+    for (auto it = m_layers.begin(); it != m_layers.end(); ++it) {
+        if (it->last_used < m_frame && (lru == m_layers.end() || it->last_used < lru->last_used)) {
+            lru = it;
+        }
+    }
+    if (lru == m_layers.end()) {
+        return -1;
+    }
+    const int layer = lru->layer;
+    m_layers.erase(lru);
+    return layer;
 }
@@ -1,19 +1,31 @@
 #ifndef IMAGETEXTUREGL_H
 #define IMAGETEXTUREGL_H
 
-#include <QVector2D>
-#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QRectF>
-#include <QOpenGLTexture>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+#include <QSharedPointer>
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
 
+#include <functional>
+
 class QImage;
+class ImagePyramid;
 
 // This class represents a tiled image to be rendered using textures. This class
 // is used to render the cell tissue image which has a high resolution
-class ImageTextureGL : public QOpenGLFunctions
+// The image is a pyramid of levels, only the tiles of the level that matches
+// the zoom that are inside the view (culled against the MVP matrix) are drawn.
+// The tiles are decoded on background threads when they become visible (and the
+// neighbour tiles are prefetched) and uploaded to the layers of a texture array that
+// are reused in least-recently-used order (the number of layers is limited by a
+// memory budget). The visible tiles are drawn with one instanced draw call.
+class ImageTextureGL : public QOpenGLExtraFunctions
 {
 
 public:
@@ -27,30 +39,87 @@ public:
     // will remove and destroy all textures
     void clearData();
 
-    // will split the image given as input into small textures of fixed size
-    // returns true if the parsing and creation of tiles was correct
-    void createTiles(const QVector<QPair<QImage, QPoint>> &tiles);
+    // sets the pyramid of tiles of the image and creates the texture array of the tiles
+    void createTiles(const QSharedPointer<ImagePyramid> &pyramid);
+
+    // draw the tiles of the level of the pyramid that matches the zoom
+    // (pixels of the screen per scene unit) that are inside the view of the mvp matrix
+    // the tiles that are not loaded yet are requested and the coarsest level is drawn instead
+    void draw(const QMatrix4x4 &mvp_matrx, const double zoom);
+
+    // the maximum memory (in bytes) used by the texture array of the tiles
+    void setMemoryBudget(const qint64 bytes);
 
-    // draw the image
-    void draw(const QMatrix4x4 &mvp_matrx);
+    // the function called (from a background thread) when a requested tile is decoded
+    void setTileLoadedCallback(const std::function<void()> &callback);
 
 private:
 
-    // internal functions to create a texture from an image and add it to the
-    // rendering list (one texture for each image tile)
-    void addTexture(const QImage &image, const int x = 0, const int y = 0);
+    // the layer of the texture array of a tile and the last frame it was drawn
+    struct TileLayer {
+        int layer;
+        quint64 last_used;
+    };
+
+    // the data of a drawn tile (an instance of the quad), the rect of the tile
+    // in scene units and its layer and size (0 to 1) in the texture array
+    struct TileInstance {
+        float x;
+        float y;
+        float width;
+        float height;
+        float layer;
+        float s;
+        float t;
+    };
+
+    // adds the tiles that are loaded to the instances to draw and updates their use
+    void appendTiles(const int level, const QVector<int> &tiles);
+
+    // draws the instances (the tiles) with one draw call
+    void drawInstances(const QMatrix4x4 &mvp_matrx);
+
+    // copies the tile to a layer of the texture array
+    // returns false if all the layers are used by the tiles of the current frame
+    bool uploadTile(const quint64 key, const QImage &image);
+
+    // uploads the tiles decoded in the background
+    void uploadDecodedTiles();
+
+    // requests the tiles that are not loaded to be decoded in the background
+    // (the tiles in memory are uploaded directly), returns true if tiles were uploaded
+    bool requestTiles(const int level, const QVector<int> &tiles, const int priority);
+
+    // returns a free layer of the texture array, the least recently used tile (not drawn
+    // in the current frame) is removed if there are no free layers, -1 if there are none
+    int takeLayer();
 
     // internal function to remove and clean textures
     void clearTextures();
-    void clearNodes();
 
-    // OpenGL rendering data and buffers
-    QVector<QOpenGLTexture *> m_textures;
-    QVector<QVector3D> m_textures_pos;
-    QVector<QVector2D> m_texture_coords;
+    // the pyramid of tiles
+    QSharedPointer<ImagePyramid> m_pyramid;
+
+    // the texture array, the layers of the tiles (by level and tile) and the free layers
+    GLuint m_texture;
+    QHash<quint64, TileLayer> m_layers;
+    QVector<int> m_free_layers;
+    qint64 m_memory_budget;
+    quint64 m_frame;
+
+    // the tiles being decoded in the background, the tiles that are still wanted
+    // (visible or prefetched) and the decoded tiles waiting to be uploaded
+    QSet<quint64> m_requested;
+    QSet<quint64> m_wanted;
+    QHash<quint64, QImage> m_decoded;
+    QMutex m_mutex;
+    QThreadPool m_pool;
+    std::function<void()> m_tile_loaded;
+
+    // OpenGL rendering data and buffers (the quads of the tiles are instanced)
+    QVector<TileInstance> m_instances;
     QOpenGLVertexArrayObject m_vao;
-    QOpenGLBuffer m_posBuf;
-    QOpenGLBuffer m_coordBuf;
+    QOpenGLBuffer m_instanceBuf;
     QOpenGLShaderProgram *m_program;
 
     bool m_isInitialized;